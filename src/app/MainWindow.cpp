@@ -21,7 +21,11 @@
 
 #include "NewOpenProjectPanel.h"
 #include "RecentProjects.h"
-#include "WorkerThread.h"
+#include "WorkerThreadPool.h"
+#include "MemoryBudget.h"
+#include "ImagePrefetcher.h"
+#include "ImageWriterQueue.h"
+#include "imageproc/ImageBufferPool.h"
 #include "ProjectPages.h"
 #include "PageSelectionAccessor.h"
 #include "StageSequence.h"
@@ -142,7 +146,7 @@
 MainWindow::MainWindow()
     :   m_ptrPages(new ProjectPages),
         m_ptrStages(new StageSequence(m_ptrPages, newPageSelectionAccessor())),
-        m_ptrWorkerThread(new WorkerThread),
+        m_ptrWorkerThreadPool(new WorkerThreadPool(WorkerThreadPool::numWorkersFromSettings())),
         m_ptrInteractiveQueue(new ProcessingTaskQueue(ProcessingTaskQueue::RANDOM_ORDER)),
         m_curFilter(0),
         m_ignoreSelectionChanges(0),
@@ -255,7 +259,7 @@ MainWindow::MainWindow()
     );
 
     connect(
-        m_ptrWorkerThread.get(),
+        m_ptrWorkerThreadPool.get(),
         SIGNAL(taskResult(BackgroundTaskPtr,FilterResultPtr)),
         this, SLOT(filterResult(BackgroundTaskPtr,FilterResultPtr))
     );
@@ -357,7 +361,7 @@ MainWindow::~MainWindow()
     if (m_ptrBatchQueue.get()) {
         m_ptrBatchQueue->cancelAndClear();
     }
-    m_ptrWorkerThread->shutdown();
+    m_ptrWorkerThreadPool->shutdown();
 
     removeWidgetsFromLayout(m_pImageFrameLayout);
     removeWidgetsFromLayout(m_pOptionsFrameLayout);
@@ -1450,6 +1454,11 @@ MainWindow::filterSelectionChanged(QItemSelection const& selected)
         m_ptrBatchQueue->cancelAndClear();
     }
 
+    if (m_curFilter == m_ptrStages->outputFilterIdx()) {
+        // Images kept for editing zones are of no use in other stages.
+        m_ptrStages->outputFilter()->preZoneImageCache().clear();
+    }
+
     bool const was_below_fix_orientation = isBelowFixOrientation(m_curFilter);
     bool const was_below_select_content = isBelowSelectContent(m_curFilter);
     m_curFilter = selected.front().top();
@@ -1582,9 +1591,28 @@ MainWindow::startBatchProcessing()
         )
     );
 
+    // Input images are decoded ahead and output files are written
+    // behind the pages being processed, unless disabled.
+    int const pipeline_depth = settings.value(
+        _key_batch_processing_pipeline_depth, _key_batch_processing_pipeline_depth_def
+    ).toInt();
+    if (pipeline_depth > 0) {
+        m_ptrBatchPrefetcher.reset(new ImagePrefetcher(pipeline_depth));
+        ImageWriterQueue::instance().setCapacity(pipeline_depth);
+    }
+
+    // Pages aren't admitted while the ones in flight use up the budget.
+    MemoryBudget::instance().setLimit(MemoryBudget::limitFromSettings());
+    imageproc::ImageBufferPool::instance().setCapacity(
+        imageproc::ImageBufferPool::BATCH_CAPACITY
+    );
+
     PageInfo start_page = processAll ? m_ptrThumbSequence->firstPage() : m_ptrThumbSequence->selectionLeader();
     PageInfo page = start_page;
     for (; !page.isNull(); page = m_ptrThumbSequence->nextPage(page.id())) {
+        if (m_ptrBatchPrefetcher.get()) {
+            m_ptrBatchPrefetcher->enqueue(page.imageId());
+        }
         m_ptrBatchQueue->addProcessingTask(
             page, createCompositeTask(page, m_curFilter, /*batch=*/true, m_debug)
         );
@@ -1598,10 +1626,8 @@ MainWindow::startBatchProcessing()
     filterList->setBatchProcessingInProgress(true);
     filterList->setEnabled(false);
 
-    BackgroundTaskPtr const task(m_ptrBatchQueue->takeForProcessing());
-    if (task) {
-        m_ptrWorkerThread->performTask(task);
-    } else {
+    submitBatchTasks();
+    if (m_ptrBatchQueue->allProcessed()) {
         stopBatchProcessing();
     }
 
@@ -1626,8 +1652,22 @@ MainWindow::stopBatchProcessing(MainAreaAction main_area)
         m_ptrThumbSequence->setSelection(page.id());
     }
 
+    // The pages already processed are finished even though their tasks
+    // get cancelled below.
+    ImageWriterQueue::instance().keepQueuedJobs();
+
     m_ptrBatchQueue->cancelAndClear();
     m_ptrBatchQueue.reset();
+    m_ptrBatchPrefetcher.reset();
+
+    // The files already queued are written in the background, each
+    // one updating its thumbnail when done.
+    ImageWriterQueue::instance().setCapacity(0);
+
+    // Interactive processing isn't limited, and keeping page-sized buffers
+    // around between batches isn't worth the memory.
+    MemoryBudget::instance().setLimit(0);
+    imageproc::ImageBufferPool::instance().setCapacity(0);
 
     filterList->setBatchProcessingInProgress(false);
     filterList->setEnabled(true);
@@ -1706,10 +1746,7 @@ MainWindow::filterResult(BackgroundTaskPtr const& task, FilterResultPtr const& r
             return;
         }
 
-        BackgroundTaskPtr const task(m_ptrBatchQueue->takeForProcessing());
-        if (task) {
-            m_ptrWorkerThread->performTask(task);
-        }
+        submitBatchTasks();
 
         PageInfo const page(m_ptrBatchQueue->selectedPage());
         if (!page.isNull()) {
@@ -1718,6 +1755,22 @@ MainWindow::filterResult(BackgroundTaskPtr const& task, FilterResultPtr const& r
     }
 }
 
+void
+MainWindow::submitBatchTasks()
+{
+    while (m_ptrBatchQueue->numTakenForProcessing() < m_ptrWorkerThreadPool->size()) {
+        if (m_ptrBatchQueue->numTakenForProcessing() > 0 && !MemoryBudget::instance().canAdmit()) {
+            // submitBatchTasks() is called again once a page is done.
+            break;
+        }
+        BackgroundTaskPtr const task(m_ptrBatchQueue->takeForProcessing());
+        if (!task) {
+            break;
+        }
+        m_ptrWorkerThreadPool->performTask(task);
+    }
+}
+
 void
 MainWindow::fixDpiDialogRequested()
 {
@@ -2363,7 +2416,7 @@ MainWindow::loadPageInteractive(PageInfo const& page)
     m_ptrInteractiveQueue->addProcessingTask(
         page, createCompositeTask(page, m_curFilter, /*batch=*/false, m_debug)
     );
-    m_ptrWorkerThread->performTask(m_ptrInteractiveQueue->takeForProcessing());
+    m_ptrWorkerThreadPool->performTask(m_ptrInteractiveQueue->takeForProcessing());
 }
 
 void
@@ -2402,9 +2455,24 @@ MainWindow::closeProjectInteractive()
         return true;
     }
 
+    // Output params of a page are only stored once its files are written,
+    // so the queued writes have to finish before the project is compared
+    // or saved.  A running batch keeps queueing them, so it's only stopped
+    // once closing is confirmed, and until then the project counts as
+    // modified.
+    bool const batch_running = isBatchProcessingInProgress();
+    auto const finish_writing = [this]() {
+        stopBatchProcessing();
+        ImageWriterQueue::instance().flush();
+    };
+    if (!batch_running) {
+        finish_writing();
+    }
+
     if (m_projectFile.isEmpty()) {
         switch (promptProjectSave()) {
         case SAVE:
+            finish_writing();
             saveProjectTriggered();
         // fall through
         case DONT_SAVE:
@@ -2412,6 +2480,7 @@ MainWindow::closeProjectInteractive()
         case CANCEL:
             return false;
         }
+        finish_writing();
         closeProjectWithoutSaving();
         return true;
     }
@@ -2430,6 +2499,7 @@ MainWindow::closeProjectInteractive()
         QFile::remove(backup_file_path);
         switch (promptProjectSave()) {
         case SAVE:
+            finish_writing();
             saveProjectTriggered();
         // fall through
         case DONT_SAVE:
@@ -2437,11 +2507,12 @@ MainWindow::closeProjectInteractive()
         case CANCEL:
             return false;
         }
+        finish_writing();
         closeProjectWithoutSaving();
         return true;
     }
 
-    if (compareFiles(m_projectFile, backup_file_path)) {
+    if (!batch_running && compareFiles(m_projectFile, backup_file_path)) {
         // The project hasn't really changed.
         QFile::remove(backup_file_path);
         closeProjectWithoutSaving();
@@ -2450,8 +2521,15 @@ MainWindow::closeProjectInteractive()
 
     switch (promptProjectSave()) {
     case SAVE:
-        if (!Utils::overwritingRename(
-                    backup_file_path, m_projectFile)) {
+        if (batch_running) {
+            // The backup doesn't have the pages finished since it was written.
+            QFile::remove(backup_file_path);
+            finish_writing();
+            if (!saveProjectWithFeedback(m_projectFile)) {
+                return false;
+            }
+        } else if (!Utils::overwritingRename(
+                       backup_file_path, m_projectFile)) {
             QMessageBox::warning(
                 this, tr("Error"),
                 tr("Error saving the project file!")
@@ -2466,6 +2544,7 @@ MainWindow::closeProjectInteractive()
         return false;
     }
 
+    finish_writing();
     closeProjectWithoutSaving();
     return true;
 }
@@ -2951,7 +3030,8 @@ MainWindow::createCompositeTask(
     return BackgroundTaskPtr(
                new LoadFileTask(
                    batch ? BackgroundTask::BATCH : BackgroundTask::INTERACTIVE,
-                   page, m_ptrThumbnailCache, m_ptrPages, fix_orientation_task
+                   page, m_ptrThumbnailCache, m_ptrPages, fix_orientation_task,
+                   batch ? m_ptrBatchPrefetcher : IntrusivePtr<ImagePrefetcher>()
                )
            );
 }
@@ -70,7 +70,8 @@ class ProcessingIndicationWidget;
 class ImageInfo;
 class PageInfo;
 class QStackedLayout;
-class WorkerThread;
+class WorkerThreadPool;
+class ImagePrefetcher;
 class ProjectReader;
 class DebugImages;
 class ContentBoxPropagator;
@@ -307,6 +308,11 @@ private:
 
     bool isBatchProcessingInProgress() const;
 
+    /**
+     * \brief Takes tasks from the batch queue until every worker thread has one.
+     */
+    void submitBatchTasks();
+
     bool isProjectLoaded() const;
 
     bool isBelowSelectContent() const;
@@ -388,8 +394,9 @@ private:
     OutputFileNameGenerator m_outFileNameGen;
     IntrusivePtr<ThumbnailPixmapCache> m_ptrThumbnailCache;
     std::unique_ptr<ThumbnailSequence> m_ptrThumbSequence;
-    std::unique_ptr<WorkerThread> m_ptrWorkerThread;
+    std::unique_ptr<WorkerThreadPool> m_ptrWorkerThreadPool;
     std::unique_ptr<ProcessingTaskQueue> m_ptrBatchQueue;
+    IntrusivePtr<ImagePrefetcher> m_ptrBatchPrefetcher;
     std::unique_ptr<ProcessingTaskQueue> m_ptrInteractiveQueue;
     QStackedLayout* m_pImageFrameLayout;
     QStackedLayout* m_pOptionsFrameLayout;
@@ -0,0 +1,131 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BatchResultCache.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+
+namespace
+{
+
+quint32 const CACHE_MAGIC = 0x53544243; // "STBC"
+quint32 const CACHE_VERSION = 1;
+
+}
+
+BatchResultCache::BatchResultCache(QString const& file_path)
+    :   m_filePath(file_path)
+{
+    QFile file(file_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream strm(&file);
+    strm.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    strm >> magic >> version;
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        return;
+    }
+
+    QSet<QByteArray> keys;
+    QHash<QString, QByteArray> digests;
+    strm >> keys >> digests;
+    if (strm.status() != QDataStream::Ok) {
+        return;
+    }
+
+    m_oldKeys.swap(keys);
+    m_oldDigests.swap(digests);
+}
+
+QByteArray
+BatchResultCache::fileDigest(QString const& file_path)
+{
+    QFileInfo const info(file_path);
+    // The digest is only trusted as long as the file looks untouched.
+    QString const stamp(
+        QString("%1|%2|%3").arg(info.absoluteFilePath())
+        .arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch())
+    );
+
+    QHash<QString, QByteArray>::const_iterator it(m_newDigests.constFind(stamp));
+    if (it != m_newDigests.constEnd()) {
+        return it.value();
+    }
+
+    QByteArray digest(m_oldDigests.value(stamp));
+    if (digest.isEmpty()) {
+        QFile file(file_path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return QByteArray();
+        }
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        if (!hash.addData(&file)) {
+            return QByteArray();
+        }
+        digest = hash.result();
+    }
+
+    m_newDigests.insert(stamp, digest);
+    return digest;
+}
+
+bool
+BatchResultCache::contains(QByteArray const& key) const
+{
+    return !key.isEmpty() && m_oldKeys.contains(key);
+}
+
+void
+BatchResultCache::insert(QByteArray const& key)
+{
+    if (!key.isEmpty()) {
+        m_newKeys.insert(key);
+    }
+}
+
+bool
+BatchResultCache::save() const
+{
+    QDir().mkpath(QFileInfo(m_filePath).absolutePath());
+
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream strm(&file);
+    strm.setVersion(QDataStream::Qt_5_0);
+    strm << CACHE_MAGIC << CACHE_VERSION << m_newKeys << m_newDigests;
+    if (strm.status() != QDataStream::Ok) {
+        file.cancelWriting();
+        return false;
+    }
+
+    return file.commit();
+}
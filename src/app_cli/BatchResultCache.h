@@ -0,0 +1,80 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BATCH_RESULT_CACHE_H_
+#define BATCH_RESULT_CACHE_H_
+
+#include "NonCopyable.h"
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+
+/**
+ * \brief A persistent record of per-page stage results, used by
+ *        incremental batch processing.
+ *
+ * The cache doesn't store the results themselves, as those live in the
+ * project file.  It stores the keys of results known to be up to date.
+ * A key is a hash of everything the result depends on: the contents of
+ * the source file, the settings of the stage and the ones preceding it.
+ * A page whose current key is present may be skipped for that stage.
+ */
+class BatchResultCache
+{
+    DECLARE_NON_COPYABLE(BatchResultCache)
+public:
+    /**
+     * \brief Loads the cache from \p file_path, if it exists.
+     */
+    explicit BatchResultCache(QString const& file_path);
+
+    /**
+     * \brief Returns a SHA-1 digest of the file's contents.
+     *
+     * The file is only read if its size or modification time
+     * changed since the digest was last computed.
+     * An empty array is returned if the file can't be read.
+     */
+    QByteArray fileDigest(QString const& file_path);
+
+    /**
+     * \brief Checks whether a result with this key was recorded
+     *        by the previous run.
+     */
+    bool contains(QByteArray const& key) const;
+
+    /**
+     * \brief Records an up to date result to be saved.
+     */
+    void insert(QByteArray const& key);
+
+    /**
+     * \brief Replaces the cache file with the keys inserted
+     *        and the digests computed during this run.
+     */
+    bool save() const;
+private:
+    QString m_filePath;
+    QSet<QByteArray> m_oldKeys;
+    QSet<QByteArray> m_newKeys;
+    QHash<QString, QByteArray> m_oldDigests;
+    QHash<QString, QByteArray> m_newDigests;
+};
+
+#endif
@@ -20,6 +20,10 @@
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <exception>
 #include <assert.h>
 
 #include "Utils.h"
@@ -31,15 +35,23 @@
 #include "OutputFileNameGenerator.h"
 #include "ImageInfo.h"
 #include "ImageFileInfo.h"
+#include "ImageMetadata.h"
+#include "ImageMetadataLoader.h"
 #include "PageInfo.h"
 #include "PageSequence.h"
 #include "ImageId.h"
 #include "ThumbnailPixmapCache.h"
 #include "LoadFileTask.h"
+#include "ImagePrefetcher.h"
+#include "ImageWriterQueue.h"
+#include "imageproc/ImageBufferPool.h"
+#include "MemoryBudget.h"
+#include "BatchResultCache.h"
 #include "ProjectWriter.h"
 #include "ProjectReader.h"
 #include "OrthogonalRotation.h"
 #include "SelectedPage.h"
+#include "settings/globalstaticsettings.h"
 
 #include "filters/fix_orientation/Settings.h"
 #include "filters/fix_orientation/Filter.h"
@@ -69,11 +81,133 @@
 
 #include <QMap>
 #include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QDomDocument>
+#include <QDomElement>
+#include <QDomNamedNodeMap>
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QStringList>
+#include <QSet>
 
 #include "ConsoleBatch.h"
 #include "CommandLine.h"
 
+namespace
+{
+
+void hashString(QCryptographicHash& hash, QString const& str)
+{
+    hash.addData(str.toUtf8());
+    hash.addData("", 1);
+}
+
+/**
+ * Feeds a DOM subtree into a hash.  Unlike the text QDomNode::save()
+ * produces, the result doesn't depend on the order of attributes,
+ * which Qt doesn't preserve.  Attributes named in \p ignored are left
+ * out at any depth.
+ */
+void hashDomNode(
+    QCryptographicHash& hash, QDomNode const& node,
+    bool const skip_id, QSet<QString> const& ignored)
+{
+    if (node.isCharacterData()) {
+        hashString(hash, node.nodeValue());
+        return;
+    }
+    if (!node.isElement()) {
+        return;
+    }
+
+    QDomElement const el(node.toElement());
+    hashString(hash, el.tagName());
+
+    QDomNamedNodeMap const attrs(el.attributes());
+    QStringList names;
+    for (int i = 0; i < attrs.count(); ++i) {
+        names.push_back(attrs.item(i).nodeName());
+    }
+    names.sort();
+    for (QString const& name : names) {
+        if ((skip_id && name == "id") || ignored.contains(name)) {
+            continue;
+        }
+        hashString(hash, name);
+        hashString(hash, el.attribute(name));
+    }
+
+    hash.addData("<", 1);
+    for (QDomNode child(el.firstChild()); !child.isNull(); child = child.nextSibling()) {
+        hashDomNode(hash, child, false, ignored);
+    }
+    hash.addData(">", 1);
+}
+
+/**
+ * Digests of the settings of a filter, as saved to a project file.
+ */
+class FilterDigests
+{
+public:
+    /**
+     * \param derived_attrs Attributes holding statistics derived from
+     *        all pages, which don't affect the results of any page.
+     */
+    FilterDigests(QDomElement const& filter_el, QSet<QString> const& derived_attrs)
+    {
+        QCryptographicHash global_hash(QCryptographicHash::Sha1);
+        QDomElement global_el(filter_el.cloneNode(false).toElement());
+        hashDomNode(global_hash, global_el, false, derived_attrs);
+        m_global = global_hash.result();
+
+        QCryptographicHash all_hash(QCryptographicHash::Sha1);
+        hashDomNode(all_hash, filter_el, false, derived_attrs);
+        m_all = all_hash.result();
+
+        // Per-page settings are stored in <page> elements and per-image
+        // ones in <image> elements.  Their numeric ids are left out,
+        // as those change when pages are added or removed.
+        for (QDomElement el(filter_el.firstChildElement()); !el.isNull(); el = el.nextSiblingElement()) {
+            bool ok = true;
+            int const id = el.attribute("id").toInt(&ok);
+            if (!ok) {
+                continue;
+            }
+            QCryptographicHash item_hash(QCryptographicHash::Sha1);
+            hashDomNode(item_hash, el, true, derived_attrs);
+            m_items[std::make_pair(el.tagName(), id)] = item_hash.result();
+        }
+    }
+
+    /** The filter-wide settings. */
+    QByteArray const& global() const
+    {
+        return m_global;
+    }
+
+    /** The settings of every page. */
+    QByteArray const& all() const
+    {
+        return m_all;
+    }
+
+    /** The settings stored in a <page> or an <image> element. */
+    QByteArray item(QString const& tag, int const numeric_id) const
+    {
+        auto const it(m_items.find(std::make_pair(tag, numeric_id)));
+        return it == m_items.end() ? QByteArray() : it->second;
+    }
+private:
+    QByteArray m_global;
+    QByteArray m_all;
+    std::map<std::pair<QString, int>, QByteArray> m_items;
+};
+
+} // anonymous namespace
+
 ConsoleBatch::ConsoleBatch(std::vector<ImageFileInfo> const& images, QString const& output_directory, Qt::LayoutDirection const layout)
     :   batch(true), debug(true),
         m_ptrDisambiguator(new FileNameDisambiguator),
@@ -125,7 +259,8 @@ ConsoleBatch::ConsoleBatch(QString const project_file)
 BackgroundTaskPtr
 ConsoleBatch::createCompositeTask(
     PageInfo const& page,
-    int const last_filter_idx)
+    int const last_filter_idx,
+    IntrusivePtr<ImagePrefetcher> const& prefetcher)
 {
     IntrusivePtr<fix_orientation::Task> fix_orientation_task;
     IntrusivePtr<page_split::Task> page_split_task;
@@ -179,7 +314,8 @@ ConsoleBatch::createCompositeTask(
     return BackgroundTaskPtr(
                new LoadFileTask(
                    BackgroundTask::BATCH,
-                   page, m_ptrThumbnailCache, m_ptrPages, fix_orientation_task
+                   page, m_ptrThumbnailCache, m_ptrPages, fix_orientation_task,
+                   prefetcher
                )
            );
 }
@@ -210,6 +346,28 @@ ConsoleBatch::process()
         endFilterIdx = ef;
     }
 
+    // Decoding of the input images and writing of the output ones
+    // are pipelined with processing, unless disabled.
+    int const pipeline_depth = cli.getPipelineDepth();
+    ImageWriterQueue::instance().setCapacity(pipeline_depth);
+
+    // Pages processed in parallel wait for each other's memory
+    // reservations rather than exceed --memory-budget.
+    MemoryBudget::instance().setLimit(qint64(cli.getMemoryBudget()) << 20);
+    imageproc::ImageBufferPool::instance().setCapacity(
+        imageproc::ImageBufferPool::BATCH_CAPACITY
+    );
+
+    // With --incremental, pages whose stage results are known
+    // to be up to date aren't processed again.
+    std::unique_ptr<BatchResultCache> result_cache;
+    if (cli.isIncremental()) {
+        result_cache.reset(new BatchResultCache(m_outFileNameGen.outDir() + "/cache/batch"));
+    }
+
+    // Pages that failed at any stage don't get their results recorded.
+    std::set<PageId> failed_pages;
+
     // run filters
     for (int j = startFilterIdx; j <= endFilterIdx; j++) {
         if (cli.isVerbose()) {
@@ -217,17 +375,46 @@ ConsoleBatch::process()
         }
 
         // process pages
-        PageSequence page_sequence = m_ptrPages->toPageSequence(PAGE_VIEW);
-        setupFilter(j, page_sequence.asPageIdSet());
-        for (const PageInfo& page : page_sequence) {
+        PageSequence const all_pages = m_ptrPages->toPageSequence(PAGE_VIEW);
+        setupFilter(j, all_pages.asPageIdSet());
+
+        PageSequence page_sequence;
+        if (result_cache) {
+            std::vector<QByteArray> const keys(stageKeys(all_pages, j, *result_cache));
+            for (size_t i = 0; i < all_pages.numPages(); ++i) {
+                if (!result_cache->contains(keys[i])) {
+                    page_sequence.append(all_pages.pageAt(i));
+                }
+            }
             if (cli.isVerbose()) {
-                std::cout << "\tProcessing: " << page.imageId().filePath().toLocal8Bit().constData() << "\n";
+                std::cout << "\tUp to date: " << (all_pages.numPages() - page_sequence.numPages()) << " pages\n";
             }
-            BackgroundTaskPtr bgTask = createCompositeTask(page, j);
-            (*bgTask)();
+        } else {
+            page_sequence = all_pages;
+        }
+
+        // Composite tasks are created here, in page order, because
+        // createCompositeTask() isn't thread-safe.  Running them is.
+        IntrusivePtr<ImagePrefetcher> prefetcher;
+        if (pipeline_depth > 0) {
+            prefetcher.reset(new ImagePrefetcher(pipeline_depth));
         }
+        std::vector<BackgroundTaskPtr> tasks;
+        for (const PageInfo& page : page_sequence) {
+            if (prefetcher.get()) {
+                prefetcher->enqueue(page.imageId());
+            }
+            tasks.push_back(createCompositeTask(page, j, prefetcher));
+        }
+        runTasks(page_sequence, tasks, failed_pages);
     }
 
+    // Wait for the output files to be written and stop the writer.
+    ImageWriterQueue::instance().flush();
+    ImageWriterQueue::instance().setCapacity(0);
+    MemoryBudget::instance().setLimit(0);
+    imageproc::ImageBufferPool::instance().setCapacity(0);
+
     // setup rest filters with params from cli
     const std::set<PageId> select_all = m_ptrPages->toPageSequence(PAGE_VIEW).asPageIdSet();
     for (int j = endFilterIdx + 1; j <= m_ptrStages->count(); j++) {
@@ -238,6 +425,175 @@ ConsoleBatch::process()
     for (int j = 0; j <= endFilterIdx; j++) {
         m_ptrStages->filterAt(j)->updateStatistics();
     }
+
+    if (result_cache) {
+        // Record the results of the stages just run.  Those of the other
+        // stages are kept, as long as they are still up to date.
+        PageSequence const all_pages = m_ptrPages->toPageSequence(PAGE_VIEW);
+        for (int j = 0; j < m_ptrStages->count(); j++) {
+            bool const executed = (j >= startFilterIdx && j <= endFilterIdx);
+            std::vector<QByteArray> const keys(stageKeys(all_pages, j, *result_cache));
+            for (size_t i = 0; i < keys.size(); ++i) {
+                if (executed && failed_pages.count(all_pages.pageAt(i).id())) {
+                    continue;
+                }
+                if (executed || result_cache->contains(keys[i])) {
+                    result_cache->insert(keys[i]);
+                }
+            }
+        }
+        if (!result_cache->save()) {
+            std::cerr << "Unable to save the batch result cache.\n";
+        }
+    }
+}
+
+void
+ConsoleBatch::runTasks(
+    PageSequence const& pages, std::vector<BackgroundTaskPtr> const& tasks,
+    std::set<PageId>& failed_pages)
+{
+    CommandLine const& cli = CommandLine::get();
+    int const num_tasks = static_cast<int>(tasks.size());
+    int const max_threads = std::max(1, std::min(cli.getThreads(), num_tasks));
+
+    // A task doesn't load its image until it's run, so no more than
+    // max_threads pages are held in memory at any given time.
+    // Exceptions must not escape an OpenMP region, so we remember
+    // the first one and rethrow it once all workers are done.
+    std::exception_ptr error;
+    QMutex mutex;
+
+    #pragma omp parallel for schedule(dynamic) num_threads(max_threads)
+    for (int i = 0; i < num_tasks; ++i) {
+        {
+            QMutexLocker const locker(&mutex);
+            if (error) {
+                continue;
+            }
+            if (cli.isVerbose()) {
+                std::cout << "\tProcessing: " << pages.pageAt(size_t(i)).imageId().filePath().toLocal8Bit().constData() << "\n";
+            }
+        }
+
+        try {
+            // A result without a filter reports a file that couldn't be loaded.
+            FilterResultPtr const result((*tasks[i])());
+            if (result && !result->filter()) {
+                QMutexLocker const locker(&mutex);
+                failed_pages.insert(pages.pageAt(size_t(i)).id());
+            }
+        } catch (...) {
+            QMutexLocker const locker(&mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    // Output params are stored once the files are written,
+    // and the next stage may depend on them.
+    ImageWriterQueue::instance().flush();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+std::vector<QByteArray>
+ConsoleBatch::stageKeys(PageSequence const& pages, int const filter_idx, BatchResultCache& cache) const
+{
+    std::vector<QByteArray> keys;
+    if (pages.numPages() == 0) {
+        return keys;
+    }
+
+    SelectedPage const sPage(pages.pageAt(size_t(0)).id(), IMAGE_VIEW);
+    ProjectWriter const writer(m_ptrPages, sPage, m_outFileNameGen);
+
+    std::map<PageId, int> page_ids;
+    writer.enumPages([&page_ids](PageId const& page_id, int numeric_id) {
+        page_ids[page_id] = numeric_id;
+    });
+    std::map<ImageId, int> image_ids;
+    writer.enumImages([&image_ids](ImageId const& image_id, int numeric_id) {
+        image_ids[image_id] = numeric_id;
+    });
+
+    // The content size statistics of "Select Content" only serve to
+    // highlight unusual pages.  Editing any page changes them for every
+    // page, so they would make every key change along with it.
+    QSet<QString> select_content_stats;
+    select_content_stats << "average" << "sigma" << "deviation";
+
+    QDomDocument doc;
+    std::vector<FilterDigests> digests;
+    for (int i = 0; i <= filter_idx; i++) {
+        digests.emplace_back(
+            m_ptrStages->filterAt(i)->saveSettings(writer, doc),
+            i == m_ptrStages->selectContentFilterIdx() ? select_content_stats : QSet<QString>()
+        );
+    }
+
+    // Global settings the output depends on, which aren't part of a project.
+    CommandLine const& cli = CommandLine::get();
+    QString const output_env(
+        QString("%1|%2|%3|%4|%5|%6|%7|%8|%9")
+        .arg(GlobalStaticSettings::m_tiff_compr_method_bw)
+        .arg(GlobalStaticSettings::m_tiff_compr_method_color)
+        .arg(int(cli.hasTiffForceRGB()))
+        .arg(int(cli.hasTiffForceGrayscale()))
+        .arg(int(cli.hasTiffForceKeepColorSpace()))
+        .arg(int(GlobalStaticSettings::m_use_horizontal_predictor))
+        .arg(int(GlobalStaticSettings::m_disable_bw_smoothing))
+        .arg(int(GlobalStaticSettings::m_output_copy_icc_metadata))
+        .arg(GlobalStaticSettings::m_picture_detection_sensitivity)
+    );
+
+    keys.reserve(pages.numPages());
+    for (PageInfo const& page : pages) {
+        QByteArray const source_digest(cache.fileDigest(page.imageId().filePath()));
+        if (source_digest.isEmpty()) {
+            keys.push_back(QByteArray());
+            continue;
+        }
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(source_digest);
+        hashString(hash, QString::number(page.imageId().page()));
+        hashString(hash, page.id().subPageAsString());
+
+        int const page_id = page_ids[page.id()];
+        int const image_id = image_ids[page.imageId()];
+        for (int i = 0; i <= filter_idx; i++) {
+            hash.addData(digests[i].global());
+            if (i == m_ptrStages->pageLayoutFilterIdx()) {
+                // The layout of a page depends on the content of all pages.
+                hash.addData(digests[i].all());
+            } else {
+                hash.addData(digests[i].item("page", page_id));
+                hash.addData(digests[i].item("image", image_id));
+            }
+        }
+
+        if (filter_idx == m_ptrStages->outputFilterIdx()) {
+            // Output params are removed if writing the files failed.
+            QFileInfo const out_file(m_outFileNameGen.filePathFor(page.id()));
+            if (!out_file.exists()
+                    || !m_ptrStages->outputFilter()->getSettings()->getOutputParams(page.id())) {
+                keys.push_back(QByteArray());
+                continue;
+            }
+            hashString(hash, out_file.absoluteFilePath());
+            hashString(hash, QString::number(out_file.size()));
+            hashString(hash, QString::number(out_file.lastModified().toMSecsSinceEpoch()));
+            hashString(hash, output_env);
+        }
+
+        keys.push_back(hash.result());
+    }
+
+    return keys;
 }
 
 void
@@ -369,41 +725,38 @@ ConsoleBatch::setupPageLayout(std::set<PageId> allPages)
 {
     IntrusivePtr<page_layout::Filter> page_layout = m_ptrStages->pageLayoutFilter();
     CommandLine const& cli = CommandLine::get();
-    QMap<QString, float> img_cache;
+    std::map<ImageId, float> img_cache;
+    std::vector<float> sorted_ratios;
+
+    if (cli.hasMatchLayoutTolerance()) {
+        for (PageId const& page : allPages) {
+            ImageId const& image_id = page.imageId();
+            if (img_cache.find(image_id) == img_cache.end()) {
+                img_cache[image_id] = imageAspectRatio(image_id);
+            }
+            sorted_ratios.push_back(img_cache[image_id]);
+        }
+        // Sorted ratios let us count the pages within tolerance
+        // with two binary searches instead of comparing every pair.
+        std::sort(sorted_ratios.begin(), sorted_ratios.end());
+    }
 
     for (PageId const& page : allPages) {
         // PAGE LAYOUT FILTER
         page_layout::Alignment alignment = cli.getAlignment();
         if (cli.hasMatchLayoutTolerance()) {
-            QString const path = page.imageId().filePath();
-            if (!img_cache.contains(path)) {
-                QImage img(path);
-                img_cache[path] = float(img.width()) / float(img.height());
-            }
-            float imgAspectRatio = img_cache[path];
-            float tolerance = cli.getMatchLayoutTolerance();
-            std::vector<float> diffs;
-            for (PageId const& page : allPages) {
-                ImageId pimageId = page.imageId();
-                QString ppath = pimageId.filePath();
-                if (!img_cache.contains(ppath)) {
-                    QImage img(ppath);
-                    img_cache[ppath] = float(img.width()) / float(img.height());
-                }
-                float pimgAspectRatio = img_cache[ppath];
-                float diff = imgAspectRatio - pimgAspectRatio;
-                if (diff < 0.0) {
-                    diff *= -1;
-                }
-                diffs.push_back(diff);
-            }
-            unsigned bad_diffs = 0;
-            for (unsigned j = 0; j < diffs.size(); j++) {
-                if (diffs[j] > tolerance) {
-                    bad_diffs += 1;
-                }
-            }
-            if (bad_diffs > (diffs.size() / 2)) {
+            float const imgAspectRatio = img_cache[page.imageId()];
+            float const tolerance = cli.getMatchLayoutTolerance();
+            std::vector<float>::const_iterator const first_good = std::partition_point(
+                        sorted_ratios.cbegin(), sorted_ratios.cend(), [=](float ratio) {
+                return imgAspectRatio - ratio > tolerance;
+            });
+            std::vector<float>::const_iterator const last_good = std::partition_point(
+                        first_good, sorted_ratios.cend(), [=](float ratio) {
+                return !(ratio - imgAspectRatio > tolerance);
+            });
+            size_t const bad_diffs = sorted_ratios.size() - (last_good - first_good);
+            if (bad_diffs > (sorted_ratios.size() / 2)) {
                 alignment.setNull(true);
             }
         }
@@ -416,6 +769,27 @@ ConsoleBatch::setupPageLayout(std::set<PageId> allPages)
     }
 }
 
+/**
+ * Returns width / height of an image, reading only its metadata if possible.
+ */
+float
+ConsoleBatch::imageAspectRatio(ImageId const& image_id)
+{
+    std::vector<QSize> sizes;
+    ImageMetadataLoader::load(image_id.filePath(), [&](ImageMetadata const& metadata) {
+        sizes.push_back(metadata.size());
+    });
+
+    QSize size;
+    if (image_id.zeroBasedPage() < (int)sizes.size()) {
+        size = sizes[image_id.zeroBasedPage()];
+    }
+    if (size.isEmpty()) {
+        return 0.0f;
+    }
+    return float(size.width()) / float(size.height());
+}
+
 void
 ConsoleBatch::setupOutput(std::set<PageId> allPages)
 {
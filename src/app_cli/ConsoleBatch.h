@@ -23,6 +23,7 @@
 
 #include <QString>
 #include <vector>
+#include <set>
 
 #include "IntrusivePtr.h"
 #include "BackgroundTask.h"
@@ -30,6 +31,7 @@
 #include "OutputFileNameGenerator.h"
 #include "PageId.h"
 #include "PageInfo.h"
+#include "PageSequence.h"
 #include "PageView.h"
 #include "ProjectPages.h"
 #include "ImageFileInfo.h"
@@ -38,6 +40,9 @@
 #include "StageSequence.h"
 #include "PageSelectionAccessor.h"
 #include "ProjectReader.h"
+#include "ImagePrefetcher.h"
+#include "BatchResultCache.h"
+#include <QByteArray>
 
 class ConsoleBatch
 {
@@ -69,10 +74,37 @@ private:
     void setupPageLayout(std::set<PageId> allPages);
     void setupOutput(std::set<PageId> allPages);
 
+    static float imageAspectRatio(ImageId const& image_id);
+
     BackgroundTaskPtr createCompositeTask(
         PageInfo const& page,
-        int const last_filter_idx
+        int const last_filter_idx,
+        IntrusivePtr<ImagePrefetcher> const& prefetcher = IntrusivePtr<ImagePrefetcher>()
     );
+
+    /**
+     * \brief Computes the result cache keys of a filter stage, one per page.
+     *
+     * A key covers the source file and the settings of the stage and
+     * of the stages preceding it.  The key of the output stage also
+     * covers the output file.  Empty keys are returned for pages
+     * whose source or output file is missing, or whose output params
+     * weren't stored.
+     */
+    std::vector<QByteArray> stageKeys(
+        PageSequence const& pages, int filter_idx, BatchResultCache& cache) const;
+
+    /**
+     * \brief Runs the tasks of a single filter stage.
+     *
+     * Up to CommandLine::getThreads() pages are processed in parallel.
+     * The call returns once every task has finished.
+     *
+     * \param failed_pages Pages whose image couldn't be loaded are added there.
+     */
+    void runTasks(
+        PageSequence const& pages, std::vector<BackgroundTaskPtr> const& tasks,
+        std::set<PageId>& failed_pages);
 };
 
 #endif
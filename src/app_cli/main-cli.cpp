@@ -17,6 +17,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "config.h"
 #include <QCoreApplication>
 #include "settings/ini_keys.h"
 #include <QString>
@@ -25,7 +26,13 @@
 
 #include "CommandLine.h"
 #include "ConsoleBatch.h"
-#include "config.h"
+#include "PngMetadataLoader.h"
+#include "TiffMetadataLoader.h"
+#include "JpegMetadataLoader.h"
+#ifdef ENABLE_OPENJPEG
+#include "Jp2MetadataLoader.h"
+#endif
+#include "GenericMetadataLoader.h"
 
 int main(int argc, char** argv)
 {
@@ -57,6 +64,16 @@ int main(int argc, char** argv)
         return 0;
     }
 
+    // Used to probe image dimensions without decoding whole images.
+    PngMetadataLoader::registerMyself();
+    TiffMetadataLoader::registerMyself();
+    JpegMetadataLoader::registerMyself();
+#ifdef ENABLE_OPENJPEG
+    Jp2MetadataLoader::registerMyself();
+#endif
+    // should be the last one as the most dumb and loads whole image into mem
+    GenericMetadataLoader::registerMyself();
+
     std::unique_ptr<ConsoleBatch> cbatch;
 
     try {
@@ -31,6 +31,15 @@ public:
 
     virtual QImage makeThumbnail(QImage const& image, QSize const& max_thumb_size) const = 0;
 
+    /**
+     * \brief Whether makeThumbnail() may be given a downscaled image
+     *        instead of the full resolution one.
+     */
+    virtual bool acceptsDownscaledImage() const
+    {
+        return false;
+    }
+
     virtual std::unique_ptr<AbstractThumbnailMaker> clone() const = 0;
 };
 
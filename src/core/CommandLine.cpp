@@ -18,6 +18,7 @@
 */
 
 #include <cstdlib>
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
 #include <tiff.h>
@@ -126,6 +127,10 @@ CommandLine::parseCli(QStringList const& argv)
     opts << "tiff-force-rgb";
     opts << "tiff-force-grayscale";
     opts << "tiff-force-keep-color-space";
+    opts << "threads";
+    opts << "pipeline-depth";
+    opts << "memory-budget";
+    opts << "incremental";
 
     QMap<QString, QString> shortMap;
     shortMap["h"] = "help";
@@ -281,6 +286,9 @@ CommandLine::setup()
     m_startFilterIdx = fetchStartFilterIdx();
     m_endFilterIdx = fetchEndFilterIdx();
     m_matchLayoutTolerance = fetchMatchLayoutTolerance();
+    m_threads = fetchThreads();
+    m_pipelineDepth = fetchPipelineDepth();
+    m_memoryBudget = fetchMemoryBudget();
     m_compressionBW = fetchCompressionBW();
     m_compressionColor = fetchCompressionColor();
     m_language = fetchLanguage();
@@ -402,7 +410,11 @@ CommandLine::printHelp()
     std::cout << "\t--window-title=WindowTitle\t\t-- default: project name" << std::endl;
     std::cout << "\t--page-detection-box=<widthxheight>\t\t-- in mm" << std::endl;
     std::cout << "\t\t--page-detection-tolerance=<0.0..1.0>\t-- default: 0.1" << std::endl;
-    std::cout << "\t--disable-check-output\t\t\t-- don't check if page is valid when switching to step 6";
+    std::cout << "\t--disable-check-output\t\t\t-- don't check if page is valid when switching to step 6" << std::endl;
+    std::cout << "\t--threads=<number>\t\t\t-- default: 1; number of pages processed in parallel" << std::endl;
+    std::cout << "\t--pipeline-depth=<number>\t\t-- default: 2; number of images decoded ahead and of pages queued for writing, 0 disables" << std::endl;
+    std::cout << "\t--memory-budget=<MB>\t\t\t-- default: 0 (unlimited); pages wait for memory used by the ones in flight above this" << std::endl;
+    std::cout << "\t--incremental\t\t\t\t-- skip the pages whose sources and settings didn't change since the last run" << std::endl;
     std::cout << std::endl;
 }
 
@@ -791,6 +803,36 @@ CommandLine::fetchMatchLayoutTolerance()
     return m_options["match-layout-tolerance"].toFloat();
 }
 
+int
+CommandLine::fetchThreads()
+{
+    if (!hasThreads()) {
+        return 1;
+    }
+
+    return std::max(1, m_options.value("threads").toInt());
+}
+
+int
+CommandLine::fetchPipelineDepth()
+{
+    if (!hasPipelineDepth()) {
+        return 2;
+    }
+
+    return std::max(0, m_options.value("pipeline-depth").toInt());
+}
+
+int
+CommandLine::fetchMemoryBudget()
+{
+    if (!hasMemoryBudget()) {
+        return 0;
+    }
+
+    return std::max(0, m_options.value("memory-budget").toInt());
+}
+
 bool
 CommandLine::hasMargins(QString base) const
 {
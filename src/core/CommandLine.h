@@ -271,6 +271,22 @@ public:
     {
         return contains("disable-check-output");
     }
+    bool isIncremental() const
+    {
+        return contains("incremental");
+    }
+    bool hasThreads() const
+    {
+        return contains("threads") && !m_options["threads"].isEmpty();
+    }
+    bool hasPipelineDepth() const
+    {
+        return contains("pipeline-depth") && !m_options["pipeline-depth"].isEmpty();
+    }
+    bool hasMemoryBudget() const
+    {
+        return contains("memory-budget") && !m_options["memory-budget"].isEmpty();
+    }
 
     page_split::LayoutType getLayout() const
     {
@@ -376,6 +392,18 @@ public:
     {
         return m_matchLayoutTolerance;
     }
+    int getThreads() const
+    {
+        return m_threads;
+    }
+    int getPipelineDepth() const
+    {
+        return m_pipelineDepth;
+    }
+    int getMemoryBudget() const
+    {
+        return m_memoryBudget;
+    }
     QString getTiffCompressionBW() const {
         return m_compressionBW;
     }
@@ -473,6 +501,9 @@ private:
     int m_endFilterIdx;
     output::DespeckleLevel m_despeckleLevel;
     float m_matchLayoutTolerance;
+    int m_threads;
+    int m_pipelineDepth;
+    int m_memoryBudget;
 
     bool parseCli(QStringList const& argv);
     void addImage(QString const& path);
@@ -512,6 +543,9 @@ private:
     int fetchEndFilterIdx();
     output::DespeckleLevel fetchDespeckleLevel();
     float fetchMatchLayoutTolerance();
+    int fetchThreads();
+    int fetchPipelineDepth();
+    int fetchMemoryBudget();
     QString fetchCompressionBW() const;
     QString fetchCompressionColor() const;
     QString fetchLanguage() const;
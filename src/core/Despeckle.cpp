@@ -67,6 +67,12 @@ namespace
 static int const VERTICAL_SCALE = 2;
 static int const VERTICAL_SCALE_SQ = VERTICAL_SCALE * VERTICAL_SCALE;
 
+/**
+ * Voronoi diagrams are built in horizontal bands of this many lines,
+ * which are processed in parallel.
+ */
+static int const VORONOI_BAND_HEIGHT = 128;
+
 struct Settings {
     /**
      * When multiplied by the number of pixels in a connected component,
@@ -368,301 +374,380 @@ bool canBeAttachedTo(
     return false;
 }
 
-void voronoi(ConnectivityMap& cmap, std::vector<Distance>& dist)
+/**
+ * Propagates distances to a line from the line above it and along the line.
+ * Pixels having \p special_distance neither spread nor get taken over.
+ * The squared distances are kept in \p sqdist_line and \p top_sqdist_line,
+ * except for pixels having \p special_distance.
+ * If \p top_wins_ties is set, a pixel just taken over from the left is
+ * rather taken over from the top if that's equally close.
+ *
+ * \return true if any pixel in the line got closer to a connected component.
+ */
+bool propagateDown(
+    Distance* dist_line, uint32_t* cmap_line, uint32_t* sqdist_line,
+    Distance const* top_dist_line, uint32_t const* top_cmap_line,
+    uint32_t const* top_sqdist_line, int const width, Distance const special_distance,
+    bool const top_wins_ties)
 {
-    int const width = cmap.size().width() + 2;
-    int const height = cmap.size().height() + 2;
+    bool changed = false;
 
-    assert(dist.empty());
-    dist.resize(width * height, Distance::zero());
-
-    std::vector<uint32_t> sqdists(width * 2, 0);
-    uint32_t* prev_sqdist_line = &sqdists[0];
-    uint32_t* this_sqdist_line = &sqdists[width];
-
-    Distance* dist_line = &dist[0];
-    uint32_t* cmap_line = cmap.paddedData();
-
-    dist_line[0].reset(0);
-    prev_sqdist_line[0] = dist_line[0].sqdist();
-    for (int x = 1; x < width; ++x) {
-        dist_line[x].vec.x = dist_line[x - 1].vec.x - 1;
-        prev_sqdist_line[x] = prev_sqdist_line[x - 1]
-                              - (int(dist_line[x - 1].vec.x) << 1) + 1;
-    }
-
-    // Top to bottom scan.
-    for (int y = 1; y < height; ++y) {
-        dist_line += width;
-        cmap_line += width;
-        dist_line[0].reset(0);
-        dist_line[width - 1].reset(width - 1);
-        this_sqdist_line[0] = dist_line[0].sqdist();
-        this_sqdist_line[width - 1] = dist_line[width - 1].sqdist();
-        // Left to right scan.
-        for (int x = 1; x < width - 1; ++x) {
-            if (cmap_line[x]) {
-                this_sqdist_line[x] = 0;
-                assert(dist_line[x] == Distance::zero());
-                continue;
-            }
+    sqdist_line[0] = dist_line[0].sqdist();
+    sqdist_line[width - 1] = dist_line[width - 1].sqdist();
 
-            // Propagate from left.
-            Distance left_dist = dist_line[x - 1];
-            uint32_t sqdist_left = this_sqdist_line[x - 1];
-            sqdist_left += 1 - (int(left_dist.vec.x) << 1);
+    // Left to right scan.
+    for (int x = 1; x < width - 1; ++x) {
+        if (dist_line[x] == special_distance) {
+            continue;
+        }
 
-            // Propagate from top.
-            Distance top_dist = dist_line[x - width];
-            uint32_t sqdist_top = prev_sqdist_line[x];
-            sqdist_top += VERTICAL_SCALE_SQ - 2 * VERTICAL_SCALE_SQ * int(top_dist.vec.y);
+        sqdist_line[x] = dist_line[x].sqdist();
 
-            if (sqdist_left < sqdist_top) {
-                this_sqdist_line[x] = sqdist_left;
+        // Propagate from left.
+        bool took_left = false;
+        Distance left_dist = dist_line[x - 1];
+        if (left_dist != special_distance) {
+            uint32_t sqdist_left = sqdist_line[x - 1];
+            sqdist_left += 1 - (int(left_dist.vec.x) << 1);
+            if (sqdist_left < sqdist_line[x]) {
+                sqdist_line[x] = sqdist_left;
                 --left_dist.vec.x;
                 dist_line[x] = left_dist;
+                assert(cmap_line[x] == 0 || cmap_line[x - 1] != 0);
                 cmap_line[x] = cmap_line[x - 1];
-            } else {
-                this_sqdist_line[x] = sqdist_top;
+                changed = true;
+                took_left = true;
+            }
+        }
+
+        // Propagate from top.
+        Distance top_dist = top_dist_line[x];
+        if (top_dist != special_distance) {
+            uint32_t sqdist_top = top_sqdist_line[x];
+            sqdist_top += VERTICAL_SCALE_SQ - 2 * VERTICAL_SCALE_SQ * int(top_dist.vec.y);
+            if (sqdist_top < sqdist_line[x] ||
+                    (top_wins_ties && took_left && sqdist_top == sqdist_line[x])) {
+                sqdist_line[x] = sqdist_top;
                 --top_dist.vec.y;
                 dist_line[x] = top_dist;
-                cmap_line[x] = cmap_line[x - width];
+                assert(cmap_line[x] == 0 || top_cmap_line[x] != 0);
+                cmap_line[x] = top_cmap_line[x];
+                changed = true;
             }
         }
+    }
 
-        // Right to left scan.
-        for (int x = width - 2; x >= 1; --x) {
-            // Propagate from right.
-            Distance right_dist = dist_line[x + 1];
-            uint32_t sqdist_right = this_sqdist_line[x + 1];
-            sqdist_right += 1 + (int(right_dist.vec.x) << 1);
+    // Right to left scan.
+    for (int x = width - 2; x >= 1; --x) {
+        if (dist_line[x] == special_distance) {
+            continue;
+        }
 
-            if (sqdist_right < this_sqdist_line[x]) {
-                this_sqdist_line[x] = sqdist_right;
+        // Propagate from right.
+        Distance right_dist = dist_line[x + 1];
+        if (right_dist != special_distance) {
+            uint32_t sqdist_right = sqdist_line[x + 1];
+            sqdist_right += 1 + (int(right_dist.vec.x) << 1);
+            if (sqdist_right < sqdist_line[x]) {
+                sqdist_line[x] = sqdist_right;
                 ++right_dist.vec.x;
                 dist_line[x] = right_dist;
+                assert(cmap_line[x] == 0 || cmap_line[x + 1] != 0);
                 cmap_line[x] = cmap_line[x + 1];
+                changed = true;
             }
         }
-
-        std::swap(this_sqdist_line, prev_sqdist_line);
     }
 
-    // Bottom to top scan.
-    for (int y = height - 2; y >= 1; --y) {
-        dist_line -= width;
-        cmap_line -= width;
-        dist_line[0].reset(0);
-        dist_line[width - 1].reset(width - 1);
-        this_sqdist_line[0] = dist_line[0].sqdist();
-        this_sqdist_line[width - 1] = dist_line[width - 1].sqdist();
-        // Right to left scan.
-        for (int x = width - 2; x >= 1; --x) {
-            // Propagate from right.
-            Distance right_dist = dist_line[x + 1];
-            uint32_t sqdist_right = this_sqdist_line[x + 1];
-            sqdist_right += 1 + (int(right_dist.vec.x) << 1);
+    return changed;
+}
 
-            // Propagate from bottom.
-            Distance bottom_dist = dist_line[x + width];
-            uint32_t sqdist_bottom = prev_sqdist_line[x];
-            sqdist_bottom += VERTICAL_SCALE_SQ + 2 * VERTICAL_SCALE_SQ * int(bottom_dist.vec.y);
+/**
+ * The same as propagateDown(), but from the line below.
+ */
+bool propagateUp(
+    Distance* dist_line, uint32_t* cmap_line, uint32_t* sqdist_line,
+    Distance const* bottom_dist_line, uint32_t const* bottom_cmap_line,
+    uint32_t const* bottom_sqdist_line, int const width, Distance const special_distance)
+{
+    bool changed = false;
 
-            this_sqdist_line[x] = dist_line[x].sqdist();
+    sqdist_line[0] = dist_line[0].sqdist();
+    sqdist_line[width - 1] = dist_line[width - 1].sqdist();
 
-            if (sqdist_right < this_sqdist_line[x]) {
-                this_sqdist_line[x] = sqdist_right;
+    // Right to left scan.
+    for (int x = width - 2; x >= 1; --x) {
+        if (dist_line[x] == special_distance) {
+            continue;
+        }
+
+        sqdist_line[x] = dist_line[x].sqdist();
+
+        // Propagate from right.
+        Distance right_dist = dist_line[x + 1];
+        if (right_dist != special_distance) {
+            uint32_t sqdist_right = sqdist_line[x + 1];
+            sqdist_right += 1 + (int(right_dist.vec.x) << 1);
+            if (sqdist_right < sqdist_line[x]) {
+                sqdist_line[x] = sqdist_right;
                 ++right_dist.vec.x;
                 dist_line[x] = right_dist;
                 assert(cmap_line[x] == 0 || cmap_line[x + 1] != 0);
                 cmap_line[x] = cmap_line[x + 1];
+                changed = true;
             }
-            if (sqdist_bottom < this_sqdist_line[x]) {
-                this_sqdist_line[x] = sqdist_bottom;
+        }
+
+        // Propagate from bottom.
+        Distance bottom_dist = bottom_dist_line[x];
+        if (bottom_dist != special_distance) {
+            uint32_t sqdist_bottom = bottom_sqdist_line[x];
+            sqdist_bottom += VERTICAL_SCALE_SQ + 2 * VERTICAL_SCALE_SQ * int(bottom_dist.vec.y);
+            if (sqdist_bottom < sqdist_line[x]) {
+                sqdist_line[x] = sqdist_bottom;
                 ++bottom_dist.vec.y;
                 dist_line[x] = bottom_dist;
-                assert(cmap_line[x] == 0 || cmap_line[x + width] != 0);
-                cmap_line[x] = cmap_line[x + width];
+                assert(cmap_line[x] == 0 || bottom_cmap_line[x] != 0);
+                cmap_line[x] = bottom_cmap_line[x];
+                changed = true;
             }
         }
+    }
+
+    // Left to right scan.
+    for (int x = 1; x < width - 1; ++x) {
+        if (dist_line[x] == special_distance) {
+            continue;
+        }
 
-        // Left to right scan.
-        for (int x = 1; x < width - 1; ++x) {
-            // Propagate from left.
-            Distance left_dist = dist_line[x - 1];
-            uint32_t sqdist_left = this_sqdist_line[x - 1];
+        // Propagate from left.
+        Distance left_dist = dist_line[x - 1];
+        if (left_dist != special_distance) {
+            uint32_t sqdist_left = sqdist_line[x - 1];
             sqdist_left += 1 - (int(left_dist.vec.x) << 1);
-
-            if (sqdist_left < this_sqdist_line[x]) {
-                this_sqdist_line[x] = sqdist_left;
+            if (sqdist_left < sqdist_line[x]) {
+                sqdist_line[x] = sqdist_left;
                 --left_dist.vec.x;
                 dist_line[x] = left_dist;
                 assert(cmap_line[x] == 0 || cmap_line[x - 1] != 0);
                 cmap_line[x] = cmap_line[x - 1];
+                changed = true;
             }
         }
-
-        std::swap(this_sqdist_line, prev_sqdist_line);
     }
+
+    return changed;
 }
 
-void voronoiSpecial(ConnectivityMap& cmap, std::vector<Distance>& dist, Distance const special_distance)
+/**
+ * Runs the top to bottom and / or the bottom to top pass over lines
+ * [top, bottom) of the padded distance matrix and connectivity map.
+ * The lines adjacent to that range are taken from \p above_* and \p below_*.
+ * If \p partial is set, a pass stops at the first line that didn't change.
+ */
+void sweepBand(
+    Distance* dist_data, uint32_t* cmap_data, int const width,
+    int const top, int const bottom,
+    Distance const* above_dist, uint32_t const* above_cmap,
+    Distance const* below_dist, uint32_t const* below_cmap,
+    bool const down, bool const up, bool const partial,
+    Distance const special_distance, bool const top_wins_ties)
 {
-    int const width = cmap.size().width() + 2;
-    int const height = cmap.size().height() + 2;
-
     std::vector<uint32_t> sqdists(width * 2, 0);
-    uint32_t* prev_sqdist_line = &sqdists[0];
-    uint32_t* this_sqdist_line = &sqdists[width];
-
-    Distance* dist_line = &dist[0];
-    uint32_t* cmap_line = cmap.paddedData();
-
-    dist_line[0].reset(0);
-    prev_sqdist_line[0] = dist_line[0].sqdist();
-    for (int x = 1; x < width; ++x) {
-        dist_line[x].vec.x = dist_line[x - 1].vec.x - 1;
-        prev_sqdist_line[x] = prev_sqdist_line[x - 1]
-                              - (int(dist_line[x - 1].vec.x) << 1) + 1;
-    }
-
-    // Top to bottom scan.
-    for (int y = 1; y < height - 1; ++y) {
-        dist_line += width;
-        cmap_line += width;
-        dist_line[0].reset(0);
-        dist_line[width - 1].reset(width - 1);
-        this_sqdist_line[0] = dist_line[0].sqdist();
-        this_sqdist_line[width - 1] = dist_line[width - 1].sqdist();
-        // Left to right scan.
-        for (int x = 1; x < width - 1; ++x) {
-            if (dist_line[x] == special_distance) {
-                continue;
-            }
+    uint32_t* this_sqdist_line = &sqdists[0];
+    uint32_t* prev_sqdist_line = &sqdists[width];
 
-            this_sqdist_line[x] = dist_line[x].sqdist();
-
-            // Propagate from left.
-            Distance left_dist = dist_line[x - 1];
-            if (left_dist != special_distance) {
-                uint32_t sqdist_left = this_sqdist_line[x - 1];
-                sqdist_left += 1 - (int(left_dist.vec.x) << 1);
-                if (sqdist_left < this_sqdist_line[x]) {
-                    this_sqdist_line[x] = sqdist_left;
-                    --left_dist.vec.x;
-                    dist_line[x] = left_dist;
-                    assert(cmap_line[x] == 0 || cmap_line[x - 1] != 0);
-                    cmap_line[x] = cmap_line[x - 1];
-                }
+    if (down) {
+        Distance const* prev_dist_line = above_dist;
+        uint32_t const* prev_cmap_line = above_cmap;
+        for (int x = 0; x < width; ++x) {
+            if (above_dist[x] != special_distance) {
+                prev_sqdist_line[x] = above_dist[x].sqdist();
             }
-
-            // Propagate from top.
-            Distance top_dist = dist_line[x - width];
-            if (top_dist != special_distance) {
-                uint32_t sqdist_top = prev_sqdist_line[x];
-                sqdist_top += VERTICAL_SCALE_SQ - 2 * VERTICAL_SCALE_SQ * int(top_dist.vec.y);
-                if (sqdist_top < this_sqdist_line[x]) {
-                    this_sqdist_line[x] = sqdist_top;
-                    --top_dist.vec.y;
-                    dist_line[x] = top_dist;
-                    assert(cmap_line[x] == 0 || cmap_line[x - width] != 0);
-                    cmap_line[x] = cmap_line[x - width];
-                }
+        }
+        for (int y = top; y < bottom; ++y) {
+            Distance* const dist_line = dist_data + y * width;
+            uint32_t* const cmap_line = cmap_data + y * width;
+            bool const changed = propagateDown(
+                dist_line, cmap_line, this_sqdist_line,
+                prev_dist_line, prev_cmap_line, prev_sqdist_line,
+                width, special_distance, top_wins_ties
+            );
+            if (partial && !changed) {
+                break;
             }
+            prev_dist_line = dist_line;
+            prev_cmap_line = cmap_line;
+            std::swap(this_sqdist_line, prev_sqdist_line);
         }
+    }
 
-        // Right to left scan.
-        for (int x = width - 2; x >= 1; --x) {
-            if (dist_line[x] == special_distance) {
-                continue;
+    if (up) {
+        Distance const* next_dist_line = below_dist;
+        uint32_t const* next_cmap_line = below_cmap;
+        for (int x = 0; x < width; ++x) {
+            if (below_dist[x] != special_distance) {
+                prev_sqdist_line[x] = below_dist[x].sqdist();
             }
-
-            // Propagate from right.
-            Distance right_dist = dist_line[x + 1];
-            if (right_dist != special_distance) {
-                uint32_t sqdist_right = this_sqdist_line[x + 1];
-                sqdist_right += 1 + (int(right_dist.vec.x) << 1);
-                if (sqdist_right < this_sqdist_line[x]) {
-                    this_sqdist_line[x] = sqdist_right;
-                    ++right_dist.vec.x;
-                    dist_line[x] = right_dist;
-                    assert(cmap_line[x] == 0 || cmap_line[x + 1] != 0);
-                    cmap_line[x] = cmap_line[x + 1];
-                }
+        }
+        for (int y = bottom - 1; y >= top; --y) {
+            Distance* const dist_line = dist_data + y * width;
+            uint32_t* const cmap_line = cmap_data + y * width;
+            bool const changed = propagateUp(
+                dist_line, cmap_line, this_sqdist_line,
+                next_dist_line, next_cmap_line, prev_sqdist_line,
+                width, special_distance
+            );
+            if (partial && !changed) {
+                break;
             }
+            next_dist_line = dist_line;
+            next_cmap_line = cmap_line;
+            std::swap(this_sqdist_line, prev_sqdist_line);
         }
-
-        std::swap(this_sqdist_line, prev_sqdist_line);
     }
+}
 
-    // Bottom to top scan.
-    for (int y = height - 2; y >= 1; --y) {
-        dist_line -= width;
-        cmap_line -= width;
-        dist_line[0].reset(0);
-        dist_line[width - 1].reset(width - 1);
-        this_sqdist_line[0] = dist_line[0].sqdist();
-        this_sqdist_line[width - 1] = dist_line[width - 1].sqdist();
-        // Right to left scan.
-        for (int x = width - 2; x >= 1; --x) {
-            if (dist_line[x] == special_distance) {
+/**
+ * Spreads connected components over the background, in such a way that
+ * every background pixel gets the label of its nearest component and
+ * a vector to the nearest pixel of that component.
+ *
+ * Pixels with a zero distance are the sources.  Pixels with
+ * \p special_distance are obstacles that don't spread and can't be
+ * taken over.  Other pixels may be taken over by a closer source.
+ *
+ * The image is split into bands of VORONOI_BAND_HEIGHT lines, that are
+ * processed in parallel.  Bands exchange their edge lines between
+ * iterations, until no edge line changes.  The band layout doesn't
+ * depend on the number of threads, and within an iteration a band only
+ * sees the state its neighbors had before that iteration, so the result
+ * is the same regardless of how many threads are used.
+ *
+ * An image consisting of a single band gets exactly the result of
+ * a sequential sweep down the whole image and back up.  With more bands
+ * it may differ in a few pixels.  Sweeping by vector propagation is only
+ * an approximation of the exact distance transform, and its result depends
+ * on the order pixels are visited in.  A sequential sweep carries what it
+ * finds in one band through all the bands below it before sweeping back up,
+ * while here, every band is swept on its own first, and what crosses band
+ * edges comes later.  Reproducing the sequential order would mean
+ * processing bands one after another, which is what we are avoiding.
+ */
+void voronoiBands(
+    ConnectivityMap& cmap, std::vector<Distance>& dist, Distance const special_distance,
+    bool const top_wins_ties)
+{
+    int const width = cmap.size().width() + 2;
+    int const height = cmap.size().height() + 2;
+    int const num_bands = (height - 2 + VORONOI_BAND_HEIGHT - 1) / VORONOI_BAND_HEIGHT;
+
+    Distance* const dist_data = &dist[0];
+    uint32_t* const cmap_data = cmap.paddedData(); // never call cmap.paddedData() inside omp
+
+    // The first and the last line of each band, as of the beginning of
+    // the current iteration.
+    std::vector<Distance> edge_dists(num_bands * 2 * width);
+    std::vector<uint32_t> edge_labels(num_bands * 2 * width);
+
+    std::vector<uint8_t> sweep_down(num_bands, 1);
+    std::vector<uint8_t> sweep_up(num_bands, 1);
+    std::vector<uint8_t> top_changed(num_bands, 0);
+    std::vector<uint8_t> bottom_changed(num_bands, 0);
+
+    for (bool first_iteration = true;; first_iteration = false) {
+        #pragma omp parallel for
+        for (int band = 0; band < num_bands; ++band) {
+            int const top = 1 + band * VORONOI_BAND_HEIGHT;
+            int const bottom = std::min(top + VORONOI_BAND_HEIGHT, height - 1);
+            int const first_edge = band * 2 * width;
+            int const second_edge = first_edge + width;
+            std::copy(dist_data + top * width, dist_data + (top + 1) * width, &edge_dists[first_edge]);
+            std::copy(cmap_data + top * width, cmap_data + (top + 1) * width, &edge_labels[first_edge]);
+            std::copy(dist_data + (bottom - 1) * width, dist_data + bottom * width, &edge_dists[second_edge]);
+            std::copy(cmap_data + (bottom - 1) * width, cmap_data + bottom * width, &edge_labels[second_edge]);
+        }
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int band = 0; band < num_bands; ++band) {
+            top_changed[band] = 0;
+            bottom_changed[band] = 0;
+            if (!sweep_down[band] && !sweep_up[band]) {
                 continue;
             }
 
-            this_sqdist_line[x] = dist_line[x].sqdist();
-
-            // Propagate from right.
-            Distance right_dist = dist_line[x + 1];
-            if (right_dist != special_distance) {
-                uint32_t sqdist_right = this_sqdist_line[x + 1];
-                sqdist_right += 1 + (int(right_dist.vec.x) << 1);
-                if (sqdist_right < this_sqdist_line[x]) {
-                    this_sqdist_line[x] = sqdist_right;
-                    ++right_dist.vec.x;
-                    dist_line[x] = right_dist;
-                    assert(cmap_line[x] == 0 || cmap_line[x + 1] != 0);
-                    cmap_line[x] = cmap_line[x + 1];
-                }
-            }
+            int const top = 1 + band * VORONOI_BAND_HEIGHT;
+            int const bottom = std::min(top + VORONOI_BAND_HEIGHT, height - 1);
+
+            // Padding lines border the first and the last band.
+            int const above_offset = band == 0 ? -1 : (band * 2 - 1) * width;
+            int const below_offset = band == num_bands - 1 ? -1 : (band * 2 + 2) * width;
+            Distance const* const above_dist = above_offset < 0 ? dist_data : &edge_dists[above_offset];
+            uint32_t const* const above_cmap = above_offset < 0 ? cmap_data : &edge_labels[above_offset];
+            Distance const* const below_dist = below_offset < 0
+                                               ? dist_data + bottom * width : &edge_dists[below_offset];
+            uint32_t const* const below_cmap = below_offset < 0
+                                               ? cmap_data + bottom * width : &edge_labels[below_offset];
+
+            sweepBand(
+                dist_data, cmap_data, width, top, bottom,
+                above_dist, above_cmap, below_dist, below_cmap,
+                sweep_down[band] != 0, sweep_up[band] != 0, !first_iteration,
+                special_distance, top_wins_ties
+            );
+
+            int const first_edge = band * 2 * width;
+            int const second_edge = first_edge + width;
+            top_changed[band] = !std::equal(
+                dist_data + top * width, dist_data + (top + 1) * width, &edge_dists[first_edge]
+            );
+            bottom_changed[band] = !std::equal(
+                dist_data + (bottom - 1) * width, dist_data + bottom * width, &edge_dists[second_edge]
+            );
+        }
 
-            // Propagate from bottom.
-            Distance bottom_dist = dist_line[x + width];
-            if (bottom_dist != special_distance) {
-                uint32_t sqdist_bottom = prev_sqdist_line[x];
-                sqdist_bottom += VERTICAL_SCALE_SQ + 2 * VERTICAL_SCALE_SQ * int(bottom_dist.vec.y);
-                if (sqdist_bottom < this_sqdist_line[x]) {
-                    this_sqdist_line[x] = sqdist_bottom;
-                    ++bottom_dist.vec.y;
-                    dist_line[x] = bottom_dist;
-                    assert(cmap_line[x] == 0 || cmap_line[x + width] != 0);
-                    cmap_line[x] = cmap_line[x + width];
-                }
-            }
+        bool have_work = false;
+        for (int band = 0; band < num_bands; ++band) {
+            sweep_down[band] = band > 0 && bottom_changed[band - 1];
+            sweep_up[band] = band < num_bands - 1 && top_changed[band + 1];
+            have_work = have_work || sweep_down[band] || sweep_up[band];
         }
+        if (!have_work) {
+            break;
+        }
+    }
+}
 
-        // Left to right scan.
-        for (int x = 1; x < width - 1; ++x) {
-            if (dist_line[x] == special_distance) {
-                continue;
-            }
+void voronoiSpecial(ConnectivityMap& cmap, std::vector<Distance>& dist, Distance const special_distance)
+{
+    voronoiBands(cmap, dist, special_distance, false);
+}
 
-            // Propagate from left.
-            Distance left_dist = dist_line[x - 1];
-            if (left_dist != special_distance) {
-                uint32_t sqdist_left = this_sqdist_line[x - 1];
-                sqdist_left += 1 - (int(left_dist.vec.x) << 1);
-                if (sqdist_left < this_sqdist_line[x]) {
-                    this_sqdist_line[x] = sqdist_left;
-                    --left_dist.vec.x;
-                    dist_line[x] = left_dist;
-                    assert(cmap_line[x] == 0 || cmap_line[x - 1] != 0);
-                    cmap_line[x] = cmap_line[x - 1];
-                }
+void voronoi(ConnectivityMap& cmap, std::vector<Distance>& dist)
+{
+    int const width = cmap.size().width() + 2;
+    int const height = cmap.size().height() + 2;
+
+    assert(dist.empty());
+    dist.resize(width * height, Distance::zero());
+
+    Distance* const dist_data = &dist[0];
+    uint32_t const* const cmap_data = cmap.paddedData(); // never call cmap.paddedData() inside omp
+
+    // Connected components are the sources, everything else,
+    // including the padding, is infinitely far from them.
+    #pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        int const offset = y * width;
+        for (int x = 0; x < width; ++x) {
+            if (!cmap_data[offset + x]) {
+                dist_data[offset + x].reset(x);
             }
         }
-
-        std::swap(this_sqdist_line, prev_sqdist_line);
     }
+
+    // There are no obstacles, as nothing has a special distance.
+    voronoiBands(cmap, dist, Distance::special(), true);
 }
 
 /**
@@ -676,35 +761,69 @@ void voronoiDistances(
 {
     int const width = cmap.size().width();
     int const height = cmap.size().height();
+    int const stride = cmap.stride();
 
-    int const offsets[] = { -cmap.stride(), -1, 1, cmap.stride() };
+    int const offsets[] = { -stride, -1, 1, stride };
 
-    uint32_t const* const cmap_data = cmap.data();
+    uint32_t const* const cmap_data = cmap.data(); // never call cmap.data() inside omp
     Distance const* const distance_data = &distance_matrix[0] + width + 3;
-    for (int y = 0, offset = 0; y < height; ++y, offset += 2) {
-        for (int x = 0; x < width; ++x, ++offset) {
-            uint32_t const label = cmap_data[offset];
-            assert(label != 0);
-
-            int const x1 = x + distance_data[offset].vec.x;
-            int const y1 = y + distance_data[offset].vec.y;
-
-            for (int i = 0; i < 4; ++i) {
-                int const nbh_offset = offset + offsets[i];
-                uint32_t const nbh_label = cmap_data[nbh_offset];
-                if (nbh_label == 0 || nbh_label == label) {
-                    // label 0 can be encountered in
-                    // padding lines.
-                    continue;
+
+    #pragma omp parallel
+    {
+        // Connections are collected as (lesser_label << 32 | greater_label, sqdist)
+        // pairs.  Neighboring pixels along a Voronoi edge mostly produce
+        // the same connection, so consecutive duplicates are merged right away.
+        std::vector<std::pair<uint64_t, uint32_t> > conns_l;
+
+        #pragma omp for
+        for (int y = 0; y < height; ++y) {
+            int offset = y * stride;
+            for (int x = 0; x < width; ++x, ++offset) {
+                uint32_t const label = cmap_data[offset];
+                assert(label != 0);
+
+                int const x1 = x + distance_data[offset].vec.x;
+                int const y1 = y + distance_data[offset].vec.y;
+
+                for (int i = 0; i < 4; ++i) {
+                    int const nbh_offset = offset + offsets[i];
+                    uint32_t const nbh_label = cmap_data[nbh_offset];
+                    if (nbh_label == 0 || nbh_label == label) {
+                        // label 0 can be encountered in
+                        // padding lines.
+                        continue;
+                    }
+
+                    int const x2 = x + distance_data[nbh_offset].vec.x;
+                    int const y2 = y + distance_data[nbh_offset].vec.y;
+                    int const dx = x1 - x2;
+                    int const dy = y1 - y2;
+                    uint32_t const sqdist = dx * dx + dy * dy;
+
+                    Connection const conn(label, nbh_label);
+                    uint64_t const key = (uint64_t(conn.lesser_label) << 32) | conn.greater_label;
+                    if (!conns_l.empty() && conns_l.back().first == key) {
+                        conns_l.back().second = std::min(conns_l.back().second, sqdist);
+                    } else {
+                        conns_l.push_back(std::make_pair(key, sqdist));
+                    }
                 }
+            }
+        }
 
-                int const x2 = x + distance_data[nbh_offset].vec.x;
-                int const y2 = y + distance_data[nbh_offset].vec.y;
-                int const dx = x1 - x2;
-                int const dy = y1 - y2;
-                uint32_t const sqdist = dx * dx + dy * dy;
+        // After sorting, the first pair of each connection has the minimum distance.
+        std::sort(conns_l.begin(), conns_l.end());
 
-                updateDistance(conns, label, nbh_label, sqdist);
+        // updateDistance() takes the minimum, so the result doesn't
+        // depend on how lines were split between threads.
+        #pragma omp critical
+        {
+            uint64_t prev_key = 0;
+            for (std::pair<uint64_t, uint32_t> const& pair : conns_l) {
+                if (pair.first != prev_key) {
+                    prev_key = pair.first;
+                    updateDistance(conns, uint32_t(pair.first >> 32), uint32_t(pair.first), pair.second);
+                }
             }
         }
     }
@@ -868,7 +987,9 @@ Despeckle::despeckleInPlace(
 
         Distance const zero_distance(Distance::zero());
         Distance const special_distance(Distance::special());
-        for (int y = 0, offset = 0; y < height; ++y, offset += 2) {
+        #pragma omp parallel for
+        for (int y = 0; y < height; ++y) {
+            int offset = y * cmap_stride;
             for (int x = 0; x < width; ++x, ++offset) {
                 uint32_t const label = cmap_data[offset];
                 assert(label != 0);
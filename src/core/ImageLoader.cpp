@@ -19,15 +19,27 @@
 #include "config.h"
 #include "ImageLoader.h"
 #include "TiffReader.h"
+#include "JpegReader.h"
 #ifdef ENABLE_OPENJPEG
 #include "Jp2Reader.h"
 #endif
 #include "ImageId.h"
+#include "ImageMetadata.h"
+#include "VirtualFunction.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/GrayImage.h"
+#include "imageproc/RasterOp.h"
+#include "imageproc/ReduceThreshold.h"
+#include "imageproc/Scale.h"
 #include <QImageReader>
 #include <QImage>
 #include <QString>
 #include <QIODevice>
 #include <QFile>
+#include <QRect>
+#include <QPoint>
+#include <QSize>
+#include <QtGlobal>
 
 QImage
 ImageLoader::load(ImageId const& image_id)
@@ -73,3 +85,155 @@ ImageLoader::load(QIODevice& io_dev, int const page_num)
     QImageReader(&io_dev).read(&image);
     return image;
 }
+
+/**
+ * Halves the resolution of an image \p levels times, rounding the size up.
+ * The result has the same format as the source.
+ */
+static QImage reduceResolution(QImage const& image, int const levels)
+{
+    using namespace imageproc;
+
+    if (image.isNull() || levels <= 0) {
+        return image;
+    }
+
+    int const factor = 1 << levels;
+    QSize const size(
+        (image.width() + factor - 1) / factor,
+        (image.height() + factor - 1) / factor
+    );
+
+    QImage reduced;
+    if (image.format() == QImage::Format_Mono || image.format() == QImage::Format_MonoLSB) {
+        BinaryImage bw(image);
+        for (int i = 0; i < levels; ++i) {
+            // ReduceThreshold rounds down, so odd sizes get a white pixel added.
+            QSize const even_size((bw.width() + 1) & ~1, (bw.height() + 1) & ~1);
+            if (even_size != bw.size()) {
+                BinaryImage padded(even_size, WHITE);
+                rasterOp<RopSrc>(padded, bw.rect(), bw, QPoint(0, 0));
+                bw.swap(padded);
+            }
+            bw = ReduceThreshold(bw).reduce(2).image();
+        }
+        reduced = bw.toQImage();
+    } else if (image.format() == QImage::Format_Grayscale8
+               || (image.format() == QImage::Format_Indexed8 && image.isGrayscale())) {
+        reduced = scaleToGray(GrayImage(image), size).toQImage();
+    } else {
+        reduced = image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    // QImage::scaled() makes palette based images 32-bit.
+    if (reduced.format() != image.format()) {
+        if (image.format() == QImage::Format_Indexed8) {
+            reduced = reduced.convertToFormat(QImage::Format_Indexed8, image.colorTable());
+        } else {
+            reduced = reduced.convertToFormat(image.format());
+        }
+    }
+
+    reduced.setDotsPerMeterX(image.dotsPerMeterX() / factor);
+    reduced.setDotsPerMeterY(image.dotsPerMeterY() / factor);
+    return reduced;
+}
+
+QImage
+ImageLoader::load(
+    ImageId const& image_id, QRect const& region,
+    int const reduce, int const num_threads)
+{
+    QFile file(image_id.filePath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QImage();
+    }
+
+    if (image_id.filePath().startsWith(":")) {
+        // See load(QString const&, int).
+        return load(file, 0, region, reduce, num_threads);
+    }
+
+    return load(file, image_id.zeroBasedPage(), region, reduce, num_threads);
+}
+
+QImage
+ImageLoader::load(
+    QIODevice& io_dev, int const page_num, QRect const& region,
+    int reduce, int const num_threads)
+{
+    // Beyond that, every image is reduced to a single pixel.
+    reduce = qBound(0, reduce, 16);
+
+    if (TiffReader::canRead(io_dev)) {
+        return reduceResolution(TiffReader::readImage(io_dev, page_num, region), reduce);
+    }
+
+#ifdef ENABLE_OPENJPEG
+    if (page_num == 0 && Jp2Reader::canRead(io_dev)) {
+        return Jp2Reader::readImage(io_dev, region, reduce, num_threads);
+    }
+#else
+    Q_UNUSED(num_threads);
+#endif
+
+    QImage image(load(io_dev, page_num));
+    if (!image.isNull() && !region.isNull()) {
+        image = image.copy(region.intersected(image.rect()));
+    }
+    return reduceResolution(image, reduce);
+}
+
+QImage
+ImageLoader::load(ImageId const& image_id, QSize const& hint)
+{
+    QFile file(image_id.filePath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QImage();
+    }
+
+    if (image_id.filePath().startsWith(":")) {
+        // See load(QString const&, int).
+        return load(file, 0, hint);
+    }
+
+    return load(file, image_id.zeroBasedPage(), hint);
+}
+
+QImage
+ImageLoader::load(QIODevice& io_dev, int const page_num, QSize const& hint)
+{
+    if (page_num == 0 && hint.isValid()) {
+        if (JpegReader::canRead(io_dev)) {
+            QImage const image(JpegReader::readImage(io_dev, hint));
+            if (!image.isNull()) {
+                return image;
+            }
+            // Let Qt try colour spaces we don't handle.
+            io_dev.seek(0);
+        }
+
+#ifdef ENABLE_OPENJPEG
+        if (Jp2Reader::canRead(io_dev)) {
+            QSize size;
+            auto set_size = [&size](ImageMetadata const& metadata) {
+                size = metadata.size();
+            };
+            ProxyFunction1<decltype(set_size), void, ImageMetadata const&> proxy(set_size);
+            Jp2Reader::readMetadata(io_dev, proxy);
+            io_dev.seek(0);
+
+            // The largest reduction keeping the image as large as the hint.
+            int reduce = 0;
+            while (reduce < 16 &&
+                    ((size.width() - 1) >> (reduce + 1)) + 1 >= hint.width() &&
+                    ((size.height() - 1) >> (reduce + 1)) + 1 >= hint.height()) {
+                ++reduce;
+            }
+            return Jp2Reader::readImage(io_dev, QRect(), reduce, 1);
+        }
+#endif
+    }
+
+    return load(io_dev, page_num);
+}
@@ -23,6 +23,8 @@ class ImageId;
 class QImage;
 class QString;
 class QIODevice;
+class QRect;
+class QSize;
 
 class ImageLoader
 {
@@ -32,6 +34,44 @@ public:
     static QImage load(ImageId const& image_id);
 
     static QImage load(QIODevice& io_dev, int page_num);
+
+    /**
+     * \brief Loads a rectangular region of an image,
+     *        optionally at a reduced resolution.
+     *
+     * JPEG 2000 files decode only the region and the resolution levels
+     * needed.  TIFF files decode only the strips or tiles covering the
+     * region.  Other formats are loaded whole and cropped.
+     *
+     * \param region The region to load, in full resolution pixels.
+     *        It's clipped to the image.  A null rectangle stands for
+     *        the whole image.
+     * \param reduce Each level halves the width, the height and
+     *        the DPI of the result.  Formats that can't decode at
+     *        a lower resolution are scaled down after loading.
+     * \param num_threads The number of threads a decoder may use.
+     *        Only the JPEG 2000 decoder makes use of it.
+     */
+    static QImage load(
+        ImageId const& image_id, QRect const& region,
+        int reduce = 0, int num_threads = 1);
+
+    static QImage load(
+        QIODevice& io_dev, int page_num, QRect const& region,
+        int reduce = 0, int num_threads = 1);
+
+    /**
+     * \brief Loads an image at a resolution just high enough for \p hint.
+     *
+     * The result is at least as large as \p hint in both dimensions,
+     * unless the image itself is smaller, but may be larger than that.
+     * JPEG images are downscaled by libjpeg while decoding, and JPEG 2000
+     * ones skip the unneeded resolution levels.  Other formats are loaded
+     * at full resolution.  The DPI of the result matches its size.
+     */
+    static QImage load(ImageId const& image_id, QSize const& hint);
+
+    static QImage load(QIODevice& io_dev, int page_num, QSize const& hint);
 };
 
 #endif
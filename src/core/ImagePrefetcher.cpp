@@ -0,0 +1,182 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ImagePrefetcher.h"
+#include "ImageLoader.h"
+#include "OutOfMemoryHandler.h"
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include <new>
+
+class ImagePrefetcher::LoaderThread : public QThread
+{
+public:
+    LoaderThread(ImagePrefetcher& owner) : m_rOwner(owner) {}
+protected:
+    virtual void run()
+    {
+        m_rOwner.loaderLoop();
+    }
+private:
+    ImagePrefetcher& m_rOwner;
+};
+
+ImagePrefetcher::ImagePrefetcher(int capacity)
+    :   m_capacity(std::max(1, capacity)),
+        m_numResident(0),
+        m_exiting(false),
+        m_ptrLoaderThread(new LoaderThread(*this))
+{
+    m_ptrLoaderThread->start(QThread::LowPriority);
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+    {
+        QMutexLocker const locker(&m_mutex);
+        m_exiting = true;
+        m_cond.wakeAll();
+    }
+    m_ptrLoaderThread->wait();
+}
+
+void
+ImagePrefetcher::enqueue(ImageId const& image_id)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    if (!m_entries.empty() && m_entries.back().imageId == image_id) {
+        ++m_entries.back().numTakers;
+        return;
+    }
+
+    m_entries.push_back(Entry(image_id));
+    m_cond.wakeAll();
+}
+
+QImage
+ImagePrefetcher::take(ImageId const& image_id)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    std::list<Entry>::iterator it(m_entries.begin());
+    std::list<Entry>::iterator const end(m_entries.end());
+    for (; it != end && it->imageId != image_id; ++it) {
+        // Just looking.
+    }
+    if (it == end) {
+        return QImage();
+    }
+
+    while (it->state == LOADING) {
+        m_cond.wait(&m_mutex);
+        // Neither the loader nor other takers remove the entry,
+        // as we haven't taken our share yet.
+    }
+
+    QImage image;
+    if (it->state == LOADED) {
+        image = it->image;
+    }
+
+    dropTaker(it);
+
+    return image;
+}
+
+void
+ImagePrefetcher::discard(ImageId const& image_id)
+{
+    QMutexLocker const locker(&m_mutex);
+
+    std::list<Entry>::iterator it(m_entries.begin());
+    std::list<Entry>::iterator const end(m_entries.end());
+    for (; it != end && it->imageId != image_id; ++it) {
+        // Just looking.
+    }
+    if (it != end) {
+        dropTaker(it);
+    }
+}
+
+void
+ImagePrefetcher::dropTaker(std::list<Entry>::iterator const it)
+{
+    if (--it->numTakers > 0 || it->state == LOADING) {
+        // The loader erases a LOADING entry nobody takes once it's done.
+        return;
+    }
+
+    if (it->state == LOADED) {
+        --m_numResident;
+    }
+    m_entries.erase(it);
+    m_cond.wakeAll();
+}
+
+void
+ImagePrefetcher::loaderLoop()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (;;) {
+        std::list<Entry>::iterator it(m_entries.begin());
+        std::list<Entry>::iterator const end(m_entries.end());
+        if (m_numResident < m_capacity) {
+            for (; it != end && it->state != PENDING; ++it) {
+                // Just looking.
+            }
+        } else {
+            it = end;
+        }
+
+        if (m_exiting) {
+            return;
+        }
+
+        if (it == end) {
+            m_cond.wait(&m_mutex);
+            continue;
+        }
+
+        it->state = LOADING;
+        ++m_numResident;
+        ImageId const image_id(it->imageId);
+        QImage image;
+
+        locker.unlock();
+        try {
+            image = ImageLoader::load(image_id);
+        } catch (std::bad_alloc const&) {
+            OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+        }
+        locker.relock();
+
+        // Entries in LOADING state are never erased, so <it> is still valid.
+        if (it->numTakers == 0) {
+            // Discarded while being loaded.
+            --m_numResident;
+            m_entries.erase(it);
+        } else {
+            it->image = image;
+            it->state = LOADED;
+        }
+        m_cond.wakeAll();
+    }
+}
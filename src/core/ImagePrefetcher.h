@@ -0,0 +1,116 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGE_PREFETCHER_H_
+#define IMAGE_PREFETCHER_H_
+
+#include "NonCopyable.h"
+#include "RefCountable.h"
+#include "ImageId.h"
+#include <QImage>
+#include <QMutex>
+#include <QWaitCondition>
+#include <list>
+#include <memory>
+
+/**
+ * \brief Decodes images ahead of the batch processing tasks that need them.
+ *
+ * Image ids are enqueued in processing order.  A background thread decodes
+ * them one by one, keeping no more than a given number of decoded images
+ * that weren't taken yet, including the one being decoded.  LoadFileTask then takes an already decoded image
+ * instead of loading the file itself, so decoding overlaps with processing
+ * of the previous pages.
+ */
+class ImagePrefetcher : public RefCountable
+{
+    DECLARE_NON_COPYABLE(ImagePrefetcher)
+public:
+    /**
+     * \param capacity The maximum number of decoded images waiting to be taken.
+     */
+    explicit ImagePrefetcher(int capacity);
+
+    /**
+     * Stops the background thread, discarding any images not taken.
+     */
+    virtual ~ImagePrefetcher();
+
+    /**
+     * \brief Schedules an image to be decoded.
+     *
+     * Enqueuing the same image several times in a row (as happens with
+     * two-page scans) results in a single decode.
+     */
+    void enqueue(ImageId const& image_id);
+
+    /**
+     * \brief Takes a decoded image.
+     *
+     * If the image is being decoded right now, waits for that to finish.
+     * If it's decoded already, returns it without waiting.  Otherwise,
+     * cancels its decoding and returns a null image, in which case the
+     * caller is expected to load the image itself.
+     *
+     * May be called from any thread.
+     */
+    QImage take(ImageId const& image_id);
+
+    /**
+     * \brief Gives up on an image that's not going to be taken.
+     *
+     * For tasks that get cancelled or removed before taking their image.
+     * The image is freed right away, or as soon as it's decoded if that's
+     * happening right now.
+     *
+     * May be called from any thread.
+     */
+    void discard(ImageId const& image_id);
+private:
+    enum State { PENDING, LOADING, LOADED };
+
+    struct Entry {
+        ImageId imageId;
+        QImage image;
+        State state;
+        int numTakers;
+
+        explicit Entry(ImageId const& image_id)
+            : imageId(image_id), state(PENDING), numTakers(1) {}
+    };
+
+    class LoaderThread;
+
+    void loaderLoop();
+
+    /**
+     * Removes a taker from the entry, erasing it if that was the last one.
+     * Must be called with m_mutex locked.
+     */
+    void dropTaker(std::list<Entry>::iterator it);
+
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+    std::list<Entry> m_entries;
+    int m_capacity;
+    int m_numResident; /**< The number of entries being loaded or loaded. */
+    bool m_exiting;
+    std::unique_ptr<LoaderThread> m_ptrLoaderThread;
+};
+
+#endif
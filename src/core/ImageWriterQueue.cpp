@@ -0,0 +1,212 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ImageWriterQueue.h"
+#include "OutOfMemoryHandler.h"
+#include "MemoryBudget.h"
+#include "PayloadEvent.h"
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include <new>
+
+class ImageWriterQueue::WriterThread : public QThread
+{
+public:
+    WriterThread(ImageWriterQueue& owner) : m_rOwner(owner) {}
+protected:
+    virtual void run()
+    {
+        m_rOwner.writerLoop();
+    }
+private:
+    ImageWriterQueue& m_rOwner;
+};
+
+/**
+ * Lives in the main thread and runs the on_written callbacks posted to it.
+ */
+class ImageWriterQueue::Notifier : public QObject
+{
+public:
+    typedef PayloadEvent<Job> JobEvent;
+protected:
+    virtual bool event(QEvent* event)
+    {
+        if (event->type() != QEvent::User) {
+            return QObject::event(event);
+        }
+        static_cast<JobEvent*>(event)->payload()();
+        return true;
+    }
+};
+
+ImageWriterQueue::ImageWriterQueue()
+    :   m_ptrNotifier(new Notifier),
+        m_capacity(0),
+        m_busy(false),
+        m_exiting(false),
+        m_writerRunning(false)
+{
+    if (QCoreApplication* const app = QCoreApplication::instance()) {
+        m_ptrNotifier->moveToThread(app->thread());
+    }
+}
+
+ImageWriterQueue::~ImageWriterQueue()
+{
+    setCapacity(0);
+    if (m_ptrWriterThread.get()) {
+        m_ptrWriterThread->wait();
+    }
+}
+
+ImageWriterQueue&
+ImageWriterQueue::instance()
+{
+    static ImageWriterQueue object;
+    return object;
+}
+
+void
+ImageWriterQueue::setCapacity(int capacity)
+{
+    std::unique_ptr<WriterThread> finished_thread;
+
+    {
+        QMutexLocker const locker(&m_mutex);
+        m_capacity = std::max(0, capacity);
+        m_exiting = m_capacity == 0;
+        if (m_capacity > 0 && !m_writerRunning) {
+            finished_thread.swap(m_ptrWriterThread);
+            m_writerRunning = true;
+            m_ptrWriterThread.reset(new WriterThread(*this));
+            m_ptrWriterThread->start();
+        }
+        // When disabled, the writer thread drains the queue and exits.
+        m_cond.wakeAll();
+    }
+
+    if (finished_thread.get()) {
+        // It has already left writerLoop(), so this doesn't block for long.
+        finished_thread->wait();
+    }
+}
+
+void
+ImageWriterQueue::submit(
+    Job const& job, Job const& on_written,
+    IntrusivePtr<BackgroundTask const> const& task, qint64 const bytes)
+{
+    Entry entry;
+    entry.job = job;
+    entry.onWritten = on_written;
+    entry.task = task;
+    entry.bytes = bytes;
+
+    {
+        QMutexLocker const locker(&m_mutex);
+        while (m_capacity > 0 && (int)m_jobs.size() >= m_capacity) {
+            m_cond.wait(&m_mutex);
+        }
+        if (m_capacity > 0) {
+            MemoryBudget::instance().hold(bytes);
+            m_jobs.push_back(entry);
+            m_cond.wakeAll();
+            return;
+        }
+
+        // The queue may still be draining in the background.
+        while (!m_jobs.empty() || m_busy) {
+            m_cond.wait(&m_mutex);
+        }
+    }
+
+    runEntry(entry);
+}
+
+void
+ImageWriterQueue::keepQueuedJobs()
+{
+    QMutexLocker const locker(&m_mutex);
+    for (Entry& entry : m_jobs) {
+        entry.task.reset();
+    }
+}
+
+void
+ImageWriterQueue::flush()
+{
+    QMutexLocker const locker(&m_mutex);
+    while (!m_jobs.empty() || m_busy) {
+        m_cond.wait(&m_mutex);
+    }
+}
+
+void
+ImageWriterQueue::writerLoop()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (;;) {
+        if (m_jobs.empty()) {
+            if (m_exiting) {
+                m_writerRunning = false;
+                return;
+            }
+            m_cond.wait(&m_mutex);
+            continue;
+        }
+
+        Entry entry(m_jobs.front());
+        m_jobs.pop_front();
+        m_busy = true;
+        m_cond.wakeAll();
+
+        locker.unlock();
+        runEntry(entry);
+        qint64 const bytes = entry.bytes;
+        entry = Entry(); // Free the images before releasing their budget.
+        MemoryBudget::instance().release(bytes);
+        locker.relock();
+
+        m_busy = false;
+        m_cond.wakeAll();
+    }
+}
+
+void
+ImageWriterQueue::runEntry(Entry const& entry)
+{
+    if (entry.task && entry.task->isCancelled()) {
+        // The page was removed or is going to be processed again.
+        return;
+    }
+
+    try {
+        entry.job();
+    } catch (std::bad_alloc const&) {
+        OutOfMemoryHandler::instance().handleOutOfMemorySituation();
+        return;
+    }
+
+    if (entry.onWritten) {
+        QCoreApplication::postEvent(m_ptrNotifier.get(), new Notifier::JobEvent(entry.onWritten));
+    }
+}
@@ -0,0 +1,118 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGE_WRITER_QUEUE_H_
+#define IMAGE_WRITER_QUEUE_H_
+
+#include "NonCopyable.h"
+#include "IntrusivePtr.h"
+#include "BackgroundTask.h"
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+#include <functional>
+#include <memory>
+
+/**
+ * \brief The encoder / writer stage of batch processing.
+ *
+ * Batch tasks hand over the encoding and writing of their output files,
+ * so the next page can be processed while TIFF compression and disk I/O
+ * of the previous one take place on a dedicated thread.
+ * While disabled (the default), submitted jobs run synchronously.
+ */
+class ImageWriterQueue
+{
+    DECLARE_NON_COPYABLE(ImageWriterQueue)
+public:
+    typedef std::function<void()> Job;
+
+    static ImageWriterQueue& instance();
+
+    /**
+     * \brief Enables or disables asynchronous writing.
+     *
+     * \param capacity The maximum number of queued jobs.  Once it's reached,
+     *        submit() blocks until the writer catches up.  Zero disables
+     *        asynchronous writing.  The jobs already queued are still
+     *        carried out in the background, so this never blocks.
+     */
+    void setCapacity(int capacity);
+
+    /**
+     * \brief Queues a job, or runs it right away if the queue is disabled.
+     *
+     * May be called from any thread.  A synchronous job still waits for
+     * the queued ones, so jobs always finish in submission order.
+     *
+     * \param job Encodes and writes the files.
+     * \param on_written If set, called from the main thread's event loop
+     *        once \p job has finished.
+     * \param task If set and cancelled by the time \p job would start,
+     *        neither \p job nor \p on_written are called.
+     * \param bytes The memory taken by the images \p job holds.  It counts
+     *        against MemoryBudget for as long as the job is queued.
+     */
+    void submit(Job const& job, Job const& on_written = Job(),
+                IntrusivePtr<BackgroundTask const> const& task = IntrusivePtr<BackgroundTask const>(),
+                qint64 bytes = 0);
+
+    /**
+     * \brief Makes the jobs queued so far run even if their tasks
+     *        get cancelled.
+     *
+     * Stopping batch processing cancels its tasks, but the pages whose
+     * files are already queued are done and have to be written.
+     */
+    void keepQueuedJobs();
+
+    /**
+     * \brief Waits for all submitted jobs to finish.
+     */
+    void flush();
+private:
+    class WriterThread;
+    class Notifier;
+
+    struct Entry {
+        Job job;
+        Job onWritten;
+        IntrusivePtr<BackgroundTask const> task;
+        qint64 bytes;
+    };
+
+    ImageWriterQueue();
+
+    ~ImageWriterQueue();
+
+    void writerLoop();
+
+    void runEntry(Entry const& entry);
+
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+    std::deque<Entry> m_jobs;
+    std::unique_ptr<WriterThread> m_ptrWriterThread;
+    std::unique_ptr<Notifier> m_ptrNotifier;
+    int m_capacity;
+    bool m_busy;
+    bool m_exiting;
+    bool m_writerRunning;
+};
+
+#endif
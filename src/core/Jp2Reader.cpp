@@ -27,6 +27,7 @@
 #include <QImage>
 #include <QColor>
 #include <QSize>
+#include <QRect>
 #include <QDebug>
 #include <algorithm>
 #include <new>
@@ -142,7 +143,8 @@ ImageMetadataLoader::Status prepareMetadata(
         QIODevice& device,
         opj_stream_t** p_stream,
         opj_codec_t** p_codec,
-        opj_image_t** p_image)
+        opj_image_t** p_image,
+        int const num_threads = 1)
 {
 
     opj_stream_t*& stream = *p_stream;
@@ -194,8 +196,6 @@ ImageMetadataLoader::Status prepareMetadata(
         qCritical() << msg;
     }, nullptr);
 
-    // we don't set thread number for decoder - relying on defaults
-
     opj_dparameters_t  parameters;
     opj_set_default_decoder_parameters (&parameters);
 
@@ -205,6 +205,15 @@ ImageMetadataLoader::Status prepareMetadata(
         return ImageMetadataLoader::GENERIC_ERROR;
     }
 
+#if defined(OPJ_VERSION_MAJOR) && (OPJ_VERSION_MAJOR > 2 || (OPJ_VERSION_MAJOR == 2 && OPJ_VERSION_MINOR >= 2))
+    // Has to be set between opj_setup_decoder() and opj_read_header().
+    if (num_threads > 1 && opj_has_thread_support()) {
+        opj_codec_set_threads(codec, num_threads);
+    }
+#else
+    Q_UNUSED(num_threads);
+#endif
+
     image = nullptr;
     if (opj_read_header (stream, codec, &image) != OPJ_TRUE) {
         if (image) {
@@ -308,14 +317,63 @@ QImage openjpegToQImage(opj_image_t* source)
     return image;
 }
 
+/**
+ * Returns the number of resolution levels every component has.
+ */
+int numResolutions(opj_codec_t* codec)
+{
+    int num_resolutions = 1;
+
+    opj_codestream_info_v2_t* info = opj_get_cstr_info(codec);
+    if (info) {
+        opj_tile_info_v2_t const& tile_info = info->m_default_tile_info;
+        if (tile_info.tccp_info && info->nbcomps > 0) {
+            num_resolutions = tile_info.tccp_info[0].numresolutions;
+            for (OPJ_UINT32 i = 1; i < info->nbcomps; ++i) {
+                num_resolutions = std::min<int>(num_resolutions, tile_info.tccp_info[i].numresolutions);
+            }
+        }
+        opj_destroy_cstr_info(&info);
+    }
+
+    return std::max(1, num_resolutions);
+}
+
 QImage
 Jp2Reader::readImage(QIODevice& device)
+{
+    return readImage(device, QRect(), 0, 1);
+}
+
+QImage
+Jp2Reader::readImage(
+    QIODevice& device, QRect const& region, int reduce, int const num_threads)
 {
     opj_stream_t* stream = nullptr;
     opj_codec_t* codec = nullptr;
     opj_image_t* jp2_image = nullptr;
     ImageMetadataLoader::Status res =
-            prepareMetadata(device, &stream, &codec, &jp2_image);
+            prepareMetadata(device, &stream, &codec, &jp2_image, num_threads);
+    if (res == ImageMetadataLoader::LOADED) {
+        reduce = qBound(0, reduce, numResolutions(codec) - 1);
+        if (reduce > 0 && !opj_set_decoded_resolution_factor(codec, reduce)) {
+            res = ImageMetadataLoader::GENERIC_ERROR;
+        }
+    }
+    if (res == ImageMetadataLoader::LOADED && !region.isNull()) {
+        // The decode area is given on the reference grid.
+        opj_image_comp_t const& comp = jp2_image->comps[0];
+        QRect const rect(region.intersected(QRect(0, 0, comp.w, comp.h)));
+        if (rect.isEmpty() ||
+                !opj_set_decode_area(
+                    codec, jp2_image,
+                    jp2_image->x0 + rect.left() * comp.dx,
+                    jp2_image->y0 + rect.top() * comp.dy,
+                    std::min<OPJ_UINT32>(jp2_image->x0 + (rect.right() + 1) * comp.dx, jp2_image->x1),
+                    std::min<OPJ_UINT32>(jp2_image->y0 + (rect.bottom() + 1) * comp.dy, jp2_image->y1))) {
+            res = ImageMetadataLoader::GENERIC_ERROR;
+        }
+    }
     if (res != ImageMetadataLoader::LOADED) {
         if (jp2_image) {
             opj_image_destroy(jp2_image);
@@ -373,8 +431,9 @@ Jp2Reader::readImage(QIODevice& device)
 
     Dpi dpm = lookforJP2Dpm(device);
     if (!dpm.isNull()) {
-        image.setDotsPerMeterX(dpm.horizontal());
-        image.setDotsPerMeterY(dpm.vertical());
+        // Each discarded resolution level halves the resolution.
+        image.setDotsPerMeterX(dpm.horizontal() >> reduce);
+        image.setDotsPerMeterY(dpm.vertical() >> reduce);
     }
 
     return image;
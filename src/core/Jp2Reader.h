@@ -24,6 +24,7 @@
 
 class QIODevice;
 class QImage;
+class QRect;
 class ImageMetadata;
 class Dpi;
 
@@ -46,6 +47,27 @@ public:
      * \return The resulting image, or a null image in case of failure.
      */
     static QImage readImage(QIODevice& device);
+
+    /**
+     * \brief Reads a region of the image, possibly at a reduced resolution.
+     *
+     * Only the code-blocks covering the region and the requested
+     * resolution levels are decoded.
+     *
+     * \param device The device to read from.  This device must be
+     *        opened for reading and must be seekable.
+     * \param region The region to read, in full resolution pixels.
+     *        It's clipped to the image.  A null rectangle stands for
+     *        the whole image.
+     * \param reduce The number of resolution levels to discard.
+     *        Each level halves the width and the height of the result.
+     *        It's capped by the number of levels in the codestream.
+     * \param num_threads The number of decoder threads.  Ignored with
+     *        OpenJPEG versions older than 2.2.
+     * \return The resulting image, or a null image in case of failure.
+     */
+    static QImage readImage(
+        QIODevice& device, QRect const& region, int reduce, int num_threads);
 };
 
 #endif
@@ -0,0 +1,58 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2009  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JPEGREADER_H_
+#define JPEGREADER_H_
+
+#include "ImageMetadataLoader.h"
+#include "VirtualFunction.h"
+
+class QIODevice;
+class QImage;
+class QSize;
+class ImageMetadata;
+
+class JpegReader
+{
+public:
+    static bool canRead(QIODevice& device);
+
+    static ImageMetadataLoader::Status readMetadata(
+        QIODevice& device,
+        VirtualFunction1<void, ImageMetadata const&>& out);
+
+    /**
+     * \brief Reads the image from io device to QImage, downscaling it
+     *        while decoding if a size hint is given.
+     *
+     * libjpeg can skip most of the work when decoding at 1/2, 1/4 or 1/8
+     * of the full resolution.  The largest of these factors keeping the
+     * image at least as large as \p hint is used.  The DPI of the result
+     * is scaled accordingly.
+     *
+     * \param device The device to read from.  This device must be
+     *        opened for reading.
+     * \param hint The minimum size needed by the caller, or an invalid
+     *        size to decode at full resolution.
+     * \return The resulting image, or a null image in case of failure
+     *         or of a colour space other than grayscale or RGB.
+     */
+    static QImage readImage(QIODevice& device, QSize const& hint);
+};
+
+#endif
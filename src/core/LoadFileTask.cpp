@@ -32,6 +32,7 @@
 #include "Dpm.h"
 #include "FilterData.h"
 #include "ImageLoader.h"
+#include "ImagePrefetcher.h"
 #include <QCoreApplication>
 #include <QFile>
 #include <QDir>
@@ -62,25 +63,39 @@ LoadFileTask::LoadFileTask(
     Type type, PageInfo const& page,
     IntrusivePtr<ThumbnailPixmapCache> const& thumbnail_cache,
     IntrusivePtr<ProjectPages> const& pages,
-    IntrusivePtr<fix_orientation::Task> const& next_task)
+    IntrusivePtr<fix_orientation::Task> const& next_task,
+    IntrusivePtr<ImagePrefetcher> const& prefetcher)
     :   BackgroundTask(type),
         m_ptrThumbnailCache(thumbnail_cache),
         m_imageId(page.imageId()),
         m_imageMetadata(page.metadata()),
         m_ptrPages(pages),
-        m_ptrNextTask(next_task)
+        m_ptrNextTask(next_task),
+        m_ptrPrefetcher(prefetcher)
 {
     assert(m_ptrNextTask);
 }
 
 LoadFileTask::~LoadFileTask()
 {
+    if (m_ptrPrefetcher.get()) {
+        // Cancelled or removed before getting to take the image,
+        // which shouldn't stay in memory.
+        m_ptrPrefetcher->discard(m_imageId);
+    }
 }
 
 FilterResultPtr
 LoadFileTask::operator()()
 {
-    QImage image(ImageLoader::load(m_imageId));
+    QImage image;
+    if (m_ptrPrefetcher.get()) {
+        image = m_ptrPrefetcher->take(m_imageId);
+        m_ptrPrefetcher.reset();
+    }
+    if (image.isNull()) {
+        image = ImageLoader::load(m_imageId);
+    }
 
     try {
         throwIfCancelled();
@@ -27,6 +27,7 @@
 #include "ImageMetadata.h"
 
 class ThumbnailPixmapCache;
+class ImagePrefetcher;
 class PageInfo;
 class ProjectPages;
 class QImage;
@@ -43,7 +44,8 @@ public:
     LoadFileTask(Type type, PageInfo const& page,
                  IntrusivePtr<ThumbnailPixmapCache> const& thumbnail_cache,
                  IntrusivePtr<ProjectPages> const& pages,
-                 IntrusivePtr<fix_orientation::Task> const& next_task);
+                 IntrusivePtr<fix_orientation::Task> const& next_task,
+                 IntrusivePtr<ImagePrefetcher> const& prefetcher = IntrusivePtr<ImagePrefetcher>());
 
     virtual ~LoadFileTask();
 
@@ -60,6 +62,7 @@ private:
     ImageMetadata m_imageMetadata;
     IntrusivePtr<ProjectPages> const m_ptrPages;
     IntrusivePtr<fix_orientation::Task> const m_ptrNextTask;
+    IntrusivePtr<ImagePrefetcher> m_ptrPrefetcher; /**< Reset once the image is taken. */
 };
 
 #endif
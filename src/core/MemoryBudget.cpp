@@ -0,0 +1,142 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MemoryBudget.h"
+#include "TaskStatus.h"
+#include "settings/ini_keys.h"
+#include "imageproc/ImageBufferPool.h"
+#include <QMutexLocker>
+#include <QSettings>
+
+MemoryBudget::Reservation::Reservation(qint64 const bytes, TaskStatus const& status)
+    :   m_bytes(bytes)
+{
+    MemoryBudget& budget = MemoryBudget::instance();
+    QMutexLocker locker(&budget.m_mutex);
+
+    while (budget.m_limit > 0) {
+        // Pooled buffers can be freed, so we never wait for them.
+        budget.makeRoomInPool(bytes);
+        if (budget.m_reserved == 0 ||
+                budget.m_reserved + budget.m_held + bytes <= budget.m_limit) {
+            break;
+        }
+
+        // Wake up periodically to check for cancellation.
+        budget.m_released.wait(&budget.m_mutex, 100);
+        if (status.isCancelled()) {
+            locker.unlock();
+            status.throwIfCancelled();
+            locker.relock();
+        }
+    }
+
+    budget.m_reserved += bytes;
+}
+
+MemoryBudget::Reservation::~Reservation()
+{
+    MemoryBudget& budget = MemoryBudget::instance();
+    QMutexLocker const locker(&budget.m_mutex);
+    budget.m_reserved -= m_bytes;
+    budget.m_released.wakeAll();
+}
+
+MemoryBudget::MemoryBudget()
+    :   m_limit(0),
+        m_reserved(0),
+        m_held(0)
+{
+}
+
+MemoryBudget&
+MemoryBudget::instance()
+{
+    static MemoryBudget object;
+    return object;
+}
+
+qint64
+MemoryBudget::limitFromSettings()
+{
+    int const megabytes = QSettings().value(
+        _key_batch_processing_memory_budget, _key_batch_processing_memory_budget_def
+    ).toInt();
+    return qint64(qMax(0, megabytes)) << 20;
+}
+
+qint64
+MemoryBudget::limit() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_limit;
+}
+
+void
+MemoryBudget::setLimit(qint64 const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_limit = qMax<qint64>(0, bytes);
+    m_released.wakeAll();
+}
+
+qint64
+MemoryBudget::reserved() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_reserved;
+}
+
+void
+MemoryBudget::hold(qint64 const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_held += bytes;
+}
+
+void
+MemoryBudget::release(qint64 const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_held -= bytes;
+    m_released.wakeAll();
+}
+
+qint64
+MemoryBudget::held() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_held;
+}
+
+bool
+MemoryBudget::canAdmit() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_limit <= 0 || m_reserved + m_held < m_limit;
+}
+
+void
+MemoryBudget::makeRoomInPool(qint64 const bytes) const
+{
+    imageproc::ImageBufferPool& pool = imageproc::ImageBufferPool::instance();
+    qint64 const room = m_limit - m_reserved - m_held - bytes;
+    if (qint64(pool.cachedBytes()) > room) {
+        pool.trim(size_t(qMax<qint64>(0, room)));
+    }
+}
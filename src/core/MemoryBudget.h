@@ -0,0 +1,116 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MEMORY_BUDGET_H_
+#define MEMORY_BUDGET_H_
+
+#include "NonCopyable.h"
+#include <QMutex>
+#include <QWaitCondition>
+#include <QtGlobal>
+
+class TaskStatus;
+
+/**
+ * \brief A process-wide limit on memory used by pages processed in parallel.
+ *
+ * Memory hungry stages reserve their estimated peak usage for the time
+ * they run, and the batch scheduler checks canAdmit() before starting
+ * another page.  A reservation that doesn't fit waits for others to be
+ * released, unless nothing is reserved at all, in which case it's granted
+ * anyway, so a single page larger than the limit is still processed.
+ *
+ * Memory that is already allocated, such as images waiting for the writer,
+ * is accounted with hold() and release().  It never blocks, but it delays
+ * reservations and admission of further pages.  Buffers cached by
+ * imageproc::ImageBufferPool count as well, though as they can be freed
+ * at any time, a reservation that doesn't fit frees them rather than wait.
+ *
+ * A zero limit means unlimited.  All methods are thread-safe.
+ */
+class MemoryBudget
+{
+    DECLARE_NON_COPYABLE(MemoryBudget)
+public:
+    /**
+     * \brief Holds a part of the budget for its lifetime.
+     */
+    class Reservation
+    {
+        DECLARE_NON_COPYABLE(Reservation)
+    public:
+        /**
+         * \brief Blocks until \p bytes fit into the budget.
+         *
+         * \throw Whatever status.throwIfCancelled() throws.
+         */
+        Reservation(qint64 bytes, TaskStatus const& status);
+
+        ~Reservation();
+    private:
+        qint64 m_bytes;
+    };
+
+    static MemoryBudget& instance();
+
+    /**
+     * \brief Reads the limit from settings, converting megabytes to bytes.
+     */
+    static qint64 limitFromSettings();
+
+    qint64 limit() const;
+
+    void setLimit(qint64 bytes);
+
+    qint64 reserved() const;
+
+    /**
+     * \brief Accounts for \p bytes allocated outside of any reservation.
+     *
+     * Unlike a Reservation, this doesn't wait for the bytes to fit.
+     */
+    void hold(qint64 bytes);
+
+    /**
+     * \brief Undoes a hold() of the same number of bytes.
+     */
+    void release(qint64 bytes);
+
+    qint64 held() const;
+
+    /**
+     * \brief Returns true if there is room left for another page.
+     */
+    bool canAdmit() const;
+private:
+    MemoryBudget();
+
+    /**
+     * Frees pooled image buffers until \p bytes more fit into the limit.
+     * Must be called with m_mutex locked.
+     */
+    void makeRoomInPool(qint64 bytes) const;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_released;
+    qint64 m_limit;
+    qint64 m_reserved;
+    qint64 m_held;
+};
+
+#endif
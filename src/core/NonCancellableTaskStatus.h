@@ -0,0 +1,43 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NON_CANCELLABLE_TASK_STATUS_H_
+#define NON_CANCELLABLE_TASK_STATUS_H_
+
+#include "TaskStatus.h"
+
+/**
+ * \brief A TaskStatus that is never cancelled.
+ *
+ * For code running inside OpenMP parallel regions, where exceptions
+ * must not be thrown, and for tests.
+ */
+class NonCancellableTaskStatus : public TaskStatus
+{
+public:
+    virtual void cancel() {}
+
+    virtual bool isCancelled() const
+    {
+        return false;
+    }
+
+    virtual void throwIfCancelled() const {}
+};
+
+#endif
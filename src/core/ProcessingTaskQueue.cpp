@@ -94,6 +94,20 @@ ProcessingTaskQueue::processingFinished(BackgroundTaskPtr const& task)
     m_queue.erase(it);
 }
 
+int
+ProcessingTaskQueue::numTakenForProcessing() const
+{
+    int count = 0;
+    for (Entry const& ent : m_queue) {
+        if (!ent.takenForProcessing) {
+            // Taken entries always precede the rest.
+            break;
+        }
+        ++count;
+    }
+    return count;
+}
+
 PageInfo
 ProcessingTaskQueue::selectedPage() const
 {
@@ -50,6 +50,11 @@ public:
 
     void processingFinished(BackgroundTaskPtr const& task);
 
+    /**
+     * \brief Returns the number of tasks taken for processing but not yet finished.
+     */
+    int numTakenForProcessing() const;
+
     /**
      * \brief Returns the page to be visually selected.
      *
@@ -46,6 +46,13 @@ ThumbnailMakerBase::makeThumbnail(QImage const& image, QSize const& max_thumb_si
     );
 }
 
+bool
+ThumbnailMakerBase::acceptsDownscaledImage() const
+{
+    // We only scale the image down to fit the thumbnail.
+    return true;
+}
+
 std::unique_ptr<AbstractThumbnailMaker>
 ThumbnailMakerBase::clone() const
 {
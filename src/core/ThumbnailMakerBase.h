@@ -25,6 +25,8 @@ class ThumbnailMakerBase: public AbstractThumbnailMaker
 {
     virtual QImage makeThumbnail(QImage const& image, QSize const& max_thumb_size) const;
 
+    virtual bool acceptsDownscaledImage() const;
+
     virtual std::unique_ptr<AbstractThumbnailMaker> clone() const;
 };
 
@@ -0,0 +1,852 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThumbnailPack.h"
+#include "AtomicFileOverwriter.h"
+#include <QColor>
+#include <QFile>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QMutexLocker>
+#include <QVector>
+#include <QtGlobal>
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+
+/**
+ * Both the file header and every record are multiples of this size.
+ * The pixels of a record are aligned to it as well, which
+ * is more than QImage requires of its scan lines.
+ */
+qint64 const ALIGNMENT = 16;
+
+quint32 const FILE_MAGIC = 0x4b505453; // "STPK" in little endian.
+quint32 const FILE_VERSION = 3;
+quint32 const RECORD_MAGIC = 0x43455254; // "TREC" in little endian.
+
+/**
+ * A pack mostly consisting of superseded records gets rewritten,
+ * unless it's smaller than this.
+ */
+qint64 const MIN_GARBAGE_TO_COMPACT = 4 << 20;
+
+/**
+ * A pack exceeding this size gets rewritten with only the newest
+ * records, up to half of this size.  Evicting down to half keeps
+ * a busy pack from being rewritten every few thumbnails.
+ */
+qint64 const MAX_PACK_SIZE = 256 << 20;
+
+/**
+ * Stored thumbnails are appended once either of these is reached.
+ */
+int const MAX_PENDING_RECORDS = 64;
+qint64 const MAX_PENDING_BYTES = 4 << 20;
+
+/**
+ * If appending keeps failing, pending thumbnails are dropped
+ * rather than accumulated beyond this.
+ */
+qint64 const MAX_UNWRITABLE_BYTES = 16 << 20;
+
+/**
+ * How long to wait for another process to release the pack.
+ * Thumbnails can always be regenerated, so we rather keep them
+ * pending than stall a worker thread.
+ */
+int const LOCK_TIMEOUT_MS = 5000;
+
+struct FileHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 reserved[2];
+};
+
+/**
+ * The record header is followed by the key, then by padding to
+ * ALIGNMENT, then by the raw pixels, then by another padding.
+ * All fields are in host byte order, as the pack is a local cache.
+ * The colors are only used by Format_Mono records.
+ */
+struct RecordHeader
+{
+    quint32 magic;
+    quint32 recordSize;
+    quint32 keyLength;
+    quint32 format;
+    quint32 width;
+    quint32 height;
+    quint32 bytesPerLine;
+    quint32 dataSize;
+    quint32 color0;
+    quint32 color1;
+};
+
+/**
+ * Holds a QLockFile, if it could be acquired in time.
+ */
+class LockFileGuard
+{
+    DECLARE_NON_COPYABLE(LockFileGuard)
+public:
+    explicit LockFileGuard(QLockFile& lock_file)
+        : m_rLockFile(lock_file), m_locked(lock_file.tryLock(LOCK_TIMEOUT_MS))
+    {
+    }
+
+    ~LockFileGuard()
+    {
+        if (m_locked) {
+            m_rLockFile.unlock();
+        }
+    }
+
+    bool isLocked() const
+    {
+        return m_locked;
+    }
+private:
+    QLockFile& m_rLockFile;
+    bool m_locked;
+};
+
+qint64 align(qint64 const size)
+{
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+qint64 dataOffset(quint32 const key_length)
+{
+    return align(sizeof(RecordHeader) + key_length);
+}
+
+qint64 imageBytes(QImage const& image)
+{
+    return qint64(image.bytesPerLine()) * image.height();
+}
+
+qint64 recordSize(QByteArray const& key, QImage const& image)
+{
+    return align(dataOffset(key.size()) + imageBytes(image));
+}
+
+bool isIdentityGrayTable(QImage const& image)
+{
+    if (image.colorCount() != 256) {
+        return false;
+    }
+
+    for (int i = 0; i < 256; ++i) {
+        if (image.color(i) != qRgb(i, i, i)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool isOpaque(QImage const& image)
+{
+    if (!image.hasAlphaChannel()) {
+        return true;
+    }
+
+    QImage const argb(image.convertToFormat(QImage::Format_ARGB32));
+    for (int y = 0; y < argb.height(); ++y) {
+        QRgb const* line = reinterpret_cast<QRgb const*>(argb.constScanLine(y));
+        for (int x = 0; x < argb.width(); ++x) {
+            if (qAlpha(line[x]) != 0xff) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool isStorableFormat(QImage::Format const format)
+{
+    switch (format) {
+    case QImage::Format_Mono:
+    case QImage::Format_Grayscale8:
+    case QImage::Format_RGB888:
+    case QImage::Format_ARGB32_Premultiplied:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Converts to the narrowest format that doesn't lose anything, as
+ * records aren't compressed.  Those formats have no color table,
+ * except for Format_Mono, whose two colors go into the record header.
+ */
+QImage toStorableFormat(QImage const& image)
+{
+    switch (image.format()) {
+    case QImage::Format_Invalid:
+        return QImage();
+    case QImage::Format_Mono:
+    case QImage::Format_MonoLSB:
+        if (image.colorCount() == 2) {
+            return image.convertToFormat(QImage::Format_Mono);
+        }
+        return image.convertToFormat(QImage::Format_Grayscale8);
+    case QImage::Format_Grayscale8:
+        return image;
+    case QImage::Format_Indexed8:
+        if (isIdentityGrayTable(image)) {
+            // Same pixels, just a different interpretation.
+            return QImage(
+                       image.constBits(), image.width(), image.height(),
+                       image.bytesPerLine(), QImage::Format_Grayscale8
+                   ).copy();
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (!isOpaque(image)) {
+        return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    } else if (image.allGray()) {
+        return image.convertToFormat(QImage::Format_Grayscale8);
+    } else {
+        return image.convertToFormat(QImage::Format_RGB888);
+    }
+}
+
+QByteArray makeRecord(QByteArray const& key, QImage const& image)
+{
+    qint64 const data_offset = dataOffset(key.size());
+    qint64 const data_size = imageBytes(image);
+    qint64 const record_size = recordSize(key, image);
+
+    RecordHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = RECORD_MAGIC;
+    hdr.recordSize = quint32(record_size);
+    hdr.keyLength = key.size();
+    hdr.format = image.format();
+    hdr.width = image.width();
+    hdr.height = image.height();
+    hdr.bytesPerLine = image.bytesPerLine();
+    hdr.dataSize = quint32(data_size);
+    if (image.format() == QImage::Format_Mono) {
+        hdr.color0 = image.color(0);
+        hdr.color1 = image.color(1);
+    }
+
+    QByteArray record(int(record_size), '\0');
+    memcpy(record.data(), &hdr, sizeof(hdr));
+    memcpy(record.data() + sizeof(hdr), key.constData(), key.size());
+    memcpy(record.data() + data_offset, image.constBits(), data_size);
+
+    return record;
+}
+
+bool isValidRecordHeader(
+    RecordHeader const& hdr, qint64 const offset, qint64 const file_size)
+{
+    if (hdr.magic != RECORD_MAGIC || hdr.recordSize % ALIGNMENT != 0) {
+        return false;
+    }
+
+    return offset + hdr.recordSize <= file_size
+           && dataOffset(hdr.keyLength) + hdr.dataSize <= hdr.recordSize;
+}
+
+bool readRecordHeader(
+    QFile& file, qint64 const file_size, qint64 const offset, RecordHeader& hdr)
+{
+    if (offset + qint64(sizeof(hdr)) > file_size || !file.seek(offset)) {
+        return false;
+    }
+
+    if (file.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)) != sizeof(hdr)) {
+        return false;
+    }
+
+    return isValidRecordHeader(hdr, offset, file_size);
+}
+
+} // anonymous namespace
+
+
+struct ThumbnailPack::PackFile
+{
+    /**
+     * Mappings get released by whichever thread drops the last image
+     * referring to them, so all access to \p file goes through this.
+     */
+    QMutex mutex;
+
+    QFile file;
+};
+
+
+/**
+ * \brief A read-only mapping of the pack file.
+ *
+ * Loaded images keep it, along with the file it belongs to, alive.
+ * That file may have been replaced on disk in the meantime.
+ */
+class ThumbnailPack::Mapping
+{
+    DECLARE_NON_COPYABLE(Mapping)
+public:
+    Mapping(std::shared_ptr<PackFile> const& file, qint64 const size)
+        : m_ptrFile(file), m_pData(0), m_size(0)
+    {
+        QMutexLocker const locker(&m_ptrFile->mutex);
+        m_pData = m_ptrFile->file.map(0, size);
+        if (m_pData) {
+            m_size = size;
+        }
+    }
+
+    ~Mapping()
+    {
+        if (m_pData) {
+            QMutexLocker const locker(&m_ptrFile->mutex);
+            m_ptrFile->file.unmap(m_pData);
+        }
+    }
+
+    uchar const* data() const
+    {
+        return m_pData;
+    }
+
+    /**
+     * Zero if mapping failed.
+     */
+    qint64 size() const
+    {
+        return m_size;
+    }
+private:
+    std::shared_ptr<PackFile> m_ptrFile;
+    uchar* m_pData;
+    qint64 m_size;
+};
+
+
+ThumbnailPack::ThumbnailPack(QString const& file_path)
+    : m_filePath(file_path),
+      m_lockFile(file_path + QLatin1String(".lock")),
+      m_pendingBytes(0),
+      m_fileEnd(0),
+      m_liveBytes(0),
+      m_deadBytes(0)
+{
+    QMutexLocker const write_locker(&m_writeMutex);
+    LockFileGuard const file_lock(m_lockFile);
+    open(file_lock.isLocked());
+}
+
+ThumbnailPack::~ThumbnailPack()
+{
+    flush();
+}
+
+bool
+ThumbnailPack::contains(QByteArray const& key) const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_pending.contains(key) || m_index.contains(key);
+}
+
+QImage
+ThumbnailPack::load(QByteArray const& key) const
+{
+    Entry entry;
+    std::shared_ptr<Mapping const> mapping;
+
+    {
+        QMutexLocker const locker(&m_mutex);
+
+        QHash<QByteArray, QImage>::const_iterator const pending(m_pending.constFind(key));
+        if (pending != m_pending.constEnd()) {
+            return pending.value();
+        }
+
+        QHash<QByteArray, Entry>::const_iterator const it(m_index.constFind(key));
+        if (it == m_index.constEnd() || !m_ptrMapping) {
+            return QImage();
+        }
+
+        entry = it.value();
+        mapping = m_ptrMapping;
+    }
+
+    return imageFromRecord(mapping, entry, key);
+}
+
+bool
+ThumbnailPack::store(QByteArray const& key, QImage const& thumbnail)
+{
+    QImage const image(toStorableFormat(thumbnail));
+    if (image.isNull() || recordSize(key, image) > 0x7fffffff) {
+        return false;
+    }
+
+    bool need_flush = false;
+
+    {
+        QMutexLocker const locker(&m_mutex);
+
+        QImage& pending = m_pending[key];
+        m_pendingBytes += imageBytes(image) - imageBytes(pending);
+        pending = image;
+
+        need_flush = m_pending.size() >= MAX_PENDING_RECORDS
+                     || m_pendingBytes >= MAX_PENDING_BYTES;
+    }
+
+    if (need_flush && !flush()) {
+        QMutexLocker const locker(&m_mutex);
+        if (m_pendingBytes >= MAX_UNWRITABLE_BYTES) {
+            // The pack can't be opened or stays locked by another process.
+            m_pending.clear();
+            m_pendingBytes = 0;
+        }
+    }
+
+    return true;
+}
+
+bool
+ThumbnailPack::flush()
+{
+    QMutexLocker const write_locker(&m_writeMutex);
+
+    QHash<QByteArray, QImage> pending;
+
+    {
+        QMutexLocker const locker(&m_mutex);
+        pending = m_pending;
+    }
+
+    if (pending.isEmpty()) {
+        return true;
+    }
+
+    if (!m_ptrFile) {
+        return false;
+    }
+
+    LockFileGuard const file_lock(m_lockFile);
+    if (!file_lock.isLocked() || !syncWithFile()) {
+        return false;
+    }
+
+    Records records;
+
+    {
+        QMutexLocker const file_locker(&m_ptrFile->mutex);
+        QFile& file = m_ptrFile->file;
+
+        qint64 offset = m_fileEnd;
+        bool ok = file.seek(offset);
+        QHash<QByteArray, QImage>::const_iterator it(pending.constBegin());
+        for (; ok && it != pending.constEnd(); ++it) {
+            QByteArray const record(makeRecord(it.key(), it.value()));
+            ok = file.write(record) == record.size();
+            if (ok) {
+                records.push_back(std::make_pair(it.key(), Entry(offset, record.size())));
+                offset += record.size();
+            }
+        }
+
+        if (!file.flush()) {
+            ok = false;
+            records.clear();
+            offset = m_fileEnd;
+        }
+
+        if (!ok) {
+            // Don't leave a partial record that would stop scanning on the next run.
+            file.resize(offset);
+        }
+        m_fileEnd = offset;
+    }
+
+    publish(records, false);
+
+    {
+        QMutexLocker const locker(&m_mutex);
+
+        for (Records::value_type const& record : records) {
+            QHash<QByteArray, QImage>::iterator const it(m_pending.find(record.first));
+            // Unless it was stored again while we were writing.
+            if (it != m_pending.end()
+                    && it.value().cacheKey() == pending.value(record.first).cacheKey()) {
+                m_pendingBytes -= imageBytes(it.value());
+                m_pending.erase(it);
+            }
+        }
+    }
+
+    if (needsCompaction()) {
+        compact();
+    }
+
+    return records.size() == size_t(pending.size());
+}
+
+bool
+ThumbnailPack::open(bool const may_modify)
+{
+    std::shared_ptr<PackFile> file(new PackFile);
+    file->file.setFileName(m_filePath);
+    if (!file->file.open(QIODevice::ReadWrite)) {
+        reset();
+        return false;
+    }
+
+    m_ptrFile = file;
+    if (!readPack(may_modify)) {
+        reset();
+        return false;
+    }
+
+    return true;
+}
+
+bool
+ThumbnailPack::readPack(bool const may_modify)
+{
+    Records records;
+
+    {
+        QMutexLocker const file_locker(&m_ptrFile->mutex);
+        QFile& file = m_ptrFile->file;
+
+        FileHeader hdr;
+        if (!file.seek(0)
+                || file.size() < qint64(sizeof(hdr))
+                || file.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)) != sizeof(hdr)
+                || hdr.magic != FILE_MAGIC || hdr.version != FILE_VERSION) {
+            if (!may_modify) {
+                // Maybe another process is just creating it.
+                return false;
+            }
+
+            // New, foreign or outdated file.  Start from scratch.
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.magic = FILE_MAGIC;
+            hdr.version = FILE_VERSION;
+            m_fileEnd = sizeof(hdr);
+            if (!file.resize(0)
+                    || !file.seek(0)
+                    || file.write(reinterpret_cast<char const*>(&hdr), sizeof(hdr)) != sizeof(hdr)
+                    || !file.flush()) {
+                return false;
+            }
+        } else if (!scan(sizeof(FileHeader), records) && may_modify) {
+            // Drop the torn record left by a crash, so that
+            // further records are appended after valid ones.
+            file.resize(m_fileEnd);
+        }
+    }
+
+    publish(records, true);
+
+    if (may_modify && needsCompaction()) {
+        compact();
+    }
+
+    return true;
+}
+
+bool
+ThumbnailPack::syncWithFile()
+{
+    QFileInfo const file_info(m_filePath);
+    Records records;
+    bool rewritten = false;
+
+    {
+        QMutexLocker const file_locker(&m_ptrFile->mutex);
+        QFile& file = m_ptrFile->file;
+        qint64 const size = file.size();
+
+        rewritten = !file_info.exists() || file_info.size() != size;
+        if (!rewritten) {
+            if (size <= m_fileEnd) {
+                return true;
+            }
+
+            if (!scan(m_fileEnd, records) && !file.resize(m_fileEnd)) {
+                // Failed to drop a torn record left by a crashed process.
+                return false;
+            }
+        }
+    }
+
+    if (rewritten) {
+        // Another process has rewritten the pack, so our handle refers
+        // to an orphaned file.  A rewrite that happens to produce a file
+        // of exactly the same size goes unnoticed, which only means
+        // our records become invisible to others.
+        return open(true);
+    }
+
+    publish(records, false);
+    return true;
+}
+
+bool
+ThumbnailPack::scan(qint64 offset, Records& records)
+{
+    QFile& file = m_ptrFile->file;
+    qint64 const size = file.size();
+    RecordHeader hdr;
+
+    m_fileEnd = offset;
+    while (offset < size) {
+        if (!readRecordHeader(file, size, offset, hdr)) {
+            return false;
+        }
+
+        QByteArray const key(file.read(hdr.keyLength));
+        if (key.size() != int(hdr.keyLength)) {
+            return false;
+        }
+
+        records.push_back(std::make_pair(key, Entry(offset, hdr.recordSize)));
+
+        offset += hdr.recordSize;
+        m_fileEnd = offset;
+    }
+
+    return true;
+}
+
+void
+ThumbnailPack::publish(Records const& records, bool const replace_index)
+{
+    // Mapping is cheap, so we rather map the whole file again than
+    // keep track of which mapping covers which records.  Should it
+    // fail, loading fails as well, and thumbnails get regenerated.
+    std::shared_ptr<Mapping const> const mapping(new Mapping(m_ptrFile, m_fileEnd));
+
+    QMutexLocker const locker(&m_mutex);
+
+    if (replace_index) {
+        m_index.clear();
+        m_liveBytes = 0;
+        m_deadBytes = 0;
+    }
+
+    for (Records::value_type const& record : records) {
+        Entry& entry = m_index[record.first];
+        if (entry.size != 0) {
+            // Superseded by this record.
+            m_liveBytes -= entry.size;
+            m_deadBytes += entry.size;
+        }
+        entry = record.second;
+        m_liveBytes += entry.size;
+    }
+
+    m_ptrMapping = mapping;
+}
+
+bool
+ThumbnailPack::needsCompaction() const
+{
+    if (m_fileEnd > MAX_PACK_SIZE) {
+        return true;
+    }
+
+    return m_deadBytes > m_liveBytes && m_deadBytes > MIN_GARBAGE_TO_COMPACT;
+}
+
+void
+ThumbnailPack::compact()
+{
+    Records records;
+    std::shared_ptr<Mapping const> mapping;
+
+    {
+        QMutexLocker const locker(&m_mutex);
+
+        records.reserve(m_index.size());
+        QHash<QByteArray, Entry>::const_iterator it(m_index.constBegin());
+        for (; it != m_index.constEnd(); ++it) {
+            records.push_back(std::make_pair(it.key(), it.value()));
+        }
+        mapping = m_ptrMapping;
+    }
+
+    if (!mapping) {
+        return;
+    }
+
+    // Newest records first, so that eviction drops the oldest ones.
+    std::sort(
+        records.begin(), records.end(),
+        [](Records::value_type const& lhs, Records::value_type const& rhs) {
+            return lhs.second.offset > rhs.second.offset;
+        }
+    );
+
+    qint64 live_bytes = 0;
+    size_t num_kept = 0;
+    for (; num_kept < records.size(); ++num_kept) {
+        qint64 const size = records[num_kept].second.size;
+        if (qint64(sizeof(FileHeader)) + live_bytes + size > MAX_PACK_SIZE / 2) {
+            break;
+        }
+        live_bytes += size;
+    }
+    records.resize(num_kept);
+    std::reverse(records.begin(), records.end());
+
+    // The new file is written from the mapping, without holding m_mutex,
+    // so loading goes on meanwhile.  Appending is held off by m_writeMutex
+    // and by the file lock.
+    AtomicFileOverwriter overwriter;
+    QIODevice* iodev = overwriter.startWriting(m_filePath);
+    if (!iodev) {
+        return;
+    }
+
+    FileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = FILE_MAGIC;
+    hdr.version = FILE_VERSION;
+    if (iodev->write(reinterpret_cast<char const*>(&hdr), sizeof(hdr)) != sizeof(hdr)) {
+        return;
+    }
+
+    qint64 offset = sizeof(FileHeader);
+    for (Records::value_type& record : records) {
+        Entry& entry = record.second;
+        if (entry.offset + entry.size > mapping->size()) {
+            return;
+        }
+
+        char const* data = reinterpret_cast<char const*>(mapping->data() + entry.offset);
+        if (iodev->write(data, entry.size) != entry.size) {
+            return;
+        }
+
+        entry.offset = offset;
+        offset += entry.size;
+    }
+
+    // Some platforms won't replace a file that's open or mapped.
+    // Until the file is reopened, loading finds nothing.
+    mapping.reset();
+    {
+        QMutexLocker const locker(&m_mutex);
+        m_ptrMapping.reset();
+    }
+    m_ptrFile.reset();
+
+    bool const replaced = overwriter.commit();
+
+    std::shared_ptr<PackFile> file(new PackFile);
+    file->file.setFileName(m_filePath);
+    if (!file->file.open(QIODevice::ReadWrite)) {
+        reset();
+        return;
+    }
+    m_ptrFile = file;
+
+    if (replaced) {
+        m_fileEnd = offset;
+        publish(records, true);
+    } else {
+        // The old file is still there, and the index still matches it.
+        publish(Records(), false);
+    }
+}
+
+void
+ThumbnailPack::reset()
+{
+    m_ptrFile.reset();
+    m_fileEnd = 0;
+
+    QMutexLocker const locker(&m_mutex);
+    m_ptrMapping.reset();
+    m_index.clear();
+    m_liveBytes = 0;
+    m_deadBytes = 0;
+}
+
+QImage
+ThumbnailPack::imageFromRecord(
+    std::shared_ptr<Mapping const> const& mapping,
+    Entry const& entry, QByteArray const& key)
+{
+    RecordHeader hdr;
+    if (entry.size < qint64(sizeof(hdr)) || entry.offset + entry.size > mapping->size()) {
+        return QImage();
+    }
+
+    uchar const* const record = mapping->data() + entry.offset;
+    memcpy(&hdr, record, sizeof(hdr));
+
+    if (!isValidRecordHeader(hdr, 0, entry.size)
+            || key != QByteArray::fromRawData(
+                reinterpret_cast<char const*>(record) + sizeof(hdr), hdr.keyLength)) {
+        return QImage();
+    }
+
+    QImage::Format const format = QImage::Format(hdr.format);
+    if (!isStorableFormat(format)
+            || qint64(hdr.bytesPerLine) * hdr.height != hdr.dataSize) {
+        return QImage();
+    }
+
+    // The image refers to the mapping, and keeps it alive until destroyed.
+    std::shared_ptr<Mapping const>* const ref = new std::shared_ptr<Mapping const>(mapping);
+    QImage image(
+        record + dataOffset(hdr.keyLength), hdr.width, hdr.height,
+        hdr.bytesPerLine, format, &ThumbnailPack::releaseMapping, ref
+    );
+    if (image.isNull()) {
+        // QImage doesn't call the cleanup function in this case.
+        delete ref;
+        return QImage();
+    }
+
+    if (format == QImage::Format_Mono) {
+        // Setting the color table makes a copy, but bilevel thumbnails
+        // are an order of magnitude smaller than any others.
+        image.setColorTable(QVector<QRgb>() << hdr.color0 << hdr.color1);
+    }
+
+    return image;
+}
+
+void
+ThumbnailPack::releaseMapping(void* const mapping)
+{
+    delete static_cast<std::shared_ptr<Mapping const>*>(mapping);
+}
@@ -0,0 +1,186 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THUMBNAIL_PACK_H_
+#define THUMBNAIL_PACK_H_
+
+#include "NonCopyable.h"
+#include "RefCountable.h"
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QLockFile>
+#include <QMutex>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief Stores thumbnails in a single append-only file.
+ *
+ * Opening and stat'ing a file per thumbnail gets slow on network
+ * storage and with tens of thousands of pages.  Here, thumbnails are
+ * appended to one pack file as raw pixels, and an in-memory index maps
+ * keys to the latest record.  The pack is memory-mapped, and loaded
+ * thumbnails are views into the mapping rather than copies.
+ *
+ * Stored thumbnails are kept in memory until enough of them accumulate,
+ * or until flush() is called, and are then appended in one go.
+ * As the pack may be shared by several processes (the GUI and the CLI),
+ * appending happens under an advisory lock file, and records appended
+ * by other processes are picked up before appending our own.
+ *
+ * The pack is rewritten when superseded records dominate it, or when
+ * it outgrows a size limit, in which case the oldest records are dropped.
+ * The rewrite goes into a new file that then replaces the pack, while
+ * loading keeps working off the old one.
+ *
+ * All methods are thread-safe.
+ */
+class ThumbnailPack : public RefCountable
+{
+    DECLARE_NON_COPYABLE(ThumbnailPack)
+public:
+    /**
+     * \brief Opens or creates the pack file.
+     *
+     * If the file can't be opened, the pack stays empty and
+     * stored thumbnails are eventually dropped.
+     */
+    explicit ThumbnailPack(QString const& file_path);
+
+    /**
+     * \brief Flushes the pending thumbnails.
+     */
+    virtual ~ThumbnailPack();
+
+    QString const& filePath() const
+    {
+        return m_filePath;
+    }
+
+    bool contains(QByteArray const& key) const;
+
+    /**
+     * \brief Returns the stored thumbnail, or a null image.
+     *
+     * The returned image refers to the mapped file, which stays mapped
+     * for as long as the image exists.  Modifying it makes a copy.
+     */
+    QImage load(QByteArray const& key) const;
+
+    /**
+     * \brief Stores a thumbnail, replacing any earlier one with the same key.
+     *
+     * The thumbnail becomes visible to load() immediately, but gets written
+     * to the file only once enough thumbnails are pending, or by flush().
+     */
+    bool store(QByteArray const& key, QImage const& thumbnail);
+
+    /**
+     * \brief Appends the pending thumbnails to the file.
+     *
+     * Fails if the pack is locked by another process for too long,
+     * in which case the thumbnails stay pending.
+     */
+    bool flush();
+private:
+    struct Entry
+    {
+        qint64 offset;
+        qint64 size;
+
+        Entry() : offset(0), size(0) {}
+
+        Entry(qint64 offset, qint64 size) : offset(offset), size(size) {}
+    };
+
+    struct PackFile;
+    class Mapping;
+
+    typedef std::vector<std::pair<QByteArray, Entry> > Records;
+
+    /**
+     * Opens the pack file and reads its index.  Unless \p may_modify
+     * is set, which requires holding the file lock, the file is left as is.
+     */
+    bool open(bool may_modify);
+
+    bool readPack(bool may_modify);
+
+    /**
+     * Picks up the changes made by other processes.
+     * Must be called with the file lock held.
+     */
+    bool syncWithFile();
+
+    /**
+     * Collects the records from \p offset onwards.
+     * Must be called with the file's mutex held.
+     */
+    bool scan(qint64 offset, Records& records);
+
+    /**
+     * Maps the file up to m_fileEnd and makes \p records visible to load().
+     */
+    void publish(Records const& records, bool replace_index);
+
+    bool needsCompaction() const;
+
+    void compact();
+
+    void reset();
+
+    static QImage imageFromRecord(
+        std::shared_ptr<Mapping const> const& mapping,
+        Entry const& entry, QByteArray const& key);
+
+    static void releaseMapping(void* mapping);
+
+    QString m_filePath;
+
+    /**
+     * Serializes flush() and everything else that touches the file,
+     * so that loading only ever waits for m_mutex.
+     */
+    QMutex m_writeMutex;
+
+    /**
+     * Protects m_index, m_ptrMapping and the pending thumbnails.
+     */
+    mutable QMutex m_mutex;
+
+    std::shared_ptr<PackFile> m_ptrFile;
+    std::shared_ptr<Mapping const> m_ptrMapping;
+    QLockFile m_lockFile;
+    QHash<QByteArray, Entry> m_index;
+    QHash<QByteArray, QImage> m_pending;
+    qint64 m_pendingBytes;
+
+    /**
+     * The end of the last record we've indexed.  Anything beyond
+     * that was appended by other processes.
+     */
+    qint64 m_fileEnd;
+
+    qint64 m_liveBytes;
+    qint64 m_deadBytes;
+};
+
+#endif
@@ -17,10 +17,10 @@
 */
 
 #include "ThumbnailPixmapCache.h"
+#include "ThumbnailPack.h"
 #include "AbstractThumbnailMaker.h"
 #include "ImageId.h"
 #include "ImageLoader.h"
-#include "AtomicFileOverwriter.h"
 #include "RelinkablePath.h"
 #include "OutOfMemoryHandler.h"
 #include "imageproc/Scale.h"
@@ -55,6 +55,17 @@ using namespace ::boost;
 using namespace ::boost::multi_index;
 using namespace imageproc;
 
+namespace
+{
+
+/**
+ * Each loader thread may hold a full resolution source image while making
+ * a thumbnail, so by default there are no more of them than this.
+ */
+int const MAX_DEFAULT_LOADER_THREADS = 2;
+
+} // anonymous namespace
+
 struct ThumbnailPixmapCache::ThumbId
 {
     ThumbId()
@@ -140,11 +151,12 @@ private:
     Item& operator=(Item const& other); // Assignment is forbidden.
 };
 
-class ThumbnailPixmapCache::Impl : public QThread
+class ThumbnailPixmapCache::Impl : public QObject
 {
 public:
     Impl(QString const& thumb_dir, QSize const& max_thumb_size,
-         int max_cached_pixmaps, int expiration_threshold);
+         int max_cached_pixmaps, int expiration_threshold,
+         int num_loader_threads);
 
     ~Impl();
 
@@ -163,11 +175,10 @@ public:
         ThumbId const& thumb_id, QImage const& image,
         AbstractThumbnailMaker const& thumbnail_maker);
 protected:
-    virtual void run();
-
     virtual void customEvent(QEvent* e);
 private:
     class LoadResultEvent;
+    class LoaderThread;
     class ItemsByKeyTag;
     class LoadQueueTag;
     class RemoveQueueTag;
@@ -197,11 +208,21 @@ private:
 
     void backgroundProcessing();
 
+    static bool isAbandoned(Item const& item);
+
     static QImage loadSaveThumbnail(
         ThumbId const& thumb_id, QString const& thumb_dir,
-        QSize const& max_thumb_size,
+        ThumbnailPack& pack, QSize const& max_thumb_size,
         AbstractThumbnailMaker const& thumbnail_maker);
 
+    static IntrusivePtr<ThumbnailPack> openPack(QString const& thumb_dir);
+
+    static QByteArray getPackKey(ThumbId const& thumb_id);
+
+    /**
+     * Thumbnails used to be stored as individual PNG files.
+     * We still read those, moving them into the pack.
+     */
     static QString getThumbFilePath(
         ThumbId const& thumb_id, QString const& thumb_dir);
 
@@ -218,7 +239,13 @@ private:
     void removeItemLocked(RemoveQueue::iterator const& it);
 
     mutable QMutex m_mutex;
-    BackgroundLoader m_backgroundLoader;
+
+    /**
+     * Each thread takes the next QUEUED item from the front of
+     * the load queue, so they all work on the newest requests.
+     */
+    std::vector<std::unique_ptr<LoaderThread> > m_loaderThreads;
+
     Container m_items;
     ItemsByKey& m_itemsByKey; /**< ImageId => Item mapping */
 
@@ -247,6 +274,14 @@ private:
     RemoveQueue::iterator m_endOfLoadedItems;
 
     QString m_thumbDir;
+
+    /**
+     * Thumbnails for m_thumbDir.  Gets replaced when the directory
+     * changes, so loader threads take a reference to it while
+     * holding the mutex.
+     */
+    IntrusivePtr<ThumbnailPack> m_ptrPack;
+
     QSize m_maxThumbSize;
     int m_maxCachedPixmaps;
 
@@ -268,6 +303,24 @@ private:
     bool m_shuttingDown;
 };
 
+class ThumbnailPixmapCache::Impl::LoaderThread : public QThread
+{
+public:
+    LoaderThread(Impl& owner);
+
+    /**
+     * \brief Makes the thread look for QUEUED items.
+     *
+     * To be called after the thread was started.
+     */
+    void wake();
+protected:
+    virtual void run();
+private:
+    Impl& m_rOwner;
+    BackgroundLoader m_backgroundLoader;
+};
+
 class ThumbnailPixmapCache::Impl::LoadResultEvent : public QEvent
 {
 public:
@@ -305,11 +358,12 @@ private:
 
 ThumbnailPixmapCache::ThumbnailPixmapCache(
     QString const& thumb_dir, QSize const& max_thumb_size,
-    int const max_cached_pixmaps, int const expiration_threshold)
+    int const max_cached_pixmaps, int const expiration_threshold,
+    int const num_loader_threads)
     :   m_ptrImpl(
             new Impl(
                 RelinkablePath::normalize(thumb_dir), max_thumb_size,
-                max_cached_pixmaps, expiration_threshold
+                max_cached_pixmaps, expiration_threshold, num_loader_threads
             )
         )
 {
@@ -361,9 +415,9 @@ ThumbnailPixmapCache::recreateThumbnail(
 
 ThumbnailPixmapCache::Impl::Impl(
     QString const& thumb_dir, QSize const& max_thumb_size,
-    int const max_cached_pixmaps, int const expiration_threshold)
-    :   m_backgroundLoader(*this),
-        m_items(),
+    int const max_cached_pixmaps, int const expiration_threshold,
+    int const num_loader_threads)
+    :   m_items(),
         m_itemsByKey(m_items.get<ItemsByKeyTag>()),
         m_loadQueue(m_items.get<LoadQueueTag>()),
         m_removeQueue(m_items.get<RemoveQueueTag>()),
@@ -383,8 +437,13 @@ ThumbnailPixmapCache::Impl::Impl(
     // as otherwise when loading a project from a different machine,
     // a whole bunch of bogus directories would be created.
     QDir().mkdir(m_thumbDir);
+    m_ptrPack = openPack(m_thumbDir);
 
-    m_backgroundLoader.moveToThread(this);
+    int const num_threads = num_loader_threads > 0 ? num_loader_threads
+                            : std::min(QThread::idealThreadCount(), MAX_DEFAULT_LOADER_THREADS);
+    for (int i = 0; i < std::max(1, num_threads); ++i) {
+        m_loaderThreads.emplace_back(new LoaderThread(*this));
+    }
 }
 
 ThumbnailPixmapCache::Impl::~Impl()
@@ -399,13 +458,20 @@ ThumbnailPixmapCache::Impl::~Impl()
         m_shuttingDown = true;
     }
 
-    quit();
-    wait();
+    for (std::unique_ptr<LoaderThread> const& thread : m_loaderThreads) {
+        thread->quit();
+    }
+    for (std::unique_ptr<LoaderThread> const& thread : m_loaderThreads) {
+        thread->wait();
+    }
 }
 
 void
 ThumbnailPixmapCache::Impl::setThumbDir(QString const& thumb_dir)
 {
+    // Released after the mutex, as it flushes the pending thumbnails.
+    IntrusivePtr<ThumbnailPack> old_pack;
+
     QMutexLocker locker(&m_mutex);
 
     if (thumb_dir == m_thumbDir) {
@@ -413,6 +479,8 @@ ThumbnailPixmapCache::Impl::setThumbDir(QString const& thumb_dir)
     }
 
     m_thumbDir = thumb_dir;
+    old_pack = m_ptrPack;
+    m_ptrPack = openPack(m_thumbDir);
 
     for (Item const& item : m_loadQueue) {
         // This trick will make all queued tasks to expire.
@@ -496,16 +564,17 @@ ThumbnailPixmapCache::Impl::request(
     lq_it->completionHandlers.push_back(*completion_handler);
 
     if (m_numQueuedItems++ == 0) {
-        if (m_threadStarted) {
-            // Wake the background thread up.
-            QCoreApplication::postEvent(
-                &m_backgroundLoader, new QEvent(QEvent::User)
-            );
-        } else {
-            // Start the background thread.
-            start();
-            m_threadStarted = true;
+        // Loader threads only go idle once there are no QUEUED items,
+        // so they only need to be woken up when the first one appears.
+        for (std::unique_ptr<LoaderThread> const& thread : m_loaderThreads) {
+            if (m_threadStarted) {
+                thread->wake();
+            } else {
+                // Keep the GUI responsive while loading.
+                thread->start(QThread::LowPriority);
+            }
         }
+        m_threadStarted = true;
     }
 
     return QUEUED;
@@ -526,21 +595,22 @@ ThumbnailPixmapCache::Impl::ensureThumbnailExists(
 
     QMutexLocker locker(&m_mutex);
     QString const thumb_dir(m_thumbDir);
+    IntrusivePtr<ThumbnailPack> const pack(m_ptrPack);
     QSize const max_thumb_size(m_maxThumbSize);
     locker.unlock();
 
+    QByteArray const key(getPackKey(thumb_id));
+    if (pack->contains(key)) {
+        return;
+    }
+
     QString const thumb_file_path(getThumbFilePath(thumb_id, thumb_dir));
     if (QFile::exists(thumb_file_path)) {
         return;
     }
 
     QImage const thumbnail(thumbnail_maker.makeThumbnail(image, max_thumb_size));
-
-    AtomicFileOverwriter overwriter;
-    QIODevice* iodev = overwriter.startWriting(thumb_file_path);
-    if (iodev && thumbnail.save(iodev, "PNG")) {
-        overwriter.commit();
-    }
+    pack->store(key, thumbnail);
 }
 
 void
@@ -558,26 +628,22 @@ ThumbnailPixmapCache::Impl::recreateThumbnail(
 
     QMutexLocker locker(&m_mutex);
     QString const thumb_dir(m_thumbDir);
+    IntrusivePtr<ThumbnailPack> const pack(m_ptrPack);
     QSize const max_thumb_size(m_maxThumbSize);
     locker.unlock();
 
-    QString const thumb_file_path(getThumbFilePath(thumb_id, thumb_dir));
     QImage const thumbnail(thumbnail_maker.makeThumbnail(image, max_thumb_size));
-    bool thumb_written = false;
 
     // Note that we may be called from multiple threads at the same time.
-    AtomicFileOverwriter overwriter;
-    QIODevice* iodev = overwriter.startWriting(thumb_file_path);
-    if (iodev && thumbnail.save(iodev, "PNG")) {
-        thumb_written = overwriter.commit();
-    } else {
-        overwriter.abort();
-    }
-
-    if (!thumb_written) {
+    // The pack takes care of that.
+    if (!pack->store(getPackKey(thumb_id), thumbnail)) {
         return;
     }
 
+    // A legacy file would be migrated into the pack on the next load,
+    // overwriting what we've just stored.
+    QFile::remove(getThumbFilePath(thumb_id, thumb_dir));
+
     QMutexLocker const locker2(&m_mutex);
 
     ItemsByKey::iterator const k_it(m_itemsByKey.find(thumb_id));
@@ -603,13 +669,6 @@ ThumbnailPixmapCache::Impl::recreateThumbnail(
     }
 }
 
-void
-ThumbnailPixmapCache::Impl::run()
-{
-    backgroundProcessing();
-    exec(); // Wait for further processing requests (via custom events).
-}
-
 void
 ThumbnailPixmapCache::Impl::customEvent(QEvent* e)
 {
@@ -628,6 +687,7 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
             LoadQueue::iterator lq_it;
             ThumbId thumb_id;
             QString thumb_dir;
+            IntrusivePtr<ThumbnailPack> pack;
             QSize max_thumb_size;
             AbstractThumbnailMaker const* thumbnail_maker;
 
@@ -655,6 +715,16 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
                 // receives our LoadResultEvent.
                 queuedToInProgress(lq_it);
 
+                if (isAbandoned(*lq_it)) {
+                    // Nobody is waiting for this thumbnail anymore,
+                    // so drop the request without loading anything.
+                    postLoadResult(
+                        lq_it, QImage(),
+                        ThumbnailLoadResult::REQUEST_EXPIRED
+                    );
+                    continue;
+                }
+
                 if (m_totalLoadAttempts - lq_it->precedingLoadAttempts
                         > m_expirationThreshold) {
 
@@ -675,11 +745,14 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
 
                 // Copy those while holding the mutex.
                 thumb_dir = m_thumbDir;
+                pack = m_ptrPack;
                 max_thumb_size = m_maxThumbSize;
             } // mutex scope
 
             QImage const image(
-                loadSaveThumbnail(thumb_id, thumb_dir, max_thumb_size, *thumbnail_maker)
+                loadSaveThumbnail(
+                    thumb_id, thumb_dir, *pack, max_thumb_size, *thumbnail_maker
+                )
             );
 
             ThumbnailLoadResult::Status const status = image.isNull()
@@ -690,32 +763,86 @@ ThumbnailPixmapCache::Impl::backgroundProcessing()
             OutOfMemoryHandler::instance().handleOutOfMemorySituation();
         }
     }
+
+    // Nothing left to load for now, so write out the thumbnails
+    // we've made, rather than waiting for more of them to pile up.
+    IntrusivePtr<ThumbnailPack> pack;
+    {
+        QMutexLocker const locker(&m_mutex);
+        pack = m_ptrPack;
+    }
+    pack->flush();
+}
+
+bool
+ThumbnailPixmapCache::Impl::isAbandoned(Item const& item)
+{
+    typedef boost::weak_ptr<CompletionHandler> WeakHandler;
+    return std::all_of(
+        item.completionHandlers.begin(), item.completionHandlers.end(),
+        [](WeakHandler const& wh) {
+            return wh.expired();
+        }
+    );
 }
 
 QImage
 ThumbnailPixmapCache::Impl::loadSaveThumbnail(
     ThumbId const& thumb_id, QString const& thumb_dir,
-    QSize const& max_thumb_size,
+    ThumbnailPack& pack, QSize const& max_thumb_size,
     AbstractThumbnailMaker const& thumbnail_maker)
 {
-    QString const thumb_file_path(getThumbFilePath(thumb_id, thumb_dir));
+    QByteArray const key(getPackKey(thumb_id));
+
+    QImage image(pack.load(key));
+    if (!image.isNull()) {
+        return image;
+    }
 
-    QImage image(ImageLoader::load(thumb_file_path, 0));
+    QString const thumb_file_path(getThumbFilePath(thumb_id, thumb_dir));
+    image = ImageLoader::load(thumb_file_path, 0);
     if (!image.isNull()) {
+        if (pack.store(key, image)) {
+            QFile::remove(thumb_file_path);
+        }
         return image;
     }
 
-    image = ImageLoader::load(thumb_id.imageId);
+    if (thumbnail_maker.acceptsDownscaledImage()) {
+        // No need to decode many more pixels than the thumbnail has.
+        image = ImageLoader::load(thumb_id.imageId, max_thumb_size);
+    } else {
+        image = ImageLoader::load(thumb_id.imageId);
+    }
     if (image.isNull()) {
         return QImage();
     }
 
     QImage const thumbnail(thumbnail_maker.makeThumbnail(image, max_thumb_size));
-    thumbnail.save(thumb_file_path, "PNG");
+    pack.store(key, thumbnail);
 
     return thumbnail;
 }
 
+IntrusivePtr<ThumbnailPack>
+ThumbnailPixmapCache::Impl::openPack(QString const& thumb_dir)
+{
+    return IntrusivePtr<ThumbnailPack>(
+               new ThumbnailPack(thumb_dir + QLatin1String("/thumbs.pack"))
+           );
+}
+
+QByteArray
+ThumbnailPixmapCache::Impl::getPackKey(ThumbId const& thumb_id)
+{
+    QByteArray key(thumb_id.imageId.filePath().toUtf8());
+    key += '\n';
+    key += QByteArray::number(thumb_id.imageId.zeroBasedPage());
+    key += '\n';
+    key += thumb_id.thumbVersion.toUtf8();
+    return key;
+}
+
 QString
 ThumbnailPixmapCache::Impl::getThumbFilePath(
     ThumbId const& thumb_id, QString const& thumb_dir)
@@ -920,6 +1047,30 @@ ThumbnailPixmapCache::Impl::LoadResultEvent::~LoadResultEvent()
 {
 }
 
+/*================== ThumbnailPixmapCache::Impl::LoaderThread ================*/
+
+ThumbnailPixmapCache::Impl::LoaderThread::LoaderThread(Impl& owner)
+    :   m_rOwner(owner),
+        m_backgroundLoader(owner)
+{
+    m_backgroundLoader.moveToThread(this);
+}
+
+void
+ThumbnailPixmapCache::Impl::LoaderThread::wake()
+{
+    QCoreApplication::postEvent(
+        &m_backgroundLoader, new QEvent(QEvent::User)
+    );
+}
+
+void
+ThumbnailPixmapCache::Impl::LoaderThread::run()
+{
+    m_rOwner.backgroundProcessing();
+    exec(); // Wait for further processing requests (via custom events).
+}
+
 /*================== ThumbnailPixmapCache::BackgroundLoader =================*/
 
 ThumbnailPixmapCache::Impl::BackgroundLoader::BackgroundLoader(Impl& owner)
@@ -62,10 +62,16 @@ public:
      *        expired.  \p expiration_threshold specifies the exact number
      *        of requests that cause older requests to expire.
      *
+     * \param num_loader_threads The number of threads making thumbnails
+     *        in background.  Zero stands for QThread::idealThreadCount(),
+     *        but no more than two, as each of them may hold a full
+     *        resolution image.
+     *
      * \see ThumbnailLoadResult::REQUEST_EXPIRED
      */
     ThumbnailPixmapCache(QString const& thumb_dir, QSize const& max_size,
-                         int max_cached_pixmaps, int expiration_threshold);
+                         int max_cached_pixmaps, int expiration_threshold,
+                         int num_loader_threads = 0);
 
     /**
      * \brief Destructor.  To be called from the GUI thread only.
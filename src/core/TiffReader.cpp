@@ -27,6 +27,7 @@
 #include <QImage>
 #include <QColor>
 #include <QSize>
+#include <QRect>
 #include <QDebug>
 #include <algorithm>
 #include <tiff.h>
@@ -120,12 +121,18 @@ struct TiffReader::TiffInfo {
     uint16_t samples_per_pixel;
     uint16_t sample_format;
     uint16_t photometric;
+    uint16_t compression;
+    uint16_t planar_config;
+    uint16_t orientation;
+    bool associated_alpha;
     bool host_big_endian;
     bool file_big_endian;
 
     TiffInfo(TiffHandle const& tif, TiffHeader const& header);
 
     bool mapsToBinaryOrIndexed8() const;
+
+    bool mapsToRgb() const;
 };
 
 TiffReader::TiffInfo::TiffInfo(TiffHandle const& tif, TiffHeader const& header)
@@ -135,10 +142,13 @@ TiffReader::TiffInfo::TiffInfo(TiffHandle const& tif, TiffHeader const& header)
         samples_per_pixel(1),
         sample_format(SAMPLEFORMAT_UINT),
         photometric(PHOTOMETRIC_MINISBLACK),
+        compression(COMPRESSION_NONE),
+        planar_config(PLANARCONFIG_CONTIG),
+        orientation(ORIENTATION_TOPLEFT),
+        associated_alpha(false),
         host_big_endian(QSysInfo::ByteOrder == QSysInfo::BigEndian),
         file_big_endian(header.signature() == TiffHeader::TIFF_BIG_ENDIAN)
 {
-    uint16_t compression = 1;
     TIFFGetField(tif.handle(), TIFFTAG_COMPRESSION, &compression);
     switch (compression) {
     case COMPRESSION_CCITTFAX3:
@@ -154,6 +164,14 @@ TiffReader::TiffInfo::TiffInfo(TiffHandle const& tif, TiffHeader const& header)
     TIFFGetField(tif.handle(), TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
     TIFFGetField(tif.handle(), TIFFTAG_SAMPLEFORMAT, &sample_format);
     TIFFGetField(tif.handle(), TIFFTAG_PHOTOMETRIC, &photometric);
+    TIFFGetField(tif.handle(), TIFFTAG_PLANARCONFIG, &planar_config);
+    TIFFGetField(tif.handle(), TIFFTAG_ORIENTATION, &orientation);
+
+    uint16_t num_extra_samples = 0;
+    uint16_t* extra_samples = 0;
+    if (TIFFGetField(tif.handle(), TIFFTAG_EXTRASAMPLES, &num_extra_samples, &extra_samples)) {
+        associated_alpha = num_extra_samples == 1 && extra_samples[0] == EXTRASAMPLE_ASSOCALPHA;
+    }
 }
 
 bool
@@ -173,6 +191,34 @@ TiffReader::TiffInfo::mapsToBinaryOrIndexed8() const
     return false;
 }
 
+/**
+ * Tells whether the image can be decoded strip by strip or tile by tile,
+ * giving the same result as the RGBA interface of libtiff.
+ */
+bool
+TiffReader::TiffInfo::mapsToRgb() const
+{
+    if (bits_per_sample != 8 || sample_format != SAMPLEFORMAT_UINT) {
+        return false;
+    }
+    if (planar_config != PLANARCONFIG_CONTIG || orientation != ORIENTATION_TOPLEFT) {
+        return false;
+    }
+    if (samples_per_pixel != 3 && !(samples_per_pixel == 4 && associated_alpha)) {
+        return false;
+    }
+
+    switch (photometric) {
+    case PHOTOMETRIC_RGB:
+        return true;
+    case PHOTOMETRIC_YCBCR:
+        // libjpeg converts these to RGB for us.
+        return compression == COMPRESSION_JPEG && samples_per_pixel == 3;
+    }
+
+    return false;
+}
+
 static tsize_t deviceRead(thandle_t context, tdata_t data, tsize_t size)
 {
     QIODevice* dev = (QIODevice*)context;
@@ -294,8 +340,27 @@ static void convertAbgrToArgb(uint32_t const* src, uint32_t* dst, int count)
     }
 }
 
+static void convertRgbToArgb(uint8_t const* src, uint32_t* dst, int count, int samples_per_pixel)
+{
+    if (samples_per_pixel == 3) {
+        for (int i = 0; i < count; ++i, src += 3) {
+            dst[i] = 0xFF000000 | (uint32_t(src[0]) << 16) | (uint32_t(src[1]) << 8) | src[2];
+        }
+    } else {
+        for (int i = 0; i < count; ++i, src += 4) {
+            dst[i] = (uint32_t(src[3]) << 24) | (uint32_t(src[0]) << 16) | (uint32_t(src[1]) << 8) | src[2];
+        }
+    }
+}
+
 QImage
 TiffReader::readImage(QIODevice& device, int const page_num)
+{
+    return readImage(device, page_num, QRect());
+}
+
+QImage
+TiffReader::readImage(QIODevice& device, int const page_num, QRect const& region)
 {
     if (!device.isReadable()) {
         return QImage();
@@ -329,53 +394,29 @@ TiffReader::readImage(QIODevice& device, int const page_num)
 
     ImageMetadata const metadata(currentPageMetadata(tif));
 
+    QRect const image_rect(0, 0, info.width, info.height);
+    QRect const rect(region.isNull() ? image_rect : region.intersected(image_rect));
+    if (rect.isEmpty()) {
+        return QImage();
+    }
+
     QImage image;
 
     if (info.mapsToBinaryOrIndexed8()) {
         // Common case optimization.
-        image = extractBinaryOrIndexed8Image(tif, info);
+        image = extractBinaryOrIndexed8Image(tif, info, rect);
+    } else if (info.mapsToRgb()) {
+        // Common colour case, decoded without an intermediate RGBA copy.
+        image = extractRgbImage(tif, info, rect);
     } else {
         // General case.
-        image = QImage(
-                    info.width, info.height,
-                    info.samples_per_pixel == 3
-                    ? QImage::Format_RGB32 : QImage::Format_ARGB32
-                );
-        if (image.isNull()) {
-            throw std::bad_alloc();
-        }
-
-        // For ABGR -> ARGB conversion.
-        TiffBuffer<uint32_t> tmp_buffer;
-        uint32_t const* src_line = 0;
-
-        if (image.bytesPerLine() == 4 * info.width) {
-            // We can avoid creating a temporary buffer in this case.
-            if (!TIFFReadRGBAImageOriented(tif.handle(), info.width, info.height,
-                                           (uint32_t*)image.bits(), ORIENTATION_TOPLEFT, 0)) {
-                return QImage();
-            }
-            src_line = (uint32_t const*)image.bits();
-        } else {
-            TiffBuffer<uint32_t>(info.width * info.height).swap(tmp_buffer);
-            if (!TIFFReadRGBAImageOriented(tif.handle(), info.width, info.height,
-                                           tmp_buffer.data(), ORIENTATION_TOPLEFT, 0)) {
-                return QImage();
-            }
-            src_line = tmp_buffer.data();
-        }
-
-        uint32_t* dst_line = (uint32_t*)image.bits();
-        assert(image.bytesPerLine() % 4 == 0);
-        int const dst_stride = image.bytesPerLine() / 4;
-        for (int y = 0; y < info.height; ++y) {
-            convertAbgrToArgb(src_line, dst_line, info.width);
-            src_line += info.width;
-            dst_line += dst_stride;
+        image = extractGenericImage(tif, info);
+        if (!image.isNull() && rect != image_rect) {
+            image = image.copy(rect);
         }
     }
 
-    if (!metadata.dpi().isNull()) {
+    if (!image.isNull() && !metadata.dpi().isNull()) {
         Dpm const dpm(metadata.dpi());
         image.setDotsPerMeterX(dpm.horizontal());
         image.setDotsPerMeterY(dpm.vertical());
@@ -446,7 +487,7 @@ TiffReader::getDpi(float xres, float yres, unsigned res_unit)
 
 QImage
 TiffReader::extractBinaryOrIndexed8Image(
-    TiffHandle const& tif, TiffInfo const& info)
+    TiffHandle const& tif, TiffInfo const& info, QRect const& rect)
 {
     QImage::Format format = QImage::Format_Indexed8;
     if (info.bits_per_sample == 1) {
@@ -455,7 +496,9 @@ TiffReader::extractBinaryOrIndexed8Image(
         format = QImage::Format_Mono;
     }
 
-    QImage image(info.width, info.height, format);
+    // Scanlines are read whole, so we read the full-width band
+    // covering the region and crop it afterwards.
+    QImage image(info.width, rect.height(), format);
     if (image.isNull()) {
         throw std::bad_alloc();
     }
@@ -502,26 +545,186 @@ TiffReader::extractBinaryOrIndexed8Image(
     }
 
     if (info.bits_per_sample == 1 || info.bits_per_sample == 8) {
-        readLines(tif, image);
+        readLines(tif, image, rect.top());
+    } else {
+        readAndUnpackLines(tif, info, image, rect.top());
+    }
+
+    if (rect.width() != info.width) {
+        image = image.copy(rect.left(), 0, rect.width(), rect.height());
+    }
+
+    return image;
+}
+
+QImage
+TiffReader::extractRgbImage(
+    TiffHandle const& tif, TiffInfo const& info, QRect const& rect)
+{
+    if (info.photometric == PHOTOMETRIC_YCBCR) {
+        // That's what TIFFReadRGBAImage() would do as well.
+        TIFFSetField(tif.handle(), TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+    }
+
+    QImage image(
+        rect.size(),
+        info.samples_per_pixel == 3
+        ? QImage::Format_RGB32 : QImage::Format_ARGB32
+    );
+    if (image.isNull()) {
+        throw std::bad_alloc();
+    }
+
+    bool const ok = TIFFIsTiled(tif.handle())
+                    ? readRgbTiles(tif, info, rect, image)
+                    : readRgbStrips(tif, info, rect, image);
+
+    return ok ? image : QImage();
+}
+
+bool
+TiffReader::readRgbStrips(
+    TiffHandle const& tif, TiffInfo const& info,
+    QRect const& rect, QImage& image)
+{
+    uint32_t rows_per_strip = 0;
+    TIFFGetFieldDefaulted(tif.handle(), TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+    int const strip_height = std::max<int>(1, std::min<uint32_t>(rows_per_strip, info.height));
+
+    tsize_t const strip_size = TIFFStripSize(tif.handle());
+    if (strip_size <= 0) {
+        return false;
+    }
+    TiffBuffer<uint8_t> buf(strip_size);
+
+    int const spp = info.samples_per_pixel;
+    int const src_stride = info.width * spp;
+    uint32_t* const dst_data = (uint32_t*)image.bits();
+    assert(image.bytesPerLine() % 4 == 0);
+    int const dst_stride = image.bytesPerLine() / 4;
+
+    int const first_strip_y = rect.top() - rect.top() % strip_height;
+    for (int strip_y = first_strip_y; strip_y <= rect.bottom(); strip_y += strip_height) {
+        tstrip_t const strip = TIFFComputeStrip(tif.handle(), strip_y, 0);
+        if (TIFFReadEncodedStrip(tif.handle(), strip, buf.data(), (tsize_t)-1) < 0) {
+            return false;
+        }
+
+        int const y_end = std::min(strip_y + strip_height, rect.bottom() + 1);
+        for (int y = std::max(strip_y, rect.top()); y < y_end; ++y) {
+            uint8_t const* src = buf.data() + (y - strip_y) * src_stride + rect.left() * spp;
+            uint32_t* dst = dst_data + (y - rect.top()) * dst_stride;
+            convertRgbToArgb(src, dst, rect.width(), spp);
+        }
+    }
+
+    return true;
+}
+
+bool
+TiffReader::readRgbTiles(
+    TiffHandle const& tif, TiffInfo const& info,
+    QRect const& rect, QImage& image)
+{
+    uint32_t tile_width = 0;
+    uint32_t tile_height = 0;
+    TIFFGetField(tif.handle(), TIFFTAG_TILEWIDTH, &tile_width);
+    TIFFGetField(tif.handle(), TIFFTAG_TILELENGTH, &tile_height);
+    if (tile_width == 0 || tile_height == 0) {
+        return false;
+    }
+
+    tsize_t const tile_size = TIFFTileSize(tif.handle());
+    if (tile_size <= 0) {
+        return false;
+    }
+    TiffBuffer<uint8_t> buf(tile_size);
+
+    int const spp = info.samples_per_pixel;
+    int const tw = tile_width;
+    int const th = tile_height;
+    int const src_stride = tw * spp;
+    uint32_t* const dst_data = (uint32_t*)image.bits();
+    assert(image.bytesPerLine() % 4 == 0);
+    int const dst_stride = image.bytesPerLine() / 4;
+
+    for (int tile_y = rect.top() - rect.top() % th; tile_y <= rect.bottom(); tile_y += th) {
+        for (int tile_x = rect.left() - rect.left() % tw; tile_x <= rect.right(); tile_x += tw) {
+            ttile_t const tile = TIFFComputeTile(tif.handle(), tile_x, tile_y, 0, 0);
+            if (TIFFReadEncodedTile(tif.handle(), tile, buf.data(), (tsize_t)-1) < 0) {
+                return false;
+            }
+
+            // Edge tiles are padded, so the tile geometry is always the same.
+            QRect const area(QRect(tile_x, tile_y, tw, th).intersected(rect));
+            for (int y = area.top(); y <= area.bottom(); ++y) {
+                uint8_t const* src = buf.data() + (y - tile_y) * src_stride + (area.left() - tile_x) * spp;
+                uint32_t* dst = dst_data + (y - rect.top()) * dst_stride + (area.left() - rect.left());
+                convertRgbToArgb(src, dst, area.width(), spp);
+            }
+        }
+    }
+
+    return true;
+}
+
+QImage
+TiffReader::extractGenericImage(TiffHandle const& tif, TiffInfo const& info)
+{
+    QImage image(
+        info.width, info.height,
+        info.samples_per_pixel == 3
+        ? QImage::Format_RGB32 : QImage::Format_ARGB32
+    );
+    if (image.isNull()) {
+        throw std::bad_alloc();
+    }
+
+    // For ABGR -> ARGB conversion.
+    TiffBuffer<uint32_t> tmp_buffer;
+    uint32_t const* src_line = 0;
+
+    if (image.bytesPerLine() == 4 * info.width) {
+        // We can avoid creating a temporary buffer in this case.
+        if (!TIFFReadRGBAImageOriented(tif.handle(), info.width, info.height,
+                                       (uint32_t*)image.bits(), ORIENTATION_TOPLEFT, 0)) {
+            return QImage();
+        }
+        src_line = (uint32_t const*)image.bits();
     } else {
-        readAndUnpackLines(tif, info, image);
+        TiffBuffer<uint32_t>(info.width * info.height).swap(tmp_buffer);
+        if (!TIFFReadRGBAImageOriented(tif.handle(), info.width, info.height,
+                                       tmp_buffer.data(), ORIENTATION_TOPLEFT, 0)) {
+            return QImage();
+        }
+        src_line = tmp_buffer.data();
+    }
+
+    uint32_t* dst_line = (uint32_t*)image.bits();
+    assert(image.bytesPerLine() % 4 == 0);
+    int const dst_stride = image.bytesPerLine() / 4;
+    for (int y = 0; y < info.height; ++y) {
+        convertAbgrToArgb(src_line, dst_line, info.width);
+        src_line += info.width;
+        dst_line += dst_stride;
     }
 
     return image;
 }
 
 void
-TiffReader::readLines(TiffHandle const& tif, QImage& image)
+TiffReader::readLines(TiffHandle const& tif, QImage& image, int const first_line)
 {
     int const height = image.height();
     for (int y = 0; y < height; ++y) {
-        TIFFReadScanline(tif.handle(), image.scanLine(y), y);
+        TIFFReadScanline(tif.handle(), image.scanLine(y), first_line + y);
     }
 }
 
 void
 TiffReader::readAndUnpackLines(
-    TiffHandle const& tif, TiffInfo const& info, QImage& image)
+    TiffHandle const& tif, TiffInfo const& info,
+    QImage& image, int const first_line)
 {
     TiffBuffer<uint8_t> buf(TIFFScanlineSize(tif.handle()));
 
@@ -531,7 +734,7 @@ TiffReader::readAndUnpackLines(
     unsigned const dst_mask = (1 << bits_per_sample) - 1;
 
     for (int y = 0; y < height; ++y) {
-        TIFFReadScanline(tif.handle(), buf.data(), y);
+        TIFFReadScanline(tif.handle(), buf.data(), first_line + y);
 
         unsigned accum = 0;
         int bits_in_accum = 0;
@@ -24,6 +24,7 @@
 
 class QIODevice;
 class QImage;
+class QRect;
 class ImageMetadata;
 class Dpi;
 
@@ -46,6 +47,23 @@ public:
      * \return The resulting image, or a null image in case of failure.
      */
     static QImage readImage(QIODevice& device, int page_num = 0);
+
+    /**
+     * \brief Reads a rectangular region of the image.
+     *
+     * Only the strips or tiles intersecting the region are decoded,
+     * so the whole page is never held in memory at once.
+     *
+     * \param device The device to read from.  This device must be
+     *        opened for reading and must be seekable.
+     * \param page_num A zero-based page number within a multi-page
+     *        TIFF file.
+     * \param region The region to read, in image pixels.  It's clipped
+     *        to the image.  A null rectangle stands for the whole image.
+     * \return The resulting image, or a null image in case of failure
+     *         or if the region doesn't intersect the image.
+     */
+    static QImage readImage(QIODevice& device, int page_num, QRect const& region);
 private:
     class TiffHeader;
     class TiffHandle;
@@ -61,12 +79,27 @@ private:
     static Dpi getDpi(float xres, float yres, unsigned res_unit);
 
     static QImage extractBinaryOrIndexed8Image(
+        TiffHandle const& tif, TiffInfo const& info, QRect const& rect);
+
+    static QImage extractRgbImage(
+        TiffHandle const& tif, TiffInfo const& info, QRect const& rect);
+
+    static bool readRgbStrips(
+        TiffHandle const& tif, TiffInfo const& info,
+        QRect const& rect, QImage& image);
+
+    static bool readRgbTiles(
+        TiffHandle const& tif, TiffInfo const& info,
+        QRect const& rect, QImage& image);
+
+    static QImage extractGenericImage(
         TiffHandle const& tif, TiffInfo const& info);
 
-    static void readLines(TiffHandle const& tif, QImage& image);
+    static void readLines(TiffHandle const& tif, QImage& image, int first_line);
 
     static void readAndUnpackLines(
-        TiffHandle const& tif, TiffInfo const& info, QImage& image);
+        TiffHandle const& tif, TiffInfo const& info,
+        QImage& image, int first_line);
 };
 
 #endif
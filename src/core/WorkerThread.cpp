@@ -26,6 +26,9 @@
 #include <QtGlobal> // For Q_OS_LINUX
 #include <new>
 #include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #if defined(Q_OS_LINUX) // For Linux updatePriority()
 #include <unistd.h>
@@ -42,7 +45,7 @@ public:
         ThreadRestartRequired
     };
 
-    Dispatcher(Impl& owner);
+    Dispatcher(Impl& owner, int batch_omp_threads);
 
     UpdatePriorityResult updateThreadPriority(BackgroundTask const& task);
 
@@ -54,6 +57,12 @@ private:
 
     Impl& m_rOwner;
 
+    /**
+     * The number of OpenMP threads for batch and for interactive tasks.
+     */
+    int m_batchOmpThreads;
+    int m_interactiveOmpThreads;
+
     /**
      * This one will be set if we decide we need to restart
      * the background thread before processing a given task.
@@ -66,11 +75,21 @@ class WorkerThread::Impl : public QThread
 public:
     enum { NormalExit = 0, ExitForRestart };
 
-    Impl(WorkerThread& owner);
+    Impl(WorkerThread& owner, int batch_omp_threads);
 
     ~Impl();
 
     void performTask(BackgroundTaskPtr const& task);
+
+    int numPendingTasks() const
+    {
+        return m_numPendingTasks.loadAcquire();
+    }
+
+    void taskProcessed()
+    {
+        m_numPendingTasks.fetchAndAddOrdered(-1);
+    }
 protected:
     virtual void run();
 
@@ -82,6 +101,7 @@ private:
 
     WorkerThread& m_rOwner;
     Dispatcher m_dispatcher;
+    QAtomicInt m_numPendingTasks;
     bool m_threadStarted;
 };
 
@@ -119,9 +139,9 @@ private:
 
 /*=============================== WorkerThread ==============================*/
 
-WorkerThread::WorkerThread(QObject* parent)
+WorkerThread::WorkerThread(int const batch_omp_threads, QObject* parent)
     :   QObject(parent),
-        m_ptrImpl(new Impl(*this))
+        m_ptrImpl(new Impl(*this, batch_omp_threads))
 {
 }
 
@@ -143,6 +163,12 @@ WorkerThread::performTask(BackgroundTaskPtr const& task)
     }
 }
 
+int
+WorkerThread::numPendingTasks() const
+{
+    return m_ptrImpl.get() ? m_ptrImpl->numPendingTasks() : 0;
+}
+
 void
 WorkerThread::emitTaskResult(
     BackgroundTaskPtr const& task, FilterResultPtr const& result)
@@ -152,9 +178,14 @@ WorkerThread::emitTaskResult(
 
 /*======================== WorkerThread::Dispatcher ========================*/
 
-WorkerThread::Dispatcher::Dispatcher(Impl& owner)
-    :   m_rOwner(owner)
+WorkerThread::Dispatcher::Dispatcher(Impl& owner, int const batch_omp_threads)
+    :   m_rOwner(owner),
+        m_batchOmpThreads(batch_omp_threads),
+        m_interactiveOmpThreads(0)
 {
+#ifdef _OPENMP
+    m_interactiveOmpThreads = omp_get_max_threads();
+#endif
 }
 
 WorkerThread::Dispatcher::UpdatePriorityResult
@@ -239,9 +270,20 @@ void
 WorkerThread::Dispatcher::processTask(BackgroundTaskPtr const& task)
 {
     if (task->isCancelled()) {
+        m_rOwner.taskProcessed();
         return;
     }
 
+#ifdef _OPENMP
+    // Batch tasks processed by several workers at once share the cores,
+    // while an interactive task is processed alone and gets all of them.
+    if (task->type() == BackgroundTask::BATCH && m_batchOmpThreads > 0) {
+        omp_set_num_threads(m_batchOmpThreads);
+    } else {
+        omp_set_num_threads(m_interactiveOmpThreads);
+    }
+#endif
+
     try {
         FilterResultPtr const result((*task)());
         if (result) {
@@ -252,13 +294,16 @@ WorkerThread::Dispatcher::processTask(BackgroundTaskPtr const& task)
     } catch (std::bad_alloc const&) {
         OutOfMemoryHandler::instance().handleOutOfMemorySituation();
     }
+
+    m_rOwner.taskProcessed();
 }
 
 /*========================== WorkerThread::Impl ============================*/
 
-WorkerThread::Impl::Impl(WorkerThread& owner)
+WorkerThread::Impl::Impl(WorkerThread& owner, int const batch_omp_threads)
     :   m_rOwner(owner),
-        m_dispatcher(*this),
+        m_dispatcher(*this, batch_omp_threads),
+        m_numPendingTasks(0),
         m_threadStarted(false)
 {
     m_dispatcher.moveToThread(this);
@@ -273,6 +318,7 @@ WorkerThread::Impl::~Impl()
 void
 WorkerThread::Impl::performTask(BackgroundTaskPtr const& task)
 {
+    m_numPendingTasks.fetchAndAddOrdered(1);
     QCoreApplication::postEvent(&m_dispatcher, new PerformTaskEvent(task));
     if (!m_threadStarted) {
         start();
@@ -30,7 +30,12 @@ class WorkerThread : public QObject
     Q_OBJECT
     DECLARE_NON_COPYABLE(WorkerThread)
 public:
-    WorkerThread(QObject* parent = 0);
+    /**
+     * \param batch_omp_threads The number of OpenMP threads batch tasks
+     *        are processed with.  Interactive tasks, as well as batch ones
+     *        if this is not positive, use the default number.
+     */
+    explicit WorkerThread(int batch_omp_threads = 0, QObject* parent = 0);
 
     ~WorkerThread();
 
@@ -41,6 +46,13 @@ public:
      * useful to prematuraly stop task processing.
      */
     void shutdown();
+
+    /**
+     * \brief Returns the number of tasks submitted but not yet processed.
+     *
+     * This includes the task currently being processed.
+     */
+    int numPendingTasks() const;
 public slots:
     void performTask(BackgroundTaskPtr const& task);
 signals:
@@ -0,0 +1,132 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WorkerThreadPool.h"
+#include "WorkerThread.h"
+#include "MemoryBudget.h"
+#include "settings/ini_keys.h"
+#include <QSettings>
+#include <QThread>
+#include <algorithm>
+
+namespace
+{
+
+/**
+ * Roughly the estimated peak memory of a 300 dpi color page.
+ * A memory budget allows at most one worker per this many bytes.
+ */
+qint64 const MIN_BYTES_PER_WORKER = qint64(128) << 20;
+
+/**
+ * Many processing stages are serial or don't scale well beyond a few
+ * cores, so by default cores are split between workers, each of them
+ * getting at least this many OpenMP threads.
+ */
+int const MIN_OMP_THREADS_PER_WORKER = 4;
+
+/**
+ * Every worker keeps a page in memory, so there is a limit on
+ * the default number of workers.
+ */
+int const MAX_DEFAULT_WORKERS = 4;
+
+} // anonymous namespace
+
+WorkerThreadPool::WorkerThreadPool(int num_workers, QObject* parent)
+    :   QObject(parent)
+{
+    num_workers = std::max(1, num_workers);
+
+    // With several workers, batch tasks split the cores between them
+    // instead of every one of them trying to use all the cores.
+    int batch_omp_threads = 0;
+    if (num_workers > 1) {
+        batch_omp_threads = std::max(1, QThread::idealThreadCount() / num_workers);
+    }
+
+    for (int i = 0; i < num_workers; ++i) {
+        m_workers.emplace_back(new WorkerThread(batch_omp_threads));
+        connect(
+            m_workers.back().get(),
+            SIGNAL(taskResult(BackgroundTaskPtr,FilterResultPtr)),
+            this, SIGNAL(taskResult(BackgroundTaskPtr,FilterResultPtr))
+        );
+    }
+}
+
+WorkerThreadPool::~WorkerThreadPool()
+{
+}
+
+int
+WorkerThreadPool::numWorkersFromSettings()
+{
+    int const num_workers = QSettings().value(
+        _key_batch_processing_threads, _key_batch_processing_threads_def
+    ).toInt();
+    if (num_workers > 0) {
+        return num_workers;
+    }
+
+    // Without OpenMP, every worker is a single thread.
+    int default_workers = QThread::idealThreadCount();
+#ifdef _OPENMP
+    default_workers /= MIN_OMP_THREADS_PER_WORKER;
+#endif
+    default_workers = std::max(1, std::min(default_workers, MAX_DEFAULT_WORKERS));
+
+    qint64 const memory_limit = MemoryBudget::limitFromSettings();
+    if (memory_limit > 0) {
+        default_workers = (int)std::min<qint64>(
+                              default_workers, std::max<qint64>(1, memory_limit / MIN_BYTES_PER_WORKER)
+                          );
+    }
+
+    return default_workers;
+}
+
+void
+WorkerThreadPool::shutdown()
+{
+    for (std::unique_ptr<WorkerThread>& worker : m_workers) {
+        worker->shutdown();
+    }
+}
+
+void
+WorkerThreadPool::performTask(BackgroundTaskPtr const& task)
+{
+    WorkerThread* target = m_workers.front().get();
+
+    if (task->type() == BackgroundTask::BATCH) {
+        int min_pending = target->numPendingTasks();
+        for (std::unique_ptr<WorkerThread> const& worker : m_workers) {
+            if (min_pending == 0) {
+                break;
+            }
+            int const pending = worker->numPendingTasks();
+            if (pending < min_pending) {
+                min_pending = pending;
+                target = worker.get();
+            }
+        }
+    }
+
+    target->performTask(task);
+}
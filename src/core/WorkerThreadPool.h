@@ -0,0 +1,85 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKER_THREAD_POOL_H_
+#define WORKER_THREAD_POOL_H_
+
+#include "NonCopyable.h"
+#include "BackgroundTask.h"
+#include "FilterResult.h"
+#include <QObject>
+#include <memory>
+#include <vector>
+
+class WorkerThread;
+
+/**
+ * \brief A set of WorkerThread objects sharing the same interface.
+ *
+ * Interactive tasks always go to the first worker, so they are processed
+ * one by one, in submission order, just like with a single WorkerThread.
+ * Batch tasks go to the worker with the fewest pending tasks, which allows
+ * the batch processing code to keep several pages in flight.
+ * Each worker applies ThreadPriority to the tasks it processes.
+ * With more than one worker, the cores are split between them for
+ * batch tasks, by limiting the number of OpenMP threads each uses.
+ */
+class WorkerThreadPool : public QObject
+{
+    Q_OBJECT
+    DECLARE_NON_COPYABLE(WorkerThreadPool)
+public:
+    /**
+     * \param num_workers The number of worker threads to create.
+     *        Values below 1 are treated as 1.
+     */
+    WorkerThreadPool(int num_workers, QObject* parent = 0);
+
+    virtual ~WorkerThreadPool();
+
+    /**
+     * \brief Returns the number of worker threads.
+     */
+    int size() const
+    {
+        return (int)m_workers.size();
+    }
+
+    /**
+     * \brief Reads the number of batch processing threads from settings.
+     *
+     * A non-positive value in settings means a worker per a few CPU
+     * cores, up to a small limit, further limited by the memory budget.
+     */
+    static int numWorkersFromSettings();
+
+    /**
+     * \brief Waits for pending jobs to finish and stops all threads.
+     *
+     * \see WorkerThread::shutdown()
+     */
+    void shutdown();
+public slots:
+    void performTask(BackgroundTaskPtr const& task);
+signals:
+    void taskResult(BackgroundTaskPtr const& task, FilterResultPtr const& result);
+private:
+    std::vector<std::unique_ptr<WorkerThread> > m_workers;
+};
+
+#endif
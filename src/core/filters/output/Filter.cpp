@@ -92,6 +92,7 @@ Filter::performRelinking(AbstractRelinker const& relinker)
 void
 Filter::preUpdateUI(FilterUiInterface* ui, PageId const& page_id)
 {
+    m_preZoneImageCache.keepOnly(page_id);
     m_ptrOptionsWidget->preUpdateUI(page_id);
     ui->setOptionsWidget(m_ptrOptionsWidget.get(), ui->KEEP_OWNERSHIP);
 }
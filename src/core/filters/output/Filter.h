@@ -27,6 +27,7 @@
 #include "SafeDeletingQObjectPtr.h"
 #include "PictureZonePropFactory.h"
 #include "FillZonePropFactory.h"
+#include "PreZoneImageCache.h"
 #include "ProjectPages.h"
 #include <QCoreApplication>
 #include <QImage>
@@ -92,6 +93,11 @@ public:
     {
         return m_ptrSettings.get();
     }
+
+    PreZoneImageCache& preZoneImageCache()
+    {
+        return m_preZoneImageCache;
+    }
     QStringList getZonesInfo(const PageId& id) const;
 
     virtual std::vector<PageOrderOption> pageOrderOptions() const;
@@ -107,6 +113,7 @@ private:
     SafeDeletingQObjectPtr<OptionsWidget> m_ptrOptionsWidget;
     PictureZonePropFactory m_pictureZonePropFactory;
     FillZonePropFactory m_fillZonePropFactory;
+    PreZoneImageCache m_preZoneImageCache;
     std::vector<PageOrderOption> m_pageOrderOptions;
     int m_selectedPageOrder;
 };
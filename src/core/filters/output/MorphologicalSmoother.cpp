@@ -0,0 +1,269 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MorphologicalSmoother.h"
+#include "NonCancellableTaskStatus.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/BWColor.h"
+#include "imageproc/Morphology.h"
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace imageproc;
+
+namespace output
+{
+
+namespace
+{
+
+/**
+ * Bands for smoothInBands() are at least this many times
+ * taller than the halo, to keep the work duplicated in halos modest.
+ */
+int const MIN_BAND_TO_HALO_RATIO = 4;
+
+} // anonymous namespace
+
+/**
+ * Each hit-miss pass in smoothWholeImage() may spread changes by up to
+ * the pattern's height minus one.  Patterns are applied in four orientations,
+ * and the vertical extent of a 3xN pattern is N in two of them and 3 in
+ * the other two.  Summing over all patterns gives 84.
+ */
+int const MorphologicalSmoother::HALO = 84;
+
+void
+MorphologicalSmoother::smoothInPlace(
+    BinaryImage& bin_img, TaskStatus const& status)
+{
+    int num_bands = 1;
+#ifdef _OPENMP
+    // Nested parallelism would only oversubscribe the cores,
+    // so callers already running in parallel get a single band.
+    if (!omp_in_parallel()) {
+        num_bands = std::min(
+                        omp_get_max_threads(),
+                        bin_img.height() / (HALO * MIN_BAND_TO_HALO_RATIO)
+                    );
+    }
+#endif
+
+    if (num_bands < 2) {
+        smoothWholeImage(bin_img, status);
+    } else {
+        smoothInBands(bin_img, num_bands, status);
+    }
+}
+
+/**
+ * Splits the image into horizontal bands and smoothes them in parallel.
+ * Each band is extended by HALO lines on both sides,
+ * which makes its core lines come out exactly as if the whole image
+ * was processed at once.
+ */
+void
+MorphologicalSmoother::smoothInBands(
+    BinaryImage& bin_img, int const num_bands, TaskStatus const& status)
+{
+    int const width = bin_img.width();
+    int const height = bin_img.height();
+    int const wpl = bin_img.wordsPerLine();
+    int const band_height = (height + num_bands - 1) / num_bands;
+
+    BinaryImage const& src = bin_img;
+    BinaryImage dst(bin_img.size());
+    uint32_t const* const src_data = src.data();
+    uint32_t* const dst_data = dst.data(); // never call dst.data() inside omp
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < num_bands; ++band) {
+        if (status.isCancelled()) {
+            continue;
+        }
+
+        int const top = band * band_height;
+        int const bottom = std::min(height, top + band_height);
+        if (top >= bottom) {
+            continue;
+        }
+
+        int const ext_top = std::max(0, top - HALO);
+        int const ext_bottom = std::min(height, bottom + HALO);
+
+        // Band images are thread-local, so calling data() on them is fine.
+        BinaryImage band_img(width, ext_bottom - ext_top);
+        assert(band_img.wordsPerLine() == wpl);
+        memcpy(
+            band_img.data(), src_data + ext_top * wpl,
+            (ext_bottom - ext_top) * wpl * sizeof(uint32_t)
+        );
+
+        smoothWholeImage(band_img, NonCancellableTaskStatus());
+
+        memcpy(
+            dst_data + top * wpl, band_img.data() + (top - ext_top) * wpl,
+            (bottom - top) * wpl * sizeof(uint32_t)
+        );
+    }
+
+    status.throwIfCancelled();
+
+    bin_img.swap(dst);
+}
+
+void
+MorphologicalSmoother::smoothWholeImage(
+    BinaryImage& bin_img, TaskStatus const& status)
+{
+    // When removing black noise, remove small ones first.
+
+    {
+        char const pattern[] =
+            "XXX"
+            " - "
+            "   ";
+        hitMissReplaceAllDirections(bin_img, pattern, 3, 3);
+    }
+
+    status.throwIfCancelled();
+
+    {
+        char const pattern[] =
+            "X ?"
+            "X  "
+            "X- "
+            "X- "
+            "X  "
+            "X ?";
+        hitMissReplaceAllDirections(bin_img, pattern, 3, 6);
+    }
+
+    status.throwIfCancelled();
+
+    {
+        char const pattern[] =
+            "X ?"
+            "X ?"
+            "X  "
+            "X- "
+            "X- "
+            "X- "
+            "X  "
+            "X ?"
+            "X ?";
+        hitMissReplaceAllDirections(bin_img, pattern, 3, 9);
+    }
+
+    status.throwIfCancelled();
+
+    {
+        char const pattern[] =
+            "XX?"
+            "XX?"
+            "XX "
+            "X+ "
+            "X+ "
+            "X+ "
+            "XX "
+            "XX?"
+            "XX?";
+        hitMissReplaceAllDirections(bin_img, pattern, 3, 9);
+    }
+
+    status.throwIfCancelled();
+
+    {
+        char const pattern[] =
+            "XX?"
+            "XX "
+            "X+ "
+            "X+ "
+            "XX "
+            "XX?";
+        hitMissReplaceAllDirections(bin_img, pattern, 3, 6);
+    }
+
+    status.throwIfCancelled();
+
+    {
+        char const pattern[] =
+            "   "
+            "X+X"
+            "XXX";
+        hitMissReplaceAllDirections(bin_img, pattern, 3, 3);
+    }
+}
+
+void
+MorphologicalSmoother::hitMissReplaceAllDirections(
+    imageproc::BinaryImage& img, char const* const pattern,
+    int const pattern_width, int const pattern_height)
+{
+    hitMissReplaceInPlace(img, WHITE, pattern, pattern_width, pattern_height);
+
+    std::vector<char> pattern_data(pattern_width * pattern_height, ' ');
+    char* const new_pattern = &pattern_data[0];
+
+    // Rotate 90 degrees clockwise.
+    char const* p = pattern;
+    int new_width = pattern_height;
+    int new_height = pattern_width;
+    for (int y = 0; y < pattern_height; ++y) {
+        for (int x = 0; x < pattern_width; ++x, ++p) {
+            int const new_x = pattern_height - 1 - y;
+            int const new_y = x;
+            new_pattern[new_y * new_width + new_x] = *p;
+        }
+    }
+    hitMissReplaceInPlace(img, WHITE, new_pattern, new_width, new_height);
+
+    // Rotate upside down.
+    p = pattern;
+    new_width = pattern_width;
+    new_height = pattern_height;
+    for (int y = 0; y < pattern_height; ++y) {
+        for (int x = 0; x < pattern_width; ++x, ++p) {
+            int const new_x = pattern_width - 1 - x;
+            int const new_y = pattern_height - 1 - y;
+            new_pattern[new_y * new_width + new_x] = *p;
+        }
+    }
+    hitMissReplaceInPlace(img, WHITE, new_pattern, new_width, new_height);
+
+    // Rotate 90 degrees counter-clockwise.
+    p = pattern;
+    new_width = pattern_height;
+    new_height = pattern_width;
+    for (int y = 0; y < pattern_height; ++y) {
+        for (int x = 0; x < pattern_width; ++x, ++p) {
+            int const new_x = y;
+            int const new_y = pattern_width - 1 - x;
+            new_pattern[new_y * new_width + new_x] = *p;
+        }
+    }
+    hitMissReplaceInPlace(img, WHITE, new_pattern, new_width, new_height);
+}
+
+} // namespace output
@@ -0,0 +1,68 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OUTPUT_MORPHOLOGICAL_SMOOTHER_H_
+#define OUTPUT_MORPHOLOGICAL_SMOOTHER_H_
+
+class TaskStatus;
+
+namespace imageproc
+{
+class BinaryImage;
+}
+
+namespace output
+{
+
+/**
+ * \brief Smoothes the edges of black areas in binarized output,
+ *        and removes small black and white noise along them.
+ */
+class MorphologicalSmoother
+{
+public:
+    /**
+     * How far, in lines, smoothing may spread changes.
+     */
+    static int const HALO;
+
+    /**
+     * \brief Smoothes the image, in parallel bands if it's large enough.
+     *
+     * Called from a parallel region, it processes the image as a whole.
+     */
+    static void smoothInPlace(imageproc::BinaryImage& img, TaskStatus const& status);
+
+    /**
+     * \brief Smoothes \p num_bands horizontal bands in parallel.
+     *
+     * The result is identical to that of smoothWholeImage().
+     */
+    static void smoothInBands(
+        imageproc::BinaryImage& img, int num_bands, TaskStatus const& status);
+
+    static void smoothWholeImage(imageproc::BinaryImage& img, TaskStatus const& status);
+private:
+    static void hitMissReplaceAllDirections(
+        imageproc::BinaryImage& img, char const* pattern,
+        int pattern_width, int pattern_height);
+};
+
+} // namespace output
+
+#endif
@@ -21,6 +21,7 @@
 #include "ImageTransformation.h"
 #include "FilterData.h"
 #include "TaskStatus.h"
+#include "MemoryBudget.h"
 #include "Utils.h"
 #include "DebugImages.h"
 #include "EstimateBackground.h"
@@ -32,7 +33,11 @@
 #include "ZoneSet.h"
 #include "PictureLayerProperty.h"
 #include "FillColorProperty.h"
+#include "PreZoneImageCache.h"
+#include "MorphologicalSmoother.h"
+#include "PictureDetector.h"
 #include "imageproc/GrayImage.h"
+#include "imageproc/ImageBufferPool.h"
 #include "imageproc/BinaryImage.h"
 #include "imageproc/BinaryThreshold.h"
 #include "imageproc/Binarize.h"
@@ -42,7 +47,6 @@
 #include "imageproc/Morphology.h"
 #include "imageproc/Connectivity.h"
 #include "imageproc/ConnCompEraser.h"
-#include "imageproc/SeedFill.h"
 #include "imageproc/Constants.h"
 #include "imageproc/Grayscale.h"
 #include "imageproc/RasterOp.h"
@@ -113,16 +117,6 @@ struct RaiseAboveBackground {
     }
 };
 
-struct CombineInverted {
-    static uint8_t transform(uint8_t src, uint8_t dst)
-    {
-        unsigned const dilated = dst;
-        unsigned const eroded = src;
-        unsigned const res = 255 - (255 - dilated) * eroded / 255;
-        return static_cast<uint8_t>(res);
-    }
-};
-
 /**
  * In picture areas we make sure we don't use pure black and pure white colors.
  * These are reserved for text areas.  This behaviour makes it possible to
@@ -165,8 +159,9 @@ void reserveBlackAndWhite(QSize size, int stride, PixelType* data)
     int const width = size.width();
     int const height = size.height();
 
-    PixelType* line = data;
-    for (int y = 0; y < height; ++y, line += stride) {
+    #pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        PixelType* const line = data + y * stride;
         for (int x = 0; x < width; ++x) {
             line[x] = reserveBlackAndWhite<PixelType>(line[x]);
         }
@@ -200,17 +195,22 @@ void combineMixed(
     QImage& mixed, BinaryImage const& bw_content,
     BinaryImage const& bw_mask)
 {
-    MixedPixel* mixed_line = reinterpret_cast<MixedPixel*>(mixed.bits());
+    // never call mixed.bits() inside omp
+    MixedPixel* const mixed_data = reinterpret_cast<MixedPixel*>(mixed.bits());
     int const mixed_stride = mixed.bytesPerLine() / sizeof(MixedPixel);
-    uint32_t const* bw_content_line = bw_content.data();
+    uint32_t const* const bw_content_data = bw_content.data();
     int const bw_content_stride = bw_content.wordsPerLine();
-    uint32_t const* bw_mask_line = bw_mask.data();
+    uint32_t const* const bw_mask_data = bw_mask.data();
     int const bw_mask_stride = bw_mask.wordsPerLine();
     int const width = mixed.width();
     int const height = mixed.height();
     uint32_t const msb = uint32_t(1) << 31;
 
+    #pragma omp parallel for
     for (int y = 0; y < height; ++y) {
+        MixedPixel* const mixed_line = mixed_data + y * mixed_stride;
+        uint32_t const* const bw_content_line = bw_content_data + y * bw_content_stride;
+        uint32_t const* const bw_mask_line = bw_mask_data + y * bw_mask_stride;
         for (int x = 0; x < width; ++x) {
             if (bw_mask_line[x >> 5] & (msb >> (x & 31))) {
                 // B/W content.
@@ -230,9 +230,6 @@ void combineMixed(
                 mixed_line[x] = reserveBlackAndWhite<MixedPixel>(mixed_line[x]);
             }
         }
-        mixed_line += mixed_stride;
-        bw_content_line += bw_content_stride;
-        bw_mask_line += bw_mask_stride;
     }
 }
 
@@ -293,15 +290,19 @@ OutputGenerator::process(
     imageproc::BinaryImage* speckles_image,
     DebugImages* const dbg,
     PageId* p_pageId,
-    IntrusivePtr<Settings>* p_settings
+    IntrusivePtr<Settings>* p_settings,
+    PreZoneImages* pre_zone_images
 ) const
 {
+    // Wait until the pages already being processed leave enough memory.
+    MemoryBudget::Reservation const reservation(estimatePeakMemory(input), status);
+
     QImage image(
         processImpl(
             status, input, picture_zones, fill_zones,
             keep_orig_fore_subscan,
             auto_layer_mask, speckles_image, dbg,
-            p_pageId, p_settings
+            p_pageId, p_settings, pre_zone_images
         )
     );
     assert(!image.isNull());
@@ -314,6 +315,16 @@ OutputGenerator::process(
     return image;
 }
 
+qint64
+OutputGenerator::estimatePeakMemory(FilterData const& input) const
+{
+    // At worst, processWithoutDewarping() holds three output-sized color
+    // or gray images (normalized, smoothed, dst) and a few B/W masks.
+    qint64 const pixels = qint64(m_outRect.width()) * m_outRect.height();
+    int const bytes_per_pixel = input.origImage().depth() <= 8 ? 1 : 4;
+    return pixels * (3 * bytes_per_pixel + 1) + pixels / 2;
+}
+
 QSize
 OutputGenerator::outputImageSize() const
 {
@@ -422,8 +433,8 @@ OutputGenerator::estimateBinarizationMask(
 
     status.throwIfCancelled();
 
-    // Light areas indicate pictures.
-    GrayImage picture_areas(detectPictures(downscaled_input, status, dbg));
+    // Light areas indicate pictures.  This one is 150 dpi.
+    GrayImage picture_areas(PictureDetector::detectPictures(downscaled_input, status, dbg));
     downscaled_input = GrayImage(); // Save memory.
 
     status.throwIfCancelled();
@@ -433,12 +444,10 @@ OutputGenerator::estimateBinarizationMask(
         48
     );
 
-    // Scale back to original size.
-    picture_areas = scaleToGray(
-                        picture_areas, source_sub_rect.size()
-                    );
-
-    return BinaryImage(picture_areas, threshold);
+    // Scale back to original size.  Doing it together with binarization
+    // saves us a full size grayscale image, and interpolation is only
+    // necessary near the borders of picture areas.
+    return scaleToBinary(picture_areas, source_sub_rect.size(), threshold);
 }
 
 void
@@ -530,7 +539,8 @@ OutputGenerator::processImpl(
     imageproc::BinaryImage* speckles_image,
     DebugImages* const dbg,
     PageId* p_pageId,
-    IntrusivePtr<Settings>* p_settings
+    IntrusivePtr<Settings>* p_settings,
+    PreZoneImages* pre_zone_images
 ) const
 {
     RenderParams const render_params(m_colorParams);
@@ -549,7 +559,7 @@ OutputGenerator::processImpl(
         return processWithoutDewarping(
                    status, input, picture_zones, fill_zones,
                    auto_layer_mask, speckles_image, dbg,
-                   p_pageId, p_settings
+                   p_pageId, p_settings, pre_zone_images
                );
     }
 }
@@ -618,7 +628,8 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
         imageproc::BinaryImage* auto_layer_mask,
         imageproc::BinaryImage* speckles_image,
         DebugImages* dbg, PageId* p_pageId,
-        IntrusivePtr<Settings>* p_settings
+        IntrusivePtr<Settings>* p_settings,
+        PreZoneImages* pre_zone_images
                                         ) const
 {
     RenderParams const render_params(m_colorParams);
@@ -674,35 +685,77 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
     QPolygonF normalize_illumination_crop_area(m_xform.resultingPreCropArea());
     normalize_illumination_crop_area.translate(-normalize_illumination_rect.topLeft());
 
-    if (render_params.normalizeIllumination() || render_params.mixedOutput()) {
-        maybe_normalized = normalizeIlluminationGray(
-                               status, input.grayImage(), orig_image_crop_area,
-                               m_xform.transform(), normalize_illumination_rect, 0, dbg
-                           );
-    } else {
-        maybe_normalized = transform(
-                               input.origImage(), m_xform.transform(),
-                               normalize_illumination_rect, OutsidePixels::assumeColor(Qt::white)
-                           );
-    }
+    // Everything up to applying zones may already have been done for this
+    // page, but only images computed for exactly the same geometry fit.
+    bool reuse_pre_zone = false;
+    if (pre_zone_images) {
+        PreZoneImages const& cached = *pre_zone_images;
+        if (cached.outRect == m_outRect && cached.contentRect == m_contentRect
+                && cached.transform == m_xform.transform()) {
+            if (render_params.binaryOutput() || m_outRect.isEmpty()) {
+                // Speckles that weren't asked for back then are missing.
+                reuse_pre_zone = cached.binaryOutput.size()
+                                 == m_outRect.size().expandedTo(QSize(1, 1))
+                                 && (!speckles_image || cached.hasSpeckles);
+            } else {
+                reuse_pre_zone = cached.normalized.size() == normalize_illumination_rect.size()
+                                 && (!render_params.mixedOutput()
+                                     || cached.smoothed.size() == normalize_illumination_rect.size());
+            }
+        }
 
-    status.throwIfCancelled();
+        if (!reuse_pre_zone) {
+            // Whatever is there is of no use, and gets replaced.
+            *pre_zone_images = PreZoneImages();
+            pre_zone_images->outRect = m_outRect;
+            pre_zone_images->contentRect = m_contentRect;
+            pre_zone_images->transform = m_xform.transform();
+        }
+    }
 
     QImage maybe_smoothed;
 
-    // We only do smoothing if we are going to do binarization later.
-    if (!render_params.needBinarization() || suppress_smoothing) {
-        maybe_smoothed = maybe_normalized;
+    if (reuse_pre_zone) {
+        maybe_normalized = pre_zone_images->normalized;
+        maybe_smoothed = pre_zone_images->smoothed;
     } else {
-        maybe_smoothed =  smoothToGrayscale(maybe_normalized, m_dpi);
-        if (dbg) {
-            dbg->add(maybe_smoothed, "smoothed");
+        if (render_params.normalizeIllumination() || render_params.mixedOutput()) {
+            maybe_normalized = normalizeIlluminationGray(
+                                   status, input.grayImage(), orig_image_crop_area,
+                                   m_xform.transform(), normalize_illumination_rect, 0, dbg
+                               );
+        } else {
+            maybe_normalized = transform(
+                                   input.origImage(), m_xform.transform(),
+                                   normalize_illumination_rect, OutsidePixels::assumeColor(Qt::white)
+                               );
         }
-    }
 
-    status.throwIfCancelled();
+        status.throwIfCancelled();
+
+        // We only do smoothing if we are going to do binarization later.
+        if (!render_params.needBinarization() || suppress_smoothing) {
+            maybe_smoothed = maybe_normalized;
+        } else {
+            maybe_smoothed =  smoothToGrayscale(maybe_normalized, m_dpi);
+            if (dbg) {
+                dbg->add(maybe_smoothed, "smoothed");
+            }
+        }
+
+        status.throwIfCancelled();
+    }
 
     if (render_params.binaryOutput() || m_outRect.isEmpty()) {
+        if (reuse_pre_zone) {
+            BinaryImage dst(pre_zone_images->binaryOutput);
+            if (speckles_image) {
+                *speckles_image = pre_zone_images->speckles;
+            }
+            applyFillZonesInPlace(dst, fill_zones);
+            return dst.toQImage();
+        }
+
         BinaryImage dst(m_outRect.size().expandedTo(QSize(1, 1)), WHITE);
 
         if (!m_contentRect.isEmpty()) {
@@ -716,7 +769,7 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
             status.throwIfCancelled();
 
             if (!suppress_smoothing) {
-                morphologicalSmoothInPlace(bw_content, status);
+                MorphologicalSmoother::smoothInPlace(bw_content, status);
                 if (dbg) {
                     dbg->add(bw_content, "edges_smoothed");
                 }
@@ -739,6 +792,14 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
             );
         }
 
+        if (pre_zone_images) {
+            pre_zone_images->binaryOutput = dst;
+            if (speckles_image) {
+                pre_zone_images->speckles = *speckles_image;
+                pre_zone_images->hasSpeckles = true;
+            }
+        }
+
         applyFillZonesInPlace(dst, fill_zones);
         return dst.toQImage();
     }
@@ -761,11 +822,18 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
         }
 
         if (render_params.anyLayer()) {
-            bw_mask = estimateBinarizationMask(
-                          status, GrayImage(maybe_normalized),
-                          normalize_illumination_rect,
-                          small_margins_rect, dbg
-                      );
+            if (reuse_pre_zone) {
+                bw_mask = pre_zone_images->pictureMask;
+            } else {
+                bw_mask = estimateBinarizationMask(
+                              status, GrayImage(maybe_normalized),
+                              normalize_illumination_rect,
+                              small_margins_rect, dbg
+                          );
+                if (pre_zone_images) {
+                    pre_zone_images->pictureMask = bw_mask;
+                }
+            }
 
             if (dbg) {
                 dbg->add(bw_mask, "bw_mask");
@@ -823,8 +891,9 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
         status.throwIfCancelled();
     }
 
-    if ((render_params.normalizeIllumination() && !input.origImage().allGray())
-            || render_params.mixedOutput()) {
+    // When reusing, maybe_normalized is already color-restored.
+    if (!reuse_pre_zone && ((render_params.normalizeIllumination() && !input.origImage().allGray())
+                            || render_params.mixedOutput())) {
         // in case of mixedOutput we normalized image for picture detection and now should
         // restoren non-normalized image if it has !normalizeIllumination()
         QImage tmp;
@@ -865,6 +934,15 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
 
     }
 
+    if (pre_zone_images && !reuse_pre_zone) {
+        // Both get modified below, but being implicitly shared,
+        // the stored copies stay intact.
+        pre_zone_images->normalized = maybe_normalized;
+        if (render_params.mixedOutput()) {
+            pre_zone_images->smoothed = maybe_smoothed;
+        }
+    }
+
     if (!render_params.mixedOutput()) {
         // It's "Color / Grayscale" mode, as we handle B/W above.
         reserveBlackAndWhite(maybe_normalized);
@@ -897,12 +975,12 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
         status.throwIfCancelled();
 
         if (!suppress_smoothing) {
-            morphologicalSmoothInPlace(bw_content, status);
+            MorphologicalSmoother::smoothInPlace(bw_content, status);
             if (dbg) {
                 dbg->add(bw_content, "edges_smoothed");
             }
             if (foreground_mask) {
-                morphologicalSmoothInPlace(*foreground_mask, status);
+                MorphologicalSmoother::smoothInPlace(*foreground_mask, status);
             }
         }
 
@@ -983,7 +1061,7 @@ OutputGenerator::processWithoutDewarping(TaskStatus const& status, FilterData co
     status.throwIfCancelled();
 
     assert(!target_size.isEmpty());
-    QImage dst(target_size, maybe_normalized.format());
+    QImage dst(ImageBufferPool::instance().createImage(target_size, maybe_normalized.format()));
 
     if (maybe_normalized.format() == QImage::Format_Indexed8) {
         dst.setColorTable(createGrayscalePalette());
@@ -1076,84 +1154,6 @@ OutputGenerator::fillMarginsInPlace(
     }
 }
 
-GrayImage
-OutputGenerator::detectPictures(
-    GrayImage const& input_300dpi, TaskStatus const& status,
-    DebugImages* const dbg)
-{
-    // We stretch the range of gray levels to cover the whole
-    // range of [0, 255].  We do it because we want text
-    // and background to be equally far from the center
-    // of the whole range.  Otherwise text printed with a big
-    // font will be considered a picture.
-    GrayImage stretched(stretchGrayRange(input_300dpi, 0.01, 0.01));
-    if (dbg) {
-        dbg->add(stretched, "stretched");
-    }
-
-    status.throwIfCancelled();
-
-    GrayImage eroded(erodeGray(stretched, QSize(3, 3), 0x00));
-    if (dbg) {
-        dbg->add(eroded, "eroded");
-    }
-
-    status.throwIfCancelled();
-
-    GrayImage dilated(dilateGray(stretched, QSize(3, 3), 0xff));
-    if (dbg) {
-        dbg->add(dilated, "dilated");
-    }
-
-    stretched = GrayImage(); // Save memory.
-
-    status.throwIfCancelled();
-
-    grayRasterOp<CombineInverted>(dilated, eroded);
-    GrayImage gray_gradient(dilated);
-    dilated = GrayImage();
-    eroded = GrayImage();
-    if (dbg) {
-        dbg->add(gray_gradient, "gray_gradient");
-    }
-
-    status.throwIfCancelled();
-
-    GrayImage marker(erodeGray(gray_gradient, QSize(35, 35), 0x00));
-    if (dbg) {
-        dbg->add(marker, "marker");
-    }
-
-    status.throwIfCancelled();
-
-    seedFillGrayInPlace(marker, gray_gradient, CONN8);
-    gray_gradient = GrayImage(); // Save memory.
-    GrayImage reconstructed(marker);
-    marker = GrayImage(); // Save memory.
-
-    if (dbg) {
-        dbg->add(reconstructed, "reconstructed");
-    }
-
-    status.throwIfCancelled();
-
-    grayRasterOp<GRopInvert<GRopSrc> >(reconstructed, reconstructed);
-    if (dbg) {
-        dbg->add(reconstructed, "reconstructed_inverted");
-    }
-
-    status.throwIfCancelled();
-
-    GrayImage holes_filled(createFramedImage(reconstructed.size()));
-    seedFillGrayInPlace(holes_filled, reconstructed, CONN8);
-    reconstructed = GrayImage();
-    if (dbg) {
-        dbg->add(holes_filled, "holes_filled");
-    }
-
-    return holes_filled;
-}
-
 QImage
 OutputGenerator::smoothToGrayscale(QImage const& src, Dpi const& dpi)
 {
@@ -1365,138 +1365,6 @@ OutputGenerator::maybeDespeckleInPlace(
     }
 }
 
-void
-OutputGenerator::morphologicalSmoothInPlace(
-    BinaryImage& bin_img, TaskStatus const& status)
-{
-    // When removing black noise, remove small ones first.
-
-    {
-        char const pattern[] =
-            "XXX"
-            " - "
-            "   ";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 3);
-    }
-
-    status.throwIfCancelled();
-
-    {
-        char const pattern[] =
-            "X ?"
-            "X  "
-            "X- "
-            "X- "
-            "X  "
-            "X ?";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 6);
-    }
-
-    status.throwIfCancelled();
-
-    {
-        char const pattern[] =
-            "X ?"
-            "X ?"
-            "X  "
-            "X- "
-            "X- "
-            "X- "
-            "X  "
-            "X ?"
-            "X ?";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 9);
-    }
-
-    status.throwIfCancelled();
-
-    {
-        char const pattern[] =
-            "XX?"
-            "XX?"
-            "XX "
-            "X+ "
-            "X+ "
-            "X+ "
-            "XX "
-            "XX?"
-            "XX?";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 9);
-    }
-
-    status.throwIfCancelled();
-
-    {
-        char const pattern[] =
-            "XX?"
-            "XX "
-            "X+ "
-            "X+ "
-            "XX "
-            "XX?";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 6);
-    }
-
-    status.throwIfCancelled();
-
-    {
-        char const pattern[] =
-            "   "
-            "X+X"
-            "XXX";
-        hitMissReplaceAllDirections(bin_img, pattern, 3, 3);
-    }
-}
-
-void
-OutputGenerator::hitMissReplaceAllDirections(
-    imageproc::BinaryImage& img, char const* const pattern,
-    int const pattern_width, int const pattern_height)
-{
-    hitMissReplaceInPlace(img, WHITE, pattern, pattern_width, pattern_height);
-
-    std::vector<char> pattern_data(pattern_width * pattern_height, ' ');
-    char* const new_pattern = &pattern_data[0];
-
-    // Rotate 90 degrees clockwise.
-    char const* p = pattern;
-    int new_width = pattern_height;
-    int new_height = pattern_width;
-    for (int y = 0; y < pattern_height; ++y) {
-        for (int x = 0; x < pattern_width; ++x, ++p) {
-            int const new_x = pattern_height - 1 - y;
-            int const new_y = x;
-            new_pattern[new_y * new_width + new_x] = *p;
-        }
-    }
-    hitMissReplaceInPlace(img, WHITE, new_pattern, new_width, new_height);
-
-    // Rotate upside down.
-    p = pattern;
-    new_width = pattern_width;
-    new_height = pattern_height;
-    for (int y = 0; y < pattern_height; ++y) {
-        for (int x = 0; x < pattern_width; ++x, ++p) {
-            int const new_x = pattern_width - 1 - x;
-            int const new_y = pattern_height - 1 - y;
-            new_pattern[new_y * new_width + new_x] = *p;
-        }
-    }
-    hitMissReplaceInPlace(img, WHITE, new_pattern, new_width, new_height);
-
-    // Rotate 90 degrees counter-clockwise.
-    p = pattern;
-    new_width = pattern_height;
-    new_height = pattern_width;
-    for (int y = 0; y < pattern_height; ++y) {
-        for (int x = 0; x < pattern_width; ++x, ++p) {
-            int const new_x = y;
-            int const new_y = pattern_width - 1 - x;
-            new_pattern[new_y * new_width + new_x] = *p;
-        }
-    }
-    hitMissReplaceInPlace(img, WHITE, new_pattern, new_width, new_height);
-}
 
 QSize
 OutputGenerator::calcLocalWindowSize(Dpi const& dpi)
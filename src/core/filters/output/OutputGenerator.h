@@ -79,6 +79,8 @@ using namespace imageproc;
 namespace output
 {
 
+struct PreZoneImages;
+
 enum BinarizationMask {
     BINARIZATION_MASK_ERASER1 = 1,
     BINARIZATION_MASK_PAINTER2 = 2,
@@ -117,6 +119,10 @@ public:
      *        to be performed again with different settings, without going
      *        through the whole output generation process again.
      * \param dbg An optional sink for debugging images.
+     * \param pre_zone_images If provided, the zone-independent intermediate
+     *        images present there are used instead of being computed,
+     *        and the computed ones are stored there.  They have to come
+     *        from an earlier call with the same page and parameters.
      */
     QImage process(
         TaskStatus const& status, FilterData const& input,
@@ -127,7 +133,8 @@ public:
         imageproc::BinaryImage* auto_picture_mask = 0,
         imageproc::BinaryImage* speckles_image = 0,
         DebugImages* dbg = 0,
-        PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr
+        PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr,
+        PreZoneImages* pre_zone_images = nullptr
     ) const;
 
     QSize outputImageSize() const;
@@ -148,9 +155,15 @@ private:
         imageproc::BinaryImage* auto_layer_mask = 0,
         imageproc::BinaryImage* speckles_image = 0,
         DebugImages* dbg = 0,
-        PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr
+        PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr,
+        PreZoneImages* pre_zone_images = nullptr
     ) const;
 
+    /**
+     * \brief A rough upper bound on the memory process() allocates, in bytes.
+     */
+    qint64 estimatePeakMemory(FilterData const& input) const;
+
     QImage processAsIs(
         FilterData const& input, TaskStatus const& status,
         ZoneSet const& fill_zones,
@@ -164,7 +177,8 @@ private:
                                    imageproc::BinaryImage* speckles_image = 0,
 //Picture_Shape
                                    DebugImages* dbg = 0,
-                                   PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr
+                                   PageId* p_pageId = nullptr, IntrusivePtr<Settings>* p_settings = nullptr,
+                                   PreZoneImages* pre_zone_images = nullptr
                                   ) const;
 
     static QSize from300dpi(QSize const& size, Dpi const& target_dpi);
@@ -182,10 +196,6 @@ private:
         QTransform const& xform, QRect const& target_rect,
         imageproc::GrayImage* background = 0, DebugImages* dbg = 0);
 
-    static imageproc::GrayImage detectPictures(
-        imageproc::GrayImage const& input_300dpi, TaskStatus const& status,
-        DebugImages* dbg = 0);
-
     imageproc::BinaryImage estimateBinarizationMask(
         TaskStatus const& status, imageproc::GrayImage const& gray_source,
         QRect const& source_rect, QRect const& source_sub_rect,
@@ -218,13 +228,6 @@ private:
 
     static QImage smoothToGrayscale(QImage const& src, Dpi const& dpi);
 
-    static void morphologicalSmoothInPlace(
-        imageproc::BinaryImage& img, TaskStatus const& status);
-
-    static void hitMissReplaceAllDirections(
-        imageproc::BinaryImage& img, char const* pattern,
-        int pattern_width, int pattern_height);
-
     static QSize calcLocalWindowSize(Dpi const& dpi);
 
     static unsigned char calcDominantBackgroundGrayLevel(QImage const& img);
@@ -0,0 +1,153 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PictureDetector.h"
+#include "TaskStatus.h"
+#include "DebugImages.h"
+#include "imageproc/Connectivity.h"
+#include "imageproc/Grayscale.h"
+#include "imageproc/GrayRasterOp.h"
+#include "imageproc/Morphology.h"
+#include "imageproc/Scale.h"
+#include "imageproc/SeedFill.h"
+#include <stdint.h>
+
+using namespace imageproc;
+
+namespace output
+{
+
+namespace
+{
+
+struct CombineInverted {
+    static uint8_t transform(uint8_t src, uint8_t dst)
+    {
+        unsigned const dilated = dst;
+        unsigned const eroded = src;
+        unsigned const res = 255 - (255 - dilated) * eroded / 255;
+        return static_cast<uint8_t>(res);
+    }
+};
+
+} // anonymous namespace
+
+GrayImage
+PictureDetector::detectPictures(
+    GrayImage const& input_300dpi, TaskStatus const& status,
+    DebugImages* const dbg)
+{
+    GrayImage gray_gradient(findEdges(input_300dpi, status, dbg));
+
+    status.throwIfCancelled();
+
+    // Edges need 300 dpi to be detected, but what follows looks
+    // for large areas full of edges, and for that 150 dpi is enough.
+    QSize const half_size((gray_gradient.width() + 1) / 2, (gray_gradient.height() + 1) / 2);
+    gray_gradient = scaleToGray(gray_gradient, half_size);
+
+    status.throwIfCancelled();
+
+    // That's 35x35 at 300 dpi.
+    return findEdgyAreas(gray_gradient, QSize(17, 17), status, dbg);
+}
+
+GrayImage
+PictureDetector::findEdges(
+    GrayImage const& input_300dpi, TaskStatus const& status,
+    DebugImages* const dbg)
+{
+    // We stretch the range of gray levels to cover the whole
+    // range of [0, 255].  We do it because we want text
+    // and background to be equally far from the center
+    // of the whole range.  Otherwise text printed with a big
+    // font will be considered a picture.
+    GrayImage stretched(stretchGrayRange(input_300dpi, 0.01, 0.01));
+    if (dbg) {
+        dbg->add(stretched, "stretched");
+    }
+
+    status.throwIfCancelled();
+
+    GrayImage eroded(erodeGray(stretched, QSize(3, 3), 0x00));
+    if (dbg) {
+        dbg->add(eroded, "eroded");
+    }
+
+    status.throwIfCancelled();
+
+    GrayImage dilated(dilateGray(stretched, QSize(3, 3), 0xff));
+    if (dbg) {
+        dbg->add(dilated, "dilated");
+    }
+
+    stretched = GrayImage(); // Save memory.
+
+    status.throwIfCancelled();
+
+    grayRasterOp<CombineInverted>(dilated, eroded);
+    GrayImage gray_gradient(dilated);
+    dilated = GrayImage();
+    eroded = GrayImage();
+    if (dbg) {
+        dbg->add(gray_gradient, "gray_gradient");
+    }
+
+    return gray_gradient;
+}
+
+GrayImage
+PictureDetector::findEdgyAreas(
+    GrayImage const& edges, QSize const& window,
+    TaskStatus const& status, DebugImages* const dbg)
+{
+    GrayImage marker(erodeGray(edges, window, 0x00));
+    if (dbg) {
+        dbg->add(marker, "marker");
+    }
+
+    status.throwIfCancelled();
+
+    seedFillGrayInPlace(marker, edges, CONN8);
+    GrayImage reconstructed(marker);
+    marker = GrayImage(); // Save memory.
+
+    if (dbg) {
+        dbg->add(reconstructed, "reconstructed");
+    }
+
+    status.throwIfCancelled();
+
+    grayRasterOp<GRopInvert<GRopSrc> >(reconstructed, reconstructed);
+    if (dbg) {
+        dbg->add(reconstructed, "reconstructed_inverted");
+    }
+
+    status.throwIfCancelled();
+
+    GrayImage holes_filled(createFramedImage(reconstructed.size()));
+    seedFillGrayInPlace(holes_filled, reconstructed, CONN8);
+    reconstructed = GrayImage();
+    if (dbg) {
+        dbg->add(holes_filled, "holes_filled");
+    }
+
+    return holes_filled;
+}
+
+} // namespace output
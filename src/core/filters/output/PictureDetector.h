@@ -0,0 +1,71 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OUTPUT_PICTURE_DETECTOR_H_
+#define OUTPUT_PICTURE_DETECTOR_H_
+
+#include "imageproc/GrayImage.h"
+#include <QSize>
+
+class TaskStatus;
+class DebugImages;
+
+namespace output
+{
+
+/**
+ * \brief Finds areas likely to be pictures, as opposed to text.
+ *
+ * Pictures are told apart by being full of edges.  Edges are found
+ * at 300 dpi, while the areas full of them are looked for at 150 dpi,
+ * which is enough for areas that large.
+ */
+class PictureDetector
+{
+public:
+    /**
+     * \brief Light areas in the returned image indicate pictures.
+     *
+     * The returned image is half the size of \p input_300dpi, that is 150 dpi.
+     */
+    static imageproc::GrayImage detectPictures(
+        imageproc::GrayImage const& input_300dpi, TaskStatus const& status,
+        DebugImages* dbg = 0);
+
+    /**
+     * \brief Returns an image where edges are dark.
+     */
+    static imageproc::GrayImage findEdges(
+        imageproc::GrayImage const& input_300dpi, TaskStatus const& status,
+        DebugImages* dbg = 0);
+
+    /**
+     * \brief Returns an image where areas full of edges are light.
+     *
+     * \param edges An image from findEdges(), possibly scaled.
+     * \param window The size of the smallest area that is considered
+     *        full of edges.  That's 35x35 at 300 dpi.
+     */
+    static imageproc::GrayImage findEdgyAreas(
+        imageproc::GrayImage const& edges, QSize const& window,
+        TaskStatus const& status, DebugImages* dbg = 0);
+};
+
+} // namespace output
+
+#endif
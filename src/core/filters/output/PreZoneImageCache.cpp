@@ -0,0 +1,157 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PreZoneImageCache.h"
+#include "MemoryBudget.h"
+#include "settings/globalstaticsettings.h"
+#include <QFileInfo>
+#include <QMutexLocker>
+
+namespace output
+{
+
+struct PreZoneImageCache::Entry {
+    PageId pageId;
+    QDateTime sourceModified;
+    OutputImageParams params;
+    bool disableBwSmoothing;
+    PreZoneImages images;
+    qint64 bytes;
+
+    Entry(PageId const& page_id, QDateTime const& source_modified,
+          OutputImageParams const& params, PreZoneImages const& images)
+        :   pageId(page_id),
+            sourceModified(source_modified),
+            params(params),
+            disableBwSmoothing(GlobalStaticSettings::m_disable_bw_smoothing),
+            images(images),
+            bytes(byteCount(images))
+    {
+        MemoryBudget::instance().hold(bytes);
+    }
+
+    ~Entry()
+    {
+        MemoryBudget::instance().release(bytes);
+    }
+};
+
+PreZoneImageCache::PreZoneImageCache()
+{
+}
+
+PreZoneImageCache::~PreZoneImageCache()
+{
+}
+
+bool
+PreZoneImageCache::find(
+    PageId const& page_id, OutputImageParams const& params,
+    PreZoneImages& images) const
+{
+    QDateTime const source_modified(sourceModified(page_id));
+
+    QMutexLocker const locker(&m_mutex);
+
+    if (!m_ptrEntry.get()) {
+        return false;
+    }
+
+    Entry const& entry = *m_ptrEntry;
+    if (entry.pageId != page_id || entry.sourceModified != source_modified) {
+        return false;
+    }
+
+    if (entry.disableBwSmoothing != GlobalStaticSettings::m_disable_bw_smoothing) {
+        return false;
+    }
+
+    if (!entry.params.matches(params)) {
+        return false;
+    }
+
+    // QImage and BinaryImage are implicitly shared, so this doesn't copy
+    // pixels until OutputGenerator starts modifying them.  OutputGenerator
+    // checks the geometry the images were computed for, which matches()
+    // doesn't fully cover.
+    images = entry.images;
+    return true;
+}
+
+void
+PreZoneImageCache::store(
+    PageId const& page_id, OutputImageParams const& params,
+    PreZoneImages const& images)
+{
+    QDateTime const source_modified(sourceModified(page_id));
+
+    std::unique_ptr<Entry> entry;
+    if (!images.isNull()) {
+        entry.reset(new Entry(page_id, source_modified, params, images));
+    }
+
+    QMutexLocker const locker(&m_mutex);
+    m_ptrEntry.swap(entry);
+    // The old entry gets destroyed after the lock is released.
+}
+
+void
+PreZoneImageCache::keepOnly(PageId const& page_id)
+{
+    std::unique_ptr<Entry> entry;
+
+    QMutexLocker const locker(&m_mutex);
+    if (m_ptrEntry.get() && m_ptrEntry->pageId != page_id) {
+        m_ptrEntry.swap(entry);
+    }
+}
+
+void
+PreZoneImageCache::clear()
+{
+    std::unique_ptr<Entry> entry;
+
+    QMutexLocker const locker(&m_mutex);
+    m_ptrEntry.swap(entry);
+}
+
+QDateTime
+PreZoneImageCache::sourceModified(PageId const& page_id)
+{
+    return QFileInfo(page_id.imageId().filePath()).lastModified();
+}
+
+qint64
+PreZoneImageCache::byteCount(PreZoneImages const& images)
+{
+    imageproc::BinaryImage const* const binary_images[] = {
+        &images.pictureMask, &images.binaryOutput, &images.speckles
+    };
+
+    qint64 bytes = qint64(images.normalized.bytesPerLine()) * images.normalized.height();
+    if (images.smoothed.cacheKey() != images.normalized.cacheKey()) {
+        // Unless it's the same image.
+        bytes += qint64(images.smoothed.bytesPerLine()) * images.smoothed.height();
+    }
+    for (imageproc::BinaryImage const* image : binary_images) {
+        bytes += qint64(image->wordsPerLine()) * image->height() * 4;
+    }
+    return bytes;
+}
+
+} // namespace output
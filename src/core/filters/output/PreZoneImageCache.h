@@ -0,0 +1,141 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OUTPUT_PRE_ZONE_IMAGE_CACHE_H_
+#define OUTPUT_PRE_ZONE_IMAGE_CACHE_H_
+
+#include "NonCopyable.h"
+#include "PageId.h"
+#include "OutputImageParams.h"
+#include "imageproc/BinaryImage.h"
+#include <QImage>
+#include <QRect>
+#include <QTransform>
+#include <QDateTime>
+#include <QMutex>
+#include <memory>
+
+namespace output
+{
+
+/**
+ * \brief Intermediate images of OutputGenerator that don't depend on
+ *        picture or fill zones.
+ *
+ * OutputGenerator takes the images present here instead of computing
+ * them again, and fills in the ones it had to compute.  Which of them
+ * are used depends on the color mode.  They are only used if they were
+ * computed for exactly the same geometry.
+ */
+struct PreZoneImages {
+    /** The output rectangle the images were computed for. */
+    QRect outRect;
+
+    /** The content rectangle the images were computed for. */
+    QRect contentRect;
+
+    /** The transformation the images were computed with. */
+    QTransform transform;
+
+    /**
+     * Illumination-normalized and color-restored content, before
+     * the binary layer is combined into it.
+     */
+    QImage normalized;
+
+    /** The image binarization is performed on.  Mixed mode only. */
+    QImage smoothed;
+
+    /** Automatically detected picture areas, with no zones applied. */
+    imageproc::BinaryImage pictureMask;
+
+    /** Despeckled black and white output before fill zones are applied. */
+    imageproc::BinaryImage binaryOutput;
+
+    /** The speckles removed from binaryOutput. */
+    imageproc::BinaryImage speckles;
+
+    /**
+     * Whether speckles were asked for along with binaryOutput.
+     * Even then, speckles may be null, if there was no content.
+     */
+    bool hasSpeckles;
+
+    PreZoneImages() : hasSpeckles(false) {}
+
+    bool isNull() const
+    {
+        return normalized.isNull() && binaryOutput.isNull();
+    }
+};
+
+/**
+ * \brief Keeps PreZoneImages of the page processed last.
+ *
+ * When the user edits zones of a page, the output has to be regenerated
+ * while everything else stays the same.  This cache lets that skip the
+ * expensive zone-independent stages of OutputGenerator.  Only one page
+ * is kept, as those images are large, and it's dropped as soon as
+ * another page or another filter is selected.
+ */
+class PreZoneImageCache
+{
+    DECLARE_NON_COPYABLE(PreZoneImageCache)
+public:
+    PreZoneImageCache();
+
+    ~PreZoneImageCache();
+
+    /**
+     * \brief Retrieves the images stored for the same page and parameters.
+     *
+     * \return false if there is nothing suitable, leaving \p images untouched.
+     */
+    bool find(PageId const& page_id, OutputImageParams const& params,
+              PreZoneImages& images) const;
+
+    /**
+     * \brief Replaces whatever was stored with the given images.
+     */
+    void store(PageId const& page_id, OutputImageParams const& params,
+               PreZoneImages const& images);
+
+    /**
+     * \brief Drops the stored images, unless they belong to \p page_id.
+     */
+    void keepOnly(PageId const& page_id);
+
+    void clear();
+private:
+    struct Entry;
+
+    static QDateTime sourceModified(PageId const& page_id);
+
+    /**
+     * The memory taken by the pixels of \p images, which is held
+     * against MemoryBudget while they are stored.
+     */
+    static qint64 byteCount(PreZoneImages const& images);
+
+    mutable QMutex m_mutex;
+    std::unique_ptr<Entry> m_ptrEntry;
+};
+
+} // namespace output
+
+#endif
@@ -52,6 +52,8 @@
 #include "DebugImages.h"
 #include "OutputGenerator.h"
 #include "TiffWriter.h"
+#include "ImageWriterQueue.h"
+#include "BackgroundTask.h"
 #include "ImageLoader.h"
 #include "ErrorWidget.h"
 #include "imageproc/BinaryImage.h"
@@ -75,6 +77,8 @@
 #include "ImageMetadataCopier.h"
 #endif
 #include <QDebug>
+#include <functional>
+#include <memory>
 
 #include "CommandLine.h"
 
@@ -84,6 +88,49 @@ using namespace dewarping;
 namespace output
 {
 
+/**
+ * \brief Invalidates the thumbnail of a batch processed page once its
+ *        output files are written and the UI got the task's result.
+ *
+ * The thumbnail is built from the output files, which the ImageWriterQueue
+ * may write after the result is delivered.  Both events take place in
+ * the GUI thread, in either order.
+ */
+class Task::ThumbnailInvalidator
+{
+    DECLARE_NON_COPYABLE(ThumbnailInvalidator)
+public:
+    explicit ThumbnailInvalidator(PageId const& page_id)
+        :   m_pageId(page_id),
+            m_pUi(nullptr),
+            m_written(false)
+    {
+    }
+
+    void resultDelivered(FilterUiInterface* ui)
+    {
+        m_pUi = ui;
+        maybeInvalidate();
+    }
+
+    void filesWritten()
+    {
+        m_written = true;
+        maybeInvalidate();
+    }
+private:
+    void maybeInvalidate()
+    {
+        if (m_pUi && m_written) {
+            m_pUi->invalidateThumbnail(m_pageId);
+        }
+    }
+
+    PageId m_pageId;
+    FilterUiInterface* m_pUi;
+    bool m_written;
+};
+
 class Task::UiUpdater : public FilterResult
 {
     Q_DECLARE_TR_FUNCTIONS(output::Task::UiUpdater)
@@ -100,6 +147,7 @@ public:
               BinaryImage const& picture_mask,
               DespeckleState const& despeckle_state,
               DespeckleVisualization const& despeckle_visualization,
+              std::shared_ptr<ThumbnailInvalidator> const& thumbnail_invalidator,
               bool batch, bool debug);
 
     virtual void updateUI(FilterUiInterface* ui);
@@ -124,6 +172,7 @@ private:
     BinaryImage m_pictureMask;
     DespeckleState m_despeckleState;
     DespeckleVisualization m_despeckleVisualization;
+    std::shared_ptr<ThumbnailInvalidator> m_ptrThumbnailInvalidator;
     bool m_batchProcessing;
     bool m_debug;
 };
@@ -306,6 +355,7 @@ Task::process(
     Params p = m_ptrSettings->getParams(m_pageId);
     Params::Regenerate val = p.getForceReprocess();
     bool need_reprocess = val & Params::RegeneratePage;
+    bool const forced_reprocess = need_reprocess;
     if (need_reprocess) {
         val = (Params::Regenerate)(val & ~Params::RegeneratePage);
         p.setForceReprocess(val);
@@ -383,6 +433,7 @@ Task::process(
     QImage out_img;
     BinaryImage automask_img;
     BinaryImage speckles_img;
+    std::shared_ptr<ThumbnailInvalidator> thumbnail_invalidator;
 
     if (!need_reprocess) {
         QFile out_file(out_file_path);
@@ -421,6 +472,20 @@ Task::process(
         automask_img = BinaryImage();
         speckles_img = BinaryImage();
 
+        // When the user edits zones, nothing but the zones changes between
+        // runs, so the zone-independent part of the work is kept around.
+        // Batch processing never comes back to the same page, and debug
+        // images need every stage to actually run.
+        bool const use_pre_zone_cache = !m_batchProcessing && !m_ptrDbg.get();
+        PreZoneImageCache& pre_zone_cache = m_ptrFilter->preZoneImageCache();
+        PreZoneImages pre_zone_images;
+        if (!use_pre_zone_cache || forced_reprocess
+                || !pre_zone_cache.find(m_pageId, new_output_image_params, pre_zone_images)) {
+            // Nothing stored there is going to be used, so it shouldn't
+            // take memory while this page is being processed.
+            pre_zone_cache.clear();
+        }
+
         // OutputGenerator will write a new distortion model
         // there, if dewarping mode is AUTO.
 
@@ -429,9 +494,14 @@ Task::process(
                       false,
                       write_automask ? &automask_img : nullptr,
                       write_speckles_file ? &speckles_img : nullptr,
-                      m_ptrDbg.get(), &m_pageId, &m_ptrSettings
+                      m_ptrDbg.get(), &m_pageId, &m_ptrSettings,
+                      use_pre_zone_cache ? &pre_zone_images : nullptr
                   );
 
+        if (use_pre_zone_cache) {
+            pre_zone_cache.store(m_pageId, new_output_image_params, pre_zone_images);
+        }
+
         if (write_speckles_file && speckles_img.isNull()) {
             // Even if despeckling didn't actually take place, we still need
             // to write an empty speckles file.  Making it a special case
@@ -439,65 +509,99 @@ Task::process(
             BinaryImage(out_img.size(), WHITE).swap(speckles_img);
         }
 
-        bool invalidate_params = false;
+        // In batch mode, encoding and writing the files is left to the writer
+        // stage, so we can proceed with the next page in the meantime.
+        // Output params are only stored once the files are written.
+        IntrusivePtr<Task> const self(this);
+        auto write_output_files = [=]() mutable {
+            bool invalidate_params = false;
 
-        QString TiffCompressionUsed;
+            QString TiffCompressionUsed;
 
-        if (!TiffWriter::writeImage(out_file_path, out_img, false, 0, &TiffCompressionUsed)) {
-            invalidate_params = true;
-        } else {
-            deleteMutuallyExclusiveOutputFiles();
+            if (!TiffWriter::writeImage(out_file_path, out_img, false, 0, &TiffCompressionUsed)) {
+                invalidate_params = true;
+            } else {
+                self->deleteMutuallyExclusiveOutputFiles();
 #ifdef HAVE_EXIV2
-            if (GlobalStaticSettings::m_output_copy_icc_metadata) {
-                ImageMetadataCopier::copyMetadata(m_pageId.imageId().filePath(), out_file_path);
-            }
+                if (GlobalStaticSettings::m_output_copy_icc_metadata) {
+                    ImageMetadataCopier::copyMetadata(self->m_pageId.imageId().filePath(), out_file_path);
+                }
 #endif
-            if (TiffCompressionUsed != new_output_image_params.TiffCompression()) {
-                new_output_image_params.setTiffCompression(TiffCompressionUsed);
+                if (TiffCompressionUsed != new_output_image_params.TiffCompression()) {
+                    new_output_image_params.setTiffCompression(TiffCompressionUsed);
+                }
+//                if (TiffCompressionUsed != params.TiffCompression()) {
+//                    params.setTiffCompression(TiffCompressionUsed);
+//                    m_ptrSettings->setParams(m_pageId, params);
+//                }
             }
-//            if (TiffCompressionUsed != params.TiffCompression()) {
-//                params.setTiffCompression(TiffCompressionUsed);
-//                m_ptrSettings->setParams(m_pageId, params);
-//            }
-        }
 
-        if (write_automask) {
-            // Note that QDir::mkdir() will fail if the parent directory,
-            // that is $OUT/cache doesn't exist. We want that behavior,
-            // as otherwise when loading a project from a different machine,
-            // a whole bunch of bogus directories would be created.
-            QDir().mkdir(automask_dir);
-            // Also note that QDir::mkdir() will fail if the directory already exists,
-            // so we ignore its return value here.
-
-            if (!TiffWriter::writeImage(automask_file_path, automask_img.toQImage(), false, 0)) {
-                invalidate_params = true;
+            if (write_automask) {
+                // Note that QDir::mkdir() will fail if the parent directory,
+                // that is $OUT/cache doesn't exist. We want that behavior,
+                // as otherwise when loading a project from a different machine,
+                // a whole bunch of bogus directories would be created.
+                QDir().mkdir(automask_dir);
+                // Also note that QDir::mkdir() will fail if the directory already exists,
+                // so we ignore its return value here.
+
+                if (!TiffWriter::writeImage(automask_file_path, automask_img.toQImage(), false, 0)) {
+                    invalidate_params = true;
+                }
             }
-        }
-        if (write_speckles_file) {
-            if (!QDir().mkpath(speckles_dir)) {
-                invalidate_params = true;
-            } else if (!TiffWriter::writeImage(speckles_file_path, speckles_img.toQImage(), false, 0)) {
-                invalidate_params = true;
+            if (write_speckles_file) {
+                if (!QDir().mkpath(speckles_dir)) {
+                    invalidate_params = true;
+                } else if (!TiffWriter::writeImage(speckles_file_path, speckles_img.toQImage(), false, 0)) {
+                    invalidate_params = true;
+                }
             }
-        }
 
-        if (invalidate_params) {
-            m_ptrSettings->removeOutputParams(m_pageId);
-        } else {
-            // Note that we can't reuse *_file_info objects
-            // as we've just overwritten those files.
-            OutputParams const out_params(
-                new_output_image_params,
-                OutputFileParams(QFileInfo(out_file_path)),
-                write_automask ? OutputFileParams(QFileInfo(automask_file_path))
-                : OutputFileParams(),
-                write_speckles_file ? OutputFileParams(QFileInfo(speckles_file_path))
-                : OutputFileParams(),
-                new_picture_zones, new_fill_zones
-            );
+            if (invalidate_params) {
+                self->m_ptrSettings->removeOutputParams(self->m_pageId);
+            } else {
+                // Note that we can't reuse *_file_info objects
+                // as we've just overwritten those files.
+                OutputParams const out_params(
+                    new_output_image_params,
+                    OutputFileParams(QFileInfo(out_file_path)),
+                    write_automask ? OutputFileParams(QFileInfo(automask_file_path))
+                    : OutputFileParams(),
+                    write_speckles_file ? OutputFileParams(QFileInfo(speckles_file_path))
+                    : OutputFileParams(),
+                    new_picture_zones, new_fill_zones
+                );
+
+                self->m_ptrSettings->setOutputParams(self->m_pageId, out_params);
+            }
+        };
 
-            m_ptrSettings->setOutputParams(m_pageId, out_params);
+        if (m_batchProcessing) {
+            // The status is the BackgroundTask we are part of.  If it gets
+            // cancelled before the writer gets to it, the files aren't written.
+            IntrusivePtr<BackgroundTask const> const bg_task(
+                dynamic_cast<BackgroundTask const*>(&status)
+            );
+            ImageWriterQueue::Job on_written;
+            if (CommandLine::get().isGui()) {
+                thumbnail_invalidator.reset(new ThumbnailInvalidator(m_pageId));
+                on_written = std::bind(&ThumbnailInvalidator::filesWritten, thumbnail_invalidator);
+            }
+            // The images captured by the job stay in memory until it runs.
+            qint64 queued_bytes = qint64(out_img.bytesPerLine()) * out_img.height();
+            if (write_automask) {
+                queued_bytes += qint64(automask_img.wordsPerLine()) * automask_img.height() * 4;
+            }
+            if (write_speckles_file) {
+                queued_bytes += qint64(speckles_img.wordsPerLine()) * speckles_img.height() * 4;
+            }
+            ImageWriterQueue::instance().submit(
+                write_output_files, on_written, bg_task, queued_bytes
+            );
+        } else {
+            // Runs right away, though only after whatever the writer
+            // still has queued from the last batch.
+            ImageWriterQueue::instance().submit(write_output_files);
         }
 
         m_ptrThumbnailCache->recreateThumbnail(
@@ -523,7 +627,7 @@ Task::process(
                        new_xform, generator.outputContentRect(),
                        m_pageId, data.origImage(), out_img, automask_img,
                        despeckle_state, despeckle_visualization,
-                       m_batchProcessing, m_debug
+                       thumbnail_invalidator, m_batchProcessing, m_debug
                    )
                );
     } else {
@@ -582,6 +686,7 @@ Task::UiUpdater::UiUpdater(
     BinaryImage const& picture_mask,
     DespeckleState const& despeckle_state,
     DespeckleVisualization const& despeckle_visualization,
+    std::shared_ptr<ThumbnailInvalidator> const& thumbnail_invalidator,
     bool const batch, bool const debug)
     :   m_ptrFilter(filter),
         m_ptrSettings(settings),
@@ -597,6 +702,7 @@ Task::UiUpdater::UiUpdater(
         m_pictureMask(picture_mask),
         m_despeckleState(despeckle_state),
         m_despeckleVisualization(despeckle_visualization),
+        m_ptrThumbnailInvalidator(thumbnail_invalidator),
         m_batchProcessing(batch),
         m_debug(debug)
 {
@@ -613,7 +719,11 @@ Task::UiUpdater::updateUI(FilterUiInterface* ui)
     }
     ui->setOptionsWidget(opt_widget, ui->KEEP_OWNERSHIP);
 
-    ui->invalidateThumbnail(m_pageId);
+    if (m_ptrThumbnailInvalidator) {
+        m_ptrThumbnailInvalidator->resultDelivered(ui);
+    } else {
+        ui->invalidateThumbnail(m_pageId);
+    }
 
     if (m_batchProcessing) {
         return;
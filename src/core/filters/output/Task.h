@@ -73,6 +73,7 @@ public:
     QObject* getSettingsListener();
 private:
     class UiUpdater;
+    class ThumbnailInvalidator;
 
     void deleteMutuallyExclusiveOutputFiles();
 
@@ -63,6 +63,12 @@ const bool _key_batch_dialog_start_from_current_def = true;
 const char* _key_batch_dialog_remember_choice = "batch_dialog/remember_choice";
 const bool _key_batch_dialog_remember_choice_def = false;
 const char* _key_batch_processing_priority = "settings/batch_processing_priority";
+const char* _key_batch_processing_threads = "settings/batch_processing_threads";
+const int _key_batch_processing_threads_def = 0;
+const char* _key_batch_processing_pipeline_depth = "settings/batch_processing_pipeline_depth";
+const int _key_batch_processing_pipeline_depth_def = 2;
+const char* _key_batch_processing_memory_budget = "settings/batch_processing_memory_budget_mb";
+const int _key_batch_processing_memory_budget_def = 0;
 
 /* Thumbnails */
 
@@ -71,6 +71,12 @@ extern const bool _key_batch_dialog_start_from_current_def;
 extern const char* _key_batch_dialog_remember_choice;
 extern const bool _key_batch_dialog_remember_choice_def;
 extern const char* _key_batch_processing_priority;
+extern const char* _key_batch_processing_threads;
+extern const int _key_batch_processing_threads_def;
+extern const char* _key_batch_processing_pipeline_depth;
+extern const int _key_batch_processing_pipeline_depth_def;
+extern const char* _key_batch_processing_memory_budget;
+extern const int _key_batch_processing_memory_budget_def;
 
 /* Thumbnails */
 
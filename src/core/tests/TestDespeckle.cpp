@@ -0,0 +1,128 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Despeckle.h"
+#include "Dpi.h"
+#include "NonCancellableTaskStatus.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/BWColor.h"
+#include <QRect>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <boost/test/unit_test.hpp>
+
+namespace Tests
+{
+
+using namespace imageproc;
+
+namespace
+{
+
+/**
+ * Black pixels with the given probability of 1/2^sparseness.
+ */
+BinaryImage randomImage(int const width, int const height, int const sparseness)
+{
+    BinaryImage image(width, height, WHITE);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int pixel = 1;
+            for (int i = 0; i < sparseness; ++i) {
+                pixel &= rand() & 1;
+            }
+            if (pixel) {
+                image.setPixel(x, y, BLACK);
+            }
+        }
+    }
+    return image;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(DespeckleTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_white_image)
+{
+    BinaryImage const image(50, 50, WHITE);
+    BinaryImage const result(
+        Despeckle::despeckle(image, Dpi(300, 300), Despeckle::NORMAL, NonCancellableTaskStatus())
+    );
+    BOOST_CHECK(result == image);
+}
+
+BOOST_AUTO_TEST_CASE(test_known_output)
+{
+    // Tall enough for the Voronoi diagram to be built in several bands,
+    // with the objects crossing band edges.
+    BinaryImage image(300, 400, WHITE);
+    image.fill(QRect(20, 100, 40, 40), BLACK);
+
+    // Close to the big object, so it's kept along with it.
+    image.fill(QRect(64, 126, 3, 3), BLACK);
+
+    BinaryImage expected(image);
+
+    // Too far from anything.
+    image.fill(QRect(90, 120, 3, 3), BLACK);
+    image.fill(QRect(200, 300, 3, 3), BLACK);
+
+    BinaryImage const result(
+        Despeckle::despeckle(image, Dpi(300, 300), Despeckle::NORMAL, NonCancellableTaskStatus())
+    );
+    BOOST_CHECK(result == expected);
+}
+
+BOOST_AUTO_TEST_CASE(test_independent_of_thread_count)
+{
+    srand(0);
+    BinaryImage image(randomImage(300, 700, 4));
+    for (int y = 20; y < 700; y += 90) {
+        // Big objects, for speckles around them to attach to.
+        image.fill(QRect(10, y, 280, 4), BLACK);
+    }
+
+    BinaryImage const reference(
+        Despeckle::despeckle(image, Dpi(300, 300), Despeckle::AGGRESSIVE, NonCancellableTaskStatus())
+    );
+    BOOST_REQUIRE(!(reference == image));
+
+#ifdef _OPENMP
+    int const max_threads = omp_get_max_threads();
+    for (int num_threads = 1; num_threads <= 4; ++num_threads) {
+        omp_set_num_threads(num_threads);
+        BinaryImage const result(
+            Despeckle::despeckle(image, Dpi(300, 300), Despeckle::AGGRESSIVE, NonCancellableTaskStatus())
+        );
+        BOOST_CHECK(result == reference);
+    }
+    omp_set_num_threads(max_threads);
+#else
+    BinaryImage const result(
+        Despeckle::despeckle(image, Dpi(300, 300), Despeckle::AGGRESSIVE, NonCancellableTaskStatus())
+    );
+    BOOST_CHECK(result == reference);
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
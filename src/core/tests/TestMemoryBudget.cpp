@@ -0,0 +1,254 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MemoryBudget.h"
+#include "TaskStatus.h"
+#include "imageproc/ImageBufferPool.h"
+#include <QAtomicInt>
+#include <QThread>
+#include <exception>
+#include <memory>
+#include <boost/test/unit_test.hpp>
+
+namespace Tests
+{
+
+using namespace imageproc;
+
+namespace
+{
+
+class CancelledException : public std::exception
+{
+};
+
+class Status : public TaskStatus
+{
+public:
+    Status() : m_cancelled(0) {}
+
+    virtual void cancel()
+    {
+        m_cancelled.store(1);
+    }
+
+    virtual bool isCancelled() const
+    {
+        return m_cancelled.load() != 0;
+    }
+
+    virtual void throwIfCancelled() const
+    {
+        if (isCancelled()) {
+            throw CancelledException();
+        }
+    }
+private:
+    QAtomicInt m_cancelled;
+};
+
+/**
+ * Makes a reservation from another thread, as a page being processed would.
+ */
+class ReservingThread : public QThread
+{
+public:
+    ReservingThread(qint64 bytes, TaskStatus const& status)
+        : m_bytes(bytes), m_rStatus(status), m_reserved(0), m_cancelled(0) {}
+
+    bool reserved() const
+    {
+        return m_reserved.load() != 0;
+    }
+
+    bool cancelled() const
+    {
+        return m_cancelled.load() != 0;
+    }
+protected:
+    virtual void run()
+    {
+        try {
+            MemoryBudget::Reservation const reservation(m_bytes, m_rStatus);
+            m_reserved.store(1);
+        } catch (CancelledException const&) {
+            m_cancelled.store(1);
+        }
+    }
+private:
+    qint64 m_bytes;
+    TaskStatus const& m_rStatus;
+    QAtomicInt m_reserved;
+    QAtomicInt m_cancelled;
+};
+
+/**
+ * Resets the process-wide budget, whatever the outcome of a test.
+ */
+class BudgetFixture
+{
+public:
+    BudgetFixture()
+    {
+        ImageBufferPool::instance().clear();
+        ImageBufferPool::instance().setCapacity(ImageBufferPool::BATCH_CAPACITY);
+    }
+
+    ~BudgetFixture()
+    {
+        MemoryBudget::instance().setLimit(0);
+        ImageBufferPool::instance().setCapacity(0);
+    }
+};
+
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(MemoryBudgetTestSuite, BudgetFixture);
+
+BOOST_AUTO_TEST_CASE(test_unlimited)
+{
+    Status const status;
+    MemoryBudget& budget = MemoryBudget::instance();
+    budget.setLimit(0);
+
+    MemoryBudget::Reservation const r1(qint64(1) << 40, status);
+    MemoryBudget::Reservation const r2(qint64(1) << 40, status);
+    BOOST_CHECK(budget.canAdmit());
+}
+
+BOOST_AUTO_TEST_CASE(test_reservations_are_accounted)
+{
+    Status const status;
+    MemoryBudget& budget = MemoryBudget::instance();
+    budget.setLimit(100);
+
+    {
+        MemoryBudget::Reservation const r1(40, status);
+        BOOST_CHECK_EQUAL(budget.reserved(), 40);
+        BOOST_CHECK(budget.canAdmit());
+
+        MemoryBudget::Reservation const r2(60, status);
+        BOOST_CHECK_EQUAL(budget.reserved(), 100);
+        BOOST_CHECK(!budget.canAdmit());
+    }
+
+    BOOST_CHECK_EQUAL(budget.reserved(), 0);
+    BOOST_CHECK(budget.canAdmit());
+}
+
+BOOST_AUTO_TEST_CASE(test_oversized_reservation_is_granted_alone)
+{
+    Status const status;
+    MemoryBudget::instance().setLimit(100);
+
+    // Otherwise a page larger than the limit would never be processed.
+    ReservingThread thread(1000, status);
+    thread.start();
+    BOOST_REQUIRE(thread.wait(10000));
+    BOOST_CHECK(thread.reserved());
+}
+
+BOOST_AUTO_TEST_CASE(test_reservation_waits_for_release)
+{
+    Status const status;
+    MemoryBudget::instance().setLimit(100);
+
+    std::unique_ptr<MemoryBudget::Reservation> r1(
+        new MemoryBudget::Reservation(60, status)
+    );
+
+    ReservingThread thread(60, status);
+    thread.start();
+    BOOST_CHECK(!thread.wait(300));
+    BOOST_CHECK(!thread.reserved());
+
+    r1.reset();
+    BOOST_REQUIRE(thread.wait(10000));
+    BOOST_CHECK(thread.reserved());
+}
+
+BOOST_AUTO_TEST_CASE(test_waiting_reservation_is_cancellable)
+{
+    Status status;
+    MemoryBudget::instance().setLimit(100);
+
+    MemoryBudget::Reservation const r1(60, status);
+
+    ReservingThread thread(60, status);
+    thread.start();
+    BOOST_CHECK(!thread.wait(300));
+
+    status.cancel();
+    BOOST_REQUIRE(thread.wait(10000));
+    BOOST_CHECK(thread.cancelled());
+    BOOST_CHECK(!thread.reserved());
+}
+
+BOOST_AUTO_TEST_CASE(test_held_bytes)
+{
+    Status const status;
+    MemoryBudget& budget = MemoryBudget::instance();
+    budget.setLimit(100);
+
+    MemoryBudget::Reservation const r1(10, status);
+    budget.hold(50);
+    BOOST_CHECK_EQUAL(budget.held(), 50);
+    BOOST_CHECK(budget.canAdmit());
+
+    ReservingThread thread(60, status);
+    thread.start();
+    BOOST_CHECK(!thread.wait(300));
+
+    budget.hold(40);
+    BOOST_CHECK(!budget.canAdmit());
+
+    budget.release(90);
+    BOOST_CHECK_EQUAL(budget.held(), 0);
+    BOOST_REQUIRE(thread.wait(10000));
+    BOOST_CHECK(thread.reserved());
+}
+
+BOOST_AUTO_TEST_CASE(test_reservation_trims_pool)
+{
+    Status const status;
+    ImageBufferPool& pool = ImageBufferPool::instance();
+    size_t const buffer_bytes = ImageBufferPool::MIN_POOLED_BYTES;
+
+    void* const buffer1 = pool.allocate(buffer_bytes);
+    void* const buffer2 = pool.allocate(buffer_bytes + 16);
+    pool.release(buffer1, buffer_bytes);
+    pool.release(buffer2, buffer_bytes + 16);
+    BOOST_REQUIRE_EQUAL(pool.cachedBytes(), 2 * buffer_bytes + 16);
+
+    // Room for the reservation plus the most recently cached buffer.
+    MemoryBudget::instance().setLimit(2 * buffer_bytes + 16);
+    {
+        MemoryBudget::Reservation const r1(buffer_bytes - 16, status);
+        BOOST_CHECK_EQUAL(pool.cachedBytes(), buffer_bytes + 16);
+    }
+
+    // A pool that fits is left alone.
+    {
+        MemoryBudget::Reservation const r2(buffer_bytes - 16, status);
+        BOOST_CHECK_EQUAL(pool.cachedBytes(), buffer_bytes + 16);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
@@ -0,0 +1,188 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "filters/output/MorphologicalSmoother.h"
+#include "NonCancellableTaskStatus.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/BWColor.h"
+#include <QRect>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <boost/test/unit_test.hpp>
+
+namespace Tests
+{
+
+using namespace imageproc;
+using output::MorphologicalSmoother;
+
+namespace
+{
+
+/**
+ * Black pixels with the given probability of 1/2^sparseness.
+ */
+BinaryImage randomImage(int const width, int const height, int const sparseness)
+{
+    BinaryImage image(width, height, WHITE);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int pixel = 1;
+            for (int i = 0; i < sparseness; ++i) {
+                pixel &= rand() & 1;
+            }
+            if (pixel) {
+                image.setPixel(x, y, BLACK);
+            }
+        }
+    }
+    return image;
+}
+
+/**
+ * Puts thin lines, notches and specks around line \p y,
+ * which smoothing modifies.
+ */
+void addFeaturesAround(BinaryImage& image, int const y)
+{
+    int const width = image.width();
+    int const height = image.height();
+    QRect const bounds(image.rect());
+
+    for (int dy = -2; dy <= 2; ++dy) {
+        int const x = 10 + (dy + 2) * 40;
+        if (x + 30 > width) {
+            break;
+        }
+
+        // A block with a notch and a one pixel bump on its top edge.
+        image.fill(QRect(x, y + dy, 30, 12).intersected(bounds), BLACK);
+        image.fill(QRect(x + 8, y + dy, 2, 2).intersected(bounds), WHITE);
+        if (y + dy - 1 >= 0 && y + dy - 1 < height) {
+            image.setPixel(x + 20, y + dy - 1, BLACK);
+        }
+
+        // A lone speck and a one pixel wide vertical line.
+        if (y + dy - 5 >= 0 && y + dy - 5 < height) {
+            image.setPixel(x + 35, y + dy - 5, BLACK);
+        }
+        image.fill(QRect(x + 37, y + dy - 20, 1, 40).intersected(bounds), BLACK);
+    }
+}
+
+void checkBandsMatchWholeImage(BinaryImage const& image, int const num_bands)
+{
+    BinaryImage expected(image);
+    MorphologicalSmoother::smoothWholeImage(expected, NonCancellableTaskStatus());
+
+    BinaryImage result(image);
+    MorphologicalSmoother::smoothInBands(result, num_bands, NonCancellableTaskStatus());
+
+    BOOST_CHECK_MESSAGE(
+        result == expected,
+        "height " << image.height() << ", " << num_bands << " bands"
+    );
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(MorphologicalSmootherTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_random_images)
+{
+    srand(0);
+    for (int sparseness = 1; sparseness <= 3; ++sparseness) {
+        BinaryImage const image(randomImage(100, 900, sparseness));
+        for (int num_bands = 2; num_bands <= 7; ++num_bands) {
+            checkBandsMatchWholeImage(image, num_bands);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_features_near_halo_edges)
+{
+    int const halo = MorphologicalSmoother::HALO;
+    int const height = 1000;
+
+    for (int num_bands = 2; num_bands <= 7; ++num_bands) {
+        int const band_height = (height + num_bands - 1) / num_bands;
+        BinaryImage image(220, height, WHITE);
+        for (int band = 1; band < num_bands; ++band) {
+            int const edge = band * band_height;
+            addFeaturesAround(image, edge);
+            addFeaturesAround(image, edge - halo);
+            addFeaturesAround(image, edge + halo);
+        }
+
+        BinaryImage smoothed(image);
+        MorphologicalSmoother::smoothWholeImage(smoothed, NonCancellableTaskStatus());
+        BOOST_REQUIRE(!(smoothed == image));
+
+        checkBandsMatchWholeImage(image, num_bands);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_short_and_empty_bands)
+{
+    srand(1);
+    for (int num_bands = 2; num_bands <= 7; ++num_bands) {
+        int const heights[] = {
+            // Bands shorter than the halo, and some of them left empty.
+            1, num_bands - 1, num_bands + 1, MorphologicalSmoother::HALO,
+            // A last band of a single line.
+            (num_bands - 1) * 100 + 1,
+            // Halos reaching exactly to the image edges.
+            num_bands * MorphologicalSmoother::HALO,
+            num_bands * MorphologicalSmoother::HALO + 1
+        };
+        for (int height : heights) {
+            checkBandsMatchWholeImage(randomImage(70, height, 2), num_bands);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_smooth_in_place)
+{
+    srand(2);
+    BinaryImage const image(randomImage(100, 2000, 2));
+
+    BinaryImage expected(image);
+    MorphologicalSmoother::smoothWholeImage(expected, NonCancellableTaskStatus());
+
+    BinaryImage result(image);
+    MorphologicalSmoother::smoothInPlace(result, NonCancellableTaskStatus());
+    BOOST_CHECK(result == expected);
+
+#ifdef _OPENMP
+    // Inside a parallel region, the image is processed as a single band.
+    bool all_equal = true;
+    #pragma omp parallel num_threads(2) reduction(&&:all_equal)
+    {
+        BinaryImage local(image);
+        MorphologicalSmoother::smoothInPlace(local, NonCancellableTaskStatus());
+        all_equal = (local == expected);
+    }
+    BOOST_CHECK(all_equal);
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
@@ -0,0 +1,139 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "filters/output/PictureDetector.h"
+#include "NonCancellableTaskStatus.h"
+#include "imageproc/GrayImage.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/BinaryThreshold.h"
+#include "imageproc/BWColor.h"
+#include "imageproc/Morphology.h"
+#include "imageproc/RasterOp.h"
+#include "imageproc/Scale.h"
+#include <QRect>
+#include <QSize>
+#include <stdint.h>
+#include <stdlib.h>
+#include <boost/test/unit_test.hpp>
+
+namespace Tests
+{
+
+using namespace imageproc;
+using output::PictureDetector;
+
+namespace
+{
+
+/**
+ * The threshold OutputGenerator::estimateBinarizationMask() applies.
+ */
+int const PICTURE_THRESHOLD = 48;
+
+void fill(GrayImage& image, QRect const& rect, uint8_t const color)
+{
+    uint8_t* line = image.data() + rect.top() * image.stride();
+    for (int y = rect.top(); y <= rect.bottom(); ++y, line += image.stride()) {
+        for (int x = rect.left(); x <= rect.right(); ++x) {
+            line[x] = color;
+        }
+    }
+}
+
+/**
+ * A white page at 300 dpi, with a noisy picture and some lines of text.
+ */
+GrayImage createPage(QRect const& picture_rect, QRect const& text_rect)
+{
+    GrayImage page(QSize(400, 500));
+    page.fill(0xff);
+
+    uint8_t* line = page.data() + picture_rect.top() * page.stride();
+    for (int y = picture_rect.top(); y <= picture_rect.bottom(); ++y) {
+        for (int x = picture_rect.left(); x <= picture_rect.right(); ++x) {
+            line[x] = static_cast<uint8_t>(rand() % 256);
+        }
+        line += page.stride();
+    }
+
+    // "C" shaped glyphs, with some of them missing.
+    for (int y = text_rect.top(); y + 8 <= text_rect.bottom(); y += 14) {
+        for (int x = text_rect.left(); x + 5 <= text_rect.right(); x += 9) {
+            if (rand() % 4 != 0) {
+                fill(page, QRect(x, y, 5, 2), 0x00);
+                fill(page, QRect(x, y, 2, 8), 0x00);
+                fill(page, QRect(x, y + 6, 5, 2), 0x00);
+            }
+        }
+    }
+
+    return page;
+}
+
+/**
+ * Whether black pixels of \p lhs are all black in \p rhs.
+ */
+bool isSubset(BinaryImage const& lhs, BinaryImage const& rhs)
+{
+    BinaryImage diff(lhs);
+    rasterOp<RopSubtract<RopDst, RopSrc> >(diff, rhs);
+    return diff.countBlackPixels() == 0;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(PictureDetectorTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_150dpi_matches_300dpi)
+{
+    srand(0);
+    NonCancellableTaskStatus const status;
+    QRect const picture_rect(67, 93, 250, 240);
+    QRect const text_rect(30, 370, 340, 110);
+    GrayImage const page(createPage(picture_rect, text_rect));
+    BinaryThreshold const threshold(PICTURE_THRESHOLD);
+
+    // How pictures were detected before, with all the steps at 300 dpi.
+    BinaryImage const reference(
+        PictureDetector::findEdgyAreas(
+            PictureDetector::findEdges(page, status), QSize(35, 35), status
+        ),
+        threshold
+    );
+
+    BinaryImage const result(
+        scaleToBinary(PictureDetector::detectPictures(page, status), page.size(), threshold)
+    );
+    BOOST_REQUIRE(result.size() == page.size());
+
+    // The picture is detected, and the text isn't.
+    QRect const picture_core(picture_rect.adjusted(20, 20, -20, -20));
+    BOOST_REQUIRE_EQUAL(reference.countBlackPixels(picture_core), 0);
+    BOOST_REQUIRE_EQUAL(reference.countBlackPixels(text_rect), text_rect.width() * text_rect.height());
+    BOOST_CHECK_EQUAL(result.countBlackPixels(picture_core), 0);
+    BOOST_CHECK_EQUAL(result.countBlackPixels(text_rect), text_rect.width() * text_rect.height());
+
+    // Elsewhere, the two only differ right at the borders of pictures.
+    QSize const tolerance(7, 7);
+    BOOST_CHECK(isSubset(result, dilateBrick(reference, tolerance)));
+    BOOST_CHECK(isSubset(erodeBrick(reference, tolerance), result));
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
@@ -0,0 +1,267 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C) 2007-2008  Joseph Artsimovich <joseph_a@mail.ru>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "filters/output/OutputGenerator.h"
+#include "filters/output/PreZoneImageCache.h"
+#include "filters/output/OutputImageParams.h"
+#include "filters/output/ColorParams.h"
+#include "filters/output/DespeckleLevel.h"
+#include "filters/output/FillColorProperty.h"
+#include "NonCancellableTaskStatus.h"
+#include "FilterData.h"
+#include "ImageTransformation.h"
+#include "ImageId.h"
+#include "PageId.h"
+#include "Dpi.h"
+#include "Dpm.h"
+#include "Zone.h"
+#include "ZoneSet.h"
+#include "PropertySet.h"
+#include "imageproc/BinaryImage.h"
+#include "imageproc/BWColor.h"
+#include <QImage>
+#include <QPolygonF>
+#include <QRectF>
+#include <QString>
+#include <stdlib.h>
+#include <boost/test/unit_test.hpp>
+
+namespace Tests
+{
+
+using namespace imageproc;
+using namespace output;
+
+namespace
+{
+
+Dpi const DPI(300, 300);
+
+/**
+ * A 300 dpi page with blocks of "text" and some speckles around them.
+ */
+QImage createPage()
+{
+    QImage page(500, 700, QImage::Format_RGB32);
+    page.fill(Qt::white);
+
+    Dpm const dpm(DPI);
+    page.setDotsPerMeterX(dpm.horizontal());
+    page.setDotsPerMeterY(dpm.vertical());
+
+    QRgb const black = qRgb(0, 0, 0);
+    for (int y = 60; y + 30 < 640; y += 45) {
+        for (int x = 60; x + 20 < 440; x += 28) {
+            for (int dy = 0; dy < 30; ++dy) {
+                for (int dx = 0; dx < 20; ++dx) {
+                    if (dx < 4 || dy < 4 || dy >= 26) {
+                        page.setPixel(x + dx, y + dy, black);
+                    }
+                }
+            }
+        }
+    }
+
+    srand(0);
+    for (int i = 0; i < 300; ++i) {
+        page.setPixel(40 + rand() % 420, 40 + rand() % 620, black);
+    }
+
+    return page;
+}
+
+QPolygonF contentRect(int const margin)
+{
+    return QPolygonF(QRectF(margin, margin, 500 - 2 * margin, 700 - 2 * margin));
+}
+
+ColorParams blackAndWhite()
+{
+    ColorParams params;
+    params.setColorMode(ColorParams::BLACK_AND_WHITE);
+    return params;
+}
+
+ZoneSet blackFillZone()
+{
+    PropertySet props;
+    props.locateOrCreate<FillColorProperty>()->setColor(Qt::black);
+
+    ZoneSet zones;
+    zones.add(Zone(SerializableSpline(QPolygonF(QRectF(100, 100, 150, 80))), props));
+    return zones;
+}
+
+/**
+ * Runs OutputGenerator the way output::Task does.
+ */
+QImage process(
+    OutputGenerator const& generator, FilterData const& data,
+    ZoneSet const& fill_zones, BinaryImage* speckles,
+    PreZoneImages* pre_zone_images)
+{
+    ZoneSet picture_zones;
+    return generator.process(
+               NonCancellableTaskStatus(), data, picture_zones, fill_zones,
+               false, nullptr, speckles, nullptr, nullptr, nullptr, pre_zone_images
+           );
+}
+
+/**
+ * Stands in for images that mustn't be used, so that using them shows.
+ */
+void poison(PreZoneImages& images)
+{
+    images.binaryOutput.fill(BLACK);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(PreZoneImagesTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_zone_edit)
+{
+    QImage const page(createPage());
+    FilterData const data(QString(), page);
+    OutputGenerator const generator(
+        DPI, blackAndWhite(), DESPECKLE_NORMAL, data.xform(), contentRect(30)
+    );
+
+    PreZoneImages images;
+    BinaryImage speckles;
+    process(generator, data, ZoneSet(), &speckles, &images);
+    BOOST_REQUIRE(!images.binaryOutput.isNull());
+    BOOST_REQUIRE(images.hasSpeckles);
+
+    // The fill zone is the only thing that changes.
+    ZoneSet const fill_zones(blackFillZone());
+    BinaryImage fresh_speckles;
+    QImage const fresh(process(generator, data, fill_zones, &fresh_speckles, nullptr));
+    BOOST_REQUIRE(!fresh_speckles.isNull());
+
+    PreZoneImages reused_images(images);
+    BinaryImage reused_speckles;
+    QImage const reused(process(generator, data, fill_zones, &reused_speckles, &reused_images));
+    BOOST_CHECK(reused == fresh);
+    BOOST_CHECK(reused_speckles == fresh_speckles);
+
+    // The stored images were actually used.
+    PreZoneImages poisoned(images);
+    poison(poisoned);
+    BOOST_CHECK(!(process(generator, data, fill_zones, nullptr, &poisoned) == fresh));
+}
+
+BOOST_AUTO_TEST_CASE(test_missing_speckles)
+{
+    QImage const page(createPage());
+    FilterData const data(QString(), page);
+    OutputGenerator const generator(
+        DPI, blackAndWhite(), DESPECKLE_NORMAL, data.xform(), contentRect(30)
+    );
+
+    // Speckles weren't asked for when the images were stored.
+    PreZoneImages images;
+    process(generator, data, ZoneSet(), nullptr, &images);
+    BOOST_REQUIRE(!images.binaryOutput.isNull());
+    BOOST_REQUIRE(!images.hasSpeckles);
+    poison(images);
+
+    BinaryImage fresh_speckles;
+    QImage const fresh(process(generator, data, ZoneSet(), &fresh_speckles, nullptr));
+
+    BinaryImage speckles;
+    QImage const result(process(generator, data, ZoneSet(), &speckles, &images));
+    BOOST_CHECK(result == fresh);
+    BOOST_CHECK(!speckles.isNull());
+    BOOST_CHECK(speckles == fresh_speckles);
+    BOOST_CHECK(images.hasSpeckles);
+}
+
+BOOST_AUTO_TEST_CASE(test_geometry_change)
+{
+    QImage const page(createPage());
+    FilterData const data(QString(), page);
+
+    PreZoneImages images;
+    {
+        OutputGenerator const generator(
+            DPI, blackAndWhite(), DESPECKLE_NORMAL, data.xform(), contentRect(30)
+        );
+        process(generator, data, ZoneSet(), nullptr, &images);
+    }
+    BOOST_REQUIRE(!images.binaryOutput.isNull());
+    poison(images);
+
+    OutputGenerator const generator(
+        DPI, blackAndWhite(), DESPECKLE_NORMAL, data.xform(), contentRect(50)
+    );
+    QImage const fresh(process(generator, data, ZoneSet(), nullptr, nullptr));
+    QImage const result(process(generator, data, ZoneSet(), nullptr, &images));
+    BOOST_CHECK(result == fresh);
+    BOOST_CHECK(images.contentRect == generator.outputContentRect());
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_matches_params)
+{
+    QImage const page(createPage());
+    FilterData const data(QString(), page);
+    PageId const page_id(ImageId(QString("no-such-file.png")));
+    QString const compression("LZW");
+
+    OutputImageParams const params(
+        page.size(), QRect(30, 30, 440, 640), data.xform(),
+        DPI, blackAndWhite(), DESPECKLE_NORMAL, compression
+    );
+
+    PreZoneImages images;
+    images.binaryOutput = BinaryImage(page.size(), WHITE);
+
+    PreZoneImageCache cache;
+    cache.store(page_id, params, images);
+
+    PreZoneImages found;
+    BOOST_CHECK(cache.find(page_id, params, found));
+    BOOST_CHECK(found.binaryOutput == images.binaryOutput);
+
+    // Another page.
+    BOOST_CHECK(!cache.find(PageId(ImageId(QString("other-file.png"))), params, found));
+
+    // Another content rectangle.
+    OutputImageParams const moved(
+        page.size(), QRect(50, 50, 400, 600), data.xform(),
+        DPI, blackAndWhite(), DESPECKLE_NORMAL, compression
+    );
+    BOOST_CHECK(!cache.find(page_id, moved, found));
+
+    // Other despeckling.
+    OutputImageParams const despeckled(
+        page.size(), QRect(30, 30, 440, 640), data.xform(),
+        DPI, blackAndWhite(), DESPECKLE_AGGRESSIVE, compression
+    );
+    BOOST_CHECK(!cache.find(page_id, despeckled, found));
+
+    cache.keepOnly(page_id);
+    BOOST_CHECK(cache.find(page_id, params, found));
+
+    cache.keepOnly(PageId(ImageId(QString("other-file.png"))));
+    BOOST_CHECK(!cache.find(page_id, params, found));
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace Tests
@@ -62,22 +62,361 @@ static inline bool binaryGetBW(uint32_t const* bw_line, unsigned int x)
     return (bw_line[x >> 5] & mask);
 }
 
-static inline void binarySetBW(uint32_t* bw_line, unsigned int x, bool black)
+namespace
 {
-    static uint32_t const msb = uint32_t(1) << 31;
-    uint32_t const mask = msb >> (x & 31);
-    if (black)
+
+/**
+ * \brief Sums and areas of windows centered at every pixel of a grayscale image.
+ *
+ * Integral images of pixel values and of their squares are built once,
+ * after which a whole line of windows can be summed at a time.
+ * Lines may be requested concurrently from different threads.
+ */
+class WindowStats
+{
+public:
+    /** \brief Per-thread storage for the statistics of a single line. */
+    class Line
+    {
+    public:
+        explicit Line(int width) : sums(width), sqsums(width), areas(width) {}
+
+        std::vector<uint32_t> sums;
+        std::vector<uint64_t> sqsums;
+        std::vector<int> areas;
+    };
+
+    WindowStats(GrayImage const& src, QSize window_size);
+
+    int width() const { return m_width; }
+
+    int height() const { return m_height; }
+
+    void computeLine(int y, Line& line) const;
+private:
+    template<typename T>
+    void sumLine(T const* top, T const* bottom, T* sums) const;
+
+    int m_width;
+    int m_height;
+    int m_windowLowerHalf;
+    int m_windowUpperHalf;
+    int m_windowLeftHalf;
+    int m_windowRightHalf;
+    IntegralImage<uint32_t> m_integralImage;
+    IntegralImage<uint64_t> m_integralSqImage;
+};
+
+WindowStats::WindowStats(GrayImage const& src, QSize const window_size)
+    :   m_width(src.width()),
+        m_height(src.height()),
+        m_windowLowerHalf(window_size.height() >> 1),
+        m_windowUpperHalf(window_size.height() - m_windowLowerHalf),
+        m_windowLeftHalf(window_size.width() >> 1),
+        m_windowRightHalf(window_size.width() - m_windowLeftHalf),
+        m_integralImage(m_width, m_height),
+        m_integralSqImage(m_width, m_height)
+{
+    uint8_t const* const src_data = src.data();
+    int const src_stride = src.stride();
+
+    m_integralImage.fill(
+        [src_data, src_stride](int x, int y) -> uint32_t {
+            return src_data[y * src_stride + x];
+        }
+    );
+    m_integralSqImage.fill(
+        [src_data, src_stride](int x, int y) -> uint64_t {
+            uint32_t const pixel = src_data[y * src_stride + x];
+            return pixel * pixel;
+        }
+    );
+}
+
+void
+WindowStats::computeLine(int const y, Line& line) const
+{
+    int const top = std::max(0, y - m_windowLowerHalf);
+    int const bottom = std::min(m_height, y + m_windowUpperHalf); // exclusive
+
+    sumLine(m_integralImage.line(top), m_integralImage.line(bottom), &line.sums[0]);
+    sumLine(m_integralSqImage.line(top), m_integralSqImage.line(bottom), &line.sqsums[0]);
+
+    for (int x = 0; x < m_width; ++x)
+    {
+        int const left = std::max(0, x - m_windowLeftHalf);
+        int const right = std::min(m_width, x + m_windowRightHalf); // exclusive
+        line.areas[x] = (bottom - top) * (right - left);
+        assert(line.areas[x] > 0); // because window_size > 0 and w > 0 and h > 0
+    }
+}
+
+template<typename T>
+void
+WindowStats::sumLine(T const* const top, T const* const bottom, T* const sums) const
+{
+    // Windows not clipped horizontally form a contiguous range of x.
+    // There the loop is free of branches and vectorizes.
+    int const inner_begin = std::min(m_width, m_windowLeftHalf);
+    int const inner_end = std::max(inner_begin, m_width - m_windowRightHalf);
+
+    auto const clipped_sum = [&](int const x) {
+        int const left = std::max(0, x - m_windowLeftHalf);
+        int const right = std::min(m_width, x + m_windowRightHalf); // exclusive
+        return T(bottom[right] - top[right] + top[left] - bottom[left]);
+    };
+
+    for (int x = 0; x < inner_begin; ++x)
+    {
+        sums[x] = clipped_sum(x);
+    }
+
+    T const* const top_left = top - m_windowLeftHalf;
+    T const* const top_right = top + m_windowRightHalf;
+    T const* const bottom_left = bottom - m_windowLeftHalf;
+    T const* const bottom_right = bottom + m_windowRightHalf;
+    for (int x = inner_begin; x < inner_end; ++x)
+    {
+        sums[x] = bottom_right[x] - top_right[x] + top_left[x] - bottom_left[x];
+    }
+
+    for (int x = inner_end; x < m_width; ++x)
+    {
+        sums[x] = clipped_sum(x);
+    }
+}
+
+void niblackThresholdLine(
+    WindowStats::Line const& stats, int const width, double const k, uint8_t* const thresholds)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        double const window_sum = stats.sums[x];
+        double const window_sqsum = stats.sqsums[x];
+
+        double const r_area = 1.0 / stats.areas[x];
+        double const mean = window_sum * r_area;
+        double const sqmean = window_sqsum * r_area;
+
+        double const variance = sqmean - mean * mean;
+        double const stddev = sqrt(fabs(variance));
+
+        double threshold = mean - k * stddev;
+
+        threshold = (threshold < 0.0) ? 0.0 : ((threshold < 255.0) ? threshold : 255.0);
+        thresholds[x] = (uint8_t) threshold;
+    }
+}
+
+void sauvolaThresholdLine(
+    WindowStats::Line const& stats, int const width, double const k, uint8_t* const thresholds)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        long double const window_sum = stats.sums[x];
+        long double const window_sqsum = stats.sqsums[x];
+
+        long double const r_area = 1.0 / stats.areas[x];
+        long double const mean = window_sum * r_area;
+        long double const sqmean = window_sqsum * r_area;
+
+        long double const variance = sqmean - mean * mean;
+        long double const deviation = sqrt(fabs(variance));
+
+        long double threshold = mean * (1.0 + k * (deviation / 128.0 - 1.0));
+
+        threshold = (threshold < 0.0) ? 0.0 : ((threshold < 255.0) ? threshold : 255.0);
+        thresholds[x] = (uint8_t) threshold;
+    }
+}
+
+/**
+ * Wolf's method needs the maximum deviation over the whole image before
+ * any threshold can be computed.  Rather than storing means and deviations
+ * for every pixel, they are computed twice: once here and once more
+ * in wolfThresholdLine().
+ */
+long double wolfMaxDeviationLine(WindowStats::Line const& stats, int const width)
+{
+    long double max_deviation = 0;
+    for (int x = 0; x < width; ++x)
+    {
+        long double const window_sum = stats.sums[x];
+        long double const window_sqsum = stats.sqsums[x];
+
+        long double const r_area = 1.0 / stats.areas[x];
+        long double const mean = window_sum * r_area;
+        long double const sqmean = window_sqsum * r_area;
+
+        long double const variance = sqmean - mean * mean;
+        long double const deviation = sqrt(fabs(variance));
+        max_deviation = std::max(max_deviation, deviation);
+    }
+    return max_deviation;
+}
+
+void wolfThresholdLine(
+    WindowStats::Line const& stats, int const width, double const k,
+    uint32_t const min_gray_level, long double const max_deviation, uint8_t* const thresholds)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        long double const window_sum = stats.sums[x];
+        long double const window_sqsum = stats.sqsums[x];
+
+        long double const r_area = 1.0 / stats.areas[x];
+        long double const window_mean = window_sum * r_area;
+        long double const sqmean = window_sqsum * r_area;
+
+        long double const variance = sqmean - window_mean * window_mean;
+
+        // Thresholds are computed from float precision means and deviations.
+        float const mean = window_mean;
+        float const deviation = sqrt(fabs(variance));
+
+        long double const a = 1.0 - deviation / max_deviation;
+        long double threshold = mean - k * a * (mean - min_gray_level);
+
+        threshold = (threshold < 0.0) ? 0.0 : ((threshold < 255.0) ? threshold : 255.0);
+        thresholds[x] = (uint8_t) threshold;
+    }
+}
+
+/**
+ * \brief Finds the global parameters of Wolf's method.
+ *
+ * Those are the minimum gray level and the maximum of window deviations.
+ * Both are needed before any threshold can be computed.
+ */
+void wolfGlobalStats(
+    GrayImage const& src, WindowStats const& stats,
+    uint32_t& min_gray_level, long double& max_deviation)
+{
+    int const w = stats.width();
+    int const h = stats.height();
+    uint8_t const* const src_data = src.data();
+    int const src_stride = src.stride();
+
+    min_gray_level = 255;
+    max_deviation = 0;
+
+    #pragma omp parallel
+    {
+        WindowStats::Line line(w);
+        uint32_t thread_min_gray_level = 255;
+        long double thread_max_deviation = 0;
+
+        #pragma omp for nowait
+        for (int y = 0; y < h; ++y)
+        {
+            uint8_t const* const src_line = src_data + y * src_stride;
+            for (int x = 0; x < w; ++x)
+            {
+                thread_min_gray_level = std::min<uint32_t>(thread_min_gray_level, src_line[x]);
+            }
+
+            stats.computeLine(y, line);
+            thread_max_deviation = std::max(
+                thread_max_deviation, wolfMaxDeviationLine(line, w)
+            );
+        }
+
+        #pragma omp critical
+        {
+            min_gray_level = std::min(min_gray_level, thread_min_gray_level);
+            max_deviation = std::max(max_deviation, thread_max_deviation);
+        }
+    }
+}
+
+/**
+ * \brief Packs a line of pixels into black and white words.
+ *
+ * A pixel becomes black if it's below lower_bound, or if it's not above
+ * upper_bound and is below its threshold plus delta.  Padding bits of
+ * the last word are made white.
+ */
+void binarizeLine(
+    uint8_t const* const src_line, uint8_t const* const threshold_line, int const width,
+    unsigned char const lower_bound, unsigned char const upper_bound, int const delta,
+    uint32_t* const bw_line)
+{
+    auto const is_black = [=](int const x) -> uint32_t {
+        int const pixel = src_line[x];
+        return pixel < lower_bound
+            || (pixel <= upper_bound && pixel < (int)threshold_line[x] + delta);
+    };
+
+    int const num_full_words = width >> 5;
+    for (int i = 0; i < num_full_words; ++i)
+    {
+        int const x0 = i << 5;
+        uint32_t word = 0;
+        for (int bit = 0; bit < 32; ++bit)
+        {
+            word = (word << 1) | is_black(x0 + bit);
+        }
+        bw_line[i] = word;
+    }
+
+    int const num_tail_bits = width & 31;
+    if (num_tail_bits != 0)
     {
-        // black
-        bw_line[x >> 5] |= mask;
+        int const x0 = num_full_words << 5;
+        uint32_t word = 0;
+        for (int bit = 0; bit < num_tail_bits; ++bit)
+        {
+            word = (word << 1) | is_black(x0 + bit);
+        }
+        bw_line[num_full_words] = word << (32 - num_tail_bits);
     }
-    else
+}
+
+/**
+ * \brief Binarizes an image against local thresholds, without a threshold map.
+ *
+ * Thresholds exist for only one line at a time, in a per-thread buffer
+ * filled by \p threshold_line(stats_line, thresholds).  Each thread
+ * takes a band of consecutive lines.  The result is the same as
+ * binarizeFromMap() applied to a map made of the same thresholds.
+ */
+template<typename ThresholdLine>
+BinaryImage binarizeByLines(
+    GrayImage const& src, WindowStats const& stats,
+    unsigned char const lower_bound, unsigned char const upper_bound, int const delta,
+    ThresholdLine const& threshold_line)
+{
+    int const w = stats.width();
+    int const h = stats.height();
+    uint8_t const* const src_data = src.data();
+    int const src_stride = src.stride();
+
+    BinaryImage bw_img(w, h);
+    uint32_t* const bw_data = bw_img.data(); // never call bw_img.data() inside omp
+    int const bw_stride = bw_img.wordsPerLine();
+
+    #pragma omp parallel
     {
-        // white
-        bw_line[x >> 5] &= ~mask;
+        WindowStats::Line line(w);
+        std::vector<uint8_t> thresholds(w);
+
+        #pragma omp for schedule(static)
+        for (int y = 0; y < h; ++y)
+        {
+            stats.computeLine(y, line);
+            threshold_line(line, &thresholds[0]);
+            binarizeLine(
+                src_data + y * src_stride, &thresholds[0], w,
+                lower_bound, upper_bound, delta, bw_data + y * bw_stride
+            );
+        }
     }
+
+    return bw_img;
 }
 
+} // anonymous namespace
+
 BinaryImage binarizeFromMap(GrayImage const& src, GrayImage const& threshold,
     unsigned char const lower_bound, unsigned char const upper_bound, int const delta)
 {
@@ -96,10 +435,10 @@ BinaryImage binarizeFromMap(GrayImage const& src, GrayImage const& threshold,
         return BinaryImage();
     }
 
-    uint8_t const* src_line = src.data();
-    unsigned int const src_stride = src.stride();
-    uint8_t const* threshold_line = threshold.data();
-    unsigned int const threshold_stride = threshold.stride();
+    uint8_t const* const src_data = src.data();
+    int const src_stride = src.stride();
+    uint8_t const* const threshold_data = threshold.data();
+    int const threshold_stride = threshold.stride();
 
     BinaryImage bw_img(w, h);
     if (bw_img.isNull())
@@ -107,18 +446,16 @@ BinaryImage binarizeFromMap(GrayImage const& src, GrayImage const& threshold,
         return BinaryImage();
     }
 
-    uint32_t* bw_line = bw_img.data();
-    unsigned int const bw_stride = bw_img.wordsPerLine();
+    uint32_t* const bw_data = bw_img.data(); // never call bw_img.data() inside omp
+    int const bw_stride = bw_img.wordsPerLine();
 
-    for (unsigned int y = 0; y < h; ++y)
+    #pragma omp parallel for
+    for (int y = 0; y < (int)h; ++y)
     {
-        for (unsigned int x = 0; x < w; ++x)
-        {
-            binarySetBW(bw_line, x, (src_line[x] < lower_bound || (src_line[x] <= upper_bound && ((int)src_line[x] < ((int)threshold_line[x] + delta)))));
-        }
-        src_line += src_stride;
-        threshold_line += threshold_stride;
-        bw_line += bw_stride;
+        binarizeLine(
+            src_data + y * src_stride, threshold_data + y * threshold_stride, w,
+            lower_bound, upper_bound, delta, bw_data + y * bw_stride
+        );
     }
 
     return bw_img;
@@ -143,65 +480,22 @@ GrayImage binarizeNiblackMap(
         return GrayImage();
     }
 
-    int const w = src.width();
-    int const h = src.height();
-    uint8_t const* src_line = src.data();
-    int const src_stride = src.stride();
-    uint8_t* gray_line = gray.data();
+    WindowStats const stats(src, window_size);
+    int const w = stats.width();
+    int const h = stats.height();
+    uint8_t* const gray_data = gray.data(); // never call gray.data() inside omp
     int const gray_stride = gray.stride();
 
-    IntegralImage<uint32_t> integral_image(w, h);
-    IntegralImage<uint64_t> integral_sqimage(w, h);
-
-    for (int y = 0; y < h; ++y)
+    #pragma omp parallel
     {
-        integral_image.beginRow();
-        integral_sqimage.beginRow();
-        for (int x = 0; x < w; ++x)
-        {
-            uint32_t const pixel = src_line[x];
-            integral_image.push(pixel);
-            integral_sqimage.push(pixel * pixel);
-        }
-        src_line += src_stride;
-    }
+        WindowStats::Line line(w);
 
-    int const window_lower_half = window_size.height() >> 1;
-    int const window_upper_half = window_size.height() - window_lower_half;
-    int const window_left_half = window_size.width() >> 1;
-    int const window_right_half = window_size.width() - window_left_half;
-
-    src_line = src.data();
-    for (int y = 0; y < h; ++y)
-    {
-        int const top = std::max(0, y - window_lower_half);
-        int const bottom = std::min(h, y + window_upper_half); // exclusive
-
-        for (int x = 0; x < w; ++x)
+        #pragma omp for
+        for (int y = 0; y < h; ++y)
         {
-            int const left = std::max(0, x - window_left_half);
-            int const right = std::min(w, x + window_right_half); // exclusive
-            int const area = (bottom - top) * (right - left);
-            assert(area > 0); // because window_size > 0 and w > 0 and h > 0
-
-            QRect const rect(left, top, right - left, bottom - top);
-            double const window_sum = integral_image.sum(rect);
-            double const window_sqsum = integral_sqimage.sum(rect);
-
-            double const r_area = 1.0 / area;
-            double const mean = window_sum * r_area;
-            double const sqmean = window_sqsum * r_area;
-
-            double const variance = sqmean - mean * mean;
-            double const stddev = sqrt(fabs(variance));
-
-            double threshold = mean - k * stddev;
-
-            threshold = (threshold < 0.0) ? 0.0 : ((threshold < 255.0) ? threshold : 255.0);
-            gray_line[x] = (uint8_t) threshold;
+            stats.computeLine(y, line);
+            niblackThresholdLine(line, w, k, gray_data + y * gray_stride);
         }
-        src_line += src_stride;
-        gray_line += gray_stride;
     }
 
     return gray;
@@ -227,10 +521,13 @@ BinaryImage binarizeNiblack(
         return BinaryImage();
     }
 
-    GrayImage threshold_map(binarizeNiblackMap(gray, window_size, k));
-    BinaryImage bw_img(binarizeFromMap(gray, threshold_map, 0, 255, delta));
-
-    return bw_img;
+    WindowStats const stats(gray, window_size);
+    return binarizeByLines(
+        gray, stats, 0, 255, delta,
+        [&stats, k](WindowStats::Line const& line, uint8_t* thresholds) {
+            niblackThresholdLine(line, stats.width(), k, thresholds);
+        }
+    );
 }
 
 BinaryImage binarizeGatosCleaner(
@@ -260,29 +557,25 @@ BinaryImage binarizeGatosCleaner(
     IntegralImage<uint32_t> niblack_bg_ii(w, h);
     IntegralImage<uint32_t> wiener_bg_ii(w, h);
 
-    uint32_t const* niblack_line = niblack.data();
+    uint32_t const* const niblack_data = niblack.data();
     int const niblack_stride = niblack.wordsPerLine();
-    uint8_t* wiener_line = wiener.data();
+    uint8_t* const wiener_data = wiener.data(); // never call wiener.data() inside omp
     int const wiener_stride = wiener.stride();
 
-    for (int y = 0; y < h; ++y)
-    {
-        niblack_bg_ii.beginRow();
-        wiener_bg_ii.beginRow();
-        for (int x = 0; x < w; ++x)
-        {
-            // bg: 1, fg: 0
-            uint32_t const niblack_inverted_pixel =
-                (~niblack_line[x >> 5] >> (31 - (x & 31))) & uint32_t(1);
-            uint32_t const wiener_pixel = wiener_line[x];
-            niblack_bg_ii.push(niblack_inverted_pixel);
-
-            // bg: wiener_pixel, fg: 0
-            wiener_bg_ii.push(wiener_pixel & ~(niblack_inverted_pixel - uint32_t(1)));
+    // bg: 1, fg: 0
+    auto const niblack_inverted_pixel = [niblack_data, niblack_stride](int x, int y) {
+        uint32_t const* const niblack_line = niblack_data + y * niblack_stride;
+        return (~niblack_line[x >> 5] >> (31 - (x & 31))) & uint32_t(1);
+    };
+    niblack_bg_ii.fill(niblack_inverted_pixel);
+
+    // bg: wiener_pixel, fg: 0
+    wiener_bg_ii.fill(
+        [=](int x, int y) {
+            uint32_t const wiener_pixel = wiener_data[y * wiener_stride + x];
+            return wiener_pixel & ~(niblack_inverted_pixel(x, y) - uint32_t(1));
         }
-        wiener_line += wiener_stride;
-        niblack_line += niblack_stride;
-    }
+    );
 
     std::vector<QRect> windows;
     for (int scale = 1;; ++scale)
@@ -304,11 +597,14 @@ BinaryImage binarizeGatosCleaner(
 
     QRect const image_rect(wiener.rect());
     GrayImage background(wiener);
-    uint8_t* background_line = background.data();
+    uint8_t* const background_data = background.data(); // never call background.data() inside omp
     int const background_stride = background.stride();
-    niblack_line = niblack.data();
+
+    #pragma omp parallel for reduction(+: sum_diff, sum_bg)
     for (int y = 0; y < h; ++y)
     {
+        uint8_t* const background_line = background_data + y * background_stride;
+        uint32_t const* const niblack_line = niblack_data + y * niblack_stride;
         for (int x = 0; x < w; ++x)
         {
             for (QRect window : windows)
@@ -338,8 +634,6 @@ BinaryImage binarizeGatosCleaner(
                 break;
             }
         }
-        background_line += background_stride;
-        niblack_line += niblack_stride;
     }
 
     double const delta = double(sum_diff) / (w*h - niblack_bg_ii.sum(image_rect));
@@ -354,10 +648,11 @@ BinaryImage binarizeGatosCleaner(
     double const threshold_scale = q * delta * (1.0 - p2);
     double const threshold_bias = q * delta * p2;
 
-    wiener_line = wiener.data();
-    background_line = background.data();
+    #pragma omp parallel for
     for (int y = 0; y < h; ++y)
     {
+        uint8_t* const wiener_line = wiener_data + y * wiener_stride;
+        uint8_t const* const background_line = background_data + y * background_stride;
         for (int x = 0; x < w; ++x)
         {
             uint8_t& wiener_pixel = wiener_line[x];
@@ -366,8 +661,6 @@ BinaryImage binarizeGatosCleaner(
                 (1.0 + exp(double(bg_pixel) * exp_scale + exp_bias)) + threshold_bias;
             wiener_pixel = double(bg_pixel) - double(wiener_pixel) > threshold ? 0x00 : 0xff;
         }
-        wiener_line += wiener_stride;
-        background_line += background_stride;
     }
 
     return BinaryImage(wiener);
@@ -419,58 +712,22 @@ GrayImage binarizeSauvolaMap(
         return GrayImage();
     }
 
-    int const w = src.width();
-    int const h = src.height();
-    uint8_t* gray_line = gray.data();
+    WindowStats const stats(src, window_size);
+    int const w = stats.width();
+    int const h = stats.height();
+    uint8_t* const gray_data = gray.data(); // never call gray.data() inside omp
     int const gray_stride = gray.stride();
 
-    IntegralImage<uint32_t> integral_image(w, h);
-    IntegralImage<uint64_t> integral_sqimage(w, h);
-
-    for (int y = 0; y < h; ++y) {
-        integral_image.beginRow();
-        integral_sqimage.beginRow();
-        for (int x = 0; x < w; ++x) {
-            uint32_t const pixel = gray_line[x];
-            integral_image.push(pixel);
-            integral_sqimage.push(pixel * pixel);
-        }
-        gray_line += gray_stride;
-    }
-
-    int const window_lower_half = window_size.height() >> 1;
-    int const window_upper_half = window_size.height() - window_lower_half;
-    int const window_left_half = window_size.width() >> 1;
-    int const window_right_half = window_size.width() - window_left_half;
-
-    gray_line = gray.data();
-    for (int y = 0; y < h; ++y) {
-        int const top = std::max(0, y - window_lower_half);
-        int const bottom = std::min(h, y + window_upper_half); // exclusive
-
-        for (int x = 0; x < w; ++x) {
-            int const left = std::max(0, x - window_left_half);
-            int const right = std::min(w, x + window_right_half); // exclusive
-            int const area = (bottom - top) * (right - left);
-            assert(area > 0); // because window_size > 0 and w > 0 and h > 0
-
-            QRect const rect(left, top, right - left, bottom - top);
-            long double const window_sum = integral_image.sum(rect);
-            long double const window_sqsum = integral_sqimage.sum(rect);
-
-            long double const r_area = 1.0 / area;
-            long double const mean = window_sum * r_area;
-            long double const sqmean = window_sqsum * r_area;
-
-            long double const variance = sqmean - mean * mean;
-            long double const deviation = sqrt(fabs(variance));
-
-            long double threshold = mean * (1.0 + k * (deviation / 128.0 - 1.0));
+    #pragma omp parallel
+    {
+        WindowStats::Line line(w);
 
-            threshold = (threshold < 0.0) ? 0.0 : ((threshold < 255.0) ? threshold : 255.0);
-            gray_line[x] = (uint8_t) threshold;
+        #pragma omp for
+        for (int y = 0; y < h; ++y)
+        {
+            stats.computeLine(y, line);
+            sauvolaThresholdLine(line, w, k, gray_data + y * gray_stride);
         }
-        gray_line += gray_stride;
     }
 
     return gray;
@@ -496,10 +753,13 @@ BinaryImage binarizeSauvola(
         return BinaryImage();
     }
 
-    GrayImage threshold_map(binarizeSauvolaMap(gray, window_size, k));
-    BinaryImage bw_img(binarizeFromMap(gray, threshold_map, 0, 255, delta));
-
-    return bw_img;
+    WindowStats const stats(gray, window_size);
+    return binarizeByLines(
+        gray, stats, 0, 255, delta,
+        [&stats, k](WindowStats::Line const& line, uint8_t* thresholds) {
+            sauvolaThresholdLine(line, stats.width(), k, thresholds);
+        }
+    );
 }
 
 GrayImage binarizeWolfMap(
@@ -521,78 +781,28 @@ GrayImage binarizeWolfMap(
         return GrayImage();
     }
 
-    int const w = src.width();
-    int const h = src.height();
-    uint8_t* gray_line = gray.data();
+    WindowStats const stats(src, window_size);
+    int const w = stats.width();
+    int const h = stats.height();
+    uint8_t* const gray_data = gray.data(); // never call gray.data() inside omp
     int const gray_stride = gray.stride();
 
-    IntegralImage<uint32_t> integral_image(w, h);
-    IntegralImage<uint64_t> integral_sqimage(w, h);
-
-    uint32_t min_gray_level = 255;
+    uint32_t min_gray_level;
+    long double max_deviation;
+    wolfGlobalStats(src, stats, min_gray_level, max_deviation);
 
-    for (int y = 0; y < h; ++y) {
-        integral_image.beginRow();
-        integral_sqimage.beginRow();
-        for (int x = 0; x < w; ++x) {
-            uint32_t const pixel = gray_line[x];
-            integral_image.push(pixel);
-            integral_sqimage.push(pixel * pixel);
-            min_gray_level = std::min(min_gray_level, pixel);
-        }
-        gray_line += gray_stride;
-    }
-
-    int const window_lower_half = window_size.height() >> 1;
-    int const window_upper_half = window_size.height() - window_lower_half;
-    int const window_left_half = window_size.width() >> 1;
-    int const window_right_half = window_size.width() - window_left_half;
-
-    std::vector<float> means(w * h, 0);
-    std::vector<float> deviations(w * h, 0);
-
-    long double max_deviation = 0;
-
-    for (int y = 0; y < h; ++y) {
-        int const top = std::max(0, y - window_lower_half);
-        int const bottom = std::min(h, y + window_upper_half); // exclusive
-
-        for (int x = 0; x < w; ++x) {
-            int const left = std::max(0, x - window_left_half);
-            int const right = std::min(w, x + window_right_half); // exclusive
-            int const area = (bottom - top) * (right - left);
-            assert(area > 0); // because window_size > 0 and w > 0 and h > 0
-
-            QRect const rect(left, top, right - left, bottom - top);
-            long double const window_sum = integral_image.sum(rect);
-            long double const window_sqsum = integral_sqimage.sum(rect);
-
-            long double const r_area = 1.0 / area;
-            long double const mean = window_sum * r_area;
-            long double const sqmean = window_sqsum * r_area;
-
-            long double const variance = sqmean - mean * mean;
-            long double const deviation = sqrt(fabs(variance));
-            max_deviation = std::max(max_deviation, deviation);
-            means[w * y + x] = mean;
-            deviations[w * y + x] = deviation;
-        }
-    }
-
-    // TODO: integral images can be disposed at this point.
-
-    gray_line = gray.data();
-    for (int y = 0; y < h; ++y) {
-        for (int x = 0; x < w; ++x) {
-            float const mean = means[y * w + x];
-            float const deviation = deviations[y * w + x];
-            long double const a = 1.0 - deviation / max_deviation;
-            long double threshold = mean - k * a * (mean - min_gray_level);
+    #pragma omp parallel
+    {
+        WindowStats::Line line(w);
 
-            threshold = (threshold < 0.0) ? 0.0 : ((threshold < 255.0) ? threshold : 255.0);
-            gray_line[x] = (uint8_t) threshold;
+        #pragma omp for
+        for (int y = 0; y < h; ++y)
+        {
+            stats.computeLine(y, line);
+            wolfThresholdLine(
+                line, w, k, min_gray_level, max_deviation, gray_data + y * gray_stride
+            );
         }
-        gray_line += gray_stride;
     }
 
     return gray;
@@ -619,10 +829,19 @@ BinaryImage binarizeWolf(
         return BinaryImage();
     }
 
-    GrayImage threshold_map(binarizeWolfMap(gray, window_size, k));
-    BinaryImage bw_img(binarizeFromMap(gray, threshold_map, lower_bound, upper_bound, delta));
+    WindowStats const stats(gray, window_size);
+    uint32_t min_gray_level;
+    long double max_deviation;
+    wolfGlobalStats(gray, stats, min_gray_level, max_deviation);
 
-    return bw_img;
+    return binarizeByLines(
+        gray, stats, lower_bound, upper_bound, delta,
+        [&](WindowStats::Line const& line, uint8_t* thresholds) {
+            wolfThresholdLine(
+                line, stats.width(), k, min_gray_level, max_deviation, thresholds
+            );
+        }
+    );
 }
 
 BinaryImage
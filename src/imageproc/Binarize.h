@@ -54,6 +54,21 @@ BinaryImage binarizeMokji(
     QImage const& src, unsigned max_edge_width = 3,
     unsigned min_edge_magnitude = 20);
 
+/**
+ * \brief Binarizes an image against a map of per-pixel thresholds.
+ *
+ * A pixel becomes black if it's below \p lower_bound, or if it's not above
+ * \p upper_bound and is below its threshold plus \p delta.  Threshold maps
+ * are produced by binarize*Map() functions.  The local binarization functions
+ * give the same result without building a map.
+ *
+ * \return A black and white image, or a null image if \p src and
+ *         \p threshold differ in size.
+ */
+BinaryImage binarizeFromMap(
+    GrayImage const& src, GrayImage const& threshold,
+    unsigned char lower_bound, unsigned char upper_bound, int delta);
+
 /**
   * \brief Image binarization using Niblack's local thresholding method.
   *
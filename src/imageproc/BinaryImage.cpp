@@ -19,6 +19,7 @@
 #include "BinaryImage.h"
 #include "ByteOrder.h"
 #include "BitOps.h"
+#include "ImageBufferPool.h"
 #include <QAtomicInt>
 #include <QImage>
 #include <QRect>
@@ -53,7 +54,7 @@ private:
 public:
     static SharedData* create(size_t num_words)
     {
-        return new (NumWords(num_words)) SharedData();
+        return new (NumWords(num_words)) SharedData(allocSize(num_words));
     }
 
     uint32_t* data()
@@ -82,11 +83,18 @@ public:
 
     static void operator delete (void* addr, NumWords num_words);
 private:
-    SharedData() : m_refCounter(1) {}
+    explicit SharedData(size_t alloc_size) : m_refCounter(1), m_allocSize(alloc_size) {}
 
     SharedData& operator=(SharedData const&); // forbidden
 
+    static size_t allocSize(size_t num_words)
+    {
+        SharedData* sd = 0;
+        return ((char*)&sd->m_data[0] - (char*)sd) + num_words * 4;
+    }
+
     mutable QAtomicInt m_refCounter;
+    size_t m_allocSize; // Needed to return memory to ImageBufferPool.
     uint32_t m_data[1]; // more data follows
 };
 
@@ -1416,26 +1424,22 @@ void
 BinaryImage::SharedData::unref() const
 {
     if (!m_refCounter.deref()) {
+        size_t const alloc_size = m_allocSize;
         this->~SharedData();
-        free((void*)this);
+        ImageBufferPool::instance().release((void*)this, alloc_size);
     }
 }
 
 void*
 BinaryImage::SharedData::operator new (size_t, NumWords const num_words)
 {
-    SharedData* sd = 0;
-    void* addr = malloc(((char*)&sd->m_data[0] - (char*)sd) + num_words.numWords * 4);
-    if (!addr) {
-        throw std::bad_alloc();
-    }
-    return addr;
+    return ImageBufferPool::instance().allocate(allocSize(num_words.numWords));
 }
 
 void
-BinaryImage::SharedData::operator delete (void* addr, NumWords)
+BinaryImage::SharedData::operator delete (void* addr, NumWords const num_words)
 {
-    free(addr);
+    ImageBufferPool::instance().release(addr, allocSize(num_words.numWords));
 }
 
 } // namespace imageproc
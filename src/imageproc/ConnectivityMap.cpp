@@ -34,6 +34,43 @@ namespace imageproc
 uint32_t const ConnectivityMap::BACKGROUND = ~uint32_t(0);
 uint32_t const ConnectivityMap::UNTAGGED_FG = BACKGROUND - 1;
 
+namespace
+{
+
+/**
+ * Labelling is done in bands of this many lines, which are processed
+ * in parallel and then merged.
+ */
+int const BAND_HEIGHT = 64;
+
+/**
+ * \brief Finds the root of a label in a union-find forest.
+ *
+ * Roots are the smallest labels of their trees, and a parent is always
+ * smaller than its child.  Path halving preserves that.
+ */
+inline uint32_t findRoot(uint32_t* const parents, uint32_t label)
+{
+    while (parents[label] != label) {
+        parents[label] = parents[parents[label]];
+        label = parents[label];
+    }
+    return label;
+}
+
+inline void uniteLabels(uint32_t* const parents, uint32_t const label1, uint32_t const label2)
+{
+    uint32_t const root1 = findRoot(parents, label1);
+    uint32_t const root2 = findRoot(parents, label2);
+    if (root1 < root2) {
+        parents[root2] = root1;
+    } else if (root2 < root1) {
+        parents[root1] = root2;
+    }
+}
+
+} // anonymous namespace
+
 ConnectivityMap::ConnectivityMap()
     :   m_pData(0),
         m_size(),
@@ -261,314 +298,178 @@ ConnectivityMap::copyFromInfluenceMap(InfluenceMap const& imap)
 
 void
 ConnectivityMap::assignIds(Connectivity const conn)
-{
-    uint32_t const num_initial_tags = initialTagging();
-    std::vector<uint32_t> table(num_initial_tags, 0);
-
-    switch (conn) {
-    case CONN4:
-        spreadMin4();
-        break;
-    case CONN8:
-        spreadMin8();
-        break;
-    }
-
-    markUsedIds(table);
-
-    uint32_t next_label = 1;
-    for (uint32_t i = 0; i < num_initial_tags; ++i) {
-        if (table[i]) {
-            table[i] = next_label;
-            ++next_label;
-        }
-    }
-
-    remapIds(table);
-
-    m_maxLabel = next_label - 1;
-}
-
-/**
- * Tags every object pixel that has a non-object pixel to the left.
- */
-uint32_t
-ConnectivityMap::initialTagging()
 {
     int const width = m_size.width();
     int const height = m_size.height();
-
-    uint32_t next_label = 1;
-
-    uint32_t* line = m_pData;
     int const stride = m_stride;
+    int const num_bands = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
 
-    for (int y = 0; y < height; ++y, line += stride) {
-        for (int x = 0; x < width; ++x) {
-            if (line[x - 1] == BACKGROUND
-                    && line[x] == UNTAGGED_FG) {
-                line[x] = next_label;
-                ++next_label;
-            }
-        }
-    }
+    // Label each band independently.
+    std::vector<std::vector<uint32_t> > band_parents(num_bands);
 
-    return next_label - 1;
-}
+    #pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < num_bands; ++band) {
+        int const top = band * BAND_HEIGHT;
+        int const bottom = std::min(height, top + BAND_HEIGHT);
+        labelBand(top, bottom, conn, band_parents[band]);
+    }
 
-void
-ConnectivityMap::spreadMin4()
-{
-    int const width = m_size.width();
-    int const height = m_size.height();
-    int const stride = m_stride;
+    // Put the forests of all bands into a single one, with band-local
+    // labels of a band becoming indexes starting from its offset.
+    std::vector<uint32_t> band_offsets(num_bands + 1, 0);
+    for (int band = 0; band < num_bands; ++band) {
+        band_offsets[band + 1] = band_offsets[band] + band_parents[band].size();
+    }
+    uint32_t const num_labels = band_offsets[num_bands];
 
-    uint32_t* line = m_pData;
-    uint32_t* prev_line = m_pData - stride;
+    std::vector<uint32_t> parents(num_labels + 1);
 
-    // Top to bottom.
-    for (int y = 0; y < height; ++y) {
-        // Left to right.
-        for (int x = 0; x < width; ++x) {
-            if (line[x] == BACKGROUND) {
-                continue;
-            }
-            line[x] = std::min(
-                          prev_line[x],
-                          std::min(line[x - 1], line[x])
-                      );
+    #pragma omp parallel for
+    for (int band = 0; band < num_bands; ++band) {
+        uint32_t const offset = band_offsets[band];
+        std::vector<uint32_t>& local_parents = band_parents[band];
+        for (uint32_t i = 0; i < local_parents.size(); ++i) {
+            parents[offset + i] = offset + local_parents[i];
         }
-
-        prev_line = line;
-        line += stride;
+        std::vector<uint32_t>().swap(local_parents);
     }
 
-    prev_line = line;
-    line -= stride;
-
-    FastQueue<uint32_t*> queue;
-
-    // Bottom to top.
-    for (int y = height - 1; y >= 0; --y) {
-        // Right to left.
-        for (int x = width - 1; x >= 0; --x) {
-            if (line[x] == BACKGROUND) {
-                continue;
-            }
-
-            uint32_t const new_val = std::min(
-                                         line[x + 1], prev_line[x]
-                                     );
-
-            if (new_val >= line[x]) {
-                continue;
-            }
+    // Merge components across seams between bands.  Pairs of adjacent
+    // groups of bands are merged in parallel, with group sizes doubling
+    // each round.  Groups being merged at the same time don't share labels.
+    for (int step = 1; step < num_bands; step <<= 1) {
+        #pragma omp parallel for
+        for (int band = step; band < num_bands; band += step << 1) {
+            mergeBandSeam(
+                band * BAND_HEIGHT, band_offsets[band - 1],
+                band_offsets[band], conn, &parents[0]
+            );
+        }
+    }
 
-            line[x] = new_val;
+    // Every component is now a tree rooted at its smallest index,
+    // with parents having smaller indexes than their children.  Indexes
+    // follow the raster order of runs, so numbering the roots in order
+    // labels components by their first pixel in raster order.
+    std::vector<uint32_t>& final_labels = parents;
+    uint32_t next_label = 1;
+    for (uint32_t i = 0; i < num_labels; ++i) {
+        uint32_t const parent = parents[i];
+        if (parent == i) {
+            final_labels[i] = next_label;
+            ++next_label;
+        } else {
+            final_labels[i] = final_labels[parent];
+        }
+    }
 
-            // We compare new_val + 1 < neighbor + 1 to
-            // make BACKGROUND neighbors overflow and become
-            // zero.
-            uint32_t const nvp1 = new_val + 1;
-            if (nvp1 < line[x + 1] + 1 || nvp1 < prev_line[x] + 1) {
-                queue.push(&line[x]);
+    #pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < num_bands; ++band) {
+        int const top = band * BAND_HEIGHT;
+        int const bottom = std::min(height, top + BAND_HEIGHT);
+        uint32_t const* const band_labels = final_labels.data() + band_offsets[band];
+        uint32_t* line = m_pData + top * stride;
+        for (int y = top; y < bottom; ++y, line += stride) {
+            line[-1] = 0;
+            line[width] = 0;
+            for (int x = 0; x < width; ++x) {
+                uint32_t const label = line[x];
+                line[x] = label == BACKGROUND ? 0 : band_labels[label - 1];
             }
         }
-        prev_line = line;
-        line -= stride;
     }
 
-    processQueue4(queue);
+    std::fill(m_data.begin(), m_data.begin() + stride, 0);
+    std::fill(m_data.end() - stride, m_data.end(), 0);
+
+    m_maxLabel = next_label - 1;
 }
 
+/**
+ * Gives every object pixel in lines [top, bottom) a label local to the band.
+ * New labels are given in raster order to pixels having a non-object pixel
+ * to the left, which are then united with labels of their neighbors.
+ * Label L corresponds to parents[L - 1], which holds the index of its
+ * parent, so a root is an index equal to its own position.
+ */
 void
-ConnectivityMap::spreadMin8()
+ConnectivityMap::labelBand(
+    int const top, int const bottom, Connectivity const conn,
+    std::vector<uint32_t>& parents)
 {
     int const width = m_size.width();
-    int const height = m_size.height();
     int const stride = m_stride;
 
-    uint32_t* line = m_pData;
-    uint32_t* prev_line = m_pData - stride;
+    uint32_t* line = m_pData + top * stride;
+    for (int y = top; y < bottom; ++y, line += stride) {
+        uint32_t const* const prev_line = y == top ? 0 : line - stride;
 
-    // Top to bottom.
-    for (int y = 0; y < height; ++y) {
-        // Left to right.
         for (int x = 0; x < width; ++x) {
             if (line[x] == BACKGROUND) {
                 continue;
             }
-            line[x] = std::min(
-                          std::min(
-                              std::min(prev_line[x - 1], prev_line[x]),
-                              std::min(prev_line[x + 1], line[x - 1])
-                          ),
-                          line[x]
-                      );
-        }
 
-        prev_line = line;
-        line += stride;
-    }
-
-    prev_line = line;
-    line -= stride;
-
-    FastQueue<uint32_t*> queue;
-
-    // Bottom to top.
-    for (int y = height - 1; y >= 0; --y) {
-        for (int x = width - 1; x >= 0; --x) {
-            if (line[x] == BACKGROUND) {
-                continue;
+            uint32_t label = line[x - 1];
+            if (label == BACKGROUND) {
+                label = parents.size() + 1;
+                parents.push_back(label - 1);
             }
+            line[x] = label;
 
-            uint32_t const new_val = std::min(
-                                         std::min(prev_line[x - 1], prev_line[x]),
-                                         std::min(prev_line[x + 1], line[x + 1])
-                                     );
-
-            if (new_val >= line[x]) {
+            if (!prev_line) {
                 continue;
             }
 
-            line[x] = new_val;
-
-            // We compare new_val + 1 < neighbor + 1 to
-            // make BACKGROUND neighbors overflow and become
-            // zero.
-            uint32_t const nvp1 = new_val + 1;
-            if (nvp1 < prev_line[x - 1] + 1
-                    || nvp1 < prev_line[x] + 1
-                    || nvp1 < prev_line[x + 1] + 1
-                    || nvp1 < line[x + 1] + 1) {
-                queue.push(&line[x]);
+            uint32_t* const forest = parents.data();
+            if (conn == CONN8) {
+                if (prev_line[x - 1] != BACKGROUND) {
+                    uniteLabels(forest, label - 1, prev_line[x - 1] - 1);
+                }
+                if (prev_line[x + 1] != BACKGROUND) {
+                    uniteLabels(forest, label - 1, prev_line[x + 1] - 1);
+                }
+            }
+            if (prev_line[x] != BACKGROUND) {
+                uniteLabels(forest, label - 1, prev_line[x] - 1);
             }
         }
-
-        prev_line = line;
-        line -= stride;
-    }
-
-    processQueue8(queue);
-}
-
-void
-ConnectivityMap::processNeighbor(
-    FastQueue<uint32_t*>& queue,
-    uint32_t const this_val, uint32_t* neighbor)
-{
-    // *neighbor + 1 will overflow if *neighbor == BACKGROUND,
-    // which is what we want.
-    if (this_val + 1 < *neighbor + 1) {
-        *neighbor = this_val;
-        queue.push(neighbor);
-    }
-}
-
-void
-ConnectivityMap::processQueue4(FastQueue<uint32_t*>& queue)
-{
-    int const stride = m_stride;
-
-    while (!queue.empty()) {
-        uint32_t* p = queue.front();
-        queue.pop();
-
-        uint32_t const this_val = *p;
-
-        // Northern neighbor.
-        p -= stride;
-        processNeighbor(queue, this_val, p);
-
-        // Eastern neighbor.
-        p += stride + 1;
-        processNeighbor(queue, this_val, p);
-
-        // Southern neighbor.
-        p += stride - 1;
-        processNeighbor(queue, this_val, p);
-
-        // Western neighbor.
-        p -= stride + 1;
-        processNeighbor(queue, this_val, p);
-    }
-}
-
-void
-ConnectivityMap::processQueue8(FastQueue<uint32_t*>& queue)
-{
-    int const stride = m_stride;
-
-    while (!queue.empty()) {
-        uint32_t* p = queue.front();
-        queue.pop();
-
-        uint32_t const this_val = *p;
-
-        // Northern neighbor.
-        p -= stride;
-        processNeighbor(queue, this_val, p);
-
-        // North-eastern neighbor.
-        ++p;
-        processNeighbor(queue, this_val, p);
-
-        // Eastern neighbor.
-        p += stride;
-        processNeighbor(queue, this_val, p);
-
-        // South-eastern neighbor.
-        p += stride;
-        processNeighbor(queue, this_val, p);
-
-        // Southern neighbor.
-        --p;
-        processNeighbor(queue, this_val, p);
-
-        // South-western neighbor.
-        --p;
-        processNeighbor(queue, this_val, p);
-
-        // Western neighbor.
-        p -= stride;
-        processNeighbor(queue, this_val, p);
-
-        // North-western neighbor.
-        p -= stride;
-        processNeighbor(queue, this_val, p);
     }
 }
 
+/**
+ * Unites labels of line \p y with those of the line above it, the two
+ * belonging to different bands.  Band-local labels are made global
+ * by adding band offsets.
+ */
 void
-ConnectivityMap::markUsedIds(std::vector<uint32_t>& used_map) const
+ConnectivityMap::mergeBandSeam(
+    int const y, uint32_t const upper_offset, uint32_t const lower_offset,
+    Connectivity const conn, uint32_t* const parents)
 {
     int const width = m_size.width();
-    int const height = m_size.height();
-    int const stride = m_stride;
+    uint32_t const* const line = m_pData + y * m_stride;
+    uint32_t const* const prev_line = line - m_stride;
 
-    uint32_t const* line = m_pData;
+    // Label L of a band corresponds to parents[offset + L - 1].
+    uint32_t const upper_base = upper_offset - 1;
+    uint32_t const lower_base = lower_offset - 1;
 
-    // Top to bottom.
-    for (int y = 0; y < height; ++y, line += stride) {
-        // Left to right.
-        for (int x = 0; x < width; ++x) {
-            if (line[x] == BACKGROUND) {
-                continue;
-            }
-            used_map[line[x] - 1] = 1;
+    for (int x = 0; x < width; ++x) {
+        if (line[x] == BACKGROUND) {
+            continue;
         }
-    }
-}
 
-void
-ConnectivityMap::remapIds(std::vector<uint32_t> const& map)
-{
-    for (uint32_t& label : m_data) {
-        if (label == BACKGROUND) {
-            label = 0;
-        } else {
-            label = map[label - 1];
+        uint32_t const idx = lower_base + line[x];
+        if (conn == CONN8) {
+            if (prev_line[x - 1] != BACKGROUND) {
+                uniteLabels(parents, idx, upper_base + prev_line[x - 1]);
+            }
+            if (prev_line[x + 1] != BACKGROUND) {
+                uniteLabels(parents, idx, upper_base + prev_line[x + 1]);
+            }
+        }
+        if (prev_line[x] != BACKGROUND) {
+            uniteLabels(parents, idx, upper_base + prev_line[x]);
         }
     }
 }
@@ -20,7 +20,6 @@
 #define IMAGEPROC_CONNECTIVITY_MAP_H_
 
 #include "Connectivity.h"
-#include "FastQueue.h"
 #include "foundation/GridAccessor.h"
 #include <QSize>
 #include <QColor>
@@ -226,23 +225,11 @@ private:
 
     void assignIds(Connectivity conn);
 
-    uint32_t initialTagging();
+    void labelBand(int top, int bottom, Connectivity conn, std::vector<uint32_t>& parents);
 
-    void spreadMin4();
-
-    void spreadMin8();
-
-    void processNeighbor(
-        FastQueue<uint32_t*>& queue,
-        uint32_t this_val, uint32_t* neighbor);
-
-    void processQueue4(FastQueue<uint32_t*>& queue);
-
-    void processQueue8(FastQueue<uint32_t*>& queue);
-
-    void markUsedIds(std::vector<uint32_t>& used_map) const;
-
-    void remapIds(std::vector<uint32_t> const& map);
+    void mergeBandSeam(
+        int y, uint32_t upper_offset, uint32_t lower_offset,
+        Connectivity conn, uint32_t* parents);
 
     void expandImpl(BinaryImage const* mask);
 
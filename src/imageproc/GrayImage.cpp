@@ -18,6 +18,7 @@
 
 #include "GrayImage.h"
 #include "Grayscale.h"
+#include "ImageBufferPool.h"
 #include <new>
 
 namespace imageproc
@@ -29,7 +30,7 @@ GrayImage::GrayImage(QSize size)
         return;
     }
 
-    m_image = QImage(size, QImage::Format_Indexed8);
+    m_image = ImageBufferPool::instance().createImage(size, QImage::Format_Indexed8);
     m_image.setColorTable(createGrayscalePalette());
     if (m_image.isNull()) {
         throw std::bad_alloc();
@@ -0,0 +1,206 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ImageBufferPool.h"
+#include <QMutexLocker>
+#include <iterator>
+#include <utility>
+#include <new>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+namespace imageproc
+{
+
+namespace
+{
+
+/**
+ * Images created by createImage() need to know their buffer size
+ * in order to release it, so it's stored in front of the pixels.
+ * The header is 16 bytes to keep pixels aligned for SIMD code.
+ */
+size_t const IMAGE_HEADER_BYTES = 16;
+
+} // anonymous namespace
+
+size_t const ImageBufferPool::MIN_POOLED_BYTES = 256 * 1024;
+
+size_t const ImageBufferPool::BATCH_CAPACITY = 256 * 1024 * 1024;
+
+ImageBufferPool::ImageBufferPool()
+    :   m_cachedBytes(0),
+        m_capacity(0)
+{
+}
+
+ImageBufferPool&
+ImageBufferPool::instance()
+{
+    // Never destroyed, as images holding pooled buffers may outlive
+    // static objects.
+    static ImageBufferPool* const object = new ImageBufferPool;
+
+    return *object;
+}
+
+void*
+ImageBufferPool::allocate(size_t const bytes)
+{
+    if (bytes >= MIN_POOLED_BYTES) {
+        QMutexLocker const locker(&m_mutex);
+
+        // Of the buffers of this size, take the most recently cached one.
+        auto it(m_buffersBySize.upper_bound(bytes));
+        if (it != m_buffersBySize.begin() && (--it)->first == bytes) {
+            void* const data = it->second->data;
+            m_cachedBytes -= bytes;
+            m_buffers.erase(it->second);
+            m_buffersBySize.erase(it);
+            return data;
+        }
+    }
+
+    void* const data = malloc(bytes);
+    if (!data) {
+        throw std::bad_alloc();
+    }
+    return data;
+}
+
+void
+ImageBufferPool::release(void* const buffer, size_t const bytes)
+{
+    if (!buffer) {
+        return;
+    }
+
+    if (bytes >= MIN_POOLED_BYTES) {
+        QMutexLocker const locker(&m_mutex);
+
+        if (bytes <= m_capacity) {
+            trimTo(m_capacity - bytes);
+            m_buffers.push_front(Buffer(buffer, bytes));
+            m_buffersBySize.insert(std::make_pair(bytes, m_buffers.begin()));
+            m_cachedBytes += bytes;
+            return;
+        }
+    }
+
+    free(buffer);
+}
+
+QImage
+ImageBufferPool::createImage(QSize const size, QImage::Format const format)
+{
+    int bits_per_pixel = 0;
+    switch (format) {
+    case QImage::Format_Indexed8:
+    case QImage::Format_Grayscale8:
+        bits_per_pixel = 8;
+        break;
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        bits_per_pixel = 32;
+        break;
+    default:
+        break;
+    }
+
+    if (bits_per_pixel == 0 || size.isEmpty()) {
+        return QImage(size, format);
+    }
+
+    int const bpl = ((size.width() * bits_per_pixel + 31) / 32) * 4;
+    size_t const bytes = IMAGE_HEADER_BYTES + size_t(bpl) * size.height();
+
+    uint8_t* const buffer = static_cast<uint8_t*>(allocate(bytes));
+    *reinterpret_cast<size_t*>(buffer) = bytes;
+
+    QImage image(
+        buffer + IMAGE_HEADER_BYTES, size.width(), size.height(), bpl,
+        format, &ImageBufferPool::releaseImageBuffer, buffer
+    );
+    if (image.isNull()) {
+        release(buffer, bytes);
+    }
+    return image;
+}
+
+void
+ImageBufferPool::releaseImageBuffer(void* const buffer)
+{
+    instance().release(buffer, *static_cast<size_t*>(buffer));
+}
+
+size_t
+ImageBufferPool::capacity() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_capacity;
+}
+
+void
+ImageBufferPool::setCapacity(size_t const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    m_capacity = bytes;
+    trimTo(bytes);
+}
+
+size_t
+ImageBufferPool::cachedBytes() const
+{
+    QMutexLocker const locker(&m_mutex);
+    return m_cachedBytes;
+}
+
+void
+ImageBufferPool::trim(size_t const bytes)
+{
+    QMutexLocker const locker(&m_mutex);
+    trimTo(bytes);
+}
+
+void
+ImageBufferPool::clear()
+{
+    QMutexLocker const locker(&m_mutex);
+    trimTo(0);
+}
+
+void
+ImageBufferPool::trimTo(size_t const bytes)
+{
+    while (m_cachedBytes > bytes) {
+        Buffer const& oldest = m_buffers.back();
+
+        // Being the oldest, it comes first among the buffers of its size.
+        auto const it(m_buffersBySize.lower_bound(oldest.bytes));
+        assert(it->second == std::prev(m_buffers.end()));
+        m_buffersBySize.erase(it);
+
+        m_cachedBytes -= oldest.bytes;
+        free(oldest.data);
+        m_buffers.pop_back();
+    }
+}
+
+} // namespace imageproc
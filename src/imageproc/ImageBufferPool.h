@@ -0,0 +1,147 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_IMAGE_BUFFER_POOL_H_
+#define IMAGEPROC_IMAGE_BUFFER_POOL_H_
+
+#include "NonCopyable.h"
+#include <QImage>
+#include <QSize>
+#include <QMutex>
+#include <list>
+#include <map>
+#include <stddef.h>
+
+namespace imageproc
+{
+
+/**
+ * \brief A process-wide cache of large image buffers.
+ *
+ * Processing a page allocates the same set of page-sized buffers as the
+ * previous page did.  Instead of returning freed buffers to the system,
+ * the pool keeps them, up to capacity(), and hands them out again for
+ * requests of exactly the same size.  That saves on page faults and on
+ * fragmentation when several pages are processed at once.
+ *
+ * The pool starts with a zero capacity, caching nothing.  Batch processing
+ * sets it to BATCH_CAPACITY for its duration and back to zero once it's
+ * over, and its memory budget trims the pool when room is needed for
+ * another page.
+ *
+ * Requests smaller than MIN_POOLED_BYTES go directly to malloc().
+ * All methods are thread-safe.
+ */
+class ImageBufferPool
+{
+    DECLARE_NON_COPYABLE(ImageBufferPool)
+public:
+    static size_t const MIN_POOLED_BYTES;
+
+    /**
+     * \brief The capacity batch processing sets for its duration.
+     */
+    static size_t const BATCH_CAPACITY;
+
+    static ImageBufferPool& instance();
+
+    /**
+     * \brief Allocates a buffer, reusing a cached one of the same size if possible.
+     *
+     * \throw std::bad_alloc
+     */
+    void* allocate(size_t bytes);
+
+    /**
+     * \brief Returns a buffer obtained from allocate().
+     *
+     * \p bytes must be the same value that was passed to allocate().
+     */
+    void release(void* buffer, size_t bytes);
+
+    /**
+     * \brief Creates an uninitialized image backed by a pooled buffer.
+     *
+     * Formats of 8 and 32 bits per pixel are supported.  For other formats,
+     * a regular QImage is created.  Indexed images still need a color table.
+     */
+    QImage createImage(QSize size, QImage::Format format);
+
+    /**
+     * \brief The maximum number of bytes kept in cached buffers.
+     *
+     * Zero, unless changed by setCapacity().
+     */
+    size_t capacity() const;
+
+    /**
+     * \brief Sets capacity(), freeing cached buffers that don't fit into it.
+     */
+    void setCapacity(size_t bytes);
+
+    /**
+     * \brief The number of bytes currently kept in cached buffers.
+     */
+    size_t cachedBytes() const;
+
+    /**
+     * \brief Frees the least recently cached buffers until at most
+     *        \p bytes remain cached.  Unlike setCapacity(), this doesn't
+     *        affect the buffers cached afterwards.
+     */
+    void trim(size_t bytes);
+
+    /**
+     * \brief Frees all cached buffers.
+     */
+    void clear();
+private:
+    struct Buffer {
+        void* data;
+        size_t bytes;
+
+        Buffer(void* data_, size_t bytes_) : data(data_), bytes(bytes_) {}
+    };
+
+    ImageBufferPool();
+
+    /**
+     * Frees the least recently cached buffers until at most \p bytes remain.
+     * Must be called with m_mutex locked.
+     */
+    void trimTo(size_t bytes);
+
+    static void releaseImageBuffer(void* buffer);
+
+    typedef std::list<Buffer> BufferList;
+
+    mutable QMutex m_mutex;
+    BufferList m_buffers; // Most recently cached first.
+
+    /**
+     * Cached buffers by size.  Buffers of the same size are in the order
+     * they were cached, the same as in m_buffers, only reversed.
+     */
+    std::multimap<size_t, BufferList::iterator> m_buffersBySize;
+    size_t m_cachedBytes;
+    size_t m_capacity;
+};
+
+} // namespace imageproc
+
+#endif
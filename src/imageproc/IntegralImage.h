@@ -22,6 +22,7 @@
 #include "NonCopyable.h"
 #include <QSize>
 #include <QRect>
+#include <algorithm>
 #include <new>
 
 namespace imageproc
@@ -67,6 +68,30 @@ public:
      */
     void push(T val);
 
+    /**
+     * \brief Build the whole integral image at once.
+     *
+     * This is an alternative to beginRow() and push().  First, every row
+     * gets its prefix sums, with rows processed in parallel.  Then those
+     * are accumulated down the columns, with strips of columns processed
+     * in parallel.
+     *
+     * \param values A functor taking (x, y) and returning the value
+     *        at that position.  It's called exactly once for each position
+     *        and from multiple threads.
+     */
+    template<typename Values>
+    void fill(Values const& values);
+
+    /**
+     * \brief Returns a line of the integral image.
+     *
+     * Element x of line y is the sum of values in columns [0, x) of
+     * rows [0, y).  That makes \p y range from 0 to height inclusive,
+     * and the line width + 1 elements long.
+     */
+    T const* line(int y) const { return m_pData + y * m_width; }
+
     /**
      * \brief Calculate the sum of values in the given rectangle.
      *
@@ -138,6 +163,51 @@ IntegralImage<T>::push(T const val)
     ++m_pAbove;
 }
 
+template<typename T>
+template<typename Values>
+void
+IntegralImage<T>::fill(Values const& values)
+{
+    // Keep in mind that row 0 and column 0 are fake.
+    int const width = m_width - 1;
+    int const height = m_height - 1;
+
+    #pragma omp parallel for
+    for (int y = 0; y < height; ++y) {
+        T* line = m_pData + (y + 1) * m_width;
+        T line_sum = T();
+        line[0] = T();
+        for (int x = 0; x < width; ++x) {
+            line_sum += values(x, y);
+            line[x + 1] = line_sum;
+        }
+    }
+
+    // Column strips are made narrow enough for a pair of their lines
+    // to stay in L1 cache, yet wide enough to vectorize well.
+    int const strip_width = 1024;
+    int const num_strips = (m_width + strip_width - 1) / strip_width;
+
+    #pragma omp parallel for
+    for (int strip = 0; strip < num_strips; ++strip) {
+        int const x0 = strip * strip_width;
+        int const x1 = std::min(m_width, x0 + strip_width);
+        T const* above = m_pData + m_width;
+        T* line = m_pData + 2 * m_width;
+        for (int y = 1; y < height; ++y) {
+            for (int x = x0; x < x1; ++x) {
+                line[x] += above[x];
+            }
+            above += m_width;
+            line += m_width;
+        }
+    }
+
+    m_pCur = m_pData + m_width * m_height;
+    m_pAbove = m_pCur - m_width;
+    m_lineSum = T();
+}
+
 template<typename T>
 void
 IntegralImage<T>::beginRow()
@@ -28,10 +28,15 @@
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
-#include <math.h>
 #include <assert.h>
 #include <string.h>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MORPHOLOGY_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace imageproc
 {
 
@@ -198,6 +203,12 @@ inline QRect shrinkByBrick(QRect const& rect, Brick const& brick)
 
 static int const COMPOSITE_THRESHOLD = 8;
 
+/**
+ * Horizontal spreading by following runs of pixels is only considered
+ * for bricks at least that wide.
+ */
+static int const RUNS_THRESHOLD = 16;
+
 void doInitialCopy(
     BinaryImage& dst, CoordinateSystem const& dst_cs,
     QRect const& dst_relevant_rect,
@@ -315,60 +326,253 @@ void spreadInDirection(
         return;
     }
 
-    int const first_phase_steps = (int)sqrt((double)num_steps);
+    // Shifts [0, num_steps) are covered by shifts [0, p) and
+    // [num_steps - p, num_steps), where p is the largest power of two
+    // not exceeding num_steps.  The former are done by doubling,
+    // and the latter are the former shifted once more, so the whole
+    // thing takes O(log(num_steps)) raster operations.
+    int p = 1;
+    while ((p << 1) <= num_steps) {
+        p <<= 1;
+    }
+    int const rest_dx = dx_step * (num_steps - p);
+    int const rest_dy = dy_step * (num_steps - p);
+
+    if (dst_composition_allowed) {
+        spreadInDirectionLow(
+            dst, dst_cs, dst_relevant_rect, src, src_cs,
+            dx_min, dx_step, dy_min, dy_step, p,
+            rop, initial_color, true
+        );
+
+        if (p != num_steps) {
+            QRect dst_rect(dst.rect());
+            QRect src_rect(dst_rect);
+            dst_rect.translate(rest_dx, rest_dy);
+
+            adjustToFit(dst_relevant_rect, dst_rect, src_rect);
+
+            rop(dst, dst_rect, dst, src_rect.topLeft());
+        }
+        return;
+    }
 
     BinaryImage tmp(tmp_images.retrieveOrCreate(tmp_image_size));
 
-    spreadInDirection(
+    spreadInDirectionLow(
         tmp, tmp_cs, tmp.rect(), src, src_cs,
-        tmp_images, tmp_cs, tmp_image_size,
-        dx_min, dx_step, dy_min, dy_step,
-        first_phase_steps,
+        dx_min, dx_step, dy_min, dy_step, p,
         rop, initial_color, true
     );
 
-    int const second_phase_steps = num_steps / first_phase_steps;
-
-    spreadInDirection(
-        dst, dst_cs, dst_relevant_rect, tmp, tmp_cs,
-        tmp_images, tmp_cs, tmp_image_size,
-        0, dx_step * first_phase_steps,
-        0, dy_step * first_phase_steps,
-        second_phase_steps,
-        rop, initial_color, dst_composition_allowed
+    doInitialCopy(
+        dst, dst_cs, dst_relevant_rect,
+        tmp, tmp_cs, initial_color, 0, 0
     );
 
-    int const steps_done = first_phase_steps * second_phase_steps;
-    int const steps_remaining = num_steps - steps_done;
-
-    if (steps_remaining <= 0) {
-        assert(steps_remaining == 0);
-    } else if (steps_remaining < COMPOSITE_THRESHOLD) {
-        spreadInto(
-            dst, dst_cs, dst_relevant_rect, src, src_cs,
-            dx_min + dx_step * steps_done, dx_step,
-            dy_min + dy_step * steps_done, dy_step,
-            steps_remaining, rop
-        );
-    } else {
-        spreadInDirection(
-            tmp, tmp_cs, tmp.rect(), src, src_cs,
-            tmp_images, tmp_cs, tmp_image_size,
-            dx_min + dx_step * steps_done, dx_step,
-            dy_min + dy_step * steps_done, dy_step,
-            steps_remaining,
-            rop, initial_color, true
-        );
-
+    if (p != num_steps) {
         spreadInto(
             dst, dst_cs, dst_relevant_rect, tmp, tmp_cs,
-            0, 0, 0, 0, 1, rop
+            rest_dx, 0, rest_dy, 0, 1, rop
         );
     }
 
     tmp_images.store(tmp);
 }
 
+/**
+ * \brief Sets or clears pixels [first, last] of a line.
+ */
+void fillLineSpan(uint32_t* line, int const first, int const last, BWColor const color)
+{
+    int const first_word = first >> 5;
+    int const last_word = last >> 5;
+    uint32_t const first_mask = ~uint32_t(0) >> (first & 31);
+    uint32_t const last_mask = ~uint32_t(0) << (31 - (last & 31));
+
+    if (first_word == last_word) {
+        uint32_t const mask = first_mask & last_mask;
+        if (color == BLACK) {
+            line[first_word] |= mask;
+        } else {
+            line[first_word] &= ~mask;
+        }
+        return;
+    }
+
+    if (color == BLACK) {
+        line[first_word] |= first_mask;
+        line[last_word] |= last_mask;
+    } else {
+        line[first_word] &= ~first_mask;
+        line[last_word] &= ~last_mask;
+    }
+
+    uint32_t const fill_word = color == BLACK ? ~uint32_t(0) : 0;
+    for (int i = first_word + 1; i < last_word; ++i) {
+        line[i] = fill_word;
+    }
+}
+
+/**
+ * \brief Decides if spreadHorizontallyByRuns() is going to be faster
+ *        than shifting the whole image.
+ *
+ * Shifting costs O(log(num_steps)) passes over the image, while following
+ * runs costs one pass plus per-pixel work on words having both colors.
+ * We estimate the number of such words from a sample of lines.
+ */
+bool preferSpreadingByRuns(
+    BinaryImage const& src, int const num_steps, BWColor const spreading_color)
+{
+    if (num_steps < RUNS_THRESHOLD) {
+        return false;
+    }
+
+    int log2_steps = 0;
+    while ((1 << (log2_steps + 1)) <= num_steps) {
+        ++log2_steps;
+    }
+
+    int const wpl = src.wordsPerLine();
+    int const height = src.height();
+    uint32_t const* const data = src.data();
+    uint32_t const neutral_word = spreading_color == BLACK ? 0 : ~uint32_t(0);
+
+    long long sampled_words = 0;
+    long long mixed_words = 0;
+    for (int y = 0; y < height; y += 8) {
+        uint32_t const* const line = data + y * wpl;
+        // The last word may contain padding bits, and that's fine for an estimate.
+        for (int i = 0; i < wpl; ++i) {
+            uint32_t const word = line[i] ^ neutral_word;
+            if (word != 0 && word != ~uint32_t(0)) {
+                ++mixed_words;
+            }
+        }
+        sampled_words += wpl;
+    }
+
+    return mixed_words * 16 < sampled_words * log2_steps;
+}
+
+/**
+ * \brief Horizontal spreading by painting runs of spreading_color
+ *        pixels extended by the brick.
+ *
+ * Produces the same result as spreadInDirection() with dy_step == 0
+ * and a raster operation corresponding to spreading_color,
+ * but its cost doesn't depend on num_steps.  That makes it
+ * fast for sparse images.
+ */
+void spreadHorizontallyByRuns(
+    BinaryImage& dst, CoordinateSystem const& dst_cs,
+    QRect const& dst_relevant_rect,
+    BinaryImage const& src, CoordinateSystem const& src_cs,
+    int const dx_min, int const dy, int const num_steps,
+    BWColor const spreading_color)
+{
+    dst.fill(dst_relevant_rect, !spreading_color);
+
+    // dst_point = src_point + src_to_dst
+    QPoint const src_to_dst(src_cs.offsetTo(dst_cs));
+    int const x_offset = src_to_dst.x() + dx_min;
+
+    int const src_width = src.width();
+    int const src_height = src.height();
+    int const src_wpl = src.wordsPerLine();
+    int const dst_wpl = dst.wordsPerLine();
+    uint32_t const* const src_data = src.data();
+    uint32_t* const dst_data = dst.data();
+
+    // After XORing with this, spreading_color pixels become 1 bits.
+    uint32_t const invert = spreading_color == BLACK ? 0 : ~uint32_t(0);
+    int const last_word = (src_width - 1) >> 5;
+    uint32_t const last_word_mask = ~uint32_t(0) << (31 - ((src_width - 1) & 31));
+
+    int const rel_left = dst_relevant_rect.left();
+    int const rel_right = dst_relevant_rect.right();
+
+    #pragma omp parallel for
+    for (int y = dst_relevant_rect.top(); y <= dst_relevant_rect.bottom(); ++y) {
+        int const src_y = y - src_to_dst.y() - dy;
+        if (src_y < 0 || src_y >= src_height) {
+            continue;
+        }
+
+        uint32_t const* const src_line = src_data + src_y * src_wpl;
+        uint32_t* const dst_line = dst_data + y * dst_wpl;
+
+        // Extended runs may overlap, so we merge them before painting.
+        int pending_first = 0;
+        int pending_last = 0;
+        bool have_pending = false;
+
+        auto paint = [&](int first, int last) {
+            first = std::max(first, rel_left);
+            last = std::min(last, rel_right);
+            if (first <= last) {
+                fillLineSpan(dst_line, first, last, spreading_color);
+            }
+        };
+
+        auto addRun = [&](int const src_first, int const src_last) {
+            int const first = src_first + x_offset;
+            int const last = src_last + x_offset + num_steps - 1;
+            if (have_pending && first <= pending_last + 1) {
+                pending_last = last;
+            } else {
+                if (have_pending) {
+                    paint(pending_first, pending_last);
+                }
+                pending_first = first;
+                pending_last = last;
+                have_pending = true;
+            }
+        };
+
+        int run_start = -1;
+        for (int w = 0; w <= last_word; ++w) {
+            uint32_t word = src_line[w] ^ invert;
+            if (w == last_word) {
+                word &= last_word_mask;
+            }
+
+            int const x0 = w << 5;
+            if (word == 0) {
+                if (run_start >= 0) {
+                    addRun(run_start, x0 - 1);
+                    run_start = -1;
+                }
+                continue;
+            }
+            if (word == ~uint32_t(0)) {
+                if (run_start < 0) {
+                    run_start = x0;
+                }
+                continue;
+            }
+
+            for (int bit = 0; bit < 32; ++bit) {
+                if ((word >> (31 - bit)) & 1) {
+                    if (run_start < 0) {
+                        run_start = x0 + bit;
+                    }
+                } else if (run_start >= 0) {
+                    addRun(run_start, x0 + bit - 1);
+                    run_start = -1;
+                }
+            }
+        }
+        if (run_start >= 0) {
+            addRun(run_start, src_width - 1);
+        }
+        if (have_pending) {
+            paint(pending_first, pending_last);
+        }
+    }
+}
+
 void dilateOrErodeBrick(
     BinaryImage& dst, BinaryImage const& src, Brick const& brick,
     QRect const& dst_area, BWColor const src_surroundings,
@@ -418,13 +622,22 @@ void dilateOrErodeBrick(
     // image data is already in CPU cache.
     ReusableImages tmp_images;
 
+    bool const by_runs = preferSpreadingByRuns(src, brick.width(), spreading_color);
+
     if (brick.minY() == brick.maxY()) {
-        spreadInDirection( // horizontal
-            dst, dst_cs, dst_relevant_rect, src, src_cs,
-            tmp_images, tmp_cs, tmp_image_rect.size(),
-            brick.minX(), 1, brick.minY(), 0, brick.width(),
-            rop, !spreading_color, false
-        );
+        if (by_runs) {
+            spreadHorizontallyByRuns(
+                dst, dst_cs, dst_relevant_rect, src, src_cs,
+                brick.minX(), brick.minY(), brick.width(), spreading_color
+            );
+        } else {
+            spreadInDirection( // horizontal
+                dst, dst_cs, dst_relevant_rect, src, src_cs,
+                tmp_images, tmp_cs, tmp_image_rect.size(),
+                brick.minX(), 1, brick.minY(), 0, brick.width(),
+                rop, !spreading_color, false
+            );
+        }
     } else if (brick.minX() == brick.maxX()) {
         spreadInDirection( // vertical
             dst, dst_cs, dst_relevant_rect, src, src_cs,
@@ -434,12 +647,19 @@ void dilateOrErodeBrick(
         );
     } else {
         BinaryImage tmp(tmp_area.size());
-        spreadInDirection( // horizontal
-            tmp, tmp_cs, tmp_image_rect, src, src_cs,
-            tmp_images, tmp_cs, tmp_image_rect.size(),
-            brick.minX(), 1, brick.minY(), 0, brick.width(),
-            rop, !spreading_color, true
-        );
+        if (by_runs) {
+            spreadHorizontallyByRuns(
+                tmp, tmp_cs, tmp_image_rect, src, src_cs,
+                brick.minX(), brick.minY(), brick.width(), spreading_color
+            );
+        } else {
+            spreadInDirection( // horizontal
+                tmp, tmp_cs, tmp_image_rect, src, src_cs,
+                tmp_images, tmp_cs, tmp_image_rect.size(),
+                brick.minX(), 1, brick.minY(), 0, brick.width(),
+                rop, !spreading_color, true
+            );
+        }
 
         spreadInDirection( // vertical
             dst, dst_cs, dst_relevant_rect, tmp, tmp_cs,
@@ -461,6 +681,13 @@ public:
     {
         return std::min(v1, v2);
     }
+
+#ifdef MORPHOLOGY_USE_SSE2
+    static __m128i select(__m128i v1, __m128i v2)
+    {
+        return _mm_min_epu8(v1, v2);
+    }
+#endif
 };
 
 class Lighter
@@ -470,8 +697,39 @@ public:
     {
         return std::max(v1, v2);
     }
+
+#ifdef MORPHOLOGY_USE_SSE2
+    static __m128i select(__m128i v1, __m128i v2)
+    {
+        return _mm_max_epu8(v1, v2);
+    }
+#endif
 };
 
+/**
+ * \brief dst[i] = MinOrMax::select(src1[i], src2[i]) for i in [0, len)
+ *
+ * dst may not overlap src2, but may be the same as src1.
+ */
+template<typename MinOrMax>
+void selectSpan(
+    uint8_t* dst, uint8_t const* src1, uint8_t const* src2, int const len)
+{
+    int i = 0;
+
+#ifdef MORPHOLOGY_USE_SSE2
+    for (; i + 16 <= len; i += 16) {
+        __m128i const v1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src1 + i));
+        __m128i const v2 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src2 + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), MinOrMax::select(v1, v2));
+    }
+#endif
+
+    for (; i < len; ++i) {
+        dst[i] = MinOrMax::select(src1[i], src2[i]);
+    }
+}
+
 template<typename MinOrMax>
 void fillExtremumArrayLeftHalf(
     uint8_t* dst, uint8_t const* const src_center, int const src_delta,
@@ -513,51 +771,60 @@ void spreadGrayHorizontal(
 {
     int const src_stride = src.stride();
     int const dst_stride = dst.stride();
-    uint8_t const* src_line = src.data() + dy * src_stride;
-    uint8_t* dst_line = dst.data();
+    uint8_t const* const src_data = src.data() + dy * src_stride;
+    uint8_t* const dst_data = dst.data();
 
     int const dst_width = dst.width();
     int const dst_height = dst.height();
 
     int const se_len = dx2 - dx1 + 1;
 
-    std::vector<uint8_t> min_max_array(se_len * 2 - 1, 0);
-    uint8_t* const array_center = &min_max_array[se_len - 1];
-
-    for (int y = 0; y < dst_height; ++y) {
-        for (int dst_segment_first = 0; dst_segment_first < dst_width;
-                dst_segment_first += se_len) {
-            int const dst_segment_last = std::min(
-                                             dst_segment_first + se_len, dst_width
-                                         ) - 1; // inclusive
-            int const src_segment_first = dst_segment_first + dx1;
-            int const src_segment_last = dst_segment_last + dx2;
-            int const src_segment_center =
-                (src_segment_first + src_segment_last) >> 1;
-
-            fillExtremumArrayLeftHalf<MinOrMax>(
-                array_center, src_line + src_segment_center, 1,
-                src_segment_first, src_segment_center
-            );
+    // Lines are independent, so we process them in parallel.
+    // Within a line, extremum arrays have to be built sequentially,
+    // but the final selection is done in SIMD blocks.
+    #pragma omp parallel
+    {
+        std::vector<uint8_t> min_max_array(se_len * 2 - 1, 0);
+        uint8_t* const array_center = &min_max_array[se_len - 1];
+
+        #pragma omp for
+        for (int y = 0; y < dst_height; ++y) {
+            uint8_t const* const src_line = src_data + y * src_stride;
+            uint8_t* const dst_line = dst_data + y * dst_stride;
+
+            for (int dst_segment_first = 0; dst_segment_first < dst_width;
+                    dst_segment_first += se_len) {
+                int const dst_segment_last = std::min(
+                                                 dst_segment_first + se_len, dst_width
+                                             ) - 1; // inclusive
+                int const src_segment_first = dst_segment_first + dx1;
+                int const src_segment_last = dst_segment_last + dx2;
+                int const src_segment_center =
+                    (src_segment_first + src_segment_last) >> 1;
+
+                fillExtremumArrayLeftHalf<MinOrMax>(
+                    array_center, src_line + src_segment_center, 1,
+                    src_segment_first, src_segment_center
+                );
 
-            fillExtremumArrayRightHalf<MinOrMax>(
-                array_center, src_line + src_segment_center, 1,
-                src_segment_center, src_segment_last
-            );
+                fillExtremumArrayRightHalf<MinOrMax>(
+                    array_center, src_line + src_segment_center, 1,
+                    src_segment_center, src_segment_last
+                );
 
-            for (int x = dst_segment_first; x <= dst_segment_last; ++x) {
-                int const src_first = x + dx1;
-                int const src_last = x + dx2; // inclusive
-                assert(src_segment_center >= src_first);
-                assert(src_segment_center <= src_last);
-                uint8_t v1 = array_center[src_first - src_segment_center];
-                uint8_t v2 = array_center[src_last - src_segment_center];
-                dst_line[x] = MinOrMax::select(v1, v2);
+                // dst_line[x] is a selection between
+                // array_center[x + dx1 - src_segment_center] and
+                // array_center[x + dx2 - src_segment_center].
+                assert(src_segment_center >= dst_segment_last + dx1);
+                assert(src_segment_center <= dst_segment_first + dx2);
+                selectSpan<MinOrMax>(
+                    dst_line + dst_segment_first,
+                    array_center + (src_segment_first - src_segment_center),
+                    array_center + (dst_segment_first + dx2 - src_segment_center),
+                    dst_segment_last - dst_segment_first + 1
+                );
             }
         }
-
-        src_line += src_stride;
-        dst_line += dst_stride;
     }
 }
 
@@ -590,41 +857,74 @@ void spreadGrayVertical(
     int const dst_height = dst.height();
 
     int const se_len = dy2 - dy1 + 1;
+    int const num_array_lines = se_len * 2 - 1;
 
-    std::vector<uint8_t> min_max_array(se_len * 2 - 1, 0);
-    uint8_t* const array_center = &min_max_array[se_len - 1];
-
-    for (int x = 0; x < dst_width; ++x) {
-        for (int dst_segment_first = 0; dst_segment_first < dst_height;
-                dst_segment_first += se_len) {
-            int const dst_segment_last = std::min(
-                                             dst_segment_first + se_len, dst_height
-                                         ) - 1; // inclusive
-            int const src_segment_first = dst_segment_first + dy1;
-            int const src_segment_last = dst_segment_last + dy2;
-            int const src_segment_center =
-                (src_segment_first + src_segment_last) >> 1;
-
-            fillExtremumArrayLeftHalf<MinOrMax>(
-                array_center, src_data + x + src_segment_center * src_stride,
-                src_stride, src_segment_first, src_segment_center
-            );
+    // Same as spreadGrayHorizontal(), except extremum arrays consist of
+    // whole lines, so that we walk the image line by line and select
+    // extremums in SIMD blocks.  To keep those lines in cache, we process
+    // the image in vertical strips, which also go in parallel.
+    int const max_strip_width = std::max(64, ((256 * 1024) / num_array_lines) & ~15);
+    int const strip_width = std::min(dst_width, max_strip_width);
+    int const num_strips = (dst_width + strip_width - 1) / strip_width;
 
-            fillExtremumArrayRightHalf<MinOrMax>(
-                array_center, src_data + x + src_segment_center * src_stride,
-                src_stride, src_segment_center, src_segment_last
-            );
-
-            uint8_t* dst = dst_data + x + dst_segment_first * dst_stride;
-            for (int y = dst_segment_first; y <= dst_segment_last; ++y) {
-                int const src_first = y + dy1;
-                int const src_last = y + dy2; // inclusive
-                assert(src_segment_center >= src_first);
-                assert(src_segment_center <= src_last);
-                uint8_t v1 = array_center[src_first - src_segment_center];
-                uint8_t v2 = array_center[src_last - src_segment_center];
-                *dst = MinOrMax::select(v1, v2);
-                dst += dst_stride;
+    #pragma omp parallel
+    {
+        std::vector<uint8_t> min_max_lines(num_array_lines * strip_width, 0);
+
+        // Line i of the array is at array_center + i * strip_width,
+        // for i in [-(se_len - 1), se_len - 1].
+        uint8_t* const array_center = &min_max_lines[(se_len - 1) * strip_width];
+
+        #pragma omp for
+        for (int strip = 0; strip < num_strips; ++strip) {
+            int const x0 = strip * strip_width;
+            int const width = std::min(strip_width, dst_width - x0);
+
+            for (int dst_segment_first = 0; dst_segment_first < dst_height;
+                    dst_segment_first += se_len) {
+                int const dst_segment_last = std::min(
+                                                 dst_segment_first + se_len, dst_height
+                                             ) - 1; // inclusive
+                int const src_segment_first = dst_segment_first + dy1;
+                int const src_segment_last = dst_segment_last + dy2;
+                int const src_segment_center =
+                    (src_segment_first + src_segment_last) >> 1;
+
+                uint8_t const* const src_center_line =
+                    src_data + src_segment_center * src_stride + x0;
+
+                memcpy(array_center, src_center_line, width);
+
+                uint8_t const* src_line = src_center_line;
+                uint8_t* array_line = array_center;
+                for (int i = src_segment_center - 1; i >= src_segment_first; --i) {
+                    src_line -= src_stride;
+                    array_line -= strip_width;
+                    selectSpan<MinOrMax>(array_line, array_line + strip_width, src_line, width);
+                }
+
+                src_line = src_center_line;
+                array_line = array_center;
+                for (int i = src_segment_center + 1; i <= src_segment_last; ++i) {
+                    src_line += src_stride;
+                    array_line += strip_width;
+                    selectSpan<MinOrMax>(array_line, array_line - strip_width, src_line, width);
+                }
+
+                uint8_t* dst_line = dst_data + dst_segment_first * dst_stride + x0;
+                for (int y = dst_segment_first; y <= dst_segment_last; ++y) {
+                    int const src_first = y + dy1;
+                    int const src_last = y + dy2; // inclusive
+                    assert(src_segment_center >= src_first);
+                    assert(src_segment_center <= src_last);
+                    selectSpan<MinOrMax>(
+                        dst_line,
+                        array_center + (src_first - src_segment_center) * strip_width,
+                        array_center + (src_last - src_segment_center) * strip_width,
+                        width
+                    );
+                    dst_line += dst_stride;
+                }
             }
         }
     }
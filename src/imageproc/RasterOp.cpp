@@ -0,0 +1,235 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RasterOp.h"
+#include "RasterOpEngine.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGEPROC_ROP_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(IMAGEPROC_ROP_AVX2) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace imageproc
+{
+
+namespace rop_engine
+{
+
+namespace
+{
+
+struct ScalarOps
+{
+    typedef uint32_t Block;
+
+    enum { BLOCK_WORDS = 1 };
+
+    static Block load(uint32_t const* p)
+    {
+        return *p;
+    }
+
+    static void store(uint32_t* p, Block b)
+    {
+        *p = b;
+    }
+
+    static Block zeros()
+    {
+        return 0;
+    }
+
+    static Block bitNot(Block a)
+    {
+        return ~a;
+    }
+
+    static Block bitAnd(Block a, Block b)
+    {
+        return a & b;
+    }
+
+    /** \brief Computes ~a & b. */
+    static Block andNot(Block a, Block b)
+    {
+        return ~a & b;
+    }
+
+    static Block bitOr(Block a, Block b)
+    {
+        return a | b;
+    }
+
+    static Block bitXor(Block a, Block b)
+    {
+        return a ^ b;
+    }
+
+    static Block shiftLeft(Block a, int bits)
+    {
+        return a << bits;
+    }
+
+    static Block shiftRight(Block a, int bits)
+    {
+        return a >> bits;
+    }
+};
+
+#ifdef IMAGEPROC_ROP_SSE2
+struct Sse2Ops
+{
+    typedef __m128i Block;
+
+    enum { BLOCK_WORDS = 4 };
+
+    static Block load(uint32_t const* p)
+    {
+        return _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+    }
+
+    static void store(uint32_t* p, Block const& b)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), b);
+    }
+
+    static Block zeros()
+    {
+        return _mm_setzero_si128();
+    }
+
+    static Block bitNot(Block const& a)
+    {
+        return _mm_xor_si128(a, _mm_set1_epi32(-1));
+    }
+
+    static Block bitAnd(Block const& a, Block const& b)
+    {
+        return _mm_and_si128(a, b);
+    }
+
+    /** \brief Computes ~a & b. */
+    static Block andNot(Block const& a, Block const& b)
+    {
+        return _mm_andnot_si128(a, b);
+    }
+
+    static Block bitOr(Block const& a, Block const& b)
+    {
+        return _mm_or_si128(a, b);
+    }
+
+    static Block bitXor(Block const& a, Block const& b)
+    {
+        return _mm_xor_si128(a, b);
+    }
+
+    static Block shiftLeft(Block const& a, int bits)
+    {
+        return _mm_sll_epi32(a, _mm_cvtsi32_si128(bits));
+    }
+
+    static Block shiftRight(Block const& a, int bits)
+    {
+        return _mm_srl_epi32(a, _mm_cvtsi32_si128(bits));
+    }
+};
+#endif // IMAGEPROC_ROP_SSE2
+
+#ifdef IMAGEPROC_ROP_AVX2
+bool detectAvx2()
+{
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#elif defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) {
+        return false;
+    }
+
+    // The CPU has to support AVX, and the OS has to save YMM registers.
+    __cpuid(regs, 1);
+    bool const osxsave = (regs[2] & (1 << 27)) != 0;
+    bool const avx = (regs[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool const cpuHasAvx2 = detectAvx2();
+#endif // IMAGEPROC_ROP_AVX2
+
+} // anonymous namespace
+
+} // namespace rop_engine
+
+namespace detail
+{
+
+void rasterOpWords(
+    uint32_t* dst, uint32_t const* src, int const num_words,
+    int const src_word1_shift, int const src_word2_shift,
+    unsigned const truth_table)
+{
+    using namespace rop_engine;
+
+    if (num_words <= 0) {
+        return;
+    }
+
+    int done = 0;
+
+#ifdef IMAGEPROC_ROP_AVX2
+    if (cpuHasAvx2) {
+        done = processBlocksAvx2(
+                   truth_table, dst, src, num_words,
+                   src_word1_shift, src_word2_shift
+               );
+    }
+#endif
+
+#ifdef IMAGEPROC_ROP_SSE2
+    done += processBlocks<Sse2Ops>(
+                truth_table, dst + done, src + done, num_words - done,
+                src_word1_shift, src_word2_shift
+            );
+#endif
+
+    processBlocks<ScalarOps>(
+        truth_table, dst + done, src + done, num_words - done,
+        src_word1_shift, src_word2_shift
+    );
+}
+
+} // namespace detail
+
+} // namespace imageproc
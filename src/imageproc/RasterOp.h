@@ -218,6 +218,40 @@ public:
 namespace detail
 {
 
+/**
+ * \brief Applies a bitwise raster operation to a run of whole words.
+ *
+ * Processes blocks of words with the widest SIMD instructions
+ * the CPU supports, picked at runtime.
+ *
+ * \param dst The words to write, left to right.
+ * \param src The corresponding source words.  If src_word1_shift is
+ *        non-zero, the source word for dst[i] is
+ *        (src[i] << src_word1_shift) | (src[i + 1] >> src_word2_shift).
+ * \param truth_table As returned by ropTruthTable().
+ */
+void rasterOpWords(
+    uint32_t* dst, uint32_t const* src, int num_words,
+    int src_word1_shift, int src_word2_shift, unsigned truth_table);
+
+/**
+ * \brief Describes a raster operation by its results for the four
+ *        combinations of src and dst bits.
+ *
+ * Bit (src_bit << 1 | dst_bit) of the result is Rop's output for those
+ * inputs.  All the Rop* classes are bitwise, but a user-provided
+ * operation may not be, in which case -1 is returned.
+ */
+template<typename Rop>
+int ropTruthTable()
+{
+    uint32_t const res = Rop::transform(0xCCCCCCCCu, 0xAAAAAAAAu);
+    if (res != (res & 0x0F) * 0x11111111u) {
+        return -1;
+    }
+    return int(res & 0x0F);
+}
+
 template<typename Rop>
 void rasterOpInDirection(
     BinaryImage& dst, QRect const& dr,
@@ -268,6 +302,13 @@ void rasterOpInDirection(
 
     const bool canBeParalleled = dst.data() != src.data();
 
+    // Whole words in the middle of a line go to rasterOpWords(), which reads
+    // a block of src words before writing dst ones.  That's only safe when
+    // going left to right, as in that direction src words of the same line
+    // are never to the left of dst words.
+    int const truth_table = ropTruthTable<Rop>();
+    bool const use_word_engine = dx == 1 && truth_table >= 0;
+
     int src_word1_shift;
     int src_word2_shift;
     if (src_start_bit > dst_start_bit) {
@@ -306,10 +347,18 @@ void rasterOpInDirection(
                 uint32_t new_dst_word = Rop::transform(src_word, dst_word);
                 dst_span_loc[widx] = (dst_word & ~first_dst_mask) | (new_dst_word & first_dst_mask);
 
-                while ((widx += dx) != last_dst_word) {
-                    src_word = src_span_loc[widx];
-                    dst_word = dst_span_loc[widx];
-                    dst_span_loc[widx] = Rop::transform(src_word, dst_word);
+                if (use_word_engine) {
+                    rasterOpWords(
+                        dst_span_loc + 1, src_span_loc + 1, last_dst_word - 1,
+                        0, 0, truth_table
+                    );
+                    widx = last_dst_word;
+                } else {
+                    while ((widx += dx) != last_dst_word) {
+                        src_word = src_span_loc[widx];
+                        dst_word = dst_span_loc[widx];
+                        dst_span_loc[widx] = Rop::transform(src_word, dst_word);
+                    }
                 }
 
                 // Handle the last (possibly incomplete) dst word in the line.
@@ -370,18 +419,28 @@ void rasterOpInDirection(
             uint32_t new_dst_word = Rop::transform(src_word, dst_word);
             new_dst_word = (dst_word & ~first_dst_mask) | (new_dst_word & first_dst_mask);
 
-            while ((widx += dx) != last_dst_word) {
-                uint32_t const src_word1 = src_span_loc[widx];
-                uint32_t const src_word2 = src_span_loc[widx + 1];
+            if (use_word_engine) {
+                // No need to delay writing when going left to right.
+                dst_span_loc[widx] = new_dst_word;
+                rasterOpWords(
+                    dst_span_loc + 1, src_span_loc + 1, last_dst_word - 1,
+                    src_word1_shift, src_word2_shift, truth_table
+                );
+                widx = last_dst_word;
+            } else {
+                while ((widx += dx) != last_dst_word) {
+                    uint32_t const src_word1 = src_span_loc[widx];
+                    uint32_t const src_word2 = src_span_loc[widx + 1];
 
-                dst_word = dst_span_loc[widx];
-                dst_span_loc[widx - dx] = new_dst_word;
+                    dst_word = dst_span_loc[widx];
+                    dst_span_loc[widx - dx] = new_dst_word;
 
-                new_dst_word = Rop::transform(
-                                   (src_word1 << src_word1_shift) |
-                                   (src_word2 >> src_word2_shift),
-                                   dst_word
-                               );
+                    new_dst_word = Rop::transform(
+                                       (src_word1 << src_word1_shift) |
+                                       (src_word2 >> src_word2_shift),
+                                       dst_word
+                                   );
+                }
             }
 
             // Handle the last (possibly incomplete) dst word in the line.
@@ -396,7 +455,9 @@ void rasterOpInDirection(
             }
 
             dst_word = dst_span_loc[widx];
-            dst_span_loc[widx - dx] = new_dst_word;
+            if (!use_word_engine) {
+                dst_span_loc[widx - dx] = new_dst_word;
+            }
 
             new_dst_word = Rop::transform(src_word, dst_word);
             new_dst_word = (dst_word & ~last_dst_mask) | (new_dst_word & last_dst_mask);
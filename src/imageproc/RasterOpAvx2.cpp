@@ -0,0 +1,117 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// This file is compiled with AVX2 enabled.  Don't include anything
+// that may define non-template inline functions used elsewhere,
+// as the linker could pick their AVX2 versions for the whole program.
+
+#include "RasterOpEngine.h"
+
+#ifdef IMAGEPROC_ROP_AVX2
+
+#include <immintrin.h>
+
+namespace imageproc
+{
+
+namespace rop_engine
+{
+
+namespace
+{
+
+struct Avx2Ops
+{
+    typedef __m256i Block;
+
+    enum { BLOCK_WORDS = 8 };
+
+    static Block load(uint32_t const* p)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+    }
+
+    static void store(uint32_t* p, Block const& b)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), b);
+    }
+
+    static Block zeros()
+    {
+        return _mm256_setzero_si256();
+    }
+
+    static Block bitNot(Block const& a)
+    {
+        return _mm256_xor_si256(a, _mm256_set1_epi32(-1));
+    }
+
+    static Block bitAnd(Block const& a, Block const& b)
+    {
+        return _mm256_and_si256(a, b);
+    }
+
+    /** \brief Computes ~a & b. */
+    static Block andNot(Block const& a, Block const& b)
+    {
+        return _mm256_andnot_si256(a, b);
+    }
+
+    static Block bitOr(Block const& a, Block const& b)
+    {
+        return _mm256_or_si256(a, b);
+    }
+
+    static Block bitXor(Block const& a, Block const& b)
+    {
+        return _mm256_xor_si256(a, b);
+    }
+
+    static Block shiftLeft(Block const& a, int bits)
+    {
+        return _mm256_sll_epi32(a, _mm_cvtsi32_si128(bits));
+    }
+
+    static Block shiftRight(Block const& a, int bits)
+    {
+        return _mm256_srl_epi32(a, _mm_cvtsi32_si128(bits));
+    }
+};
+
+} // anonymous namespace
+
+int processBlocksAvx2(
+    unsigned const truth_table, uint32_t* dst, uint32_t const* src,
+    int const num_words, int const src_word1_shift, int const src_word2_shift)
+{
+    int const processed = processBlocks<Avx2Ops>(
+                              truth_table, dst, src, num_words,
+                              src_word1_shift, src_word2_shift
+                          );
+
+    // Avoid AVX-SSE transition penalties in the code that follows.
+    _mm256_zeroupper();
+
+    return processed;
+}
+
+} // namespace rop_engine
+
+} // namespace imageproc
+
+#endif // IMAGEPROC_ROP_AVX2
@@ -0,0 +1,172 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGEPROC_RASTEROP_ENGINE_H_
+#define IMAGEPROC_RASTEROP_ENGINE_H_
+
+// This header is internal to RasterOp*.cpp.  It has to stay free
+// of anything but plain declarations and templates instantiated
+// for a particular instruction set, as it's also compiled with
+// instruction set flags the CPU may not support.
+
+#include <stdint.h>
+
+namespace imageproc
+{
+
+namespace rop_engine
+{
+
+/**
+ * \brief Evaluates a bitwise function of src and dst given by its truth table.
+ *
+ * Bit (src_bit << 1 | dst_bit) of TruthTable is the result for those inputs.
+ * Ops provides the operations on blocks of words for a particular
+ * instruction set.
+ */
+template<unsigned TruthTable, typename Ops>
+inline typename Ops::Block evaluate(
+    typename Ops::Block const& s, typename Ops::Block const& d)
+{
+    switch (TruthTable) {
+    case 0x0:
+        return Ops::zeros();
+    case 0x1:
+        return Ops::bitNot(Ops::bitOr(s, d));
+    case 0x2:
+        return Ops::andNot(s, d);
+    case 0x3:
+        return Ops::bitNot(s);
+    case 0x4:
+        return Ops::andNot(d, s);
+    case 0x5:
+        return Ops::bitNot(d);
+    case 0x6:
+        return Ops::bitXor(s, d);
+    case 0x7:
+        return Ops::bitNot(Ops::bitAnd(s, d));
+    case 0x8:
+        return Ops::bitAnd(s, d);
+    case 0x9:
+        return Ops::bitNot(Ops::bitXor(s, d));
+    case 0xA:
+        return d;
+    case 0xB:
+        return Ops::bitOr(Ops::bitNot(s), d);
+    case 0xC:
+        return s;
+    case 0xD:
+        return Ops::bitOr(s, Ops::bitNot(d));
+    case 0xE:
+        return Ops::bitOr(s, d);
+    default:
+        return Ops::bitNot(Ops::zeros());
+    }
+}
+
+/**
+ * \brief Processes as many whole blocks of words as fit into num_words.
+ *
+ * \return The number of words processed.
+ * \see detail::rasterOpWords()
+ */
+template<unsigned TruthTable, typename Ops>
+int processBlocks(
+    uint32_t* dst, uint32_t const* src, int const num_words,
+    int const src_word1_shift, int const src_word2_shift)
+{
+    typedef typename Ops::Block Block;
+    int const block_words = Ops::BLOCK_WORDS;
+
+    int i = 0;
+    if (src_word1_shift == 0) {
+        for (; i + block_words <= num_words; i += block_words) {
+            Block const s(Ops::load(src + i));
+            Block const d(Ops::load(dst + i));
+            Ops::store(dst + i, evaluate<TruthTable, Ops>(s, d));
+        }
+    } else {
+        for (; i + block_words <= num_words; i += block_words) {
+            Block const s(
+                Ops::bitOr(
+                    Ops::shiftLeft(Ops::load(src + i), src_word1_shift),
+                    Ops::shiftRight(Ops::load(src + i + 1), src_word2_shift)
+                )
+            );
+            Block const d(Ops::load(dst + i));
+            Ops::store(dst + i, evaluate<TruthTable, Ops>(s, d));
+        }
+    }
+
+    return i;
+}
+
+/**
+ * \brief Dispatches to processBlocks() instantiated for the given truth table.
+ */
+template<typename Ops>
+int processBlocks(
+    unsigned const truth_table, uint32_t* dst, uint32_t const* src,
+    int const num_words, int const src_word1_shift, int const src_word2_shift)
+{
+#define ROP_ENGINE_CASE(tt) \
+    case tt: \
+        return processBlocks<tt, Ops>( \
+                   dst, src, num_words, src_word1_shift, src_word2_shift \
+               );
+
+    switch (truth_table) {
+        ROP_ENGINE_CASE(0x0)
+        ROP_ENGINE_CASE(0x1)
+        ROP_ENGINE_CASE(0x2)
+        ROP_ENGINE_CASE(0x3)
+        ROP_ENGINE_CASE(0x4)
+        ROP_ENGINE_CASE(0x5)
+        ROP_ENGINE_CASE(0x6)
+        ROP_ENGINE_CASE(0x7)
+        ROP_ENGINE_CASE(0x8)
+        ROP_ENGINE_CASE(0x9)
+        ROP_ENGINE_CASE(0xB)
+        ROP_ENGINE_CASE(0xC)
+        ROP_ENGINE_CASE(0xD)
+        ROP_ENGINE_CASE(0xE)
+        ROP_ENGINE_CASE(0xF)
+    default:
+        // 0xA leaves dst as it is.
+        return num_words;
+    }
+
+#undef ROP_ENGINE_CASE
+}
+
+#ifdef IMAGEPROC_ROP_AVX2
+/**
+ * \brief processBlocks() for 256-bit blocks.
+ *
+ * Only to be called if the CPU supports AVX2.
+ */
+int processBlocksAvx2(
+    unsigned truth_table, uint32_t* dst, uint32_t const* src,
+    int num_words, int src_word1_shift, int src_word2_shift);
+#endif
+
+} // namespace rop_engine
+
+} // namespace imageproc
+
+#endif
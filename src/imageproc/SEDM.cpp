@@ -30,9 +30,59 @@
 #include <math.h>
 #include <assert.h>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEDM_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace imageproc
 {
 
+namespace
+{
+
+/**
+ * Columns are processed in strips of this many columns, so that the
+ * vertical passes walk memory line by line rather than column by column.
+ */
+int const COLUMN_STRIP = 64;
+
+#ifdef SEDM_USE_SSE2
+inline __m128i maxU32(__m128i const a, __m128i const b)
+{
+    // SSE2 only has signed comparisons.
+    __m128i const sign = _mm_set1_epi32(0x80000000);
+    __m128i const a_gt_b = _mm_cmpgt_epi32(
+        _mm_xor_si128(a, sign), _mm_xor_si128(b, sign)
+    );
+    return _mm_or_si128(_mm_and_si128(a_gt_b, a), _mm_andnot_si128(a_gt_b, b));
+}
+#endif
+
+/**
+ * dst[i] = max(src1[i], src2[i], src3[i]) for i in [0, count).
+ */
+void max3Lines(
+    uint32_t const* src1, uint32_t const* src2,
+    uint32_t const* src3, uint32_t* dst, int const count)
+{
+    int i = 0;
+#ifdef SEDM_USE_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128i const v1 = _mm_loadu_si128((__m128i const*)(src1 + i));
+        __m128i const v2 = _mm_loadu_si128((__m128i const*)(src2 + i));
+        __m128i const v3 = _mm_loadu_si128((__m128i const*)(src3 + i));
+        _mm_storeu_si128((__m128i*)(dst + i), maxU32(v1, maxU32(v2, v3)));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = std::max(src1[i], std::max(src2[i], src3[i]));
+    }
+}
+
+} // anonymous namespace
+
 // Note that -1 is an implementation detail.
 // It exists to make sure INF_DIST + 1 doesn't overflow.
 uint32_t const SEDM::INF_DIST = ~uint32_t(0) - 1;
@@ -236,31 +286,45 @@ SEDM::processColumns()
 {
     int const width = m_size.width() + 2;
     int const height = m_size.height() + 2;
+    int const num_strips = (width + COLUMN_STRIP - 1) / COLUMN_STRIP;
+    uint32_t* const data = &m_data[0];
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int strip = 0; strip < num_strips; ++strip) {
+        int const x0 = strip * COLUMN_STRIP;
+        int const strip_width = std::min(COLUMN_STRIP, width - x0);
 
-    uint32_t* p_sqd = &m_data[0];
-    for (int x = 0; x < width; ++x, ++p_sqd) {
         // (d + 1)^2 = d^2 + 2d + 1
-        uint32_t b = 1; // 2d + 1 in the above formula.
+        uint32_t b[COLUMN_STRIP]; // 2d + 1 in the above formula, per column.
+
+        std::fill(b, b + strip_width, 1);
+        uint32_t* line = data + x0;
         for (int todo = height - 1; todo > 0; --todo) {
-            uint32_t const sqd = *p_sqd + b;
-            p_sqd += width;
-            if (*p_sqd > sqd) {
-                *p_sqd = sqd;
-                b += 2;
-            } else {
-                b = 1;
+            uint32_t const* const prev_line = line;
+            line += width;
+            for (int i = 0; i < strip_width; ++i) {
+                uint32_t const sqd = prev_line[i] + b[i];
+                if (line[i] > sqd) {
+                    line[i] = sqd;
+                    b[i] += 2;
+                } else {
+                    b[i] = 1;
+                }
             }
         }
 
-        b = 1;
+        std::fill(b, b + strip_width, 1);
         for (int todo = height - 1; todo > 0; --todo) {
-            uint32_t const sqd = *p_sqd + b;
-            p_sqd -= width;
-            if (*p_sqd > sqd) {
-                *p_sqd = sqd;
-                b += 2;
-            } else {
-                b = 1;
+            uint32_t const* const prev_line = line;
+            line -= width;
+            for (int i = 0; i < strip_width; ++i) {
+                uint32_t const sqd = prev_line[i] + b[i];
+                if (line[i] > sqd) {
+                    line[i] = sqd;
+                    b[i] += 2;
+                } else {
+                    b[i] = 1;
+                }
             }
         }
     }
@@ -271,36 +335,53 @@ SEDM::processColumns(ConnectivityMap& cmap)
 {
     int const width = m_size.width() + 2;
     int const height = m_size.height() + 2;
+    int const num_strips = (width + COLUMN_STRIP - 1) / COLUMN_STRIP;
+    uint32_t* const data = &m_data[0];
+    uint32_t* const labels = cmap.paddedData();
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int strip = 0; strip < num_strips; ++strip) {
+        int const x0 = strip * COLUMN_STRIP;
+        int const strip_width = std::min(COLUMN_STRIP, width - x0);
 
-    uint32_t* p_sqd = &m_data[0];
-    uint32_t* p_label = cmap.paddedData();
-    for (int x = 0; x < width; ++x, ++p_sqd, ++p_label) {
         // (d + 1)^2 = d^2 + 2d + 1
-        uint32_t b = 1; // 2d + 1 in the above formula.
+        uint32_t b[COLUMN_STRIP]; // 2d + 1 in the above formula, per column.
+
+        std::fill(b, b + strip_width, 1);
+        uint32_t* line = data + x0;
+        uint32_t* label_line = labels + x0;
         for (int todo = height - 1; todo > 0; --todo) {
-            uint32_t const sqd = *p_sqd + b;
-            p_sqd += width;
-            p_label += width;
-            if (sqd < *p_sqd) {
-                *p_sqd = sqd;
-                *p_label = p_label[-width];
-                b += 2;
-            } else {
-                b = 1;
+            uint32_t const* const prev_line = line;
+            uint32_t const* const prev_label_line = label_line;
+            line += width;
+            label_line += width;
+            for (int i = 0; i < strip_width; ++i) {
+                uint32_t const sqd = prev_line[i] + b[i];
+                if (sqd < line[i]) {
+                    line[i] = sqd;
+                    label_line[i] = prev_label_line[i];
+                    b[i] += 2;
+                } else {
+                    b[i] = 1;
+                }
             }
         }
 
-        b = 1;
+        std::fill(b, b + strip_width, 1);
         for (int todo = height - 1; todo > 0; --todo) {
-            uint32_t const sqd = *p_sqd + b;
-            p_sqd -= width;
-            p_label -= width;
-            if (sqd < *p_sqd) {
-                *p_sqd = sqd;
-                *p_label = p_label[width];
-                b += 2;
-            } else {
-                b = 1;
+            uint32_t const* const prev_line = line;
+            uint32_t const* const prev_label_line = label_line;
+            line -= width;
+            label_line -= width;
+            for (int i = 0; i < strip_width; ++i) {
+                uint32_t const sqd = prev_line[i] + b[i];
+                if (sqd < line[i]) {
+                    line[i] = sqd;
+                    label_line[i] = prev_label_line[i];
+                    b[i] += 2;
+                } else {
+                    b[i] = 1;
+                }
             }
         }
     }
@@ -312,46 +393,52 @@ SEDM::processRows()
     int const width = m_size.width() + 2;
     int const height = m_size.height() + 2;
 
-    std::vector<int> s(width, 0);
-    std::vector<int> t(width, 0);
-    std::vector<uint32_t> row_copy(width, 0);
-
-    uint32_t* line = &m_data[0];
-    for (int y = 0; y < height; ++y, line += width) {
-        int q = 0;
-        s[0] = 0;
-        t[0] = 0;
-        for (int x = 1; x < width; ++x) {
-            while (q >= 0 && distSq(t[q], s[q], line[s[q]])
-                    > distSq(t[q], x, line[x])) {
-                --q;
-            }
+    uint32_t* const data = &m_data[0];
+
+    #pragma omp parallel
+    {
+        std::vector<int> s(width, 0);
+        std::vector<int> t(width, 0);
+        std::vector<uint32_t> row_copy(width, 0);
+
+        #pragma omp for
+        for (int y = 0; y < height; ++y) {
+            uint32_t* const line = data + y * width;
+            int q = 0;
+            s[0] = 0;
+            t[0] = 0;
+            for (int x = 1; x < width; ++x) {
+                while (q >= 0 && distSq(t[q], s[q], line[s[q]])
+                        > distSq(t[q], x, line[x])) {
+                    --q;
+                }
 
-            if (q < 0) {
-                q = 0;
-                s[0] = x;
-            } else {
-                int const x2 = s[q];
-                if (line[x] != INF_DIST && line[x2] != INF_DIST) {
-                    int w = (x * x + line[x]) - (x2 * x2 + line[x2]);
-                    w /= (x - x2) << 1;
-                    ++w;
-                    if ((unsigned)w < (unsigned)width) {
-                        ++q;
-                        s[q] = x;
-                        t[q] = w;
+                if (q < 0) {
+                    q = 0;
+                    s[0] = x;
+                } else {
+                    int const x2 = s[q];
+                    if (line[x] != INF_DIST && line[x2] != INF_DIST) {
+                        int w = (x * x + line[x]) - (x2 * x2 + line[x2]);
+                        w /= (x - x2) << 1;
+                        ++w;
+                        if ((unsigned)w < (unsigned)width) {
+                            ++q;
+                            s[q] = x;
+                            t[q] = w;
+                        }
                     }
                 }
             }
-        }
 
-        memcpy(&row_copy[0], line, width * sizeof(*line));
+            memcpy(&row_copy[0], line, width * sizeof(*line));
 
-        for (int x = width - 1; x >= 0; --x) {
-            int const x2 = s[q];
-            line[x] = distSq(x, x2, row_copy[x2]);
-            if (x == t[q]) {
-                --q;
+            for (int x = width - 1; x >= 0; --x) {
+                int const x2 = s[q];
+                line[x] = distSq(x, x2, row_copy[x2]);
+                if (x == t[q]) {
+                    --q;
+                }
             }
         }
     }
@@ -363,50 +450,57 @@ SEDM::processRows(ConnectivityMap& cmap)
     int const width = m_size.width() + 2;
     int const height = m_size.height() + 2;
 
-    std::vector<int> s(width, 0);
-    std::vector<int> t(width, 0);
-    std::vector<uint32_t> row_copy(width, 0);
-    std::vector<uint32_t> cmap_row_copy(width, 0);
-
-    uint32_t* line = &m_data[0];
-    uint32_t* cmap_line = cmap.paddedData();
-    for (int y = 0; y < height; ++y, line += width, cmap_line += width) {
-        int q = 0;
-        s[0] = 0;
-        t[0] = 0;
-        for (int x = 1; x < width; ++x) {
-            while (q >= 0 && distSq(t[q], s[q], line[s[q]])
-                    > distSq(t[q], x, line[x])) {
-                --q;
-            }
+    uint32_t* const data = &m_data[0];
+    uint32_t* const labels = cmap.paddedData();
+
+    #pragma omp parallel
+    {
+        std::vector<int> s(width, 0);
+        std::vector<int> t(width, 0);
+        std::vector<uint32_t> row_copy(width, 0);
+        std::vector<uint32_t> cmap_row_copy(width, 0);
+
+        #pragma omp for
+        for (int y = 0; y < height; ++y) {
+            uint32_t* const line = data + y * width;
+            uint32_t* const cmap_line = labels + y * width;
+            int q = 0;
+            s[0] = 0;
+            t[0] = 0;
+            for (int x = 1; x < width; ++x) {
+                while (q >= 0 && distSq(t[q], s[q], line[s[q]])
+                        > distSq(t[q], x, line[x])) {
+                    --q;
+                }
 
-            if (q < 0) {
-                q = 0;
-                s[0] = x;
-            } else {
-                int const x2 = s[q];
-                if (line[x] != INF_DIST && line[x2] != INF_DIST) {
-                    int w = (x * x + line[x]) - (x2 * x2 + line[x2]);
-                    w /= (x - x2) << 1;
-                    ++w;
-                    if ((unsigned)w < (unsigned)width) {
-                        ++q;
-                        s[q] = x;
-                        t[q] = w;
+                if (q < 0) {
+                    q = 0;
+                    s[0] = x;
+                } else {
+                    int const x2 = s[q];
+                    if (line[x] != INF_DIST && line[x2] != INF_DIST) {
+                        int w = (x * x + line[x]) - (x2 * x2 + line[x2]);
+                        w /= (x - x2) << 1;
+                        ++w;
+                        if ((unsigned)w < (unsigned)width) {
+                            ++q;
+                            s[q] = x;
+                            t[q] = w;
+                        }
                     }
                 }
             }
-        }
 
-        memcpy(&row_copy[0], line, width * sizeof(*line));
-        memcpy(&cmap_row_copy[0], cmap_line, width * sizeof(*cmap_line));
+            memcpy(&row_copy[0], line, width * sizeof(*line));
+            memcpy(&cmap_row_copy[0], cmap_line, width * sizeof(*cmap_line));
 
-        for (int x = width - 1; x >= 0; --x) {
-            int const x2 = s[q];
-            line[x] = distSq(x, x2, row_copy[x2]);
-            cmap_line[x] = cmap_row_copy[x2];
-            if (x == t[q]) {
-                --q;
+            for (int x = width - 1; x >= 0; --x) {
+                int const x2 = s[q];
+                line[x] = distSq(x, x2, row_copy[x2]);
+                cmap_line[x] = cmap_row_copy[x2];
+                if (x == t[q]) {
+                    --q;
+                }
             }
         }
     }
@@ -432,23 +526,21 @@ SEDM::buildEqualMapNonPadded(uint32_t const* src1, uint32_t const* src2) const
     int const height = m_size.height();
 
     BinaryImage dst(width, height, WHITE);
-    uint32_t* dst_line = dst.data();
+    uint32_t* const dst_data = dst.data(); // never call dst.data() inside omp
     int const dst_wpl = dst.wordsPerLine();
     int const src_stride = m_stride;
-    uint32_t const* src1_line = src1 + src_stride + 1;
-    uint32_t const* src2_line = src2 + src_stride + 1;
     uint32_t const msb = uint32_t(1) << 31;
 
+    #pragma omp parallel for
     for (int y = 0; y < height; ++y) {
+        uint32_t* const dst_line = dst_data + y * dst_wpl;
+        uint32_t const* const src1_line = src1 + (y + 1) * src_stride + 1;
+        uint32_t const* const src2_line = src2 + (y + 1) * src_stride + 1;
         for (int x = 0; x < width; ++x) {
-            if (std::max(src1_line[x], src2_line[x]) -
-                    std::min(src1_line[x], src2_line[x]) == 0) {
+            if (src1_line[x] == src2_line[x]) {
                 dst_line[x >> 5] |= msb >> (x & 31);
             }
         }
-        dst_line += dst_wpl;
-        src1_line += src_stride;
-        src2_line += src_stride;
     }
 
     return dst;
@@ -468,26 +560,19 @@ SEDM::max3x1(uint32_t const* src, uint32_t* dst) const
     int const width = m_size.width() + 2;
     int const height = m_size.height() + 2;
 
-    uint32_t const* src_line = &src[0];
-    uint32_t* dst_line = &dst[0];
-
+    #pragma omp parallel for
     for (int y = 0; y < height; ++y) {
+        uint32_t const* const src_line = src + y * width;
+        uint32_t* const dst_line = dst + y * width;
+
         // First column (no left neighbors).
-        int x = 0;
-        dst_line[x] = std::max(src_line[x], src_line[x + 1]);
-
-        for (++x; x < width - 1; ++x) {
-            uint32_t const prev = src_line[x - 1];
-            uint32_t const cur = src_line[x];
-            uint32_t const next = src_line[x + 1];
-            dst_line[x] = std::max(prev, std::max(cur, next));
-        }
+        dst_line[0] = std::max(src_line[0], src_line[1]);
+
+        max3Lines(src_line, src_line + 1, src_line + 2, dst_line + 1, width - 2);
 
         // Last column (no right neighbors).
+        int const x = width - 1;
         dst_line[x] = std::max(src_line[x], src_line[x - 1]);
-
-        src_line += width;
-        dst_line += width;
     }
 }
 
@@ -506,18 +591,15 @@ SEDM::max1x3(uint32_t const* src, uint32_t* dst) const
         ++p_dst;
     }
 
+    #pragma omp parallel for
     for (int y = 1; y < height - 1; ++y) {
-        for (int x = 0; x < width; ++x) {
-            uint32_t const prev = p_src[x - width];
-            uint32_t const cur = p_src[x];
-            uint32_t const next = p_src[x + width];
-            p_dst[x] = std::max(prev, std::max(cur, next));
-        }
-
-        p_src += width;
-        p_dst += width;
+        uint32_t const* const src_line = src + y * width;
+        max3Lines(src_line - width, src_line, src_line + width, dst + y * width, width);
     }
 
+    p_src = src + (height - 1) * width;
+    p_dst = dst + (height - 1) * width;
+
     // Last row (no bottom neighbors).
     for (int x = 0; x < width; ++x) {
         *p_dst = std::max(p_src[0], p_src[-width]);
@@ -532,19 +614,21 @@ SEDM::incrementMaskedPadded(BinaryImage const& mask)
     int const width = m_size.width() + 2;
     int const height = m_size.height() + 2;
 
-    uint32_t* data_line = &m_data[0];
-    uint32_t const* mask_line = mask.data();
+    uint32_t* const data = &m_data[0];
+    uint32_t const* const mask_data = mask.data();
     int const mask_wpl = mask.wordsPerLine();
 
     uint32_t const msb = uint32_t(1) << 31;
+
+    #pragma omp parallel for
     for (int y = 0; y < height; ++y) {
+        uint32_t* const data_line = data + y * width;
+        uint32_t const* const mask_line = mask_data + y * mask_wpl;
         for (int x = 0; x < width; ++x) {
             if (mask_line[x >> 5] & (msb >> (x & 31))) {
                 ++data_line[x];
             }
         }
-        data_line += width;
-        mask_line += mask_wpl;
     }
 }
 
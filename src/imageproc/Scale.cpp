@@ -18,9 +18,14 @@
 
 #include "Scale.h"
 #include "GrayImage.h"
+#include "BinaryImage.h"
+#include "BinaryThreshold.h"
 #include <QImage>
 #include <QSize>
+#include <vector>
+#include <algorithm>
 #include <stdexcept>
+#include <string.h>
 #include <stdint.h>
 #include <assert.h>
 
@@ -102,7 +107,7 @@ static GrayImage scaleUpIntGrayToGray(GrayImage const& src, QSize const& dst_siz
     int const dst_stride_scaled = dst_stride * yscale;
 
     int dy = 0;
-    for (; dy < dh; dy += xscale) {
+    for (; dy < dh; dy += yscale) {
         int sx = 0;
         int dx = 0;
 
@@ -379,6 +384,142 @@ static GrayImage scaleGrayToGray(GrayImage const& src, QSize const& dst_size)
     return dst;
 }
 
+/**
+ * Does what BinaryImage(scaleUpIntGrayToGray(src, dst_size), threshold) would do.
+ */
+static BinaryImage scaleUpIntGrayToBinary(
+    GrayImage const& src, QSize const& dst_size, int const threshold)
+{
+    int const sw = src.width();
+    int const sh = src.height();
+    int const dw = dst_size.width();
+    int const dh = dst_size.height();
+
+    int const xscale = dw / sw;
+    int const yscale = dh / sh;
+
+    BinaryImage dst(dst_size, WHITE);
+
+    uint8_t const* const src_data = src.data();
+    uint32_t* const dst_data = dst.data(); // never call dst.data() inside omp
+    int const src_stride = src.stride();
+    int const dst_wpl = dst.wordsPerLine();
+    uint32_t const msb = uint32_t(1) << 31;
+
+    #pragma omp parallel for
+    for (int sy = 0; sy < sh; ++sy) {
+        uint8_t const* const src_line = src_data + sy * src_stride;
+        uint32_t* const dst_line = dst_data + sy * yscale * dst_wpl;
+
+        for (int sx = 0, dx = 0; sx < sw; ++sx) {
+            int const dx_end = dx + xscale;
+            if (src_line[sx] < threshold) {
+                for (; dx < dx_end; ++dx) {
+                    dst_line[dx >> 5] |= msb >> (dx & 31);
+                }
+            }
+            dx = dx_end;
+        }
+
+        // The rest of the lines produced from this source line are the same.
+        for (int i = 1; i < yscale; ++i) {
+            memcpy(dst_line + i * dst_wpl, dst_line, dst_wpl * sizeof(uint32_t));
+        }
+    }
+
+    return dst;
+}
+
+/**
+ * Does what BinaryImage(scaleUpGrayToGray(src, dst_size), threshold) would do.
+ */
+static BinaryImage scaleUpGrayToBinary(
+    GrayImage const& src, QSize const& dst_size, int const threshold)
+{
+    int const sw = src.width();
+    int const sh = src.height();
+    int const dw = dst_size.width();
+    int const dh = dst_size.height();
+
+    double const dx2sx32 = calc32xRatio1(dw, sw);
+    double const dy2sy32 = calc32xRatio1(dh, sh);
+
+    std::vector<int> sx32s(dw);
+    for (int dx = 0; dx < dw; ++dx) {
+        sx32s[dx] = (int)(dx * dx2sx32);
+        assert((sx32s[dx] >> 5) + 1 < sw); // calc32xRatio1() ensures that.
+    }
+
+    BinaryImage dst(dst_size, WHITE);
+
+    uint8_t const* const src_data = src.data();
+    uint32_t* const dst_data = dst.data(); // never call dst.data() inside omp
+    int const src_stride = src.stride();
+    int const dst_wpl = dst.wordsPerLine();
+    uint32_t const msb = uint32_t(1) << 31;
+
+    #pragma omp parallel for
+    for (int dy = 0; dy < dh; ++dy) {
+        int const sy32 = (int)(dy * dy2sy32);
+        int const sy = sy32 >> 5;
+        unsigned const top_fraction = 32 - (sy32 & 31);
+        unsigned const bottom_fraction = sy32 & 31;
+        assert(sy + 1 < sh); // calc32xRatio1() ensures that.
+
+        uint8_t const* const src_line = src_data + sy * src_stride;
+        uint32_t* const dst_line = dst_data + dy * dst_wpl;
+
+        int dx = 0;
+        while (dx < dw) {
+            // Destination pixels [dx, dx_end) are interpolated
+            // from the same 2x2 block of source pixels.
+            int const sx = sx32s[dx] >> 5;
+            int dx_end = dx + 1;
+            while (dx_end < dw && (sx32s[dx_end] >> 5) == sx) {
+                ++dx_end;
+            }
+
+            uint8_t const* const psrc = src_line + sx;
+            int const darkest = std::min(
+                std::min(psrc[0], psrc[1]), std::min(psrc[src_stride], psrc[src_stride + 1])
+            );
+            int const lightest = std::max(
+                std::max(psrc[0], psrc[1]), std::max(psrc[src_stride], psrc[src_stride + 1])
+            );
+
+            if (darkest >= threshold) {
+                // A weighted average can't go below the darkest pixel.
+                dx = dx_end;
+            } else if (lightest < threshold) {
+                // Nor can it go above the lightest one.
+                for (; dx < dx_end; ++dx) {
+                    dst_line[dx >> 5] |= msb >> (dx & 31);
+                }
+            } else {
+                for (; dx < dx_end; ++dx) {
+                    int const sx32 = sx32s[dx];
+                    unsigned const left_fraction = 32 - (sx32 & 31);
+                    unsigned const right_fraction = sx32 & 31;
+
+                    unsigned gray_level = 0;
+                    gray_level += psrc[0] * left_fraction * top_fraction;
+                    gray_level += psrc[1] * right_fraction * top_fraction;
+                    gray_level += psrc[src_stride + 1] * right_fraction * bottom_fraction;
+                    gray_level += psrc[src_stride] * left_fraction * bottom_fraction;
+
+                    unsigned const total_area = 32 * 32;
+                    int const pix_value = (gray_level + (total_area >> 1)) / total_area;
+                    if (pix_value < threshold) {
+                        dst_line[dx >> 5] |= msb >> (dx & 31);
+                    }
+                }
+            }
+        }
+    }
+
+    return dst;
+}
+
 GrayImage scaleToGray(GrayImage const& src, QSize const& dst_size)
 {
     if (src.isNull()) {
@@ -396,4 +537,39 @@ GrayImage scaleToGray(GrayImage const& src, QSize const& dst_size)
     return scaleGrayToGray(src, dst_size);
 }
 
+BinaryImage scaleToBinary(
+    GrayImage const& src, QSize const& dst_size, BinaryThreshold const threshold)
+{
+    if (src.isNull()) {
+        return BinaryImage();
+    }
+
+    if (!dst_size.isValid()) {
+        throw std::invalid_argument("scaleToBinary: dst_size is invalid");
+    }
+
+    if (dst_size.isEmpty()) {
+        return BinaryImage();
+    }
+
+    int const sw = src.width();
+    int const sh = src.height();
+    int const dw = dst_size.width();
+    int const dh = dst_size.height();
+
+    // The same choice of algorithm as in scaleGrayToGray().
+    bool const same_size = sw == dw && sh == dh;
+    bool const int_down = sw % dw == 0 && sh % dh == 0;
+    bool const int_up = dw % sw == 0 && dh % sh == 0;
+    if (!same_size && !int_down) {
+        if (int_up) {
+            return scaleUpIntGrayToBinary(src, dst_size, threshold);
+        } else if (dw > sw && dh > sh) {
+            return scaleUpGrayToBinary(src, dst_size, threshold);
+        }
+    }
+
+    return BinaryImage(scaleGrayToGray(src, dst_size), threshold);
+}
+
 } // namespace imageproc
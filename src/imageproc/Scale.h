@@ -25,6 +25,8 @@ namespace imageproc
 {
 
 class GrayImage;
+class BinaryImage;
+class BinaryThreshold;
 
 /**
  * \brief Converts an image to grayscale and scales it to dst_size.
@@ -38,6 +40,18 @@ class GrayImage;
  */
 GrayImage scaleToGray(GrayImage const& src, QSize const& dst_size);
 
+/**
+ * \brief Scales a grayscale image to dst_size and binarizes it.
+ *
+ * The result is the same as BinaryImage(scaleToGray(src, dst_size), threshold),
+ * but no grayscale image of dst_size is created.  When upscaling,
+ * interpolation is only done where the neighboring source pixels
+ * are on different sides of the threshold, and upscaling by integer
+ * factors just replicates the binarized source pixels.
+ */
+BinaryImage scaleToBinary(
+    GrayImage const& src, QSize const& dst_size, BinaryThreshold threshold);
+
 } // namespace imageproc
 
 #endif
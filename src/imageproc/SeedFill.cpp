@@ -244,6 +244,24 @@ inline uint8_t darkest(uint8_t lhs, uint8_t rhs)
     return lhs < rhs ? lhs : rhs;
 }
 
+/**
+ * Functor versions of lightest() and darkest().  Unlike function pointers,
+ * they get inlined into seedFillGenericInPlace().
+ */
+struct Lightest {
+    uint8_t operator()(uint8_t lhs, uint8_t rhs) const
+    {
+        return lightest(lhs, rhs);
+    }
+};
+
+struct Darkest {
+    uint8_t operator()(uint8_t lhs, uint8_t rhs) const
+    {
+        return darkest(lhs, rhs);
+    }
+};
+
 void seedFillGrayHorLine(uint8_t* seed, uint8_t const* mask, int const line_len)
 {
     assert(line_len > 0);
@@ -534,7 +552,7 @@ void seedFillGrayInPlace(
     }
 
     seedFillGenericInPlace(
-        &darkest, &lightest, connectivity,
+        Darkest(), Lightest(), connectivity,
         seed.data(), seed.stride(), seed.size(),
         mask.data(), mask.stride()
     );
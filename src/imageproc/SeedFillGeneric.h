@@ -24,6 +24,9 @@
 #include <QSize>
 #include <vector>
 #include <assert.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace imageproc
 {
@@ -487,6 +490,158 @@ void seedFill8(
     );
 }
 
+/**
+ * Images with at least this many pixels are filled in horizontal bands,
+ * processed in parallel, provided there is more than one thread to do that.
+ */
+int const MIN_PIXELS_FOR_BANDS = 512 * 512;
+
+/**
+ * The height of a band.  The last band also takes the remaining lines,
+ * so every band is at least this tall.
+ */
+int const BAND_HEIGHT = 128;
+
+inline bool bandsWorthIt(QSize const size)
+{
+#ifdef _OPENMP
+    if (omp_get_max_threads() < 2) {
+        return false;
+    }
+#else
+    return false;
+#endif
+    return size.height() >= 2 * BAND_HEIGHT
+           && size.width() * size.height() >= MIN_PIXELS_FOR_BANDS;
+}
+
+/**
+ * Spreads values from line \p src into the adjacent line \p dst, which belongs
+ * to another band.  Changed pixels of \p dst are appended to \p changed, with
+ * their y coordinate being \p dst_y, which is relative to the band.
+ */
+template<typename T, typename SpreadOp, typename MaskOp>
+void spreadAcrossSeam(
+    SpreadOp spread_op, MaskOp mask_op, Connectivity const conn, int const width,
+    T const* const src, T* const dst, T const* const dst_mask, int const dst_y,
+    std::vector<Position<T> >& changed)
+{
+    for (int x = 0; x < width; ++x) {
+        T val(spread_op(dst[x], src[x]));
+        if (conn == CONN8) {
+            if (x > 0) {
+                val = spread_op(val, src[x - 1]);
+            }
+            if (x < width - 1) {
+                val = spread_op(val, src[x + 1]);
+            }
+        }
+        val = mask_op(dst_mask[x], val);
+        if (val != dst[x]) {
+            dst[x] = val;
+            changed.push_back(Position<T>(dst + x, dst_mask + x, x, dst_y));
+        }
+    }
+}
+
+/**
+ * Fills every band as if it were a separate image, then repeatedly spreads
+ * values across the seams between bands and from there into the bands,
+ * until nothing changes.  Each stage processes bands or seams in parallel.
+ */
+template<typename T, typename SpreadOp, typename MaskOp>
+void seedFillBanded(
+    SpreadOp spread_op, MaskOp mask_op, Connectivity const conn,
+    T* const seed, int const seed_stride, QSize const size,
+    T const* const mask, int const mask_stride)
+{
+    int const w = size.width();
+    int const h = size.height();
+    int const num_bands = h / BAND_HEIGHT;
+    int const last_band_height = h - (num_bands - 1) * BAND_HEIGHT;
+    assert(num_bands >= 2);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < num_bands; ++band) {
+        int const top = band * BAND_HEIGHT;
+        QSize const band_size(w, band == num_bands - 1 ? last_band_height : BAND_HEIGHT);
+        if (conn == CONN4) {
+            seedFill4(
+                spread_op, mask_op, seed + top * seed_stride, seed_stride,
+                band_size, mask + top * mask_stride, mask_stride
+            );
+        } else {
+            seedFill8(
+                spread_op, mask_op, seed + top * seed_stride, seed_stride,
+                band_size, mask + top * mask_stride, mask_stride
+            );
+        }
+    }
+
+    std::vector<HTransition> h_transitions;
+    std::vector<VTransition> v_transitions;
+    std::vector<VTransition> last_v_transitions;
+    initHorTransitions(h_transitions, w);
+    initVertTransitions(v_transitions, BAND_HEIGHT);
+    initVertTransitions(last_v_transitions, last_band_height);
+
+    // Pixels changed on the top and bottom lines of each band.
+    std::vector<std::vector<Position<T> > > top_changes(num_bands);
+    std::vector<std::vector<Position<T> > > bottom_changes(num_bands);
+
+    for (;;) {
+        bool changed = false;
+
+        // Seams only touch the top and bottom lines of bands,
+        // which are distinct lines, as bands are at least 2 lines tall.
+        #pragma omp parallel for reduction(||: changed)
+        for (int band = 1; band < num_bands; ++band) {
+            int const y = band * BAND_HEIGHT;
+            T* const upper = seed + (y - 1) * seed_stride;
+            T* const lower = upper + seed_stride;
+            T const* const upper_mask = mask + (y - 1) * mask_stride;
+            T const* const lower_mask = upper_mask + mask_stride;
+
+            spreadAcrossSeam(
+                spread_op, mask_op, conn, w, upper, lower, lower_mask, 0, top_changes[band]
+            );
+            spreadAcrossSeam(
+                spread_op, mask_op, conn, w, lower, upper, upper_mask,
+                BAND_HEIGHT - 1, bottom_changes[band - 1]
+            );
+
+            if (!top_changes[band].empty() || !bottom_changes[band - 1].empty()) {
+                changed = true;
+            }
+        }
+
+        if (!changed) {
+            break;
+        }
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int band = 0; band < num_bands; ++band) {
+            FastQueue<Position<T> > queue;
+            for (std::size_t i = 0; i < top_changes[band].size(); ++i) {
+                queue.push(top_changes[band][i]);
+            }
+            for (std::size_t i = 0; i < bottom_changes[band].size(); ++i) {
+                queue.push(bottom_changes[band][i]);
+            }
+            top_changes[band].clear();
+            bottom_changes[band].clear();
+
+            VTransition const* const vt = band == num_bands - 1
+                                          ? &last_v_transitions[0] : &v_transitions[0];
+            if (conn == CONN4) {
+                spread4(spread_op, mask_op, queue, &h_transitions[0], vt, seed_stride, mask_stride);
+            } else {
+                spread8(spread_op, mask_op, queue, &h_transitions[0], vt, seed_stride, mask_stride);
+            }
+        }
+    }
+}
+
 } // namespace seed_fill_generic
 
 } // namespace detail
@@ -518,6 +673,8 @@ void seedFill8(
  * Morphological Grayscale Reconstruction in Image Analysis:
  * Applications and Efficient Algorithms, technical report 91-16, Harvard Robotics Laboratory,
  * November 1991, IEEE Transactions on Image Processing, Vol. 2, No. 2, pp. 176-201, April 1993.\n
+ * Large images are split into horizontal bands that are filled in parallel,
+ * with values then propagated between bands until they stabilize.
  */
 template<typename T, typename SpreadOp, typename MaskOp>
 void seedFillGenericInPlace(
@@ -529,6 +686,13 @@ void seedFillGenericInPlace(
         return;
     }
 
+    if (detail::seed_fill_generic::bandsWorthIt(size)) {
+        detail::seed_fill_generic::seedFillBanded(
+            spread_op, mask_op, conn, seed, seed_stride, size, mask, mask_stride
+        );
+        return;
+    }
+
     if (conn == CONN4) {
         detail::seed_fill_generic::seedFill4(
             spread_op, mask_op, seed, seed_stride, size, mask, mask_stride
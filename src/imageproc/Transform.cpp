@@ -30,10 +30,17 @@
 #include <QDebug>
 #include <stdexcept>
 #include <algorithm>
+#include <vector>
 #include <stdint.h>
 #include <math.h>
 #include <assert.h>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace imageproc
 {
 
@@ -64,6 +71,16 @@ public:
         m_grayLevel += gray_level * area;
     }
 
+    /**
+     * \brief Adds a sum of area-weighted values of a single channel.
+     *
+     * Channel i is bits [8*i, 8*i + 8) of a pixel.
+     */
+    inline void addChannelSum(int, unsigned const sum)
+    {
+        m_grayLevel += sum;
+    }
+
     inline uint8_t result(unsigned const total_area) const
     {
         unsigned const half_area = total_area >> 1;
@@ -88,6 +105,15 @@ public:
         m_red += (rgb & 0xFF) * area;
     }
 
+    inline void addChannelSum(int const channel, unsigned const sum)
+    {
+        switch (channel) {
+            case 0: m_blue += sum; break;
+            case 1: m_green += sum; break;
+            case 2: m_red += sum; break;
+        }
+    }
+
     inline uint32_t result(unsigned const total_area) const
     {
         unsigned const half_area = total_area >> 1;
@@ -121,6 +147,16 @@ public:
         m_alpha += argb * area;
     }
 
+    inline void addChannelSum(int const channel, unsigned const sum)
+    {
+        switch (channel) {
+            case 0: m_blue += sum; break;
+            case 1: m_green += sum; break;
+            case 2: m_red += sum; break;
+            case 3: m_alpha += sum; break;
+        }
+    }
+
     inline uint32_t result(unsigned const total_area) const
     {
         unsigned const half_area = total_area >> 1;
@@ -163,6 +199,527 @@ static QSizeF calcSrcUnitSize(QTransform const& xform, QSizeF const& min)
            );
 }
 
+/**
+ * \brief The footprint of a destination row or column on one source axis.
+ *
+ * Positions and extents are in 1/32 of a source pixel.
+ */
+struct AxisSpan
+{
+    int first; /**< The first source pixel, clipped to the image. */
+    int last; /**< The last source pixel, inclusive and clipped to the image. */
+    unsigned firstWeight; /**< The part of the first pixel covered. */
+    unsigned lastWeight; /**< The part of the last pixel covered. */
+    unsigned fullExtent; /**< The extent before clipping. */
+    unsigned clippedExtent; /**< The extent after clipping. */
+    int nearest; /**< The source pixel to use when completely outside. */
+    bool outside; /**< Whether the footprint is completely outside of the image. */
+
+    unsigned weight(int const pos) const
+    {
+        return pos == first ? firstWeight : (pos == last ? lastWeight : 32);
+    }
+};
+
+/**
+ * Does exactly what transformGeneric() does for a single coordinate,
+ * so that the results of both are identical.
+ */
+static AxisSpan calcAxisSpan(double const f_src32_center, int const src32_unit, int const src_size)
+{
+    int src32_begin = (int)f_src32_center - (src32_unit >> 1);
+    int src32_end = src32_begin + src32_unit;
+    int first = src32_begin >> 5;
+    int last = (src32_end - 1) >> 5; // inclusive
+
+    AxisSpan span = AxisSpan();
+    span.outside = last < 0 || first >= src_size;
+    span.nearest = qBound<int>(0, (first + last) >> 1, src_size - 1);
+    span.fullExtent = src32_end - src32_begin;
+    if (span.outside) {
+        return span;
+    }
+
+    if (first < 0) {
+        first = 0;
+        src32_begin = 0;
+    }
+    if (last >= src_size) {
+        last = src_size - 1;
+        src32_end = src_size << 5;
+    }
+
+    span.first = first;
+    span.last = last;
+    span.clippedExtent = src32_end - src32_begin;
+    if (first == last) {
+        span.firstWeight = span.clippedExtent;
+        span.lastWeight = span.clippedExtent;
+    } else {
+        span.firstWeight = 32 - (src32_begin & 31);
+        span.lastWeight = src32_end - (last << 5);
+    }
+
+    return span;
+}
+
+/**
+ * \brief acc[i] += src[i] * weight
+ *
+ * \p weight must not exceed 32, which keeps the products in 16 bits.
+ */
+static void accumulateWeightedBytes(
+    uint32_t* const acc, uint8_t const* const src, int const num_bytes, unsigned const weight)
+{
+    assert(weight <= 32);
+
+    int i = 0;
+#ifdef TRANSFORM_USE_SSE2
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const weight16 = _mm_set1_epi16(static_cast<short>(weight));
+    for (; i + 16 <= num_bytes; i += 16) {
+        __m128i const bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        __m128i const lo = _mm_mullo_epi16(_mm_unpacklo_epi8(bytes, zero), weight16);
+        __m128i const hi = _mm_mullo_epi16(_mm_unpackhi_epi8(bytes, zero), weight16);
+        __m128i* const a = reinterpret_cast<__m128i*>(acc + i);
+        _mm_storeu_si128(a + 0, _mm_add_epi32(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+#endif
+    for (; i < num_bytes; ++i) {
+        acc[i] += src[i] * weight;
+    }
+}
+
+/**
+ * \brief Maps a byte within a pixel to a channel, as understood by Mixer::addChannelSum().
+ */
+template<typename StorageUnit>
+static inline int byteToChannel(int const byte)
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    return sizeof(StorageUnit) - 1 - byte;
+#else
+    return byte;
+#endif
+}
+
+/**
+ * \brief A faster equivalent of transformGeneric() for transformations
+ *        not involving rotation or shearing.
+ *
+ * In that case, the source footprint of a destination pixel is a product
+ * of the footprints of its row and its column.  Those are precomputed
+ * per row and per column.  The area-weighted sums are then separable:
+ * for each destination row, the source rows it covers are accumulated
+ * into a line of per-byte sums (with SIMD where available), and then
+ * each destination pixel only sums up its columns of that line.
+ * All the arithmetic is done on integers in the same units as in
+ * transformGeneric(), so the results are identical.
+ */
+template<typename StorageUnit, typename Mixer>
+static void transformAxisAligned(
+    StorageUnit const* const src_data, int const src_stride, QSize const src_size,
+    StorageUnit* const dst_data, int const dst_stride, QTransform const& inv_xform,
+    int const dw, int const dh, int const src32_unit_w, int const src32_unit_h,
+    StorageUnit const outside_color, int const outside_flags)
+{
+    int const sw = src_size.width();
+    int const sh = src_size.height();
+    int const bytes_per_pixel = sizeof(StorageUnit);
+
+    std::vector<AxisSpan> x_spans(dw);
+    int acc_first = sw;
+    int acc_last = -1;
+    for (int dx = 0; dx < dw; ++dx) {
+        double const f_dx_center = dx + 0.5;
+        double const f_sx32_center = f_dx_center * inv_xform.m11() + inv_xform.dx();
+        AxisSpan const& span = x_spans[dx] = calcAxisSpan(f_sx32_center, src32_unit_w, sw);
+        if (!span.outside) {
+            acc_first = std::min(acc_first, span.first);
+            acc_last = std::max(acc_last, span.last);
+        }
+    }
+    int const acc_width = std::max(0, acc_last - acc_first + 1);
+
+    std::vector<AxisSpan> y_spans(dh);
+    for (int dy = 0; dy < dh; ++dy) {
+        double const f_dy_center = dy + 0.5;
+        double const f_sy32_center = f_dy_center * inv_xform.m22() + inv_xform.dy();
+        y_spans[dy] = calcAxisSpan(f_sy32_center, src32_unit_h, sh);
+    }
+
+    #pragma omp parallel
+    {
+        std::vector<uint32_t> acc(acc_width * bytes_per_pixel + 1);
+
+        #pragma omp for schedule(static)
+        for (int dy = 0; dy < dh; ++dy) {
+            StorageUnit* const dst_line = dst_data + dy * dst_stride;
+            AxisSpan const& ys = y_spans[dy];
+
+            if (!ys.outside && acc_width > 0) {
+                std::fill(acc.begin(), acc.end(), 0);
+                for (int sy = ys.first; sy <= ys.last; ++sy) {
+                    accumulateWeightedBytes(
+                        &acc[0], reinterpret_cast<uint8_t const*>(
+                            src_data + sy * src_stride + acc_first
+                        ), acc_width * bytes_per_pixel, ys.weight(sy)
+                    );
+                }
+            }
+
+            for (int dx = 0; dx < dw; ++dx) {
+                AxisSpan const& xs = x_spans[dx];
+
+                if (xs.outside || ys.outside) {
+                    // Completely outside of src image.
+                    if (outside_flags & OutsidePixels::COLOR) {
+                        dst_line[dx] = outside_color;
+                    } else {
+                        dst_line[dx] = src_data[ys.nearest * src_stride + xs.nearest];
+                    }
+                    continue;
+                }
+
+                unsigned const src_area = xs.clippedExtent * ys.clippedExtent;
+                assert(src_area != 0);
+
+                // The part of the footprint clipped away.
+                unsigned background_area = xs.fullExtent * ys.fullExtent - src_area;
+
+                Mixer mixer;
+                if (outside_flags & OutsidePixels::WEAK) {
+                    background_area = 0;
+                } else {
+                    mixer.add(outside_color, background_area);
+                }
+
+                if (xs.first == xs.last && ys.first == ys.last && background_area == 0) {
+                    // dst pixel maps to a single src pixel
+                    dst_line[dx] = src_data[ys.first * src_stride + xs.first];
+                    continue;
+                }
+
+                uint32_t const* const acc_line = &acc[(xs.first - acc_first) * bytes_per_pixel];
+                for (int byte = 0; byte < bytes_per_pixel; ++byte) {
+                    uint32_t const* p = acc_line + byte;
+                    unsigned sum = 0;
+                    for (int sx = xs.first; sx <= xs.last; ++sx, p += bytes_per_pixel) {
+                        sum += *p * xs.weight(sx);
+                    }
+                    mixer.addChannelSum(byteToChannel<StorageUnit>(byte), sum);
+                }
+
+                dst_line[dx] = mixer.result(src_area + background_area);
+            }
+        }
+    }
+}
+
+/**
+ * \brief Tells whether the transformation is a rotation combined with
+ *        a uniform scaling, and possibly a reflection.
+ *
+ * That's what page rotation and deskewing produce.  The tolerance
+ * accepts the rounding errors of composing such transformations.
+ * Shearing and non-uniform scaling are left to the generic code.
+ */
+static bool isSimilarity(QTransform const& xform)
+{
+    double const scale = fabs(xform.m11()) + fabs(xform.m12());
+    double const tolerance = scale * 1e-9;
+    if (fabs(xform.m11() - xform.m22()) <= tolerance && fabs(xform.m12() + xform.m21()) <= tolerance) {
+        return true; // Rotation.
+    }
+    return fabs(xform.m11() + xform.m22()) <= tolerance && fabs(xform.m12() - xform.m21()) <= tolerance;
+}
+
+/**
+ * \brief The weights of the source pixels covered along one axis,
+ *        for footprints not clipped by the image.
+ *
+ * A footprint of a given extent always covers the same number of pixels
+ * with the same weights, given its phase, that is its start within
+ * a source pixel, in 1/32 of a pixel.  So there are only 32 variants.
+ */
+class AxisWeights
+{
+public:
+    explicit AxisWeights(int const src32_unit)
+        : m_stride(((31 + src32_unit - 1) >> 5) + 1),
+          m_counts(32),
+          m_weights(32 * m_stride)
+    {
+        // Matches what calcAxisSpan() does when nothing gets clipped.
+        for (int phase = 0; phase < 32; ++phase) {
+            int const count = ((phase + src32_unit - 1) >> 5) + 1;
+            unsigned* const weights = &m_weights[phase * m_stride];
+            m_counts[phase] = count;
+            if (count == 1) {
+                weights[0] = src32_unit;
+            } else {
+                weights[0] = 32 - phase;
+                std::fill(weights + 1, weights + count - 1, 32);
+                weights[count - 1] = phase + src32_unit - ((count - 1) << 5);
+            }
+        }
+    }
+
+    int count(int const phase) const
+    {
+        return m_counts[phase];
+    }
+
+    unsigned const* weights(int const phase) const
+    {
+        return &m_weights[phase * m_stride];
+    }
+private:
+    int m_stride;
+    std::vector<int> m_counts;
+    std::vector<unsigned> m_weights;
+};
+
+/**
+ * \brief Adapts an AxisSpan to the indexing of AxisWeights::weights().
+ */
+class SpanWeights
+{
+public:
+    explicit SpanWeights(AxisSpan const& span) : m_rSpan(span) {}
+
+    unsigned operator[](int const i) const
+    {
+        return m_rSpan.weight(m_rSpan.first + i);
+    }
+private:
+    AxisSpan const& m_rSpan;
+};
+
+/**
+ * \brief sums[0] = the area-weighted sum over nx by ny source pixels.
+ */
+template<typename XWeights, typename YWeights>
+static inline void sumFootprint(
+    uint8_t const* src_line, int const src_stride,
+    int const nx, XWeights const& wx, int const ny, YWeights const& wy, uint32_t* const sums)
+{
+    unsigned sum = 0;
+    for (int j = 0; j < ny; ++j, src_line += src_stride) {
+        unsigned row_sum = 0;
+        for (int i = 0; i < nx; ++i) {
+            row_sum += src_line[i] * wx[i];
+        }
+        sum += row_sum * wy[j];
+    }
+    sums[0] = sum;
+}
+
+/**
+ * \brief sums[c] = the area-weighted sum of channel c over nx by ny source pixels.
+ *
+ * Channel c is bits [8*c, 8*c + 8) of a pixel.  With SSE2, all four
+ * channels are processed at once, one per 32-bit lane.
+ */
+template<typename XWeights, typename YWeights>
+static inline void sumFootprint(
+    uint32_t const* src_line, int const src_stride,
+    int const nx, XWeights const& wx, int const ny, YWeights const& wy, uint32_t* const sums)
+{
+#ifdef TRANSFORM_USE_SSE2
+    __m128i const zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (int j = 0; j < ny; ++j, src_line += src_stride) {
+        for (int i = 0; i < nx; ++i) {
+            // The channels go to the low halves of 32-bit lanes, and so does
+            // the weight, which doesn't exceed 32 * 32.  That makes
+            // _mm_madd_epi16() a per-lane 32-bit multiplication.
+            __m128i const pixel = _mm_unpacklo_epi16(
+                _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(src_line[i])), zero), zero
+            );
+            __m128i const weight = _mm_set1_epi32(static_cast<int>(wy[j] * wx[i]));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pixel, weight));
+        }
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sum);
+#else
+    std::fill(sums, sums + 4, 0);
+    for (int j = 0; j < ny; ++j, src_line += src_stride) {
+        for (int i = 0; i < nx; ++i) {
+            unsigned const weight = wy[j] * wx[i];
+            uint32_t const pixel = src_line[i];
+            for (int channel = 0; channel < 4; ++channel) {
+                sums[channel] += ((pixel >> (channel * 8)) & 0xFF) * weight;
+            }
+        }
+    }
+#endif
+}
+
+/**
+ * \brief sumFootprint() for 2 by 2 source pixels, which is what
+ *        rotation without much scaling mostly produces.
+ */
+static inline void sumBlock2x2(
+    uint8_t const* const src_line, int const src_stride,
+    unsigned const* const wx, unsigned const* const wy, uint32_t* const sums)
+{
+    uint8_t const* const next_line = src_line + src_stride;
+    sums[0] = (src_line[0] * wx[0] + src_line[1] * wx[1]) * wy[0]
+              + (next_line[0] * wx[0] + next_line[1] * wx[1]) * wy[1];
+}
+
+static inline void sumBlock2x2(
+    uint32_t const* const src_line, int const src_stride,
+    unsigned const* const wx, unsigned const* const wy, uint32_t* const sums)
+{
+#ifdef TRANSFORM_USE_SSE2
+    // Covering two pixels on an axis means the weights are at most 32
+    // and add up to at most 64, which keeps the row sums in 16 bits.
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const top = _mm_unpacklo_epi8(
+        _mm_loadl_epi64(reinterpret_cast<__m128i const*>(src_line)), zero
+    );
+    __m128i const bottom = _mm_unpacklo_epi8(
+        _mm_loadl_epi64(reinterpret_cast<__m128i const*>(src_line + src_stride)), zero
+    );
+    short const wx0 = static_cast<short>(wx[0]);
+    short const wx1 = static_cast<short>(wx[1]);
+    __m128i const x_weights = _mm_set_epi16(wx1, wx1, wx1, wx1, wx0, wx0, wx0, wx0);
+    __m128i const top_x = _mm_mullo_epi16(top, x_weights);
+    __m128i const bottom_x = _mm_mullo_epi16(bottom, x_weights);
+    __m128i const top_sum = _mm_add_epi16(top_x, _mm_srli_si128(top_x, 8));
+    __m128i const bottom_sum = _mm_add_epi16(bottom_x, _mm_srli_si128(bottom_x, 8));
+    __m128i const y_weights = _mm_set1_epi32(static_cast<int>((wy[1] << 16) | wy[0]));
+    __m128i const sum = _mm_madd_epi16(_mm_unpacklo_epi16(top_sum, bottom_sum), y_weights);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sum);
+#else
+    sumFootprint(src_line, src_stride, 2, wx, 2, wy, sums);
+#endif
+}
+
+/**
+ * \brief A faster equivalent of transformGeneric() for rotation with
+ *        uniform scaling.
+ *
+ * The source footprint of a destination pixel is still an axis-aligned
+ * rectangle, but it's no longer shared with other pixels of the same
+ * row or column.  Its position is computed per pixel with the same
+ * double-precision expressions as in transformGeneric(), so that
+ * footprints don't shift.  Footprints not touching the image edges take
+ * their weights from per-phase tables, and those covering 2 by 2 pixels
+ * are handled in straight-line code.  The channels of a source pixel are
+ * weighted and accumulated together, with SIMD where available.  The sums
+ * are the same as transformGeneric() gets, just added up in a different
+ * order, so the results are identical.
+ */
+template<typename StorageUnit, typename Mixer>
+static void transformRotated(
+    StorageUnit const* const src_data, int const src_stride, QSize const src_size,
+    StorageUnit* const dst_data, int const dst_stride, QTransform const& inv_xform,
+    int const dw, int const dh, int const src32_unit_w, int const src32_unit_h,
+    StorageUnit const outside_color, int const outside_flags)
+{
+    int const sw = src_size.width();
+    int const sh = src_size.height();
+    AxisWeights const x_weights(src32_unit_w);
+    AxisWeights const y_weights(src32_unit_h);
+    unsigned const unclipped_area = src32_unit_w * src32_unit_h;
+
+    #pragma omp parallel for schedule(static)
+    for (int dy = 0; dy < dh; ++dy) {
+        StorageUnit* const dst_line = dst_data + dy * dst_stride;
+        double const f_dy_center = dy + 0.5;
+        double const f_sx32_base = f_dy_center * inv_xform.m21() + inv_xform.dx();
+        double const f_sy32_base = f_dy_center * inv_xform.m22() + inv_xform.dy();
+        uint32_t sums[sizeof(StorageUnit)];
+
+        for (int dx = 0; dx < dw; ++dx) {
+            double const f_dx_center = dx + 0.5;
+            double const f_sx32_center = f_sx32_base + f_dx_center * inv_xform.m11();
+            double const f_sy32_center = f_sy32_base + f_dx_center * inv_xform.m12();
+
+            int const src32_left = (int)f_sx32_center - (src32_unit_w >> 1);
+            int const src32_top = (int)f_sy32_center - (src32_unit_h >> 1);
+            int const src_left = src32_left >> 5;
+            int const src_top = src32_top >> 5;
+            int const nx = x_weights.count(src32_left & 31);
+            int const ny = y_weights.count(src32_top & 31);
+
+            Mixer mixer;
+
+            if (src_left >= 0 && src_top >= 0 && src_left + nx <= sw && src_top + ny <= sh) {
+                // Nothing gets clipped, so there is no background area either.
+                StorageUnit const* const src_line = src_data + src_top * src_stride + src_left;
+                if (nx == 1 && ny == 1) {
+                    // dst pixel maps to a single src pixel
+                    dst_line[dx] = *src_line;
+                    continue;
+                }
+
+                unsigned const* const wx = x_weights.weights(src32_left & 31);
+                unsigned const* const wy = y_weights.weights(src32_top & 31);
+                if (nx == 2 && ny == 2) {
+                    sumBlock2x2(src_line, src_stride, wx, wy, sums);
+                } else {
+                    sumFootprint(src_line, src_stride, nx, wx, ny, wy, sums);
+                }
+
+                for (int channel = 0; channel < int(sizeof(StorageUnit)); ++channel) {
+                    mixer.addChannelSum(channel, sums[channel]);
+                }
+                dst_line[dx] = mixer.result(unclipped_area);
+                continue;
+            }
+
+            AxisSpan const xs(calcAxisSpan(f_sx32_center, src32_unit_w, sw));
+            AxisSpan const ys(calcAxisSpan(f_sy32_center, src32_unit_h, sh));
+
+            if (xs.outside || ys.outside) {
+                // Completely outside of src image.
+                if (outside_flags & OutsidePixels::COLOR) {
+                    dst_line[dx] = outside_color;
+                } else {
+                    dst_line[dx] = src_data[ys.nearest * src_stride + xs.nearest];
+                }
+                continue;
+            }
+
+            unsigned const src_area = xs.clippedExtent * ys.clippedExtent;
+            assert(src_area != 0);
+
+            // The part of the footprint clipped away.
+            unsigned background_area = xs.fullExtent * ys.fullExtent - src_area;
+
+            if (outside_flags & OutsidePixels::WEAK) {
+                background_area = 0;
+            } else {
+                mixer.add(outside_color, background_area);
+            }
+
+            if (xs.first == xs.last && ys.first == ys.last && background_area == 0) {
+                // dst pixel maps to a single src pixel
+                dst_line[dx] = src_data[ys.first * src_stride + xs.first];
+                continue;
+            }
+
+            sumFootprint(
+                src_data + ys.first * src_stride + xs.first, src_stride,
+                xs.last - xs.first + 1, SpanWeights(xs),
+                ys.last - ys.first + 1, SpanWeights(ys), sums
+            );
+            for (int channel = 0; channel < int(sizeof(StorageUnit)); ++channel) {
+                mixer.addChannelSum(channel, sums[channel]);
+            }
+
+            dst_line[dx] = mixer.result(src_area + background_area);
+        }
+    }
+}
+
 template<typename StorageUnit, typename Mixer>
 static void transformGeneric(
     StorageUnit const* const src_data, int const src_stride, QSize const src_size,
@@ -187,6 +744,22 @@ static void transformGeneric(
     int const src32_unit_w = std::max<int>(1, qRound(src32_unit_size.width()));
     int const src32_unit_h = std::max<int>(1, qRound(src32_unit_size.height()));
 
+    if (inv_xform.m12() == 0.0 && inv_xform.m21() == 0.0) {
+        transformAxisAligned<StorageUnit, Mixer>(
+            src_data, src_stride, src_size, dst_data, dst_stride, inv_xform,
+            dw, dh, src32_unit_w, src32_unit_h, outside_color, outside_flags
+        );
+        return;
+    }
+
+    if (isSimilarity(inv_xform)) {
+        transformRotated<StorageUnit, Mixer>(
+            src_data, src_stride, src_size, dst_data, dst_stride, inv_xform,
+            dw, dh, src32_unit_w, src32_unit_h, outside_color, outside_flags
+        );
+        return;
+    }
+
     #pragma omp parallel for schedule(static) shared(inv_xform)
     for (int dy = 0; dy < dh; ++dy) {
         StorageUnit* dst_line = dst_data + dy * dst_stride;
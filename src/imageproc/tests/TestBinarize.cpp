@@ -18,6 +18,7 @@
 
 #include "Binarize.h"
 #include "BinaryImage.h"
+#include "GrayImage.h"
 #include "Utils.h"
 #include <QImage>
 #include <QSize>
@@ -34,6 +35,29 @@ namespace tests
 using namespace utils;
 
 BOOST_AUTO_TEST_SUITE(BinarizeTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_local_methods_match_threshold_maps)
+{
+    QSize const window_size(15, 11);
+    int const widths[] = { 1, 31, 32, 33, 100 };
+    for (int const width : widths) {
+        QImage const img(randomGrayImage(width, 37));
+        GrayImage const gray(img);
+
+        BOOST_CHECK(
+            binarizeNiblack(img, window_size, 0.2, 1)
+            == binarizeFromMap(gray, binarizeNiblackMap(gray, window_size, 0.2), 0, 255, 1)
+        );
+        BOOST_CHECK(
+            binarizeSauvola(img, window_size, 0.34, 2)
+            == binarizeFromMap(gray, binarizeSauvolaMap(gray, window_size, 0.34), 0, 255, 2)
+        );
+        BOOST_CHECK(
+            binarizeWolf(img, window_size, 1, 8, 0.3, -1)
+            == binarizeFromMap(gray, binarizeWolfMap(gray, window_size, 0.3), 1, 8, -1)
+        );
+    }
+}
 #if 0
 BOOST_AUTO_TEST_CASE(test)
 {
@@ -0,0 +1,192 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ConnectivityMap.h"
+#include "Connectivity.h"
+#include "BinaryImage.h"
+#include "Utils.h"
+#include <QPoint>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <stdlib.h>
+#include <stdint.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+using namespace utils;
+
+namespace
+{
+
+/**
+ * Black pixels with the given probability of 1/2^sparseness.
+ */
+std::vector<int> randomPixels(int const width, int const height, int const sparseness)
+{
+    std::vector<int> pixels(width * height);
+    for (int& pixel : pixels) {
+        pixel = 1;
+        for (int i = 0; i < sparseness; ++i) {
+            pixel &= rand() & 1;
+        }
+    }
+    return pixels;
+}
+
+/**
+ * A straightforward flood fill, labelling components by their
+ * first pixel in raster order, as ConnectivityMap does.
+ */
+std::vector<uint32_t> referenceLabels(
+    std::vector<int> const& pixels, int const width, int const height,
+    Connectivity const conn)
+{
+    std::vector<uint32_t> labels(width * height, 0);
+    uint32_t next_label = 1;
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (!pixels[y * width + x] || labels[y * width + x]) {
+                continue;
+            }
+
+            std::deque<QPoint> queue;
+            queue.push_back(QPoint(x, y));
+            labels[y * width + x] = next_label;
+
+            while (!queue.empty()) {
+                QPoint const pt(queue.front());
+                queue.pop_front();
+
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        if (conn == CONN4 && dx != 0 && dy != 0) {
+                            continue;
+                        }
+                        int const nx = pt.x() + dx;
+                        int const ny = pt.y() + dy;
+                        if (nx < 0 || ny < 0 || nx >= width || ny >= height) {
+                            continue;
+                        }
+                        int const idx = ny * width + nx;
+                        if (pixels[idx] && !labels[idx]) {
+                            labels[idx] = next_label;
+                            queue.push_back(QPoint(nx, ny));
+                        }
+                    }
+                }
+            }
+
+            ++next_label;
+        }
+    }
+
+    return labels;
+}
+
+bool matchesReference(
+    std::vector<int> const& pixels, int const width, int const height,
+    Connectivity const conn)
+{
+    ConnectivityMap const cmap(makeBinaryImage(&pixels[0], width, height), conn);
+    std::vector<uint32_t> const expected(referenceLabels(pixels, width, height, conn));
+
+    uint32_t max_label = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint32_t const label = expected[y * width + x];
+            if (cmap(x, y) != label) {
+                return false;
+            }
+            max_label = std::max(max_label, label);
+        }
+    }
+
+    return cmap.maxLabel() == max_label;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(ConnectivityMapTestSuite);
+
+BOOST_AUTO_TEST_CASE(test_conn4_across_bands)
+{
+    // Labelling is done in bands of 64 lines, so these cross several seams.
+    for (int sparseness = 0; sparseness <= 3; ++sparseness) {
+        int const width = 97;
+        int const height = 64 * 4 + 13;
+        std::vector<int> const pixels(randomPixels(width, height, sparseness));
+        BOOST_CHECK(matchesReference(pixels, width, height, CONN4));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_conn8_across_bands)
+{
+    for (int sparseness = 0; sparseness <= 3; ++sparseness) {
+        int const width = 97;
+        int const height = 64 * 4 + 13;
+        std::vector<int> const pixels(randomPixels(width, height, sparseness));
+        BOOST_CHECK(matchesReference(pixels, width, height, CONN8));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_vertical_line_across_bands)
+{
+    // A single component spanning all the bands.
+    int const width = 3;
+    int const height = 64 * 5;
+    std::vector<int> pixels(width * height, 0);
+    for (int y = 0; y < height; ++y) {
+        pixels[y * width + 1] = 1;
+    }
+
+    BOOST_CHECK(matchesReference(pixels, width, height, CONN4));
+    BOOST_CHECK(matchesReference(pixels, width, height, CONN8));
+}
+
+BOOST_AUTO_TEST_CASE(test_diagonal_across_seam)
+{
+    // Connected diagonally across the seam only with CONN8.
+    int const width = 4;
+    int const height = 128;
+    std::vector<int> pixels(width * height, 0);
+    pixels[63 * width + 1] = 1;
+    pixels[64 * width + 2] = 1;
+
+    BOOST_CHECK(matchesReference(pixels, width, height, CONN4));
+    BOOST_CHECK(matchesReference(pixels, width, height, CONN8));
+
+    ConnectivityMap const cmap4(makeBinaryImage(&pixels[0], width, height), CONN4);
+    BOOST_CHECK_EQUAL(cmap4.maxLabel(), 2u);
+    ConnectivityMap const cmap8(makeBinaryImage(&pixels[0], width, height), CONN8);
+    BOOST_CHECK_EQUAL(cmap8.maxLabel(), 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
@@ -0,0 +1,202 @@
+/*
+    Scan Tailor - Interactive post-processing tool for scanned pages.
+    Copyright (C)  Joseph Artsimovich <joseph.artsimovich@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ImageBufferPool.h"
+#include <QImage>
+#include <QSize>
+#include <stddef.h>
+#ifndef Q_MOC_RUN
+#include <boost/test/unit_test.hpp>
+#endif
+
+namespace imageproc
+{
+
+namespace tests
+{
+
+namespace
+{
+
+/**
+ * Gives each test an empty pool with the capacity batch processing uses,
+ * and restores the capacity afterwards, as the pool is process-wide.
+ */
+class PoolFixture
+{
+public:
+    PoolFixture()
+        : pool(ImageBufferPool::instance()), m_origCapacity(pool.capacity())
+    {
+        pool.clear();
+        pool.setCapacity(ImageBufferPool::BATCH_CAPACITY);
+    }
+
+    ~PoolFixture()
+    {
+        pool.clear();
+        pool.setCapacity(m_origCapacity);
+    }
+
+    ImageBufferPool& pool;
+private:
+    size_t m_origCapacity;
+};
+
+size_t const BYTES = ImageBufferPool::MIN_POOLED_BYTES;
+
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(ImageBufferPoolTestSuite, PoolFixture);
+
+BOOST_AUTO_TEST_CASE(test_buffer_reuse)
+{
+    void* const buffer = pool.allocate(BYTES);
+    pool.release(buffer, BYTES);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), BYTES);
+
+    void* const reused = pool.allocate(BYTES);
+    BOOST_CHECK(reused == buffer);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), 0u);
+    pool.release(reused, BYTES);
+}
+
+BOOST_AUTO_TEST_CASE(test_size_must_match)
+{
+    void* const buffer = pool.allocate(BYTES);
+    pool.release(buffer, BYTES);
+
+    void* const other = pool.allocate(BYTES + 16);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), BYTES);
+    pool.release(other, BYTES + 16);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), 2 * BYTES + 16);
+}
+
+BOOST_AUTO_TEST_CASE(test_same_size_buffers)
+{
+    void* const buffer1 = pool.allocate(BYTES);
+    void* const buffer2 = pool.allocate(BYTES);
+    void* const buffer3 = pool.allocate(BYTES + 16);
+    pool.release(buffer1, BYTES);
+    pool.release(buffer3, BYTES + 16);
+    pool.release(buffer2, BYTES);
+
+    // The most recently cached one is reused first.
+    BOOST_CHECK(pool.allocate(BYTES) == buffer2);
+    pool.release(buffer2, BYTES);
+
+    // Eviction goes from the oldest, whatever the sizes.
+    pool.trim(2 * BYTES + 16);
+    BOOST_CHECK(pool.allocate(BYTES) == buffer2);
+    BOOST_CHECK(pool.allocate(BYTES + 16) == buffer3);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), 0u);
+    pool.release(buffer2, BYTES);
+    pool.release(buffer3, BYTES + 16);
+}
+
+BOOST_AUTO_TEST_CASE(test_zero_capacity)
+{
+    pool.setCapacity(0);
+
+    void* const buffer = pool.allocate(BYTES);
+    pool.release(buffer, BYTES);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_small_buffers_arent_pooled)
+{
+    void* const buffer = pool.allocate(BYTES - 1);
+    pool.release(buffer, BYTES - 1);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_capacity_evicts_oldest)
+{
+    pool.setCapacity(3 * BYTES + 47);
+
+    void* const buffer1 = pool.allocate(BYTES);
+    void* const buffer2 = pool.allocate(BYTES + 16);
+    void* const buffer3 = pool.allocate(BYTES + 32);
+    pool.release(buffer1, BYTES);
+    pool.release(buffer2, BYTES + 16);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), 2 * BYTES + 16);
+
+    // Doesn't fit along with the other two, so buffer1 gets evicted.
+    pool.release(buffer3, BYTES + 32);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), 2 * BYTES + 48);
+
+    void* const reused = pool.allocate(BYTES + 16);
+    BOOST_CHECK(reused == buffer2);
+    pool.release(reused, BYTES + 16);
+
+    // Shrinking the capacity evicts as well.
+    pool.setCapacity(BYTES + 16);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), BYTES + 16);
+    BOOST_CHECK(pool.allocate(BYTES + 16) == reused);
+    pool.release(reused, BYTES + 16);
+
+    // A buffer larger than the capacity is never cached.
+    void* const large = pool.allocate(BYTES + 32);
+    pool.release(large, BYTES + 32);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), BYTES + 16);
+}
+
+BOOST_AUTO_TEST_CASE(test_trim)
+{
+    void* const buffer1 = pool.allocate(BYTES);
+    void* const buffer2 = pool.allocate(BYTES + 16);
+    pool.release(buffer1, BYTES);
+    pool.release(buffer2, BYTES + 16);
+
+    pool.trim(BYTES + 16);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), BYTES + 16);
+    BOOST_CHECK(pool.allocate(BYTES + 16) == buffer2);
+    pool.release(buffer2, BYTES + 16);
+
+    // Unlike setCapacity(), trimming doesn't affect further caching.
+    void* const buffer3 = pool.allocate(BYTES);
+    pool.release(buffer3, BYTES);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), 2 * BYTES + 16);
+
+    pool.clear();
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_image_returns_its_buffer)
+{
+    QSize const size(1000, 1000);
+    uchar const* bits = nullptr;
+
+    {
+        QImage const image(pool.createImage(size, QImage::Format_Grayscale8));
+        BOOST_REQUIRE(!image.isNull());
+        BOOST_CHECK_EQUAL(image.format(), QImage::Format_Grayscale8);
+        bits = image.constBits();
+    }
+    BOOST_CHECK(pool.cachedBytes() > 0u);
+
+    QImage const image(pool.createImage(size, QImage::Format_Grayscale8));
+    BOOST_CHECK(image.constBits() == bits);
+    BOOST_CHECK_EQUAL(pool.cachedBytes(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+} // namespace tests
+
+} // namespace imageproc
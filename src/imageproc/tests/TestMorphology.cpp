@@ -24,9 +24,13 @@
 #include <QImage>
 #include <QSize>
 #include <QPoint>
+#include <QRect>
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
 
 namespace imageproc
 {
@@ -1329,6 +1333,152 @@ BOOST_AUTO_TEST_CASE(test_hmr_1)
     BOOST_CHECK(hitMissReplace(img, BLACK, pattern, 3, 3) == control);
 }
 
+namespace
+{
+
+/**
+ * A straightforward dilateGray() / erodeGray(), taking the darkest
+ * or the lightest pixel under the brick.
+ */
+GrayImage dilateOrErodeGrayReference(
+    GrayImage const& src, Brick const& brick,
+    QRect const& dst_area, uint8_t const src_surroundings, bool const dilate)
+{
+    GrayImage dst(dst_area.size());
+    for (int y = 0; y < dst.height(); ++y) {
+        for (int x = 0; x < dst.width(); ++x) {
+            int res = dilate ? 255 : 0;
+            for (int dy = -brick.maxY(); dy <= -brick.minY(); ++dy) {
+                for (int dx = -brick.maxX(); dx <= -brick.minX(); ++dx) {
+                    int const sx = dst_area.left() + x + dx;
+                    int const sy = dst_area.top() + y + dy;
+                    int val = src_surroundings;
+                    if (src.rect().contains(sx, sy)) {
+                        val = src.data()[sy * src.stride() + sx];
+                    }
+                    res = dilate ? std::min(res, val) : std::max(res, val);
+                }
+            }
+            dst.data()[y * dst.stride() + x] = static_cast<uint8_t>(res);
+        }
+    }
+    return dst;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(test_dilate_erode_gray_large)
+{
+    GrayImage const img(randomGrayImage(300, 120));
+    Brick const brick(-7, -2, 11, 16);
+    QRect const dst_area(-5, 10, 320, 100);
+
+    BOOST_CHECK(
+        dilateGray(img, brick, dst_area, 5)
+        == dilateOrErodeGrayReference(img, brick, dst_area, 5, true)
+    );
+    BOOST_CHECK(
+        erodeGray(img, brick, dst_area, 5)
+        == dilateOrErodeGrayReference(img, brick, dst_area, 5, false)
+    );
+    BOOST_CHECK(
+        dilateGray(img, QSize(1, 31), img.rect())
+        == dilateOrErodeGrayReference(img, Brick(QSize(1, 31)), img.rect(), 0xff, true)
+    );
+    BOOST_CHECK(
+        erodeGray(img, QSize(25, 1), img.rect())
+        == dilateOrErodeGrayReference(img, Brick(QSize(25, 1)), img.rect(), 0x00, false)
+    );
+}
+
+namespace
+{
+
+bool getBit(BinaryImage const& img, int const x, int const y)
+{
+    uint32_t const* line = img.data() + y * img.wordsPerLine();
+    return ((line[x >> 5] >> (31 - (x & 31))) & 1) != 0;
+}
+
+/**
+ * A straightforward dilateBrick() / erodeBrick().
+ */
+bool matchesBrickReference(
+    BinaryImage const& result, BinaryImage const& src, Brick const& brick,
+    QRect const& dst_area, BWColor const src_surroundings, bool const dilate)
+{
+    for (int y = 0; y < dst_area.height(); ++y) {
+        for (int x = 0; x < dst_area.width(); ++x) {
+            bool res = !dilate;
+            for (int dy = brick.minY(); dy <= brick.maxY(); ++dy) {
+                for (int dx = brick.minX(); dx <= brick.maxX(); ++dx) {
+                    int const sx = dst_area.left() + x - dx;
+                    int const sy = dst_area.top() + y - dy;
+                    bool val = src_surroundings == BLACK;
+                    if (src.rect().contains(sx, sy)) {
+                        val = getBit(src, sx, sy);
+                    }
+                    res = dilate ? (res || val) : (res && val);
+                }
+            }
+            if (getBit(result, x, y) != res) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+BinaryImage sparseBinaryImage(int const width, int const height, BWColor const color)
+{
+    BinaryImage img(width, height, !color);
+    for (int i = width * height / 150; i > 0; --i) {
+        img.fill(QRect(rand() % width, rand() % height, 1 + rand() % 3, 1), color);
+    }
+    return img;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(test_dilate_erode_large_bricks)
+{
+    BinaryImage const sparse_black(sparseBinaryImage(300, 150, BLACK));
+    BinaryImage const sparse_white(sparseBinaryImage(300, 150, WHITE));
+    BinaryImage const dense(randomBinaryImage(300, 150));
+    QRect const dst_area(-7, 5, 310, 140);
+
+    Brick const bricks[] = {
+        Brick(QSize(41, 1)), Brick(QSize(1, 37)),
+        Brick(QSize(25, 19)), Brick(-30, -2, 3, 1)
+    };
+    for (Brick const& brick : bricks) {
+        BOOST_CHECK(
+            matchesBrickReference(
+                dilateBrick(sparse_black, brick, dst_area, WHITE),
+                sparse_black, brick, dst_area, WHITE, true
+            )
+        );
+        BOOST_CHECK(
+            matchesBrickReference(
+                erodeBrick(sparse_white, brick, dst_area, BLACK),
+                sparse_white, brick, dst_area, BLACK, false
+            )
+        );
+        BOOST_CHECK(
+            matchesBrickReference(
+                dilateBrick(dense, brick, dst_area, BLACK),
+                dense, brick, dst_area, BLACK, true
+            )
+        );
+        BOOST_CHECK(
+            matchesBrickReference(
+                erodeBrick(dense, brick, dst_area, WHITE),
+                dense, brick, dst_area, WHITE, false
+            )
+        );
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
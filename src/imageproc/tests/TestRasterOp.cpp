@@ -221,6 +221,75 @@ BOOST_AUTO_TEST_CASE(test_move_blocks)
     BOOST_REQUIRE(tester.testBlockMove(QRect(51, 35, 199, 200), 1, 1));
 }
 
+namespace
+{
+
+bool getBit(BinaryImage const& img, int const x, int const y)
+{
+    uint32_t const* line = img.data() + y * img.wordsPerLine();
+    return ((line[x >> 5] >> (31 - (x & 31))) & 1) != 0;
+}
+
+/**
+ * Checks rasterOp() against a pixel by pixel evaluation of Rop
+ * on lines wide enough to go through SIMD blocks.
+ */
+template<typename Rop>
+bool checkPixelwise(QRect const& dst_rect, QPoint const& src_pt, bool same_image)
+{
+    BinaryImage const src(randomBinaryImage(1000, 20));
+    BinaryImage const dst_before(randomBinaryImage(1000, 20));
+    BinaryImage const& actual_src = same_image ? dst_before : src;
+
+    BinaryImage dst(dst_before);
+    if (same_image) {
+        rasterOp<Rop>(dst, dst_rect, dst, src_pt);
+    } else {
+        rasterOp<Rop>(dst, dst_rect, src, src_pt);
+    }
+
+    QPoint const offset(src_pt - dst_rect.topLeft());
+    for (int y = 0; y < dst.height(); ++y) {
+        for (int x = 0; x < dst.width(); ++x) {
+            bool expected = getBit(dst_before, x, y);
+            if (dst_rect.contains(x, y)) {
+                uint32_t const s = getBit(actual_src, x + offset.x(), y + offset.y()) ? ~0u : 0u;
+                uint32_t const d = expected ? ~0u : 0u;
+                expected = (Rop::transform(s, d) & 1) != 0;
+            }
+            if (getBit(dst, x, y) != expected) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+template<typename Rop>
+bool checkPixelwise()
+{
+    return checkPixelwise<Rop>(QRect(0, 0, 1000, 20), QPoint(0, 0), false)
+           && checkPixelwise<Rop>(QRect(37, 3, 900, 15), QPoint(37, 1), false)
+           && checkPixelwise<Rop>(QRect(5, 2, 931, 17), QPoint(62, 0), false)
+           && checkPixelwise<Rop>(QRect(70, 1, 800, 10), QPoint(3, 9), false)
+           && checkPixelwise<Rop>(QRect(10, 4, 700, 12), QPoint(81, 4), true)
+           && checkPixelwise<Rop>(QRect(90, 4, 700, 12), QPoint(33, 6), true);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(test_wide_lines_pixelwise)
+{
+    BOOST_CHECK(checkPixelwise<RopSrc>());
+    BOOST_CHECK(checkPixelwise<RopNot<RopSrc> >());
+    BOOST_CHECK((checkPixelwise<RopAnd<RopSrc, RopDst> >()));
+    BOOST_CHECK((checkPixelwise<RopOr<RopNot<RopSrc>, RopDst> >()));
+    BOOST_CHECK((checkPixelwise<RopXor<RopSrc, RopDst> >()));
+    BOOST_CHECK((checkPixelwise<RopSubtract<RopDst, RopSrc> >()));
+    BOOST_CHECK((checkPixelwise<RopSubtractWhite<RopDst, RopSrc> >()));
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
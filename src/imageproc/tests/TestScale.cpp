@@ -18,6 +18,8 @@
 
 #include "Scale.h"
 #include "GrayImage.h"
+#include "BinaryImage.h"
+#include "BinaryThreshold.h"
 #include "Utils.h"
 #include <QImage>
 #include <QSize>
@@ -100,6 +102,36 @@ BOOST_AUTO_TEST_CASE(test_random_image)
     //BOOST_CHECK(checkScale(img, QSize(145, 55)));
 }
 
+BOOST_AUTO_TEST_CASE(test_scale_to_binary)
+{
+    GrayImage img(QSize(40, 30));
+    uint8_t* line = img.data();
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            // Large uniform blocks, so that both the interpolating
+            // and the non-interpolating code paths get exercised.
+            line[x] = ((x / 6 + y / 4) & 1) ? 200 + rand() % 56 : rand() % 56;
+            if (rand() % 10 == 0) {
+                line[x] = rand() % 256;
+            }
+        }
+        line += img.stride();
+    }
+
+    QSize const sizes[] = {
+        QSize(40, 30), QSize(20, 15), QSize(33, 21), QSize(80, 60),
+        QSize(137, 95), QSize(41, 31), QSize(300, 31), QSize(41, 200),
+        // Integer upscaling, by different factors horizontally and vertically.
+        QSize(80, 30), QSize(120, 60), QSize(40, 90)
+    };
+    for (QSize const& size : sizes) {
+        for (int threshold = 16; threshold < 256; threshold += 48) {
+            BinaryImage const expected(scaleToGray(img, size), BinaryThreshold(threshold));
+            BOOST_CHECK(scaleToBinary(img, size, BinaryThreshold(threshold)) == expected);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests
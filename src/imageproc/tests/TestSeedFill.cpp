@@ -176,6 +176,19 @@ BOOST_AUTO_TEST_CASE(test_gray8_random)
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_gray_large_random)
+{
+    // Large enough to be filled in bands, given multiple threads.
+    Connectivity const conns[] = { CONN4, CONN8 };
+    for (int i = 0; i < 2; ++i) {
+        GrayImage const seed(randomGrayImage(600, 600));
+        GrayImage const mask(randomGrayImage(600, 600));
+        GrayImage const fill_new(seedFillGray(seed, mask, conns[i]));
+        GrayImage const fill_old(seedFillGraySlow(seed, mask, conns[i]));
+        BOOST_CHECK(fill_new == fill_old);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_gray_vs_binary)
 {
     for (int i = 0; i < 200; ++i) {
@@ -24,6 +24,7 @@
 #ifndef Q_MOC_RUN
 #include <boost/test/unit_test.hpp>
 #endif
+#include <vector>
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
@@ -66,6 +67,167 @@ BOOST_AUTO_TEST_CASE(test_random_image)
     BOOST_CHECK(transformToGray(img, null_xform, img.rect(), outside_pixels) == img);
 }
 
+BOOST_AUTO_TEST_CASE(test_downscale_averages_blocks)
+{
+    GrayImage img(QSize(40, 30));
+    uint8_t* line = img.data();
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            line[x] = rand() % 256;
+        }
+        line += img.stride();
+    }
+
+    QColor const bgcolor(0xff, 0xff, 0xff);
+    OutsidePixels const outside_pixels(OutsidePixels::assumeColor(bgcolor));
+
+    QTransform xform;
+    xform.scale(0.5, 0.5);
+    GrayImage const scaled(transformToGray(img, xform, QRect(0, 0, 20, 15), outside_pixels));
+
+    bool ok = true;
+    for (int y = 0; y < scaled.height(); ++y) {
+        uint8_t const* const src_line = img.data() + 2 * y * img.stride();
+        for (int x = 0; x < scaled.width(); ++x) {
+            int const sum = src_line[2 * x] + src_line[2 * x + 1]
+                + src_line[2 * x + img.stride()] + src_line[2 * x + 1 + img.stride()];
+            if (scaled.data()[y * scaled.stride() + x] != (sum + 2) / 4) {
+                ok = false;
+            }
+        }
+    }
+    BOOST_CHECK(ok);
+}
+
+BOOST_AUTO_TEST_CASE(test_mirroring)
+{
+    GrayImage img(QSize(100, 50));
+    uint8_t* line = img.data();
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            line[x] = rand() % 256;
+        }
+        line += img.stride();
+    }
+
+    QColor const bgcolor(0xff, 0xff, 0xff);
+    OutsidePixels const outside_pixels(OutsidePixels::assumeColor(bgcolor));
+
+    QTransform const xform(-1, 0, 0, 1, img.width(), 0);
+    GrayImage const mirrored(transformToGray(img, xform, img.rect(), outside_pixels));
+
+    bool ok = true;
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            if (mirrored.data()[y * mirrored.stride() + x]
+                    != img.data()[y * img.stride() + img.width() - 1 - x]) {
+                ok = false;
+            }
+        }
+    }
+    BOOST_CHECK(ok);
+}
+
+BOOST_AUTO_TEST_CASE(test_rotation_by_90_degrees)
+{
+    GrayImage img(QSize(60, 40));
+    uint8_t* line = img.data();
+    for (int y = 0; y < img.height(); ++y) {
+        for (int x = 0; x < img.width(); ++x) {
+            line[x] = rand() % 256;
+        }
+        line += img.stride();
+    }
+
+    QColor const bgcolor(0xff, 0xff, 0xff);
+    OutsidePixels const outside_pixels(OutsidePixels::assumeColor(bgcolor));
+
+    // (x, y) -> (height - y, x)
+    QTransform const xform(0, 1, -1, 0, img.height(), 0);
+    QRect const dst_rect(0, 0, img.height(), img.width());
+    GrayImage const rotated(transformToGray(img, xform, dst_rect, outside_pixels));
+
+    bool ok = true;
+    for (int y = 0; y < rotated.height(); ++y) {
+        for (int x = 0; x < rotated.width(); ++x) {
+            if (rotated.data()[y * rotated.stride() + x]
+                    != img.data()[(img.height() - 1 - x) * img.stride() + y]) {
+                ok = false;
+            }
+        }
+    }
+    BOOST_CHECK(ok);
+}
+
+/**
+ * Transforms a color image made of independent random channels and checks
+ * that each channel of the result is what transforming that channel alone,
+ * as a grayscale image, gives.
+ */
+static bool channelsMatchGray(
+    QTransform const& xform, QRect const& dst_rect, QImage::Format const format)
+{
+    int const num_channels = format == QImage::Format_ARGB32 ? 4 : 3;
+
+    QImage src(61, 47, format);
+    std::vector<GrayImage> channels;
+    for (int c = 0; c < num_channels; ++c) {
+        channels.push_back(GrayImage(src.size()));
+    }
+    for (int y = 0; y < src.height(); ++y) {
+        QRgb* const src_line = reinterpret_cast<QRgb*>(src.scanLine(y));
+        for (int x = 0; x < src.width(); ++x) {
+            int levels[4] = { 0, 0, 0, 0xff };
+            for (int c = 0; c < num_channels; ++c) {
+                levels[c] = rand() % 256;
+                channels[c].data()[y * channels[c].stride() + x] = levels[c];
+            }
+            src_line[x] = qRgba(levels[2], levels[1], levels[0], levels[3]);
+        }
+    }
+
+    QColor const bgcolor(0xff, 0xff, 0xff);
+    OutsidePixels const outside_pixels(OutsidePixels::assumeColor(bgcolor));
+
+    QImage const dst(transform(src, xform, dst_rect, outside_pixels));
+    if (dst.format() != format) {
+        return false;
+    }
+
+    for (int c = 0; c < num_channels; ++c) {
+        GrayImage const expected(transformToGray(channels[c], xform, dst_rect, outside_pixels));
+        for (int y = 0; y < dst.height(); ++y) {
+            QRgb const* const dst_line = reinterpret_cast<QRgb const*>(dst.scanLine(y));
+            for (int x = 0; x < dst.width(); ++x) {
+                int const level = (dst_line[x] >> (8 * c)) & 0xff;
+                if (level != expected.data()[y * expected.stride() + x]) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(test_color_channels_match_gray)
+{
+    std::vector<QTransform> xforms;
+    xforms.push_back(QTransform().scale(0.6, 0.6));
+    xforms.push_back(QTransform().rotate(2.0));
+    xforms.push_back(QTransform().rotate(7.0).scale(0.45, 0.45));
+    xforms.push_back(QTransform().rotate(-30.0).scale(-1.3, 1.3));
+    xforms.push_back(QTransform(1.0, 0.2, 0.1, 1.0, 0.0, 0.0)); // Shear.
+
+    // Extends past the image, so that some footprints get clipped.
+    QRect const dst_rect(-8, -6, 70, 60);
+
+    for (QTransform const& xform : xforms) {
+        BOOST_CHECK(channelsMatchGray(xform, dst_rect, QImage::Format_RGB32));
+        BOOST_CHECK(channelsMatchGray(xform, dst_rect, QImage::Format_ARGB32));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } // namespace tests